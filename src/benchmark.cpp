@@ -387,6 +387,20 @@ namespace Stockfish::Benchmark {
 // bench 64 1 100000 default nodes  : search default positions for 100K nodes each
 // bench 64 4 5000 current movetime : search current position with 4 threads for 5 sec
 // bench 16 1 5 blah perft          : run a perft 5 on positions in file "blah"
+std::vector<std::string> default_fens() {
+
+    std::vector<std::string> fens;
+    bool                     chess960 = false;
+
+    for (const std::string& fen : Defaults)
+        if (fen.find("setoption") != std::string::npos)
+            chess960 = fen.find("true") != std::string::npos;
+        else if (!chess960)
+            fens.push_back(fen);
+
+    return fens;
+}
+
 std::vector<std::string> setup_bench(const std::string& currentFen, std::istream& is) {
 
     std::vector<std::string> fens, list;
@@ -27,6 +27,9 @@ namespace Stockfish::Benchmark {
 
 std::vector<std::string> setup_bench(const std::string&, std::istream&);
 
+// The default positions of bench, without the Chess960 ones
+std::vector<std::string> default_fens();
+
 struct BenchmarkSetup {
     int                      ttSize;
     int                      threads;
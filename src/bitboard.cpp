@@ -34,14 +34,23 @@ Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
 Bitboard RayPassBB[SQUARE_NB][SQUARE_NB];
 Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 
+#ifdef USE_HYPERBOLA
+alignas(64) SliderLines Sliders[SQUARE_NB];
+alignas(64) uint8_t     RankAttacks[FILE_NB][64];
+#else
 alignas(64) Magic Magics[SQUARE_NB][2];
+#endif
 
 namespace {
 
+#ifdef USE_HYPERBOLA
+void init_sliders();
+#else
 Bitboard RookTable[0x19000];   // To store rook attacks
 Bitboard BishopTable[0x1480];  // To store bishop attacks
 
 void init_magics(PieceType pt, Bitboard table[], Magic magics[][2]);
+#endif
 
 // Returns the bitboard of target square for the given step
 // from the given square. If the step is off the board, returns empty bitboard.
@@ -81,8 +90,12 @@ void Bitboards::init() {
         for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
             SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
 
+#ifdef USE_HYPERBOLA
+    init_sliders();
+#else
     init_magics(ROOK, RookTable, Magics);
     init_magics(BISHOP, BishopTable, Magics);
+#endif
 
     for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
     {
@@ -139,6 +152,36 @@ Bitboard sliding_attack(PieceType pt, Square sq, Bitboard occupied) {
 }
 
 
+#ifdef USE_HYPERBOLA
+
+// Computes the lines and the rank attacks of the sliders, 2 KB instead of the
+// 800 KB of the magic attack tables
+void init_sliders() {
+
+    for (Square s = SQ_A1; s <= SQ_H8; ++s)
+    {
+        Bitboard diagonal = 0, antiDiagonal = 0;
+        for (Bitboard b = sliding_attack(BISHOP, s, 0); b;)
+        {
+            const Square s2 = pop_lsb(b);
+            if (file_of(s2) - file_of(s) == rank_of(s2) - rank_of(s))
+                diagonal |= s2;
+            else
+                antiDiagonal |= s2;
+        }
+
+        Sliders[s] = {file_bb(s) ^ s, diagonal, antiDiagonal};
+    }
+
+    // The blockers on the edges do not change the attacks
+    for (File f = FILE_A; f <= FILE_H; ++f)
+        for (unsigned inner = 0; inner < 64; ++inner)
+            RankAttacks[f][inner] =
+              uint8_t(sliding_attack(ROOK, make_square(f, RANK_1), Bitboard(inner) << 1));
+}
+
+#else
+
 // Computes all rook and bishop attacks at startup. Magic
 // bitboards are used to look up attacks of sliding pieces. As a reference see
 // https://www.chessprogramming.org/Magic_Bitboards. In particular, here we use
@@ -225,6 +268,8 @@ void init_magics(PieceType pt, Bitboard table[], Magic magics[][2]) {
 #endif
     }
 }
+
+#endif
 }
 
 }  // namespace Stockfish
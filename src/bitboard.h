@@ -64,6 +64,18 @@ extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
 extern Bitboard RayPassBB[SQUARE_NB][SQUARE_NB];
 extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 
+#ifdef USE_HYPERBOLA
+
+// The lines through a square, the square excluded, from which the attacks of
+// the sliders are computed without attack tables, see line_attacks()
+struct SliderLines {
+    Bitboard file, diagonal, antiDiagonal;
+};
+
+extern SliderLines Sliders[SQUARE_NB];
+extern uint8_t     RankAttacks[FILE_NB][64];
+
+#else
 
 // Magic holds all magic bitboards relevant data for a single square
 struct Magic {
@@ -94,6 +106,8 @@ struct Magic {
 
 extern Magic Magics[SQUARE_NB][2];
 
+#endif
+
 constexpr Bitboard square_bb(Square s) {
     assert(is_ok(s));
     return (1ULL << s);
@@ -213,6 +227,36 @@ inline Bitboard attacks_bb(Square s, Color c = COLOR_NB) {
 }
 
 
+#ifdef USE_HYPERBOLA
+
+inline Bitboard byteswap(Bitboard b) {
+    #if defined(_MSC_VER)
+    return _byteswap_uint64(b);
+    #else
+    return __builtin_bswap64(b);
+    #endif
+}
+
+// The attacks along a line with at most one square on each rank, by hyperbola
+// quintessence: subtracting the slider from the blockers reaches the first one
+// above it, and doing the same on the board flipped vertically the first one
+// below it. See https://www.chessprogramming.org/Hyperbola_Quintessence
+inline Bitboard line_attacks(Square s, Bitboard occupied, Bitboard line) {
+    Bitboard forward = occupied & line;
+    Bitboard reverse = byteswap(forward);
+    forward -= square_bb(s);
+    reverse -= square_bb(flip_rank(s));
+    return (forward ^ byteswap(reverse)) & line;
+}
+
+// The attacks along the rank, looked up by the blockers on the six inner squares
+inline Bitboard rank_attacks(Square s, Bitboard occupied) {
+    const int shift = 8 * rank_of(s);
+    return Bitboard(RankAttacks[file_of(s)][(occupied >> (shift + 1)) & 63]) << shift;
+}
+
+#endif
+
 // Returns the attacks by the given piece
 // assuming the board is occupied according to the passed Bitboard.
 // Sliding piece attacks do not continue passed an occupied square.
@@ -225,7 +269,13 @@ inline Bitboard attacks_bb(Square s, Bitboard occupied) {
     {
     case BISHOP :
     case ROOK :
+#ifdef USE_HYPERBOLA
+        return Pt == BISHOP ? line_attacks(s, occupied, Sliders[s].diagonal)
+                                | line_attacks(s, occupied, Sliders[s].antiDiagonal)
+                            : line_attacks(s, occupied, Sliders[s].file) | rank_attacks(s, occupied);
+#else
         return Magics[s][Pt - BISHOP].attacks_bb(occupied);
+#endif
     case QUEEN :
         return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
     default :
@@ -0,0 +1,170 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "book.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "movegen.h"
+#include "position.h"
+#include "uci.h"
+
+namespace Stockfish {
+
+namespace {
+
+constexpr char          BookMagic[8] = {'S', 'F', 'B', 'O', 'O', 'K', 0, 0};
+constexpr std::uint32_t BookVersion  = 1;
+
+constexpr auto StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+Key start_key() {
+    StateInfo st;
+    Position  pos;
+    return pos.set(StartFEN, false, &st).key();
+}
+
+}  // namespace
+
+std::string Book::open(const std::string& file) {
+    mapped.reset();
+    entries = nullptr;
+    count   = 0;
+
+    if (file.empty() || file == "<empty>")
+        return "Book closed";
+
+    auto        f = std::make_unique<MappedFile>(file);
+    BookHeader  header;
+    const char* data = f->data();
+
+    if (!f->is_open() || f->size() < sizeof(header))
+        return "Failed to open the book " + file;
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, BookMagic, sizeof(BookMagic)) || header.version != BookVersion
+        || header.entrySize != sizeof(BookEntry)
+        || f->size() != sizeof(header) + header.count * sizeof(BookEntry))
+        return file + " is not a book";
+
+    if (header.startKey != start_key())
+        return "The book " + file + " was built with other position keys";
+
+    mapped  = std::move(f);
+    entries = reinterpret_cast<const BookEntry*>(data + sizeof(header));
+    count   = header.count;
+    return "Book " + file + " with " + std::to_string(count) + " entries";
+}
+
+Move Book::probe(const Position& pos, bool weighted) {
+    if (!entries)
+        return Move::none();
+
+    const Key  key   = pos.key();
+    const auto first = std::lower_bound(entries, entries + count, key,
+                                        [](const BookEntry& e, Key k) { return e.key < k; });
+
+    const MoveList<LEGAL> legal(pos);
+    Move                  best      = Move::none();
+    std::uint32_t         bestScore = 0, total = 0;
+
+    // With the weighted pick, each move replaces the current one with a probability
+    // of its weight over the total weight so far.
+    for (auto e = first; e != entries + count && e->key == key; ++e)
+    {
+        const Move m(e->move);
+        if (!e->weight || !legal.contains(m))
+            continue;
+
+        total += e->weight;
+        if (weighted ? rng.rand<std::uint32_t>() % total < e->weight : e->weight > bestScore)
+        {
+            best      = m;
+            bestScore = e->weight;
+        }
+    }
+
+    return best;
+}
+
+std::optional<std::size_t>
+Book::build(const std::string& gamesFile, const std::string& bookFile, int maxPlies) {
+    std::ifstream in(gamesFile);
+    if (!in)
+        return std::nullopt;
+
+    std::vector<BookEntry> moves;
+    std::string            line, token;
+
+    while (std::getline(in, line))
+    {
+        std::deque<StateInfo> states(1);
+        Position              pos;
+        pos.set(StartFEN, false, &states.back());
+
+        std::istringstream is(line);
+        for (int ply = 0; ply < maxPlies && is >> token; ++ply)
+        {
+            // A game stops at its first move that is not legal
+            const Move m = UCIEngine::to_move(pos, token);
+            if (m == Move::none())
+                break;
+
+            moves.push_back({pos.key(), m.raw(), 1, 0});
+            states.emplace_back();
+            pos.do_move(m, states.back());
+        }
+    }
+
+    std::sort(moves.begin(), moves.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    // Merge the same moves of the games, the weights saturate
+    std::vector<BookEntry> book;
+    for (const auto& e : moves)
+        if (!book.empty() && book.back().key == e.key && book.back().move == e.move)
+            book.back().weight += book.back().weight < UINT16_MAX;
+        else
+            book.push_back(e);
+
+    BookHeader header{};
+    std::memcpy(header.magic, BookMagic, sizeof(BookMagic));
+    header.version   = BookVersion;
+    header.entrySize = sizeof(BookEntry);
+    header.startKey  = start_key();
+    header.count     = book.size();
+
+    std::ofstream out(bookFile, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(book.data()),
+              std::streamsize(book.size() * sizeof(BookEntry)));
+
+    if (!out)
+        return std::nullopt;
+
+    return book.size();
+}
+
+}  // namespace Stockfish
@@ -0,0 +1,87 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOOK_H_INCLUDED
+#define BOOK_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "memory.h"
+#include "misc.h"
+#include "types.h"
+
+namespace Stockfish {
+
+class Position;
+
+// An opening book, probed before the search. The file is a BookHeader followed by
+// BookEntries sorted by key, in the byte order of the machine. It is mapped into
+// memory and searched by bisection, so opening it does not read it and a probe
+// touches a few pages. The keys are the ones of Position::key(), and the book is
+// only accepted when the key of the start position is the one it was built with.
+class Book {
+   public:
+    struct BookHeader {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t entrySize;
+        std::uint64_t startKey;  // Position::key() of the start position
+        std::uint64_t count;
+    };
+
+    struct BookEntry {
+        std::uint64_t key;
+        std::uint16_t move;    // In the Move encoding
+        std::uint16_t weight;  // Relative, the games that played the move
+        std::uint32_t reserved;
+    };
+
+    // Maps a book, or closes it when the name is empty. Returns a message for the
+    // user.
+    std::string open(const std::string& file);
+
+    bool        is_open() const { return entries != nullptr; }
+    std::size_t size() const { return count; }
+    std::size_t memory() const { return mapped ? mapped->size() : 0; }  // Mapped, in bytes
+
+    // A legal book move of the position, the one of the highest weight or a random
+    // one in proportion to the weights. Move::none() when the position is not in
+    // the book.
+    Move probe(const Position& pos, bool weighted);
+
+    // Writes a book of the first plies of the games of a text file, one game per
+    // line as UCI moves from the start position. The weight of a move is the
+    // number of games that played it. Returns the number of entries, or nothing if
+    // a file cannot be read or written.
+    static std::optional<std::size_t>
+    build(const std::string& gamesFile, const std::string& bookFile, int maxPlies);
+
+   private:
+    std::unique_ptr<MappedFile> mapped;
+    const BookEntry*            entries = nullptr;
+    std::size_t                 count   = 0;
+    PRNG                        rng{std::uint64_t(now()) | 1};
+};
+
+}  // namespace Stockfish
+
+#endif  // #ifndef BOOK_H_INCLUDED
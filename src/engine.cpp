@@ -19,18 +19,28 @@
 #include "engine.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <deque>
+#include <fstream>
+#include <future>
 #include <iosfwd>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <sstream>
 #include <string_view>
 #include <utility>
 #include <vector>
 
+#include "benchmark.h"
 #include "evaluate.h"
 #include "misc.h"
+#include "movegen.h"
+#include "nnue/features/full_threats.h"
 #include "nnue/network.h"
 #include "nnue/nnue_common.h"
 #include "nnue/nnue_misc.h"
@@ -40,6 +50,7 @@
 #include "search.h"
 #include "shm.h"
 #include "syzygy/tbprobe.h"
+#include "tune.h"
 #include "types.h"
 #include "uci.h"
 #include "ucioption.h"
@@ -52,19 +63,49 @@ constexpr auto StartFEN   = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq
 constexpr int  MaxHashMB  = Is64Bit ? 33554432 : 2048;
 int            MaxThreads = std::max(1024, 4 * int(get_hardware_concurrency()));
 
+// Options of the resources that the contexts share with their owner
+constexpr const char* SharedOptions[] = {
+  "NumaPolicy",         "EvalFile",        "EvalFileSmall",
+  "SyzygyPath",         "SyzygyCache",     "SyzygyIOThreads",
+  "SyzygyRandomAccess", "SyzygyIndexFile", "SyzygyMaxMappedMB"};
+
+struct Engine::SharedResources {
+    SharedResources() :
+        numaContext(NumaConfig::from_system_cache_topology()),
+        networks(
+          numaContext,
+          // Heap-allocate because sizeof(NN::Networks) is large
+          std::make_unique<NN::Networks>(
+            std::make_unique<NN::NetworkBig>(NN::EvalFile{EvalFileDefaultNameBig, "None", ""},
+                                             NN::EmbeddedNNUEType::BIG),
+            std::make_unique<NN::NetworkSmall>(NN::EvalFile{EvalFileDefaultNameSmall, "None", ""},
+                                               NN::EmbeddedNNUEType::SMALL))) {}
+
+    NumaReplicationContext                     numaContext;
+    LazyNumaReplicatedSystemWide<NN::Networks> networks;
+
+    std::atomic<size_t> nextContextIndex{0};
+
+    // Protects the fields below
+    std::mutex                                                  mutex;
+    std::vector<Engine*>                                        engines;
+    std::map<std::string, std::string, CaseInsensitiveLess> optionValues;
+};
+
 Engine::Engine(std::optional<std::string> path) :
-    binaryDirectory(path ? CommandLine::get_binary_directory(*path) : ""),
-    numaContext(NumaConfig::from_system()),
+    Engine(path ? CommandLine::get_binary_directory(*path) : "", nullptr) {}
+
+Engine::Engine(Engine& owner) :
+    Engine(owner.binaryDirectory, &owner) {}
+
+Engine::Engine(std::string binDir, Engine* owner) :
+    binaryDirectory(std::move(binDir)),
+    shared(owner ? owner->shared : std::make_shared<SharedResources>()),
+    contextIndex(shared->nextContextIndex++),
+    numaContext(shared->numaContext),
+    networks(shared->networks),
     states(new std::deque<StateInfo>(1)),
-    threads(),
-    networks(
-      numaContext,
-      // Heap-allocate because sizeof(NN::Networks) is large
-      std::make_unique<NN::Networks>(
-        std::make_unique<NN::NetworkBig>(NN::EvalFile{EvalFileDefaultNameBig, "None", ""},
-                                         NN::EmbeddedNNUEType::BIG),
-        std::make_unique<NN::NetworkSmall>(NN::EvalFile{EvalFileDefaultNameSmall, "None", ""},
-                                           NN::EmbeddedNNUEType::SMALL))) {
+    threads() {
 
     pos.set(StartFEN, false, &states->back());
 
@@ -75,8 +116,12 @@ Engine::Engine(std::optional<std::string> path) :
       }));
 
     options.add(  //
-      "NumaPolicy", Option("auto", [this](const Option& o) {
+      "NumaPolicy", Option("auto", [this](const Option& o) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
           set_numa_config_from_option(o);
+          update_contexts(true);
           return numa_config_information_as_string() + "\n"
                + thread_allocation_information_as_string();
       }));
@@ -87,12 +132,116 @@ Engine::Engine(std::optional<std::string> path) :
           return thread_allocation_information_as_string();
       }));
 
+    // On hybrid processors, binds the threads to the performance cores when there
+    // are enough of them
+    options.add(  //
+      "Exclude Efficiency Cores", Option(false, [this](const Option&) {
+          resize_threads();
+          return thread_allocation_information_as_string();
+      }));
+
     options.add(  //
       "Hash", Option(16, 1, MaxHashMB, [this](const Option& o) {
           set_tt_size(o);
           return std::nullopt;
       }));
 
+    // The table, the threads and the networks loaded later move to the new pages
+    options.add(  //
+      "Huge Pages", Option("THP var THP var 2MB var 1GB", "THP", [this](const Option& o) {
+          set_huge_pages(o == "1GB" ? HugePages::Pages1GB
+                         : o == "2MB" ? HugePages::Pages2MB
+                                      : HugePages::Transparent);
+          threads.release();
+          resize_threads();
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Thread Hash", Option(0, 0, 65536, [this](const Option&) {
+          // Reallocated by each thread, the histories are kept
+          wait_for_search_finished();
+          threads.init_worker_tables();
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Shared Correction History", Option(false, [this](const Option& o) {
+          wait_for_search_finished();
+          threads.clear();
+
+          // One table per NUMA node in use instead of one per thread
+          const auto   counts  = threads.get_bound_thread_count_by_numa_node();
+          const size_t tableKB = sizeof(CorrectionHistories) / 1024;
+          const size_t tables =
+            !o ? threads.size()
+               : std::max<size_t>(1, std::count_if(counts.begin(), counts.end(),
+                                                   [](size_t c) { return c > 0; }));
+          return "Correction histories: " + std::to_string(tables) + " x " + std::to_string(tableKB)
+               + " KB, " + std::to_string((threads.size() - tables) * tableKB)
+               + " KB less than with one per thread";
+      }));
+
+    options.add("TT Prefetch Moves", Option(0, 0, 16));
+
+    options.add("Parallel Search", Option("LazySMP var LazySMP var ABDADA", "LazySMP"));
+
+    options.add("Parallel MultiPV", Option(false));
+
+    options.add("Lazy Accumulator", Option(false));
+
+    options.add("Speculative Small Net", Option(false));
+
+    options.add("Search Continuation", Option(false));
+
+    options.add("Timer Thread", Option(false));
+
+    options.add(  //
+      "Reproducible Search", Option(false, [this](const Option&) {
+          // The workers pick their correction histories when they are cleared
+          wait_for_search_finished();
+          threads.clear();
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Refresh Cache Slots", Option(0, 0, 32, [this](const Option&) {
+          // Reallocated by each thread, the histories are kept
+          wait_for_search_finished();
+          threads.init_worker_tables();
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Eval Cache", Option(0, 0, 4096, [this](const Option& o) {
+          set_eval_cache_size(o);
+          return std::nullopt;
+      }));
+
+    // The thread count, the hash and the eval cache are reduced to fit in the budget
+    options.add(  //
+      "MaxMemoryMB", Option(0, 0, MaxHashMB, [this](const Option& o) {
+          resize_threads();
+          // Without a budget, the tables that were kept get their full sizes back
+          if (int(o) == 0)
+          {
+              set_tt_size(options["Hash"]);
+              set_eval_cache_size(options["Eval Cache"]);
+          }
+          return memory_budget_information();
+      }));
+
+    options.add("Rehash On Resize", Option(false));
+
+    options.add("Lazy Hash Clear", Option(false));
+
+    options.add(  //
+      "HashFile", Option("", [this](const Option& o) {
+          // Restored at the next 'isready' or 'go', see load_hash_file()
+          hashFilePending = !std::string(o).empty();
+          return std::nullopt;
+      }));
+
     options.add(  //
       "Clear Hash", Option([this](const Option&) {
           search_clear();
@@ -109,8 +258,15 @@ Engine::Engine(std::optional<std::string> path) :
 
     options.add("Move Overhead", Option(10, 0, 5000));
 
+    options.add("Adaptive Move Overhead", Option(false));
+
     options.add("nodestime", Option(0, 0, 10000));
 
+    // In thousands of nodes, for each side in a game and added after each move
+    options.add("Nodes Budget", Option(0, 0, 1000000000));
+
+    options.add("Nodes Increment", Option(0, 0, 1000000000));
+
     options.add("UCI_Chess960", Option(false));
 
     options.add("UCI_LimitStrength", Option(false));
@@ -122,8 +278,34 @@ Engine::Engine(std::optional<std::string> path) :
     options.add("UCI_ShowWDL", Option(false));
 
     options.add(  //
-      "SyzygyPath", Option("", [](const Option& o) {
-          Tablebases::init(o);
+      "BookFile", Option("", [this](const Option& o) -> std::optional<std::string> {
+          wait_for_search_finished();
+          return book.open(o);
+      }));
+
+    // The book is probed up to this full move number
+    options.add("Book Depth", Option(255, 1, 255));
+
+    // Best and Weighted play a book move without searching, Order searches it first
+    options.add("Book Mode", Option("Best var Best var Weighted var Order", "Best"));
+
+    options.add(  //
+      "SyzygyPath", Option("", [this](const Option& o) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          Tablebases::init(o, options["SyzygyIndexFile"]);
+          update_contexts(false);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "SyzygyIndexFile", Option("", [this](const Option& o) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          Tablebases::init(options["SyzygyPath"], o);
+          update_contexts(false);
           return std::nullopt;
       }));
 
@@ -134,30 +316,169 @@ Engine::Engine(std::optional<std::string> path) :
     options.add("SyzygyProbeLimit", Option(7, 0, 7));
 
     options.add(  //
-      "EvalFile", Option(EvalFileDefaultNameBig, [this](const Option& o) {
-          load_big_network(o);
+      "SyzygyCache", Option(0, 0, 1024, [this](const Option& o) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          Tablebases::resize_cache(size_t(o));
+          update_contexts(false);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "SyzygyMaxMappedMB",
+      Option(0, 0, MaxHashMB, [this](const Option& o) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          Tablebases::set_max_mapped(size_t(o));
+          update_contexts(false);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "SyzygyIOThreads", Option(0, 0, 16, [this](const Option&) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          set_tablebase_io();
+          update_contexts(false);
           return std::nullopt;
       }));
 
     options.add(  //
-      "EvalFileSmall", Option(EvalFileDefaultNameSmall, [this](const Option& o) {
-          load_small_network(o);
+      "SyzygyRandomAccess", Option(true, [this](const Option&) -> std::optional<std::string> {
+          if (contextIndex)
+              return reject_shared_option();
+          wait_for_contexts();
+          set_tablebase_io();
+          update_contexts(false);
           return std::nullopt;
       }));
 
-    load_networks();
+    options.add(  //
+      "EvalFile", Option(EvalFileDefaultNameBig,
+                       [this](const Option& o) -> std::optional<std::string> {
+                           if (contextIndex)
+                               return reject_shared_option();
+                           load_big_network(o);
+                           return std::nullopt;
+                       }));
+
+    options.add(  //
+      "EvalFileSmall", Option(EvalFileDefaultNameSmall,
+                       [this](const Option& o) -> std::optional<std::string> {
+                           if (contextIndex)
+                               return reject_shared_option();
+                           load_small_network(o);
+                           return std::nullopt;
+                       }));
+
+    options.add("Require Shared Memory", Option(false));
+
+    if (owner)
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        copy_shared_options();
+    }
+    else
+        load_networks();
+
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->engines.push_back(this);
+    }
+
     resize_threads();
 }
 
-std::uint64_t Engine::perft(const std::string& fen, Depth depth, bool isChess960) {
+Engine::~Engine() {
+    wait_for_search_finished();
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    auto&                       engines = shared->engines;
+    engines.erase(std::remove(engines.begin(), engines.end(), this), engines.end());
+}
+
+size_t Engine::context_index() const { return contextIndex; }
+
+// Copies the values of the shared options from the owner. The caller holds the lock.
+void Engine::copy_shared_options() {
+    for (const auto& [name, value] : shared->optionValues)
+        options.options_map[name].currentValue = value;
+}
+
+// The value of a shared option set on a context is reverted, as only the owner can
+// change the shared resources.
+std::optional<std::string> Engine::reject_shared_option() {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    copy_shared_options();
+    return "This option is shared with the engine that created the context, set it there.";
+}
+
+void Engine::for_each_context(const std::function<void(Engine&)>& f) {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    for (Engine* engine : shared->engines)
+        if (engine != this)
+            f(*engine);
+}
+
+// Waits for the searches of all contexts, before their shared resources are changed
+void Engine::wait_for_contexts() {
+    for_each_context([](Engine& e) { e.wait_for_search_finished(); });
+}
+
+// Publishes the shared options and lets the contexts pick up the changed networks,
+// or rebind their threads after a change of the NUMA configuration.
+void Engine::update_contexts(bool rebindThreads) {
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        // The raw values, as most of them are not string options
+        for (const char* name : SharedOptions)
+            shared->optionValues[name] = options[name].currentValue;
+    }
+
+    for_each_context([rebindThreads](Engine& e) {
+        e.copy_shared_options();
+        if (rebindThreads)
+            e.resize_threads();
+        else
+        {
+            e.evalCache.clear(e.threads);
+            e.threads.clear();
+            e.threads.ensure_network_replicated();
+        }
+    });
+}
+
+std::uint64_t Engine::perft(
+  const std::string& fen, Depth depth, bool isChess960, size_t threadCount, size_t hashMB) {
     verify_networks();
 
-    return Benchmark::perft(fen, depth, isChess960);
+    if (!threadCount && !hashMB)
+        return Benchmark::perft(fen, depth, isChess960);
+
+    wait_for_search_finished();
+    return Benchmark::perft(fen, depth, isChess960, threads, threadCount, hashMB);
 }
 
 void Engine::go(Search::LimitsType& limits) {
     assert(limits.perft == 0);
     verify_networks();
+    load_hash_file();
+
+    // A search limited to some moves, or to find a mate, is not played from the book
+    if (book.is_open() && !limits.infinite && !limits.ponderMode && !limits.mate
+        && limits.searchmoves.empty() && pos.game_ply() < 2 * int(options["Book Depth"]))
+        if (const Move m = book.probe(pos, options["Book Mode"] == "Weighted"); m != Move::none())
+        {
+            if (options["Book Mode"] != "Order")
+            {
+                updateContext.onBestmove(UCIEngine::move(m, pos.is_chess960()), "");
+                return;
+            }
+            limits.bookMove = m;
+        }
 
     threads.start_thinking(options, pos, states, limits);
 }
@@ -166,11 +487,14 @@ void Engine::stop() { threads.stop = true; }
 void Engine::search_clear() {
     wait_for_search_finished();
 
-    tt.clear(threads);
+    tt.clear(threads, options["Lazy Hash Clear"]);
+    evalCache.clear(threads);
     threads.clear();
 
-    // @TODO wont work with multiple instances
-    Tablebases::init(options["SyzygyPath"]);  // Free mapped files
+    // Free mapped files, unless some contexts may be probing the tablebases
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    if (shared->engines.size() == 1)
+        Tablebases::init(options["SyzygyPath"], options["SyzygyIndexFile"]);
 }
 
 void Engine::set_on_update_no_moves(std::function<void(const Engine::InfoShort&)>&& f) {
@@ -196,20 +520,50 @@ void Engine::set_on_verify_networks(std::function<void(std::string_view)>&& f) {
 void Engine::wait_for_search_finished() { threads.main_thread()->wait_for_search_finished(); }
 
 void Engine::set_position(const std::string& fen, const std::vector<std::string>& moves) {
-    // Drop the old state and create a new one
-    states = StateListPtr(new std::deque<StateInfo>(1));
-    pos.set(fen, options["UCI_Chess960"], &states->back());
+    const bool chess960 = options["UCI_Chess960"];
+
+    // In a game each position command repeats the moves of the last one and adds
+    // the new ones, so only those are played on the current position and states.
+    // Otherwise drop the old states and create new ones.
+    if (fen != setupFen || chess960 != pos.is_chess960() || moves.size() < setupMoves.size()
+        || !std::equal(setupMoves.begin(), setupMoves.end(), moves.begin()))
+    {
+        states = std::make_shared<std::deque<StateInfo>>(1);
+        pos.set(fen, chess960, &states->back());
+        setupFen = fen;
+        setupMoves.clear();
+    }
 
-    for (const auto& move : moves)
+    for (size_t i = setupMoves.size(); i < moves.size(); ++i)
     {
-        auto m = UCIEngine::to_move(pos, move);
+        auto m = UCIEngine::to_move(pos, moves[i]);
 
         if (m == Move::none())
             break;
 
         states->emplace_back();
         pos.do_move(m, states->back());
+        setupMoves.push_back(moves[i]);
+    }
+}
+
+bool Engine::set_position(const PackedPosition& pp, const std::vector<Move>& moves) {
+    states = std::make_shared<std::deque<StateInfo>>(1);
+    pos.set(pp, options["UCI_Chess960"], &states->back());
+    setupFen.clear();
+
+    // The moves come from the client as they are, so they are checked like the ones
+    // of the TT. The spare bits of a move are 0 unless it is a promotion.
+    for (Move m : moves)
+    {
+        if (!m.is_ok() || (m.type_of() != PROMOTION && (m.raw() & 0x3000))
+            || !pos.pseudo_legal(m) || !pos.legal(m))
+            return false;
+
+        states->emplace_back();
+        pos.do_move(m, states->back());
     }
+    return true;
 }
 
 // modifiers
@@ -217,13 +571,19 @@ void Engine::set_position(const std::string& fen, const std::vector<std::string>
 void Engine::set_numa_config_from_option(const std::string& o) {
     if (o == "auto" || o == "system")
     {
-        numaContext.set_numa_config(NumaConfig::from_system());
+        // The cores are used by "Exclude Efficiency Cores" on hybrid processors
+        numaContext.set_numa_config(NumaConfig::from_system_cache_topology());
     }
     else if (o == "hardware")
     {
         // Don't respect affinity set in the system.
         numaContext.set_numa_config(NumaConfig::from_system(false));
     }
+    else if (o == "cache")
+    {
+        // Threads bound to physical cores, grouped by last level cache
+        numaContext.set_numa_config(NumaConfig::from_system_cache_topology());
+    }
     else if (o == "none")
     {
         numaContext.set_numa_config(NumaConfig{});
@@ -240,19 +600,408 @@ void Engine::set_numa_config_from_option(const std::string& o) {
 
 void Engine::resize_threads() {
     threads.wait_for_search_finished();
-    threads.set(numaContext.get_numa_config(), {options, threads, tt, networks}, updateContext);
-
-    // Reallocate the hash with the new threadpool size
-    set_tt_size(options["Hash"]);
+    // Contexts are bound after the threads of their predecessors, so that
+    // single threaded contexts don't all end up on the first NUMA node.
+    const bool kept =
+      threads.set(numaContext.get_numa_config(), {options, threads, tt, evalCache, trace, networks},
+                  updateContext, fit_memory_budget().threads, contextIndex * size_t(options["Threads"]));
+
+    // Reallocate the hash with the new threadpool size, unless the threads were
+    // kept, in which case the tables are still on the NUMA nodes that use them.
+    // Under a budget, their sizes depend on the thread count.
+    if (!kept || int(options["MaxMemoryMB"]))
+    {
+        set_tt_size(options["Hash"]);
+        set_eval_cache_size(options["Eval Cache"]);
+    }
     threads.ensure_network_replicated();
 }
 
 void Engine::set_tt_size(size_t mb) {
     wait_for_search_finished();
-    tt.resize(mb, threads);
+    tt.resize(std::min(mb, fit_memory_budget().hashMB), threads, options["Rehash On Resize"],
+              options["Lazy Hash Clear"]);
+}
+
+// The tables follow the NUMA nodes the threads are bound to
+void Engine::set_eval_cache_size(size_t mb) {
+    wait_for_search_finished();
+    evalCache.resize(std::min(mb, fit_memory_budget().evalCacheMB), threads);
+}
+
+void Engine::set_tablebase_io() {
+    wait_for_search_finished();
+    Tablebases::set_io(size_t(options["SyzygyIOThreads"]), options["SyzygyRandomAccess"]);
+}
+
+std::pair<uint64_t, uint64_t> Engine::eval_cache_counts() const {
+    return {threads.eval_cache_probes(), threads.eval_cache_hits()};
+}
+
+size_t Engine::refresh_cache_memory() const {
+    return Eval::NNUE::AccumulatorCaches::memory_usage(size_t(options["Refresh Cache Slots"]));
+}
+
+Eval::NNUE::AccumulatorDiffCounters Engine::accumulator_diff_counts() {
+    wait_for_search_finished();
+    return threads.main_manager()->accDiffCounters;
 }
 
-void Engine::set_ponderhit(bool b) { threads.main_manager()->ponder = b; }
+MovePickerStats Engine::move_picker_stats() {
+    wait_for_search_finished();
+    return threads.main_manager()->movePickerStats;
+}
+
+std::vector<PerfCounters::Counts> Engine::perf_counts() {
+    wait_for_search_finished();
+    return threads.main_manager()->perfCounts;
+}
+
+bool Engine::trace_start(const std::string& file, int rate) {
+    wait_for_search_finished();
+    return trace.start(file, rate);
+}
+
+std::pair<uint64_t, uint64_t> Engine::trace_stop() {
+    wait_for_search_finished();
+    return trace.stop();
+}
+
+std::vector<std::string> Engine::search_stats() {
+    wait_for_search_finished();
+
+#ifdef USE_STATS
+    std::vector<std::string> lines;
+    const auto&              mgr = *threads.main_manager();
+
+    for (int i = 0; i < Search::SearchStats::COUNTER_NB; ++i)
+        lines.push_back(std::string(Search::SearchStats::Names[i]) + ": "
+                        + std::to_string(mgr.searchStats.counts[i]));
+
+    for (int net = 0; net < 2; ++net)
+    {
+        const std::string name = net == 0 ? "big" : "small";
+
+        lines.push_back("Accumulator refreshes, " + name
+                        + " net: " + std::to_string(mgr.accDiffCounters.refreshes[net]));
+        lines.push_back("Accumulator updates, " + name
+                        + " net: " + std::to_string(mgr.accDiffCounters.updates[net]));
+    }
+
+    for (int s = 0; s < MovePickerStats::PickerStageNB; ++s)
+        if (mgr.movePickerStats.stagesReached[s])
+            lines.push_back(std::string("Move picker stage ") + MovePickerStats::stage_name(s)
+                            + ": " + std::to_string(mgr.movePickerStats.stagesReached[s]));
+    return lines;
+#else
+    return {"No statistics in this build, compile with 'make stats=yes'"};
+#endif
+}
+
+bool Engine::save_tt(const std::string& file) const {
+    threads.main_thread()->wait_for_search_finished();
+    return tt.save(file);
+}
+
+bool Engine::load_tt(const std::string& file) {
+    wait_for_search_finished();
+    return tt.load(file, threads);
+}
+
+// The Hash and Threads options resize the table, which clears it, and a GUI may
+// send them in any order. So the table is restored once the options are set.
+void Engine::load_hash_file() {
+    if (!hashFilePending)
+        return;
+
+    hashFilePending = false;
+
+    // Restore a previously saved table, if there is one
+    const std::string file = options["HashFile"];
+    if (std::ifstream(file).good())
+        load_tt(file);
+}
+
+std::vector<std::string> Engine::tablebase_io_stats() const {
+    std::vector<std::string> lines = Tablebases::io_stats();
+
+    // The permille of the probes of the last search answered by the SyzygyCache
+    if (const uint64_t probes = threads.tb_cache_probes())
+        lines.push_back("Cache hits: " + std::to_string(threads.tb_cache_hits() * 1000 / probes)
+                        + " permille of " + std::to_string(probes) + " probes");
+
+    return lines;
+}
+
+void Engine::tt_stats() {
+    wait_for_search_finished();
+    sync_cout << tt.stats(threads.main_manager()->ttProbeStats) << sync_endl;
+}
+
+// Measures the latency of dependent probes into a scratch table of the given size,
+// separately for hits and misses, to compare cluster layouts on this machine.
+Engine::TTLatency Engine::tt_probe_latency(size_t mb) {
+    wait_for_search_finished();
+
+    TranspositionTable scratch;
+    scratch.resize(mb, threads);
+
+    // Fill a part of the table with random keys, a power of two of them so that
+    // the probe chain below can step through them with a full period LCG.
+    std::vector<Key> keys(size_t(1) << 20);
+    PRNG             rng(1070372);
+    while (keys.size() > mb * 1024 * 1024 / 64)
+        keys.resize(keys.size() / 2);
+
+    for (Key& k : keys)
+    {
+        k                  = rng.rand<Key>();
+        auto [_, data, tw] = scratch.probe(k);
+        tw.write(k, Value(0), false, BOUND_EXACT, 10, Move::none(), Value(0),
+                 scratch.generation());
+    }
+
+    // Each probe depends on the outcome of the previous one, so that they
+    // cannot overlap and the time per probe is the full latency.
+    constexpr size_t Probes = 1 << 22;
+    const size_t     mask   = keys.size() - 1;
+    size_t           idx = 0, hits = 0;
+    Key              missKey = rng.rand<Key>();
+
+    TimePoint start = now();
+    for (size_t i = 0; i < Probes; ++i)
+    {
+        bool hit = std::get<0>(scratch.probe(keys[idx]));
+        hits += hit;
+        idx = (idx * 0x5851F42D4C957F2DULL + 0x14057B7EF767814FULL + 2 * !hit) & mask;
+    }
+    TimePoint hitTime = now() - start;
+
+    start = now();
+    for (size_t i = 0; i < Probes; ++i)
+        missKey = rng.rand<Key>() ^ std::get<0>(scratch.probe(missKey));
+    TimePoint missTime = now() - start;
+
+    return {keys.size(), double(hits) / Probes, 1e6 * hitTime / Probes, 1e6 * missTime / Probes};
+}
+
+void Engine::tt_benchmark(size_t mb) {
+    TTLatency l = tt_probe_latency(mb);
+
+    sync_cout << "TT probe benchmark with " << mb << " MB, " << l.keys << " keys stored"
+              << "\nHit ratio                  : " << 100.0 * l.hitRatio << "%"
+              << "\nHit latency (ns/probe)     : " << l.hitNs
+              << "\nMiss latency (ns/probe)    : " << l.missNs << sync_endl;
+}
+
+// Times the generation of the active threat features of the bench positions for
+// both perspectives, which is the part of a full threat accumulator refresh that
+// does not depend on the network.
+void Engine::threats_benchmark(int repeats) {
+    using NN::Features::FullThreats;
+
+    std::vector<std::string>               fens = Benchmark::default_fens();
+    std::deque<StateInfo>                  benchStates(fens.size());
+    std::vector<std::unique_ptr<Position>> positions;
+
+    for (size_t i = 0; i < fens.size(); ++i)
+    {
+        positions.push_back(std::make_unique<Position>());
+        positions.back()->set(fens[i], false, &benchStates[i]);
+    }
+
+    size_t    features = 0;
+    TimePoint start    = now();
+    for (int r = 0; r < repeats; ++r)
+        for (const auto& p : positions)
+        {
+            FullThreats::IndexList white, black;
+            FullThreats::append_active_indices<WHITE>(*p, white);
+            FullThreats::append_active_indices<BLACK>(*p, black);
+            features += white.size() + black.size();
+        }
+    TimePoint elapsed = now() - start;
+
+    const double refreshes = 2.0 * repeats * positions.size();
+
+    sync_cout << "Threat feature refresh benchmark over " << positions.size() << " positions"
+              << "\nFeatures per refresh       : " << features / refreshes
+              << "\nLatency (ns/refresh)       : " << 1e6 * elapsed / refreshes << sync_endl;
+}
+
+namespace {
+
+// A game of an SPSA iteration, between the values of the parameters perturbed up
+// and down, each played by its own context
+struct SpsaGame {
+    std::string              fen;
+    std::vector<std::string> moves;
+    StateListPtr             states;
+    Position                 pos;
+    Color                    plusColor;
+    int                      score;  // 1, 0 or -1 for the plus side, SpsaRunning until the end
+};
+
+constexpr int SpsaRunning  = 2;
+constexpr int SpsaMaxPlies = 300;
+
+// A repetition is a draw, as is a game that reaches SpsaMaxPlies
+int spsa_score(const SpsaGame& g) {
+    if (!MoveList<LEGAL>(g.pos).size())
+        return !g.pos.checkers() ? 0 : g.pos.side_to_move() == g.plusColor ? -1 : 1;
+
+    return g.pos.is_draw(MAX_PLY) || g.moves.size() >= SpsaMaxPlies ? 0 : SpsaRunning;
+}
+
+}
+
+// Tunes the TUNE() parameters with SPSA, like fishtest does with c_end a twentieth
+// of the range of a parameter and r_end 0.002, but the games are played here, at
+// a fixed number of nodes and in parallel, by contexts that share the networks.
+// An iteration is a pair of games from a bench position with the colours swapped,
+// and the games of 'games' / 2 pairs are played at once with the same perturbation.
+// The parameters are global, so all the games are played in lockstep: first the
+// moves of the side with the values perturbed up, then those of the other one.
+void Engine::tune_spsa(int pairs, int games, uint64_t nodes) {
+    std::vector<Tune::Parameter> params = Tune::parameters();
+    if (params.empty())
+    {
+        sync_cout << "info string No TUNE() parameters to tune" << sync_endl;
+        return;
+    }
+
+    wait_for_search_finished();
+    verify_networks();
+
+    constexpr double Alpha = 0.602, Gamma = 0.101, REnd = 0.002;
+
+    const size_t        n = params.size();
+    const double        A = 0.1 * pairs;
+    std::vector<double> theta(n), c(n), a(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double cEnd = (params[i].max - params[i].min) / 20.0;
+        theta[i]          = params[i].value;
+        c[i]              = cEnd * std::pow(pairs, Gamma);
+        a[i]              = REnd * cEnd * cEnd * std::pow(A + pairs, Alpha);
+    }
+
+    // A context per side of each game, so that they don't share hash and histories
+    std::vector<std::unique_ptr<Engine>>      contexts;
+    std::vector<std::unique_ptr<AsyncEngine>> players;
+    for (int i = 0; i < 2 * games; ++i)
+    {
+        contexts.push_back(std::make_unique<Engine>(*this));
+        contexts.back()->set_on_verify_networks([](const auto&) {});
+        players.push_back(std::make_unique<AsyncEngine>(*contexts.back()));
+    }
+
+    const std::vector<std::string> fens = Benchmark::default_fens();
+    std::vector<SpsaGame>          played(games);
+    Search::LimitsType             limits;
+    PRNG                           rng(1070372);
+    int                            wins = 0, losses = 0, draws = 0;
+    TimePoint                      start = now();
+
+    limits.nodes = nodes;
+
+    for (int k = 0; k < pairs; k += games / 2)
+    {
+        const int        batch = std::min(games / 2, pairs - k);
+        std::vector<int> flip(n), plus(n), minus(n);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double ck = c[i] / std::pow(k + 1, Gamma);
+            flip[i]         = rng.rand<uint64_t>() & 1 ? 1 : -1;
+            plus[i]         = std::clamp(int(std::lround(theta[i] + ck * flip[i])),
+                                         params[i].min, params[i].max);
+            minus[i]        = std::clamp(int(std::lround(theta[i] - ck * flip[i])),
+                                         params[i].min, params[i].max);
+        }
+
+        for (int g = 0; g < 2 * batch; ++g)
+        {
+            SpsaGame& game = played[g];
+            game.fen       = fens[(k + g / 2) % fens.size()];
+            game.moves.clear();
+            game.states = std::make_shared<std::deque<StateInfo>>(1);
+            game.pos.set(game.fen, false, &game.states->back());
+            game.plusColor = g & 1 ? BLACK : WHITE;
+            game.score     = spsa_score(game);
+
+            contexts[2 * g]->search_clear();
+            contexts[2 * g + 1]->search_clear();
+        }
+
+        for (bool running = true; running;)
+        {
+            running = false;
+
+            for (bool plusSide : {true, false})
+            {
+                Tune::set_values(plusSide ? plus : minus);
+
+                std::vector<std::pair<int, std::future<AsyncEngine::Result>>> searches;
+                for (int g = 0; g < 2 * batch; ++g)
+                    if (played[g].score == SpsaRunning
+                        && (played[g].pos.side_to_move() == played[g].plusColor) == plusSide)
+                        searches.emplace_back(
+                          g, players[2 * g + !plusSide]->go(played[g].fen, played[g].moves, limits));
+
+                for (auto& [g, result] : searches)
+                {
+                    SpsaGame&         game = played[g];
+                    const std::string best = result.get().bestmove;
+                    const Move        m    = UCIEngine::to_move(game.pos, best);
+                    assert(m != Move::none());
+
+                    game.states->emplace_back();
+                    game.pos.do_move(m, game.states->back());
+                    game.moves.push_back(best);
+                    game.score = spsa_score(game);
+                    running |= game.score == SpsaRunning;
+                }
+            }
+        }
+
+        int result = 0;
+        for (int g = 0; g < 2 * batch; ++g)
+        {
+            result += played[g].score;
+            wins += played[g].score == 1;
+            losses += played[g].score == -1;
+            draws += played[g].score == 0;
+        }
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double ck = c[i] / std::pow(k + 1, Gamma);
+            const double ak = a[i] / std::pow(A + k + 1, Alpha);
+            theta[i] = std::clamp(theta[i] + ak / ck * result * flip[i], double(params[i].min),
+                                  double(params[i].max));
+        }
+
+        sync_cout << "info string SPSA " << k + batch << "/" << pairs << " pairs, +" << wins
+                  << " -" << losses << " =" << draws << ", " << (now() - start) / 1000 << " s"
+                  << sync_endl;
+    }
+
+    // Leave the tuned values in the options, and print them like Tune does at startup
+    for (size_t i = 0; i < n; ++i)
+    {
+        const int value = int(std::lround(theta[i]));
+        options.options_map[params[i].name].currentValue = std::to_string(value);
+        sync_cout << params[i].name << "," << value << sync_endl;
+    }
+    Tune::read_options();
+}
+
+void Engine::set_ponderhit(bool b) {
+    threads.main_manager()->ponder = b;
+    threads.main_manager()->timer.wake();
+}
 
 // network related
 
@@ -260,10 +1009,59 @@ void Engine::verify_networks() const {
     networks->big.verify(options["EvalFile"], onVerifyNetworks);
     networks->small.verify(options["EvalFileSmall"], onVerifyNetworks);
 
-    auto statuses = networks.get_status_and_errors();
+    for (const auto& message : network_replicas_information())
+        onVerifyNetworks(message);
+
+    onVerifyNetworks(huge_page_information());
+
+    if (!options["Require Shared Memory"])
+        return;
+
+    // Falling back to local memory would cost a full copy of the networks per process
+    for (const auto& [status, error] : networks.get_status_and_errors())
+        if (status == SystemWideSharedConstantAllocationStatus::LocalMemory)
+        {
+            onVerifyNetworks("ERROR: The networks could not be placed in shared memory.\n"
+                             "ERROR: The engine will be terminated now.");
+            exit(EXIT_FAILURE);
+        }
+}
+
+// The bytes of the large allocations that are on huge pages, from the kernel
+std::string Engine::huge_page_information() const {
+    const auto mib = [](size_t bytes) { return std::to_string((bytes + (1 << 19)) >> 20); };
+
+    const auto [table, tableSize] = tt.memory();
+
+    size_t workers = 0, workersHuge = 0;
+    for (auto it = threads.cbegin(); it != threads.cend(); ++it)
+    {
+        workers += sizeof(Search::Worker);
+        workersHuge += huge_page_bytes((*it)->worker.get(), sizeof(Search::Worker));
+    }
+
+    size_t nets = 0, netsHuge = 0;
+    for (const auto& info : networks.get_info())
+    {
+        nets += info.size;
+        netsHuge += info.hugePageBytes;
+    }
+
+    return "Huge pages (" + options["Huge Pages"].currentValue + "): TT "
+         + mib(huge_page_bytes(table, tableSize)) + " of " + mib(tableSize) + " MiB, workers "
+         + mib(workersHuge) + " of " + mib(workers) + " MiB, networks " + mib(netsHuge) + " of "
+         + mib(nets) + " MiB";
+}
+
+std::vector<std::string> Engine::network_replicas_information() const {
+    std::vector<std::string> lines;
+    auto                     statuses = networks.get_status_and_errors();
+    auto                     infos    = networks.get_info();
+
     for (size_t i = 0; i < statuses.size(); ++i)
     {
         const auto [status, error] = statuses[i];
+        const auto& info           = infos[i];
         std::string message        = "Network replica " + std::to_string(i + 1) + ": ";
         if (status == SystemWideSharedConstantAllocationStatus::NoAllocation)
         {
@@ -282,45 +1080,93 @@ void Engine::verify_networks() const {
             message += "Unknown status.";
         }
 
+        if (status != SystemWideSharedConstantAllocationStatus::NoAllocation)
+        {
+            message += " Name " + info.name + ", " + std::to_string(info.size / (1024 * 1024))
+                     + " MiB, " + (info.largePages ? "large pages" : "small pages");
+
+            if (status == SystemWideSharedConstantAllocationStatus::SharedMemory)
+                message += std::string(", ") + (info.attached ? "attached" : "created") + ", "
+                         + (info.refCount ? std::to_string(info.refCount) : "unknown")
+                         + " references";
+
+            message += ".";
+        }
+
         if (error.has_value())
         {
             message += " " + *error;
         }
 
-        onVerifyNetworks(message);
+        lines.push_back(message);
     }
+
+    return lines;
 }
 
 void Engine::load_networks() {
+    wait_for_contexts();
     networks.modify_and_replicate([this](NN::Networks& networks_) {
         networks_.big.load(binaryDirectory, options["EvalFile"]);
         networks_.small.load(binaryDirectory, options["EvalFileSmall"]);
     });
+    evalCache.clear(threads);
     threads.clear();
     threads.ensure_network_replicated();
+    update_contexts(false);
 }
 
 void Engine::load_big_network(const std::string& file) {
+    wait_for_contexts();
     networks.modify_and_replicate(
       [this, &file](NN::Networks& networks_) { networks_.big.load(binaryDirectory, file); });
+    evalCache.clear(threads);
     threads.clear();
     threads.ensure_network_replicated();
+    update_contexts(false);
 }
 
 void Engine::load_small_network(const std::string& file) {
+    wait_for_contexts();
     networks.modify_and_replicate(
       [this, &file](NN::Networks& networks_) { networks_.small.load(binaryDirectory, file); });
+    evalCache.clear(threads);
     threads.clear();
     threads.ensure_network_replicated();
+    update_contexts(false);
 }
 
 void Engine::save_network(const std::pair<std::optional<std::string>, std::string> files[2]) {
+    wait_for_contexts();
     networks.modify_and_replicate([&files](NN::Networks& networks_) {
         networks_.big.save(files[0].first);
         networks_.small.save(files[1].first);
     });
 }
 
+void Engine::save_big_network_int8_threats(const std::string& file) {
+    wait_for_contexts();
+    networks.modify_and_replicate([&file](NN::Networks& networks_) {
+        networks_.big.save(file, NN::VersionInt8Threats);
+    });
+}
+
+void Engine::save_network_native(const std::string& fileBig, const std::string& fileSmall) {
+    wait_for_contexts();
+    networks.modify_and_replicate([&](NN::Networks& networks_) {
+        networks_.big.save(fileBig, NN::VersionNative);
+        networks_.small.save(fileSmall, NN::VersionNative);
+    });
+}
+
+void Engine::save_network_compressed(const std::string& fileBig, const std::string& fileSmall) {
+    wait_for_contexts();
+    networks.modify_and_replicate([&](NN::Networks& networks_) {
+        networks_.big.save(fileBig, NN::VersionNativeCompressed);
+        networks_.small.save(fileSmall, NN::VersionNativeCompressed);
+    });
+}
+
 // utility functions
 
 void Engine::trace_eval() const {
@@ -333,12 +1179,157 @@ void Engine::trace_eval() const {
     sync_cout << "\n" << Eval::trace(p, *networks) << sync_endl;
 }
 
+// Scores every FEN or EPD line of the input file with the static evaluation and
+// writes them to the output file, in the input order, followed by what 'format'
+// returns for them. Positions in check are written unchanged, and lines that are
+// not a valid FEN are skipped. The file is read in chunks, which are split over
+// the threads of the pool, so that the memory use is bounded and the output keeps
+// up with the input.
+void Engine::eval_batch(const std::string&   inFile,
+                        const std::string&   outFile,
+                        const EvalFormatter& format) {
+    wait_for_search_finished();
+    verify_networks();
+
+    std::ifstream in(inFile);
+    std::ofstream out(outFile);
+
+    if (!in || !out)
+    {
+        sync_cout << "info string Failed to open " << (!in ? inFile : outFile) << sync_endl;
+        return;
+    }
+
+    constexpr size_t LinesPerThread = 4096;
+
+    const size_t threadCount = threads.num_threads();
+    const bool   chess960    = options["UCI_Chess960"];
+
+    std::vector<std::string> lines;
+    std::vector<std::string> results;
+    size_t                   total = 0, skipped = 0;
+    TimePoint                start = now();
+
+    // Created by each thread on its first chunk, so their memory is local to it
+    std::vector<std::unique_ptr<Eval::NNUE::AccumulatorStack>> stacks(threadCount);
+
+    while (in)
+    {
+        lines.clear();
+        for (std::string line; lines.size() < threadCount * LinesPerThread;)
+            if (!std::getline(in, line))
+                break;
+            else if (Position::is_valid_fen(line))
+                lines.push_back(std::move(line));
+            else
+                skipped += !line.empty();
+
+        results.assign(lines.size(), std::string());
+        const size_t perThread = (lines.size() + threadCount - 1) / threadCount;
+
+        for (size_t i = 0; i < threadCount; ++i)
+            threads.run_on_thread(i, [&, i]() {
+                const size_t begin = std::min(i * perThread, lines.size());
+                const size_t end   = std::min(begin + perThread, lines.size());
+                const auto&  bound = threads.get_bound_thread_to_numa_node();
+                const auto&  nets  = networks[NumaReplicatedAccessToken(
+                  bound.empty() ? 0 : bound[i])];
+
+                if (!stacks[i])
+                    stacks[i] = std::make_unique<Eval::NNUE::AccumulatorStack>();
+
+                std::vector<StateInfo>       stateInfos(end - begin);
+                std::vector<Position>        positions(end - begin);
+                std::vector<const Position*> batch;
+                std::vector<size_t>          index;
+
+                for (size_t j = begin; j < end; ++j)
+                {
+                    Position& p = positions[j - begin];
+                    p.set(lines[j], chess960, &stateInfos[j - begin]);
+
+                    if (!p.checkers())
+                    {
+                        batch.push_back(&p);
+                        index.push_back(j);
+                    }
+                    else
+                        results[j] = lines[j];
+                }
+
+                std::vector<Value> values(batch.size());
+                Eval::evaluate_batch(nets, batch.data(), batch.size(), *stacks[i], values.data());
+
+                for (size_t k = 0; k < batch.size(); ++k)
+                    results[index[k]] = lines[index[k]] + format(*batch[k], values[k]);
+            });
+
+        for (size_t i = 0; i < threadCount; ++i)
+            threads.wait_on_thread(i);
+
+        for (const auto& r : results)
+            out << r << '\n';
+
+        total += lines.size();
+    }
+
+    sync_cout << "info string Evaluated " << total << " positions in " << now() - start << " ms"
+              << (skipped ? ", skipped " + std::to_string(skipped) + " invalid lines" : "")
+              << sync_endl;
+}
+
+double Engine::eval_throughput(const std::vector<std::string>& fens, int rounds) {
+    wait_for_search_finished();
+    verify_networks();
+
+    double perSecond = 0;
+
+    threads.run_on_thread(0, [&]() {
+        const auto& bound = threads.get_bound_thread_to_numa_node();
+        const auto& nets  = networks[NumaReplicatedAccessToken(bound.empty() ? 0 : bound[0])];
+
+        auto stack = std::make_unique<Eval::NNUE::AccumulatorStack>();
+
+        std::vector<StateInfo>       stateInfos(fens.size());
+        std::vector<Position>        positions(fens.size());
+        std::vector<const Position*> batch;
+
+        for (size_t i = 0; i < fens.size(); ++i)
+        {
+            positions[i].set(fens[i], false, &stateInfos[i]);
+
+            if (!positions[i].checkers())
+                batch.push_back(&positions[i]);
+        }
+
+        std::vector<Value> values(batch.size());
+
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+            Eval::evaluate_batch(nets, batch.data(), batch.size(), *stack, values.data());
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        perSecond = double(rounds) * batch.size() / std::max(elapsed.count(), 1e-9);
+    });
+
+    threads.wait_on_thread(0);
+
+    return perSecond;
+}
+
 const OptionsMap& Engine::get_options() const { return options; }
 OptionsMap&       Engine::get_options() { return options; }
 
 std::string Engine::fen() const { return pos.fen(); }
 
-void Engine::flip() { pos.flip(); }
+void Engine::flip() {
+    pos.flip();
+    setupFen.clear();
+}
+
+Move Engine::to_move(const std::string& str) const { return UCIEngine::to_move(pos, str); }
+
+uint64_t Engine::nodes_searched() const { return threads.nodes_searched(); }
 
 std::string Engine::visualize() const {
     std::stringstream ss;
@@ -386,6 +1377,20 @@ std::string Engine::thread_binding_information_as_string() const {
         isFirst = false;
     }
 
+    // The threads and the physical cores of each last level cache
+    const NumaConfig& cfg    = numaContext.get_numa_config();
+    const auto        counts = threads.get_bound_thread_count_by_cache_domain(cfg);
+    if (!counts.empty())
+        ss << ", by cache:";
+
+    for (size_t d = 0; d < counts.size(); ++d)
+    {
+        const auto cores = std::count_if(cfg.cores.begin(), cfg.cores.end(),
+                                         [d](const auto& core) { return core.cacheDomain == d; });
+        ss << " " << NumaConfig::cpus_to_string(cfg.cacheDomains[d]) << " " << counts[d] << "/"
+           << cores;
+    }
+
     return ss.str();
 }
 
@@ -404,4 +1409,280 @@ std::string Engine::thread_allocation_information_as_string() const {
 
     return ss.str();
 }
+
+size_t Engine::fixed_memory() const {
+    size_t bytes = 0;
+    for (const auto& info : networks.get_info())
+        bytes += info.size;
+
+    return bytes + threads.shared_correction_history_nodes().size() * sizeof(CorrectionHistories)
+         + Tablebases::cache_bytes() + book.memory();
+}
+
+size_t Engine::thread_memory() const {
+    return sizeof(Search::Worker) + refresh_cache_memory()
+         + size_t(options["Thread Hash"]) * 1024
+         + (options["Shared Correction History"] ? 0 : sizeof(CorrectionHistories));
+}
+
+// The eval cache is given up first, then the hash down to 16 MB, then threads, and
+// the hash down to 1 MB last. The memory of each thread and the fixed memory are
+// counted but not reduced, and the mapped tablebase files have their own limit.
+Engine::MemoryFit Engine::fit_memory_budget() const {
+    constexpr size_t MB = 1024 * 1024;
+
+    MemoryFit    fit{size_t(options["Threads"]), size_t(options["Hash"]),
+                  size_t(options["Eval Cache"])};
+    const size_t budget = size_t(options["MaxMemoryMB"]) * MB;
+    if (!budget)
+        return fit;
+
+    const size_t fixed = fixed_memory(), perThread = thread_memory();
+
+    const auto excessMB = [&]() -> size_t {
+        const size_t used = fixed + fit.threads * perThread + (fit.hashMB + fit.evalCacheMB) * MB;
+        return used > budget ? (used - budget + MB - 1) / MB : 0;
+    };
+    const auto shrink = [&](size_t& mb, size_t minMB) {
+        mb -= std::min(mb - std::min(mb, minMB), excessMB());
+    };
+
+    shrink(fit.evalCacheMB, 0);
+    shrink(fit.hashMB, 16);
+    while (fit.threads > 1 && excessMB())
+        --fit.threads;
+
+    // The hash takes back what the dropped threads left
+    fit.hashMB = size_t(options["Hash"]);
+    shrink(fit.hashMB, 1);
+
+    return fit;
+}
+
+std::string Engine::memory_budget_information() const {
+    const size_t budgetMB = options["MaxMemoryMB"];
+    if (!budgetMB)
+        return "No memory budget";
+
+    const MemoryFit fit   = fit_memory_budget();
+    const size_t    usedMB = (fixed_memory() + fit.threads * thread_memory() + (1 << 19)) / (1 << 20)
+                        + fit.hashMB + fit.evalCacheMB;
+
+    return "Memory budget " + std::to_string(budgetMB) + " MiB: " + std::to_string(fit.threads)
+         + " of " + std::to_string(size_t(options["Threads"])) + " threads, Hash "
+         + std::to_string(fit.hashMB) + " of " + std::to_string(size_t(options["Hash"]))
+         + " MB, Eval Cache " + std::to_string(fit.evalCacheMB) + " of "
+         + std::to_string(size_t(options["Eval Cache"])) + " MB, " + std::to_string(usedMB)
+         + " MiB used" + (usedMB > budgetMB ? ", over the budget" : "");
+}
+
+std::vector<std::string> Engine::memory_information() const {
+    const auto mib = [](size_t bytes) { return std::to_string((bytes + (1 << 19)) >> 20); };
+    const auto kib = [](size_t bytes) { return std::to_string((bytes + (1 << 9)) >> 10); };
+
+    const auto   infos       = networks.get_info();
+    const auto   cacheTables = evalCache.memory_by_node();
+    const auto   chNodes     = threads.shared_correction_history_nodes();
+    const size_t hash        = tt.memory().second;
+    const size_t perThread   = thread_memory();
+    const size_t sharedCH    = chNodes.size() * sizeof(CorrectionHistories);
+    const bool   ownCH       = !options["Shared Correction History"];
+
+    size_t cache = 0, nets = 0;
+    for (size_t bytes : cacheTables)
+        cache += bytes;
+    for (const auto& info : infos)
+        nets += info.size;
+
+    const size_t total = hash + threads.size() * perThread + sharedCH + cache + nets
+                       + Tablebases::mapped_bytes() + Tablebases::cache_bytes() + book.memory();
+
+    std::vector<std::string> lines;
+    lines.push_back("Memory: " + mib(total) + " MiB in total");
+    lines.push_back("Hash: " + mib(hash) + " MiB");
+    lines.push_back("Threads: " + std::to_string(threads.size()) + " x " + kib(perThread)
+                    + " KiB (worker " + kib(sizeof(Search::Worker)) + ", refresh caches "
+                    + kib(refresh_cache_memory()) + ", thread hash "
+                    + kib(size_t(options["Thread Hash"]) * 1024) + ", correction histories "
+                    + kib(ownCH ? sizeof(CorrectionHistories) : 0) + " KiB)");
+    lines.push_back("Shared correction histories: " + std::to_string(chNodes.size()) + " x "
+                    + kib(sizeof(CorrectionHistories)) + " KiB" + (ownCH ? ", not in use" : ""));
+    lines.push_back("Eval cache: " + mib(cache) + " MiB");
+    lines.push_back("Networks: " + std::to_string(infos.size()) + " x "
+                    + mib(infos.empty() ? 0 : nets / infos.size()) + " MiB");
+    lines.push_back("Syzygy: " + mib(Tablebases::mapped_bytes()) + " MiB mapped, "
+                    + mib(Tablebases::cache_bytes()) + " MiB cache");
+    lines.push_back("Book: " + mib(book.memory()) + " MiB mapped");
+
+    // The hash is spread over the nodes, the rest is on the node of its threads
+    const auto& boundNodes = threads.get_bound_thread_to_numa_node();
+    if (boundNodes.empty())
+        lines.push_back("NUMA nodes: the threads are not bound");
+
+    const NumaIndex nodes =
+      boundNodes.empty() ? 0 : *std::max_element(boundNodes.begin(), boundNodes.end()) + 1;
+    for (NumaIndex n = 0; n < nodes; ++n)
+    {
+        const size_t count = std::count(boundNodes.begin(), boundNodes.end(), n);
+        const size_t bytes =
+          count * perThread + (n < infos.size() ? infos[n].size : 0)
+          + (n < cacheTables.size() ? cacheTables[n] : 0)
+          + (std::count(chNodes.begin(), chNodes.end(), n) ? sizeof(CorrectionHistories) : 0);
+
+        lines.push_back("NUMA node " + std::to_string(n) + ": " + std::to_string(count)
+                        + " threads, " + mib(bytes) + " MiB without the hash");
+    }
+
+    if (int(options["MaxMemoryMB"]))
+        lines.push_back(memory_budget_information());
+
+    return lines;
+}
+
+AsyncEngine::AsyncEngine(Engine& e) :
+    engine(e),
+    infos(std::make_unique<SpscRing<Info, InfoRingSize>>()) {
+
+    engine.wait_for_search_finished();
+
+    engine.set_on_iter([](const auto&) {});
+    engine.set_on_update_no_moves([](const auto&) {});
+    engine.set_on_update_full([this](const Engine::InfoFull& i) {
+        Info info;
+        static_cast<Search::InfoShort&>(info) = i;
+        info.selDepth                          = i.selDepth;
+        info.multiPV                           = i.multiPV;
+        info.wdl                               = i.wdl;
+        info.bound                             = i.bound;
+        info.timeMs                            = i.timeMs;
+        info.nodes                             = i.nodes;
+        info.nps                               = i.nps;
+        info.tbHits                            = i.tbHits;
+        info.pv                                = i.pv;
+        info.hashfull                          = i.hashfull;
+        infos->try_push(std::move(info));
+    });
+    engine.set_on_bestmove([this](std::string_view bestmove, std::string_view ponder) {
+        // Before the value is set, so that a stop right after it goes to the next search
+        currentResolved = true;
+        --unresolved;
+        current.set_value({std::string(bestmove), std::string(ponder)});
+    });
+
+    dispatcher = std::thread(&AsyncEngine::dispatch, this);
+}
+
+AsyncEngine::~AsyncEngine() {
+    cancel_queued();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exit = true;
+        engine.stop();
+    }
+    cv.notify_one();
+    dispatcher.join();
+
+    engine.set_on_update_full([](const auto&) {});
+    engine.set_on_bestmove([](const auto&, const auto&) {});
+}
+
+std::future<AsyncEngine::Result> AsyncEngine::go(const std::string&              fen,
+                                                 const std::vector<std::string>& moves,
+                                                 const Search::LimitsType&       limits) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back({fen, moves, limits, std::promise<Result>()});
+    auto future = queue.back().result.get_future();
+    ++unresolved;
+    cv.notify_one();
+    return future;
+}
+
+// When the best move of the current search was already sent, the stop is kept for
+// the next search, which may not have started yet.
+void AsyncEngine::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!unresolved)
+        return;
+
+    if (currentResolved)
+        stopNext = true;
+    else
+        engine.stop();
+}
+
+void AsyncEngine::ponderhit() { engine.set_ponderhit(false); }
+
+void AsyncEngine::cancel_queued() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& request : queue)
+        request.result.set_value({});
+    unresolved -= queue.size();
+    queue.clear();
+}
+
+bool AsyncEngine::poll_info(Info& info) { return infos->try_pop(info); }
+
+size_t AsyncEngine::dropped_infos() const { return infos->dropped_count(); }
+
+// Starts the queued searches one after another. While a search runs, the position
+// of the next queued one is already set up, so that it can start right away.
+void AsyncEngine::dispatch() {
+    std::optional<Request> next;
+
+    while (true)
+    {
+        if (!next)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return exit || !queue.empty(); });
+            if (exit)
+                return;
+
+            next = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            engine.set_position(next->fen, next->moves);
+        }
+
+        Request request = std::move(*next);
+        next.reset();
+
+        {
+            // Started under the lock, so that the destructor can't stop the search
+            // before it has started.
+            std::lock_guard<std::mutex> lock(mutex);
+            if (exit)
+            {
+                request.result.set_value({});
+                return;
+            }
+
+            // The time of the search is counted from its start, not from the request
+            request.limits.startTime = now();
+            current                  = std::move(request.result);
+            currentResolved          = false;
+            engine.go(request.limits);
+
+            if (stopNext)
+            {
+                stopNext = false;
+                engine.stop();
+            }
+
+            if (!queue.empty())
+            {
+                next = std::move(queue.front());
+                queue.pop_front();
+            }
+        }
+
+        // The search has copied the root position, and set_position() at most appends
+        // to the states it reads, see ThreadPool::setupStates
+        if (next)
+            engine.set_position(next->fen, next->moves);
+
+        engine.wait_for_search_finished();
+    }
+}
 }
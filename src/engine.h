@@ -20,14 +20,24 @@
 #define ENGINE_H_INCLUDED
 
 #include <cstddef>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "book.h"
+#include "evalcache.h"
+#include "misc.h"
 #include "nnue/network.h"
 #include "numa.h"
 #include "position.h"
@@ -46,6 +56,11 @@ class Engine {
     using InfoIter  = Search::InfoIteration;
 
     Engine(std::optional<std::string> path = std::nullopt);
+    // Creates a context for an independent game in the same process. It has its own
+    // position, threads, hash and histories, but shares the networks, the NUMA
+    // configuration and the tablebases with the owner, which is the only one that
+    // can change them.
+    explicit Engine(Engine& owner);
 
     // Cannot be movable due to components holding backreferences to fields
     Engine(const Engine&)            = delete;
@@ -53,9 +68,18 @@ class Engine {
     Engine& operator=(const Engine&) = delete;
     Engine& operator=(Engine&&)      = delete;
 
-    ~Engine() { wait_for_search_finished(); }
+    ~Engine();
 
-    std::uint64_t perft(const std::string& fen, Depth depth, bool isChess960);
+    // 0 for the engine that owns the shared resources, and a unique index for each context
+    size_t context_index() const;
+
+    // With a thread count or a hash size, the perft is split over the threads and
+    // uses a hash table of the subtrees
+    std::uint64_t perft(const std::string& fen,
+                        Depth              depth,
+                        bool               isChess960,
+                        size_t             threadCount = 0,
+                        size_t             hashMB      = 0);
 
     // non blocking call to start searching
     void go(Search::LimitsType&);
@@ -66,13 +90,53 @@ class Engine {
     void wait_for_search_finished();
     // set a new position, moves are in UCI format
     void set_position(const std::string& fen, const std::vector<std::string>& moves);
+    // set a new position from its packed form, returns false at the first move that
+    // is not legal, leaving the position before it
+    bool set_position(const PackedPosition& pp, const std::vector<Move>& moves);
 
     // modifiers
 
     void set_numa_config_from_option(const std::string& o);
     void resize_threads();
     void set_tt_size(size_t mb);
-    void set_ponderhit(bool);
+    void set_eval_cache_size(size_t mb);
+    void set_tablebase_io();
+    // probes and hits of the eval cache in the last search
+    std::pair<uint64_t, uint64_t> eval_cache_counts() const;
+    // bytes of the accumulator refresh caches of each thread
+    size_t refresh_cache_memory() const;
+    // accumulator diffs of all threads in the last search
+    Eval::NNUE::AccumulatorDiffCounters accumulator_diff_counts();
+    // move generation stages of all threads in the last search
+    MovePickerStats move_picker_stats();
+    // hardware counters of each thread in the last search, see LimitsType::perfCounters
+    std::vector<PerfCounters::Counts> perf_counts();
+    // hot path counters of all threads in the last search, with a 'stats=yes' build
+    std::vector<std::string> search_stats();
+    // samples one node of search() in 'rate' to the file, see SearchTrace
+    bool trace_start(const std::string& file, int rate);
+    // the records written and dropped
+    std::pair<uint64_t, uint64_t> trace_stop();
+    bool save_tt(const std::string& file) const;
+    bool load_tt(const std::string& file);
+    // loads the file of the HashFile option, if it was set since the last 'isready'
+    // or 'go', so that the options that clear the table can be set after it
+    void load_hash_file();
+    struct TTLatency {
+        size_t keys;
+        double hitRatio, hitNs, missNs;
+    };
+    TTLatency tt_probe_latency(size_t mb);
+    void      tt_benchmark(size_t mb);
+    // time per perspective of the threat features of a full accumulator refresh
+    void threats_benchmark(int repeats);
+    // tunes the TUNE() parameters with fixed node games between parallel contexts
+    void tune_spsa(int pairs, int games, uint64_t nodes);
+    void tt_stats();
+    // page faults of the tablebase files avoided by the search probes, and the
+    // SyzygyCache hits of the last search
+    std::vector<std::string> tablebase_io_stats() const;
+    void                     set_ponderhit(bool);
     void search_clear();
 
     void set_on_update_no_moves(std::function<void(const InfoShort&)>&&);
@@ -84,14 +148,27 @@ class Engine {
     // network related
 
     void verify_networks() const;
+    // Describes the memory backing each replica of the networks
+    std::vector<std::string> network_replicas_information() const;
     void load_networks();
     void load_big_network(const std::string& file);
     void load_small_network(const std::string& file);
     void save_network(const std::pair<std::optional<std::string>, std::string> files[2]);
+    void save_big_network_int8_threats(const std::string& file);
+    void save_network_native(const std::string& fileBig, const std::string& fileSmall);
+    void save_network_compressed(const std::string& fileBig, const std::string& fileSmall);
 
     // utility functions
 
     void trace_eval() const;
+    // Returns what eval_batch() appends to the line of a position, given its evaluation
+    using EvalFormatter = std::function<std::string(const Position&, Value)>;
+    void eval_batch(const std::string&   inFile,
+                    const std::string&   outFile,
+                    const EvalFormatter& format);
+    // Evaluates the positions the given number of times on one search thread,
+    // and returns the evaluations per second
+    double eval_throughput(const std::vector<std::string>& fens, int rounds);
 
     const OptionsMap& get_options() const;
     OptionsMap&       get_options();
@@ -99,31 +176,138 @@ class Engine {
     int get_hashfull(int maxAge = 0) const;
 
     std::string                            fen() const;
+    Move                                   to_move(const std::string& str) const;
+    uint64_t                               nodes_searched() const;
     void                                   flip();
     std::string                            visualize() const;
+    std::string                            huge_page_information() const;
     std::vector<std::pair<size_t, size_t>> get_bound_thread_count_by_numa_node() const;
     std::string                            get_numa_config_as_string() const;
     std::string                            numa_config_information_as_string() const;
     std::string                            thread_allocation_information_as_string() const;
     std::string                            thread_binding_information_as_string() const;
+    // The bytes of each subsystem and of each NUMA node, the first line a summary
+    std::vector<std::string> memory_information() const;
 
    private:
+    struct SharedResources;
+
+    Engine(std::string binaryDirectory, Engine* owner);
+
+    void                       copy_shared_options();
+    std::optional<std::string> reject_shared_option();
+    void                       for_each_context(const std::function<void(Engine&)>& f);
+    void                       wait_for_contexts();
+    void                       update_contexts(bool rebindThreads);
+
+    // The thread count and the sizes in MB of the hash and of the eval cache that
+    // fit in MaxMemoryMB, the requested ones without a budget
+    struct MemoryFit {
+        size_t threads, hashMB, evalCacheMB;
+    };
+    MemoryFit   fit_memory_budget() const;
+    size_t      fixed_memory() const;   // Bytes that do not depend on the thread count
+    size_t      thread_memory() const;  // Bytes of each thread
+    std::string memory_budget_information() const;
+
     const std::string binaryDirectory;
 
-    NumaReplicationContext numaContext;
+    std::shared_ptr<SharedResources> shared;
+    const size_t                     contextIndex;
+
+    NumaReplicationContext&                             numaContext;
+    LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& networks;
 
     Position     pos;
     StateListPtr states;
-
-    OptionsMap                                         options;
-    ThreadPool                                         threads;
-    TranspositionTable                                 tt;
-    LazyNumaReplicatedSystemWide<Eval::NNUE::Networks> networks;
+    bool         hashFilePending = false;
+    // The position command that set pos, whose moves may be extended by the next one
+    std::string              setupFen;
+    std::vector<std::string> setupMoves;
+
+    OptionsMap         options;
+    ThreadPool         threads;
+    TranspositionTable tt;
+    EvalCache          evalCache;
+    SearchTrace        trace;
+    Book               book;
 
     Search::SearchManager::UpdateContext  updateContext;
     std::function<void(std::string_view)> onVerifyNetworks;
 };
 
+// Runs searches on an engine without blocking the caller, for embedding the engine
+// in a service. Searches are queued and started one after another by a dispatcher
+// thread, and each one returns a future of its best move. The full info updates
+// are delivered through a lock-free ring, so that the search never waits for the
+// consumer. The callbacks of the engine are taken over for the lifetime of this.
+class AsyncEngine {
+   public:
+    struct Result {
+        std::string bestmove;
+        std::string ponder;
+    };
+
+    // Search::InfoFull, with the strings owned so that they outlive the callback
+    struct Info: Search::InfoShort {
+        int         selDepth;
+        size_t      multiPV;
+        std::string wdl;
+        std::string bound;
+        size_t      timeMs;
+        size_t      nodes;
+        size_t      nps;
+        size_t      tbHits;
+        std::string pv;
+        int         hashfull;
+    };
+
+    static constexpr size_t InfoRingSize = 1024;
+
+    explicit AsyncEngine(Engine& e);
+    ~AsyncEngine();
+
+    // Queues a search, which starts as soon as the previous ones are finished
+    std::future<Result> go(const std::string&              fen,
+                           const std::vector<std::string>& moves,
+                           const Search::LimitsType&       limits);
+    // Stops the oldest search that has no result yet, the later ones still run
+    void stop();
+    void ponderhit();
+    // Drops the queued searches, their futures get an empty best move
+    void cancel_queued();
+
+    // Takes the oldest info update, returns false if there is none
+    bool poll_info(Info& info);
+    // Info updates dropped because the consumer did not keep up
+    size_t dropped_infos() const;
+
+   private:
+    struct Request {
+        std::string              fen;
+        std::vector<std::string> moves;
+        Search::LimitsType       limits;
+        std::promise<Result>     result;
+    };
+
+    void dispatch();
+
+    Engine&                                        engine;
+    std::unique_ptr<SpscRing<Info, InfoRingSize>> infos;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::deque<Request>     queue;
+    bool                    exit     = false;
+    bool                    stopNext = false;
+
+    // Fulfilled by the main search thread with the best move of the current search
+    std::promise<Result> current;
+    std::atomic<bool>    currentResolved{true};
+    std::atomic<size_t>  unresolved{0};
+    std::thread          dispatcher;
+};
+
 }  // namespace Stockfish
 
 
@@ -0,0 +1,126 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "evalcache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "memory.h"
+#include "misc.h"
+#include "thread.h"
+
+namespace Stockfish {
+
+namespace {
+
+// Entry layout: key 32 bit | psqt 16 bit | positional 16 bit
+constexpr uint64_t pack(Key key, Value psqt, Value positional) {
+    return uint64_t(uint32_t(key)) << 32 | uint64_t(uint16_t(psqt)) << 16 | uint16_t(positional);
+}
+
+constexpr bool fits_16_bits(Value v) { return v >= INT16_MIN && v <= INT16_MAX; }
+
+}  // namespace
+
+
+// Allocates one table of the given size per NUMA node used by the thread pool.
+// The memory is only touched when clear() runs on the threads of each node.
+void EvalCache::resize(size_t mbSize, ThreadPool& threads) {
+    free();
+
+    entryCount = mbSize * 1024 * 1024 / sizeof(uint64_t);
+    if (!entryCount)
+        return;
+
+    const auto& bound = threads.get_bound_thread_to_numa_node();
+    NumaIndex   nodes = 1;
+    for (NumaIndex n : bound)
+        nodes = std::max(nodes, n + 1);
+
+    for (NumaIndex n = 0; n < nodes; ++n)
+    {
+        auto* table = static_cast<std::atomic<uint64_t>*>(
+          aligned_large_pages_alloc(entryCount * sizeof(uint64_t)));
+
+        if (!table)
+        {
+            std::cerr << "Failed to allocate " << mbSize << "MB for eval cache." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        tables.push_back(table);
+    }
+
+    clear(threads);
+}
+
+
+// Each table is zeroed by the first thread bound to its node
+void EvalCache::clear(ThreadPool& threads) {
+    const auto&         bound = threads.get_bound_thread_to_numa_node();
+    std::vector<size_t> clearing;
+
+    for (NumaIndex n = 0; n < tables.size(); ++n)
+    {
+        size_t i = 0;
+        while (i < bound.size() && bound[i] != n)
+            ++i;
+
+        clearing.push_back(i < bound.size() ? i : 0);
+
+        threads.run_on_thread(clearing.back(), [this, n]() {
+            std::memset(static_cast<void*>(tables[n]), 0, entryCount * sizeof(uint64_t));
+        });
+    }
+
+    for (size_t i : clearing)
+        threads.wait_on_thread(i);
+}
+
+
+void EvalCache::free() {
+    for (auto* table : tables)
+        aligned_large_pages_free(table);
+
+    tables.clear();
+    entryCount = 0;
+}
+
+
+bool EvalCache::probe(Key key, NumaIndex node, Value& psqt, Value& positional) const {
+    const uint64_t e = tables[node][mul_hi64(key, entryCount)].load(std::memory_order_relaxed);
+
+    if (uint32_t(e >> 32) != uint32_t(key))
+        return false;
+
+    psqt       = int16_t(e >> 16);
+    positional = int16_t(e);
+    return true;
+}
+
+
+void EvalCache::save(Key key, NumaIndex node, Value psqt, Value positional) {
+    if (fits_16_bits(psqt) && fits_16_bits(positional))
+        tables[node][mul_hi64(key, entryCount)].store(pack(key, psqt, positional),
+                                                      std::memory_order_relaxed);
+}
+
+}  // namespace Stockfish
@@ -0,0 +1,68 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVALCACHE_H_INCLUDED
+#define EVALCACHE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "numa.h"
+#include "types.h"
+
+namespace Stockfish {
+
+class ThreadPool;
+
+// A small hash of network outputs in front of the NNUE evaluation. There is one
+// table per NUMA node the threads are bound to, shared by the threads of that node.
+// An entry is a single 64 bit word holding the low 32 bits of the key and both
+// outputs, so it is lock-free: a racing read returns either a whole entry or a miss.
+// The outputs do not depend on the optimism nor on the rule50 counter, so the final
+// evaluation is still computed by Eval::blend() on a hit.
+class EvalCache {
+   public:
+    EvalCache()                 = default;
+    EvalCache(const EvalCache&) = delete;
+    ~EvalCache() { free(); }
+
+    void resize(size_t mbSize, ThreadPool& threads);  // A size of 0 disables the cache
+    void clear(ThreadPool& threads);                   // Multithreaded, node by node
+
+    bool enabled() const { return entryCount != 0; }
+
+    // The size of the table of each NUMA node
+    std::vector<size_t> memory_by_node() const {
+        return std::vector<size_t>(tables.size(), entryCount * sizeof(uint64_t));
+    }
+
+    bool probe(Key key, NumaIndex node, Value& psqt, Value& positional) const;
+    void save(Key key, NumaIndex node, Value psqt, Value positional);
+
+   private:
+    void free();
+
+    std::vector<std::atomic<uint64_t>*> tables;
+    size_t                              entryCount = 0;
+};
+
+}  // namespace Stockfish
+
+#endif  // #ifndef EVALCACHE_H_INCLUDED
@@ -27,6 +27,7 @@
 #include <memory>
 #include <sstream>
 #include <tuple>
+#include <vector>
 
 #include "nnue/network.h"
 #include "nnue/nnue_misc.h"
@@ -46,31 +47,94 @@ int Eval::simple_eval(const Position& pos) {
          + (pos.non_pawn_material(c) - pos.non_pawn_material(~c));
 }
 
-bool Eval::use_smallnet(const Position& pos) { return std::abs(simple_eval(pos)) > 962; }
+namespace {
 
-// Evaluate is the evaluator for the outer world. It returns a static evaluation
-// of the position from the point of view of the side to move.
-Value Eval::evaluate(const Eval::NNUE::Networks&    networks,
-                     const Position&                pos,
-                     Eval::NNUE::AccumulatorStack&  accumulators,
-                     Eval::NNUE::AccumulatorCaches& caches,
-                     int                            optimism) {
+// Above this material imbalance, the position is evaluated with the small net
+constexpr int SmallNetThreshold = 962;
 
-    assert(!pos.checkers());
+// Below the use_smallnet() threshold by at most this much, the small net is
+// likely to be used after a capture.
+constexpr int SmallNetSpeculationMargin = 350;
+
+Value nnue_value(Value psqt, Value positional) { return (125 * psqt + 131 * positional) / 128; }
+
+// A castling move is encoded as the king taking its own rook
+Piece captured_piece(const Position& pos, Move m) {
+    return m.type_of() == EN_PASSANT ? make_piece(~pos.side_to_move(), PAWN)
+         : m.type_of() == CASTLING   ? NO_PIECE
+                                     : pos.piece_on(m.to_sq());
+}
+
+// The material the side to move wins with the move
+int material_gain(const Position& pos, Move m) {
+    return PieceValue[captured_piece(pos, m)]
+         + (m.type_of() == PROMOTION ? PieceValue[m.promotion_type()] - PawnValue : 0);
+}
+
+}  // namespace
+
+bool Eval::use_smallnet(const Position& pos) {
+    return std::abs(simple_eval(pos)) > SmallNetThreshold;
+}
+
+// Whether the small net will evaluate the position after the move, known before
+// the move is made
+bool Eval::use_smallnet(const Position& pos, Move m) {
+    return std::abs(simple_eval(pos) + material_gain(pos, m)) > SmallNetThreshold;
+}
+
+// Runs the small or the big network, as evaluate() does, and returns their
+// psqt and positional outputs.
+std::tuple<Value, Value> Eval::network_output(const Eval::NNUE::Networks&    networks,
+                                              const Position&                pos,
+                                              Eval::NNUE::AccumulatorStack&  accumulators,
+                                              Eval::NNUE::AccumulatorCaches& caches) {
 
     bool smallNet           = use_smallnet(pos);
     auto [psqt, positional] = smallNet ? networks.small.evaluate(pos, accumulators, &caches.small)
                                        : networks.big.evaluate(pos, accumulators, &caches.big);
 
-    Value nnue = (125 * psqt + 131 * positional) / 128;
-
     // Re-evaluate the position when higher eval accuracy is worth the time spent
-    if (smallNet && (std::abs(nnue) < 236))
-    {
+    if (smallNet && (std::abs(nnue_value(psqt, positional)) < 236))
         std::tie(psqt, positional) = networks.big.evaluate(pos, accumulators, &caches.big);
-        nnue                       = (125 * psqt + 131 * positional) / 128;
-        smallNet                   = false;
-    }
+
+    return {psqt, positional};
+}
+
+// Updates the small net accumulators of a position evaluated with the big net,
+// when its imbalance is close to the use_smallnet() threshold. The small net is
+// then updated incrementally from here if a capture crosses it, instead of from
+// a refresh. Returns whether an update was made.
+bool Eval::speculate_smallnet(const Eval::NNUE::Networks&    networks,
+                              const Position&                pos,
+                              Eval::NNUE::AccumulatorStack&  accumulators,
+                              Eval::NNUE::AccumulatorCaches& caches) {
+
+    const int imbalance = std::abs(simple_eval(pos));
+
+    if (imbalance > SmallNetThreshold || imbalance <= SmallNetThreshold - SmallNetSpeculationMargin)
+        return false;
+
+    networks.small.update_accumulators(pos, accumulators, &caches.small);
+    return true;
+}
+
+// Prefetches the weights of the network that will evaluate the position after
+// the move, while it is being made, when the move switches between the networks.
+void Eval::prefetch_network(const Eval::NNUE::Networks& networks, const Position& pos, Move m) {
+
+    const int pieceCount = pos.count<ALL_PIECES>() - (captured_piece(pos, m) != NO_PIECE);
+
+    if (use_smallnet(pos, m))
+        networks.small.prefetch(pieceCount);
+    else
+        networks.big.prefetch(pieceCount);
+}
+
+// Turns the outputs of the network into the final evaluation
+Value Eval::blend(const Position& pos, Value psqt, Value positional, int optimism) {
+
+    Value nnue = nnue_value(psqt, positional);
 
     // Blend optimism and eval with nnue complexity
     int nnueComplexity = std::abs(psqt - positional);
@@ -89,6 +153,66 @@ Value Eval::evaluate(const Eval::NNUE::Networks&    networks,
     return v;
 }
 
+// Evaluate is the evaluator for the outer world. It returns a static evaluation
+// of the position from the point of view of the side to move.
+Value Eval::evaluate(const Eval::NNUE::Networks&    networks,
+                     const Position&                pos,
+                     Eval::NNUE::AccumulatorStack&  accumulators,
+                     Eval::NNUE::AccumulatorCaches& caches,
+                     int                            optimism) {
+
+    assert(!pos.checkers());
+
+    auto [psqt, positional] = network_output(networks, pos, accumulators, caches);
+
+    return blend(pos, psqt, positional, optimism);
+}
+
+// Evaluates many unrelated positions, none of them in check, with the same
+// result as evaluate() with no optimism. The positions are run through each
+// network in batches, see Network::evaluate_batch().
+void Eval::evaluate_batch(const Eval::NNUE::Networks&   networks,
+                          const Position* const*        positions,
+                          size_t                        count,
+                          Eval::NNUE::AccumulatorStack& accumulators,
+                          Value*                        values) {
+
+    std::vector<const Position*>     smallPos, bigPos;
+    std::vector<size_t>              smallIdx, bigIdx;
+    std::vector<NNUE::NetworkOutput> out(count, {VALUE_ZERO, VALUE_ZERO});
+    std::vector<NNUE::NetworkOutput> smallOut, bigOut;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        assert(!positions[i]->checkers());
+
+        (use_smallnet(*positions[i]) ? smallPos : bigPos).push_back(positions[i]);
+        (use_smallnet(*positions[i]) ? smallIdx : bigIdx).push_back(i);
+    }
+
+    smallOut.resize(smallPos.size());
+    networks.small.evaluate_batch(smallPos.data(), smallPos.size(), accumulators, smallOut.data());
+
+    // As in evaluate(), close small net evaluations are redone with the big net
+    for (size_t j = 0; j < smallPos.size(); ++j)
+        if (std::abs(nnue_value(std::get<0>(smallOut[j]), std::get<1>(smallOut[j]))) < 236)
+        {
+            bigPos.push_back(smallPos[j]);
+            bigIdx.push_back(smallIdx[j]);
+        }
+        else
+            out[smallIdx[j]] = smallOut[j];
+
+    bigOut.resize(bigPos.size());
+    networks.big.evaluate_batch(bigPos.data(), bigPos.size(), accumulators, bigOut.data());
+
+    for (size_t j = 0; j < bigPos.size(); ++j)
+        out[bigIdx[j]] = bigOut[j];
+
+    for (size_t i = 0; i < count; ++i)
+        values[i] = blend(*positions[i], std::get<0>(out[i]), std::get<1>(out[i]), 0);
+}
+
 // Like evaluate(), but instead of returning a value, it returns
 // a string (suitable for outputting to stdout) that contains the detailed
 // descriptions and values of each evaluation term. Useful for debugging.
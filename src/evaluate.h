@@ -19,7 +19,9 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include <cstddef>
 #include <string>
+#include <tuple>
 
 #include "types.h"
 
@@ -46,11 +48,27 @@ std::string trace(Position& pos, const Eval::NNUE::Networks& networks);
 
 int   simple_eval(const Position& pos);
 bool  use_smallnet(const Position& pos);
+bool  use_smallnet(const Position& pos, Move m);
+Value blend(const Position& pos, Value psqt, Value positional, int optimism);
+bool  speculate_smallnet(const NNUE::Networks&          networks,
+                         const Position&                pos,
+                         Eval::NNUE::AccumulatorStack&  accumulators,
+                         Eval::NNUE::AccumulatorCaches& caches);
+void  prefetch_network(const NNUE::Networks& networks, const Position& pos, Move m);
+std::tuple<Value, Value> network_output(const NNUE::Networks&          networks,
+                                        const Position&                pos,
+                                        Eval::NNUE::AccumulatorStack&  accumulators,
+                                        Eval::NNUE::AccumulatorCaches& caches);
 Value evaluate(const NNUE::Networks&          networks,
                const Position&                pos,
                Eval::NNUE::AccumulatorStack&  accumulators,
                Eval::NNUE::AccumulatorCaches& caches,
                int                            optimism);
+void  evaluate_batch(const NNUE::Networks&         networks,
+                     const Position* const*        positions,
+                     std::size_t                   count,
+                     Eval::NNUE::AccumulatorStack& accumulators,
+                     Value*                        values);
 }  // namespace Eval
 
 }  // namespace Stockfish
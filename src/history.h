@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
@@ -61,32 +62,54 @@ inline int non_pawn_index(const Position& pos) {
     return pos.non_pawn_key(c) & (CORRECTION_HISTORY_SIZE - 1);
 }
 
+// A relaxed atomic value that can be copied, for the entries of tables that are
+// updated by several threads. Loads and stores compile to plain moves, but a
+// concurrent update may overwrite another one, which is harmless for statistics.
+template<typename T>
+class RelaxedAtomic {
+    std::atomic<T> value;
+
+   public:
+    RelaxedAtomic() = default;
+    RelaxedAtomic(const RelaxedAtomic& other) :
+        value(T(other)) {}
+    RelaxedAtomic& operator=(const RelaxedAtomic& other) { return *this = T(other); }
+    RelaxedAtomic& operator=(T v) {
+        value.store(v, std::memory_order_relaxed);
+        return *this;
+    }
+    operator T() const { return value.load(std::memory_order_relaxed); }
+};
+
 // StatsEntry is the container of various numerical statistics. We use a class
 // instead of a naked value to directly call history update operator<<() on
 // the entry. The first template parameter T is the base type of the array,
 // and the second template parameter D limits the range of updates in [-D, D]
-// when we update values with the << operator
-template<typename T, int D>
+// when we update values with the << operator. Atomic entries can be updated
+// by several threads.
+template<typename T, int D, bool Atomic = false>
 class StatsEntry {
 
     static_assert(std::is_arithmetic_v<T>, "Not an arithmetic type");
     static_assert(D <= std::numeric_limits<T>::max(), "D overflows T");
 
-    T entry;
+    std::conditional_t<Atomic, RelaxedAtomic<T>, T> entry;
 
    public:
     StatsEntry& operator=(const T& v) {
         entry = v;
         return *this;
     }
-    operator const T&() const { return entry; }
+    operator T() const { return entry; }
 
     void operator<<(int bonus) {
         // Make sure that bonus is in range [-D, D]
         int clampedBonus = std::clamp(bonus, -D, D);
-        entry += clampedBonus - entry * std::abs(clampedBonus) / D;
+        T   v            = entry;
+        v += clampedBonus - v * std::abs(clampedBonus) / D;
+        entry = v;
 
-        assert(std::abs(entry) <= D);
+        assert(std::abs(v) <= D);
     }
 };
 
@@ -98,6 +121,9 @@ enum StatsType {
 template<typename T, int D, std::size_t... Sizes>
 using Stats = MultiArray<StatsEntry<T, D>, Sizes...>;
 
+template<typename T, int D, std::size_t... Sizes>
+using AtomicStats = MultiArray<StatsEntry<T, D, true>, Sizes...>;
+
 // ButterflyHistory records how often quiet moves have been successful or unsuccessful
 // during the current search, and is used for reduction and move ordering decisions.
 // It uses 2 tables (one for each color) indexed by the move's from and to squares,
@@ -120,6 +146,23 @@ using PieceToHistory = Stats<std::int16_t, 30000, PIECE_NB, SQUARE_NB>;
 // PieceToHistory instead of ButterflyBoards.
 using ContinuationHistory = MultiArray<PieceToHistory, PIECE_NB, SQUARE_NB>;
 
+// Cache lines of the continuation histories touched when scoring the quiet moves.
+// Packed counts the lines of the [piece][to] tables actually read, interleaved
+// those a layout keeping the entries of all the plies of a [piece][to] adjacent
+// would read, to compare both in bench.
+struct ContHistLineCounters {
+    std::uint64_t moves       = 0;
+    std::uint64_t packed      = 0;
+    std::uint64_t interleaved = 0;
+
+    ContHistLineCounters& operator+=(const ContHistLineCounters& c) {
+        moves += c.moves;
+        packed += c.packed;
+        interleaved += c.interleaved;
+        return *this;
+    }
+};
+
 // PawnHistory is addressed by the pawn structure and a move's [piece][to]
 using PawnHistory = Stats<std::int16_t, 8192, PAWN_HISTORY_SIZE, PIECE_NB, SQUARE_NB>;
 
@@ -139,7 +182,8 @@ namespace Detail {
 
 template<CorrHistType>
 struct CorrHistTypedef {
-    using type = Stats<std::int16_t, CORRECTION_HISTORY_LIMIT, CORRECTION_HISTORY_SIZE, COLOR_NB>;
+    using type =
+      AtomicStats<std::int16_t, CORRECTION_HISTORY_LIMIT, CORRECTION_HISTORY_SIZE, COLOR_NB>;
 };
 
 template<>
@@ -154,8 +198,11 @@ struct CorrHistTypedef<Continuation> {
 
 template<>
 struct CorrHistTypedef<NonPawn> {
-    using type =
-      Stats<std::int16_t, CORRECTION_HISTORY_LIMIT, CORRECTION_HISTORY_SIZE, COLOR_NB, COLOR_NB>;
+    using type = AtomicStats<std::int16_t,
+                             CORRECTION_HISTORY_LIMIT,
+                             CORRECTION_HISTORY_SIZE,
+                             COLOR_NB,
+                             COLOR_NB>;
 };
 
 }
@@ -165,6 +212,20 @@ using CorrectionHistory = typename Detail::CorrHistTypedef<T>::type;
 
 using TTMoveHistory = StatsEntry<std::int16_t, 8192>;
 
+// The correction histories indexed by position keys, which are either private
+// to a thread or shared by the threads of a NUMA node.
+struct CorrectionHistories {
+    CorrectionHistory<Pawn>    pawn;
+    CorrectionHistory<Minor>   minorPiece;
+    CorrectionHistory<NonPawn> nonPawn;
+
+    void clear() {
+        pawn.fill(5);
+        minorPiece.fill(0);
+        nonPawn.fill(0);
+    }
+};
+
 }  // namespace Stockfish
 
 #endif  // #ifndef HISTORY_H_INCLUDED
@@ -16,12 +16,15 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 
 #include "bitboard.h"
 #include "misc.h"
 #include "nnue/features/full_threats.h"
+#include "nnue/nnue_kernels.h"
 #include "position.h"
 #include "tune.h"
 #include "uci.h"
@@ -31,9 +34,25 @@ using namespace Stockfish;
 int main(int argc, char* argv[]) {
     std::cout << engine_info() << std::endl;
 
+#if defined(USE_SVE)
+    // Code built with -msve-vector-bits is only correct on that vector length
+    std::uint64_t vectorBytes;
+    asm volatile("rdvl %0, #1" : "=r"(vectorBytes));
+    if (vectorBytes * 8 != __ARM_FEATURE_SVE_BITS)
+    {
+        std::cerr << "This binary needs " << __ARM_FEATURE_SVE_BITS << "-bit SVE vectors, found "
+                  << vectorBytes * 8 << "-bit. Rebuild with sve_bits=" << vectorBytes * 8
+                  << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+#endif
+
     Bitboards::init();
     Position::init();
     Eval::NNUE::Features::init_threat_offsets();
+#if defined(USE_NNUE_DISPATCH)
+    Eval::NNUE::select_kernels();
+#endif
 
     auto uci = std::make_unique<UCIEngine>(argc, argv);
 
@@ -18,14 +18,25 @@
 
 #include "memory.h"
 
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 #if __has_include("features.h")
     #include <features.h>
 #endif
 
-#if defined(__linux__) && !defined(__ANDROID__)
+#if !defined(_WIN32)
+    #include <fcntl.h>
     #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) \
@@ -124,8 +135,58 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #else
 
+namespace {
+
+std::atomic<HugePages> hugePages{HugePages::Transparent};
+
+    #if defined(__linux__) && defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+        #define USE_HUGETLB
+
+// The hugetlbfs mappings and their sizes, which must be unmapped instead of freed
+std::mutex                        hugetlbMutex;
+std::unordered_map<void*, size_t> hugetlbMappings;
+
+void* hugetlb_alloc(size_t allocSize) {
+
+    const int maxShift = hugePages == HugePages::Pages1GB ? 30
+                       : hugePages == HugePages::Pages2MB ? 21
+                                                          : 0;
+
+    // Rounding a small allocation up to a page of 1GB would waste most of it
+    for (int shift = maxShift; shift >= 21; shift -= 9)
+    {
+        const size_t pageSize = size_t(1) << shift;
+        if (allocSize < pageSize)
+            continue;
+
+        const size_t size = (allocSize + pageSize - 1) & ~(pageSize - 1);
+        void*        mem  = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT),
+                                 -1, 0);
+        if (mem == MAP_FAILED)
+            continue;  // Not enough reserved pages of this size
+
+        std::lock_guard<std::mutex> lock(hugetlbMutex);
+        hugetlbMappings[mem] = size;
+        return mem;
+    }
+
+    return nullptr;
+}
+    #endif
+
+}  // namespace
+
+void set_huge_pages(HugePages pages) { hugePages = pages; }
+
 void* aligned_large_pages_alloc(size_t allocSize) {
 
+    #if defined(USE_HUGETLB)
+    if (hugePages != HugePages::Transparent)
+        if (void* mem = hugetlb_alloc(allocSize))
+            return mem;
+    #endif
+
     #if defined(__linux__)
     constexpr size_t alignment = 2 * 1024 * 1024;  // 2MB page size assumed
     #else
@@ -175,6 +236,88 @@ bool has_large_pages() {
 }
 
 
+// is_large_page_backed() and huge_page_bytes() look up the mapping in
+// /proc/self/smaps. Transparent huge pages show up as AnonHugePages or
+// ShmemPmdMapped, and hugetlbfs mappings have a kernel page size above the base
+// page size, with their touched pages as Private_Hugetlb or Shared_Hugetlb.
+
+namespace {
+
+struct SmapsEntry {
+    unsigned long long hugeKb = 0, kernelPageKb = 0;
+};
+
+[[maybe_unused]] SmapsEntry read_smaps(const void* mem) {
+
+    SmapsEntry entry;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string   line;
+    bool          inMapping = false;
+    const auto    addr      = reinterpret_cast<std::uintptr_t>(mem);
+
+    while (std::getline(smaps, line))
+    {
+        unsigned long long start, end;
+        char               dash;
+
+        // Mapping headers start with "start-end", field lines with a name
+        if (std::isxdigit(static_cast<unsigned char>(line[0]))
+            && std::sscanf(line.c_str(), "%llx%c%llx", &start, &dash, &end) == 3 && dash == '-')
+        {
+            if (inMapping)
+                break;
+
+            inMapping = start <= addr && addr < end;
+            continue;
+        }
+
+        if (!inMapping)
+            continue;
+
+        unsigned long long kb;
+        if (std::sscanf(line.c_str(), "AnonHugePages: %llu", &kb) == 1
+            || std::sscanf(line.c_str(), "ShmemPmdMapped: %llu", &kb) == 1
+            || std::sscanf(line.c_str(), "Private_Hugetlb: %llu", &kb) == 1
+            || std::sscanf(line.c_str(), "Shared_Hugetlb: %llu", &kb) == 1)
+            entry.hugeKb += kb;
+
+        else if (std::sscanf(line.c_str(), "KernelPageSize: %llu", &kb) == 1)
+            entry.kernelPageKb = kb;
+    }
+
+    return entry;
+}
+
+}  // namespace
+
+bool is_large_page_backed([[maybe_unused]] const void* mem) {
+
+#if defined(__linux__)
+
+    const SmapsEntry entry = read_smaps(mem);
+    return entry.hugeKb > 0 || entry.kernelPageKb > 4;
+
+#else
+
+    return false;
+
+#endif
+}
+
+size_t huge_page_bytes([[maybe_unused]] const void* mem, [[maybe_unused]] size_t size) {
+
+#if defined(__linux__)
+
+    return mem ? std::min(size_t(read_smaps(mem).hugeKb) * 1024, size) : 0;
+
+#else
+
+    return 0;
+
+#endif
+}
+
+
 // aligned_large_pages_free() will free the previously memory allocated
 // by aligned_large_pages_alloc(). The effect is a nop if mem == nullptr.
 
@@ -193,7 +336,85 @@ void aligned_large_pages_free(void* mem) {
 
 #else
 
-void aligned_large_pages_free(void* mem) { std_aligned_free(mem); }
+void aligned_large_pages_free(void* mem) {
+
+    #if defined(USE_HUGETLB)
+    if (mem)
+    {
+        std::lock_guard<std::mutex> lock(hugetlbMutex);
+        if (auto it = hugetlbMappings.find(mem); it != hugetlbMappings.end())
+        {
+            munmap(mem, it->second);
+            hugetlbMappings.erase(it);
+            return;
+        }
+    }
+    #endif
+
+    std_aligned_free(mem);
+}
 
 #endif
+
+
+// MappedFile() maps the file privately, so that it costs no memory beyond the
+// page cache, and asks for its pages to be read ahead since the caller is
+// expected to go through all of them once.
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& filename) {
+
+    std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+    if (!stream)
+        return;
+
+    size_  = size_t(stream.tellg());
+    buffer = std::make_unique<char[]>(std::max(size_, size_t(1)));
+    stream.seekg(0);
+
+    if (stream.read(buffer.get(), std::streamsize(size_)))
+        data_ = buffer.get();
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        int flags = MAP_PRIVATE;
+    #if defined(MAP_POPULATE)
+        flags |= MAP_POPULATE;
+    #endif
+        void* mem = mmap(nullptr, size_t(st.st_size), PROT_READ, flags, fd, 0);
+
+        if (mem != MAP_FAILED)
+        {
+    #if defined(MADV_HUGEPAGE)
+            madvise(mem, size_t(st.st_size), MADV_HUGEPAGE);
+    #endif
+            madvise(mem, size_t(st.st_size), MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mem);
+            size_ = size_t(st.st_size);
+        }
+    }
+
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
 }  // namespace Stockfish
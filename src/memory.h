@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <memory>
 #include <new>
+#include <string>
 #include <type_traits>
 #include <utility>
 
@@ -63,6 +64,26 @@ void  aligned_large_pages_free(void* mem);
 
 bool has_large_pages();
 
+// The pages of the next aligned_large_pages_alloc() calls on Linux. By default
+// the memory is only advised for transparent huge pages. Otherwise it is mapped
+// from the reserved hugetlbfs pages of the largest size, up to the given one,
+// that the allocation fills at least once, falling back to the default when
+// none are left.
+enum class HugePages {
+    Transparent,
+    Pages2MB,
+    Pages1GB
+};
+void set_huge_pages(HugePages pages);
+
+// Whether the mapping that contains mem currently uses large pages, as far as
+// the OS lets us know. Always false where it cannot be queried.
+bool is_large_page_backed(const void* mem);
+
+// The bytes of the mapping that contains mem that are on huge pages, transparent
+// or not, up to size. Always 0 where it cannot be queried.
+size_t huge_page_bytes(const void* mem, size_t size);
+
 // Frees memory which was placed there with placement new.
 // Works for both single objects and arrays of unknown bound.
 template<typename T, typename FREE_FUNC>
@@ -179,6 +200,32 @@ std::enable_if_t<std::is_array_v<T>, LargePagePtr<T>> make_unique_large_page(siz
     return LargePagePtr<T>(memory);
 }
 
+//
+//
+// read-only file mapping
+//
+//
+
+// The whole content of a file, mapped read-only where the OS allows it and
+// read into an allocation otherwise. The data is valid until destruction.
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool        is_open() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t      size() const { return size_; }
+
+   private:
+    const char*             data_ = nullptr;
+    size_t                  size_ = 0;
+    std::unique_ptr<char[]> buffer;  // Only used without mmap()
+};
+
 //
 //
 // aligned unique ptr
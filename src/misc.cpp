@@ -18,10 +18,12 @@
 
 #include "misc.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
@@ -32,9 +34,22 @@
 #include <mutex>
 #include <sstream>
 #include <string_view>
+#include <thread>
 
+#include "nnue/nnue_kernels.h"
 #include "types.h"
 
+#if defined(USE_SSE2)
+    #include <emmintrin.h>
+#endif
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
 namespace Stockfish {
 
 namespace {
@@ -265,11 +280,19 @@ std::string compiler_info() {
 #elif defined(USE_NEON)
     compiler += " NEON";
 #endif
+#if defined(USE_SVE)
+    compiler += " SVE2_" + std::to_string(__ARM_FEATURE_SVE_BITS);
+#endif
 
 #if !defined(NDEBUG)
     compiler += " DEBUG";
 #endif
 
+#if defined(USE_NNUE_DISPATCH)
+    compiler += "\nNNUE kernels picked        : ";
+    compiler += Eval::NNUE::kernels->arch;
+#endif
+
     compiler += "\nCompiler __VERSION__ macro : ";
 #ifdef __VERSION__
     compiler += __VERSION__;
@@ -410,6 +433,138 @@ void dbg_clear() {
     extremes.fill({});
 }
 
+PerfCounters::Counts& PerfCounters::Counts::operator+=(const Counts& c) {
+    for (int i = 0; i < EVENT_NB; ++i)
+    {
+        total[i] += c.total[i];
+        eval[i] += c.eval[i];
+        supported[i] |= c.supported[i];
+    }
+    error = error ? error : c.error;
+    return *this;
+}
+
+#if defined(__linux__)
+
+bool PerfCounters::open() {
+    close();
+    result = {};
+    evals  = 0;
+
+    // The generic events, and the read misses of the cache events
+    constexpr auto CacheReadMiss = [](uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    const std::pair<uint32_t, uint64_t> events[EVENT_NB] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE, CacheReadMiss(PERF_COUNT_HW_CACHE_L1D)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HW_CACHE, CacheReadMiss(PERF_COUNT_HW_CACHE_DTLB)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+    opened = 0;
+    for (int i = 0; i < EVENT_NB; ++i)
+    {
+        perf_event_attr attr{};
+        attr.size           = sizeof(attr);
+        attr.type           = events[i].first;
+        attr.config         = events[i].second;
+        attr.disabled       = leader < 0;  // The group is enabled at once below
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format =
+          PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // This thread, on any cpu
+        fds[i]  = int(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        slot[i] = fds[i] >= 0 ? opened++ : -1;
+
+        if (fds[i] < 0 && i == Cycles)
+        {
+            result.error = errno;
+            return false;
+        }
+        if (i == Cycles)
+            leader = fds[i];
+    }
+
+    for (int i = 0; i < EVENT_NB; ++i)
+        result.supported[i] = slot[i] >= 0;
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void PerfCounters::close() {
+    if (leader < 0)
+        return;
+
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // When the group shared the hardware with other events, it was counted only a
+    // part of the time, so scale the counts to the whole time. A group that needs
+    // more counters than the cpu has is never counted.
+    uint64_t enabled, running;
+    if (!read(result.total, &enabled, &running) || !running)
+    {
+        result       = {};
+        result.error = EBUSY;
+    }
+    else
+        for (int i = 0; i < EVENT_NB; ++i)
+        {
+            // Only one evaluation in EvalSampleInterval was read
+            result.eval[i] = std::min(result.eval[i] * EvalSampleInterval, result.total[i]);
+
+            if (running < enabled)
+            {
+                result.total[i] = uint64_t(double(result.total[i]) * enabled / running);
+                result.eval[i]  = uint64_t(double(result.eval[i]) * enabled / running);
+            }
+        }
+
+    for (int i = 0; i < EVENT_NB; ++i)
+        if (fds[i] >= 0)
+            ::close(fds[i]);
+    leader = -1;
+}
+
+bool PerfCounters::read(uint64_t* values, uint64_t* enabled, uint64_t* running) {
+    // The number of events, the times enabled and running, then the values
+    uint64_t buf[3 + EVENT_NB];
+
+    if (::read(leader, buf, sizeof(buf)) < ssize_t(sizeof(uint64_t) * (3 + opened)))
+        return false;
+
+    for (int i = 0; i < EVENT_NB; ++i)
+        values[i] = slot[i] >= 0 ? buf[3 + slot[i]] : 0;
+    if (enabled)
+        *enabled = buf[1], *running = buf[2];
+    return true;
+}
+
+void PerfCounters::add_eval() {
+    if (read(evalEnd))
+        for (int i = 0; i < EVENT_NB; ++i)
+            result.eval[i] += evalEnd[i] - evalStart[i];
+}
+
+#else
+
+bool PerfCounters::open() {
+    result       = {};
+    result.error = ENOSYS;
+    return false;
+}
+
+void PerfCounters::close() {}
+bool PerfCounters::read(uint64_t*, uint64_t*, uint64_t*) { return false; }
+void PerfCounters::add_eval() {}
+
+#endif
+
 // Used to serialize access to std::cout
 // to avoid multiple threads writing at the same time.
 std::ostream& operator<<(std::ostream& os, SyncCout sc) {
@@ -449,6 +604,33 @@ void prefetch(const void* addr) {
 
 #endif
 
+void fill_non_temporal(void* dst, std::size_t size, const char* pattern) {
+    char*       p = static_cast<char*>(dst);
+    std::size_t i = 0;
+
+#if defined(USE_SSE2)
+    // Write up to the first aligned address normally, then the rest of the
+    // aligned blocks with streaming stores of the pattern at their offset.
+    const std::size_t head =
+      std::min(size, (16 - reinterpret_cast<std::uintptr_t>(p) % 16) % 16);
+    for (; i < head; ++i)
+        p[i] = pattern[i % 16];
+
+    alignas(16) char block[16];
+    for (std::size_t j = 0; j < 16; ++j)
+        block[j] = pattern[(head + j) % 16];
+
+    const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    for (; i + 16 <= size; i += 16)
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i), v);
+
+    _mm_sfence();
+#endif
+
+    for (; i < size; ++i)
+        p[i] = pattern[i % 16];
+}
+
 #ifdef _WIN32
     #include <direct.h>
     #define GETCWD _getcwd
@@ -457,6 +639,38 @@ void prefetch(const void* addr) {
     #define GETCWD getcwd
 #endif
 
+std::size_t get_raw_data_hash_parallel(const char* data, std::size_t size) {
+
+    constexpr std::size_t ChunkSize  = 1 << 20;
+    constexpr std::size_t MaxThreads = 8;  // Hashing is bound by memory bandwidth
+
+    const std::size_t chunks   = (size + ChunkSize - 1) / ChunkSize;
+    const std::size_t nthreads = std::min({chunks, MaxThreads,
+                                           std::size_t(std::thread::hardware_concurrency())});
+
+    std::vector<std::size_t> chunkHashes(chunks);
+
+    auto hash_chunks = [&](std::size_t first) {
+        for (std::size_t i = first; i < chunks; i += std::max(nthreads, std::size_t(1)))
+            chunkHashes[i] = std::hash<std::string_view>{}(
+              std::string_view(data + i * ChunkSize, std::min(ChunkSize, size - i * ChunkSize)));
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < nthreads; ++t)
+        threads.emplace_back(hash_chunks, t);
+
+    hash_chunks(0);
+
+    for (auto& th : threads)
+        th.join();
+
+    std::size_t h = size;
+    for (std::size_t chunkHash : chunkHashes)
+        hash_combine(h, chunkHash);
+    return h;
+}
+
 size_t str_to_size_t(const std::string& s) {
     unsigned long long value = std::stoull(s);
     if (value > std::numeric_limits<size_t>::max())
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
@@ -34,6 +35,7 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 #define stringify2(x) #x
@@ -49,6 +51,9 @@ std::string compiler_info();
 // function that doesn't stall the CPU waiting for data to be loaded from memory,
 // which can be quite slow.
 void prefetch(const void* addr);
+// Fills the memory with a 16 byte pattern, which starts at dst, with non-temporal
+// stores where available
+void fill_non_temporal(void* dst, std::size_t size, const char* pattern);
 
 void start_logger(const std::string& fname);
 
@@ -79,6 +84,81 @@ void dbg_correl_of(int64_t value1, int64_t value2, int slot = 0);
 void dbg_print();
 void dbg_clear();
 
+// Hardware performance counters of the calling thread, read with perf_event on
+// Linux. The counters run from open() to close(), and the part spent in the NNUE
+// evaluation is taken from a read at the start and at the end of one evaluation
+// in EvalSampleInterval, scaled up at close(), see EvalScope. A read is a system
+// call, which would otherwise cost more than the evaluation it measures.
+// Without the permission (see /proc/sys/kernel/perf_event_paranoid)
+// or the hardware support, open() fails and nothing is counted. An event that is
+// not supported alone is left out.
+class PerfCounters {
+   public:
+    enum Event {
+        Cycles,
+        Instructions,
+        L1DMisses,
+        LLCMisses,
+        DTLBMisses,
+        BranchMisses,
+        EVENT_NB
+    };
+    static constexpr const char* Names[EVENT_NB] = {"cycles",     "instructions", "L1D misses",
+                                                    "LLC misses", "dTLB misses",  "branch misses"};
+
+    struct Counts {
+        uint64_t total[EVENT_NB] = {};
+        uint64_t eval[EVENT_NB]  = {};
+        bool     supported[EVENT_NB] = {};
+        // errno of the failed open, 0 if the counters were read
+        int error = 0;
+
+        Counts& operator+=(const Counts& c);
+    };
+
+    static constexpr unsigned EvalSampleInterval = 64;
+
+    struct EvalScope {
+        explicit EvalScope(PerfCounters& p) :
+            pc(p),
+            sampled(pc.leader >= 0 && ++pc.evals % EvalSampleInterval == 0) {
+            if (sampled)
+                pc.read(pc.evalStart);
+        }
+        ~EvalScope() {
+            if (sampled)
+                pc.add_eval();
+        }
+        PerfCounters& pc;
+        const bool    sampled;
+    };
+
+    PerfCounters() = default;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() { close(); }
+
+    // Starts counting from zero, returns false if the counters are not available
+    bool open();
+    // Stops counting and stores the counts of the thread, see counts()
+    void close();
+
+    bool           is_open() const { return leader >= 0; }
+    const Counts&  counts() const { return result; }
+
+   private:
+    bool read(uint64_t* values, uint64_t* enabled = nullptr, uint64_t* running = nullptr);
+    void add_eval();
+
+    int      leader = -1;
+    int      fds[EVENT_NB];
+    int      slot[EVENT_NB];  // Position of the event in a group read, -1 if not counted
+    int      opened = 0;
+    unsigned evals  = 0;
+    uint64_t evalStart[EVENT_NB], evalEnd[EVENT_NB];
+    Counts   result;
+};
+
 using TimePoint = std::chrono::milliseconds::rep;  // A value in milliseconds
 static_assert(sizeof(TimePoint) == sizeof(int64_t), "TimePoint should be 64 bits");
 inline TimePoint now() {
@@ -147,6 +227,43 @@ class ValueList {
     std::size_t size_ = 0;
 };
 
+// Lock-free ring buffer for a single producer and a single consumer. The producer
+// never waits: when the ring is full the value is dropped and counted instead.
+template<typename T, std::size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+   public:
+    bool try_push(T&& value) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[t & (Capacity - 1)] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = std::move(slots[h & (Capacity - 1)]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+
+   private:
+    std::array<T, Capacity>              slots;
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::atomic<std::size_t>             dropped{0};
+};
+
 
 template<typename T, std::size_t Size, std::size_t... Sizes>
 class MultiArray;
@@ -235,6 +352,25 @@ class MultiArray {
         }
     }
 
+    // Like fill(), but bypasses the caches where possible, so that clearing a large
+    // table doesn't evict everything else from them
+    template<typename U>
+    void fill_non_temporal(const U& v) {
+        static_assert(Detail::is_strictly_assignable_v<T, U>,
+                      "Cannot assign fill value to entry type");
+        static_assert(std::is_trivially_copyable_v<T> && 16 % sizeof(T) == 0);
+        static_assert(sizeof(*this) == sizeof(T) * (Size * ... * Sizes));
+
+        T entry;
+        entry = v;
+
+        char pattern[16];
+        for (std::size_t i = 0; i < 16; i += sizeof(T))
+            std::memcpy(pattern + i, &entry, sizeof(T));
+
+        Stockfish::fill_non_temporal(this, sizeof(*this), pattern);
+    }
+
     constexpr void swap(MultiArray<T, Size, Sizes...>& other) noexcept { data_.swap(other.data_); }
 };
 
@@ -315,6 +451,15 @@ inline std::size_t get_raw_data_hash(const T& value) {
       std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
 }
 
+// Hash of a large block of memory, computed chunk by chunk on several threads.
+// The chunks have a fixed size, so the result only depends on the content.
+std::size_t get_raw_data_hash_parallel(const char* data, std::size_t size);
+
+template<typename T>
+inline std::size_t get_raw_data_hash_parallel(const T& value) {
+    return get_raw_data_hash_parallel(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
 template<std::size_t Capacity>
 class FixedString {
    public:
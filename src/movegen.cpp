@@ -260,6 +260,168 @@ Move* generate_all(const Position& pos, Move* moveList) {
     return moveList;
 }
 
+
+// Receives the moves of the legal generator, or only counts them
+template<bool CountOnly>
+struct LegalMoves {
+    Move*  moveList;
+    size_t count = 0;
+
+    template<Direction D>
+    void pawn_moves(Bitboard to) {
+        if constexpr (CountOnly)
+            count += popcount(to);
+        else
+            moveList = splat_pawn_moves<D>(moveList, to);
+    }
+
+    template<Direction D>
+    void promotions(Bitboard to) {
+        if constexpr (CountOnly)
+            count += 4 * popcount(to);
+        else
+            while (to)
+                moveList = make_promotions<NON_EVASIONS, D, true>(moveList, pop_lsb(to));
+    }
+
+    void moves(Square from, Bitboard to) {
+        if constexpr (CountOnly)
+            count += popcount(to);
+        else
+            moveList = splat_moves(moveList, from, to);
+    }
+
+    void add(Move m) {
+        if constexpr (CountOnly)
+            count++;
+        else
+            *moveList++ = m;
+    }
+};
+
+
+template<Color Us, PieceType Pt, bool CountOnly>
+void generate_legal_moves(const Position&        pos,
+                          LegalMoves<CountOnly>& list,
+                          Bitboard               target,
+                          Bitboard               pinned) {
+
+    const Square ksq = pos.square<KING>(Us);
+
+    for (Bitboard bb = pos.pieces(Us, Pt); bb;)
+    {
+        Square   from = pop_lsb(bb);
+        Bitboard b    = attacks_bb<Pt>(from, pos.pieces()) & target;
+
+        list.moves(from, pinned & from ? b & line_bb(ksq, from) : b);
+    }
+}
+
+
+// Generates the legal moves in the order of generate_all<EVASIONS> when in check
+// and of generate_all<NON_EVASIONS> otherwise, without the illegal ones. Pinned
+// pieces are restricted to the line of their pin and king moves to the squares
+// that are not attacked, so only castling and en passant captures, which are
+// rare, need a call to Position::legal().
+template<Color Us, bool CountOnly>
+void generate_legal(const Position& pos, LegalMoves<CountOnly>& list) {
+
+    constexpr Color     Them     = ~Us;
+    constexpr Bitboard  TRank7BB = (Us == WHITE ? Rank7BB : Rank2BB);
+    constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB : Rank6BB);
+    constexpr Direction Up       = pawn_push(Us);
+    constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+    constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
+
+    const Square   ksq      = pos.square<KING>(Us);
+    const Bitboard checkers = pos.checkers();
+    const Bitboard pinned   = pos.blockers_for_king(Us) & pos.pieces(Us);
+
+    // Skip generating non-king moves when in double check
+    if (!more_than_one(checkers))
+    {
+        const Bitboard target = checkers ? between_bb(ksq, lsb(checkers)) : ~pos.pieces(Us);
+        const Bitboard emptySquares = ~pos.pieces();
+        const Bitboard enemies      = pos.pieces(Them) & target;
+        const Bitboard pawns        = pos.pieces(Us, PAWN);
+
+        // The pawns that can move in each direction, a pinned one only along its pin
+        Bitboard pushers = pawns & ~pinned, rightCapturers = pushers, leftCapturers = pushers;
+
+        for (Bitboard b = pawns & pinned; b;)
+        {
+            Square   s   = pop_lsb(b);
+            Bitboard pin = line_bb(ksq, s);
+
+            if (shift<Up>(square_bb(s)) & pin)
+                pushers |= s;
+            if (shift<UpRight>(square_bb(s)) & pin)
+                rightCapturers |= s;
+            if (shift<UpLeft>(square_bb(s)) & pin)
+                leftCapturers |= s;
+        }
+
+        // Single and double pawn pushes, no promotions
+        Bitboard b1 = shift<Up>(pushers & ~TRank7BB) & emptySquares;
+        Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
+
+        list.template pawn_moves<Up>(b1 & target);
+        list.template pawn_moves<Up + Up>(b2 & target);
+
+        // Promotions and underpromotions
+        if (pawns & TRank7BB)
+        {
+            list.template promotions<UpRight>(shift<UpRight>(rightCapturers & TRank7BB) & enemies);
+            list.template promotions<UpLeft>(shift<UpLeft>(leftCapturers & TRank7BB) & enemies);
+            list.template promotions<Up>(shift<Up>(pushers & TRank7BB) & emptySquares & target);
+        }
+
+        // Standard and en passant captures
+        list.template pawn_moves<UpRight>(shift<UpRight>(rightCapturers & ~TRank7BB) & enemies);
+        list.template pawn_moves<UpLeft>(shift<UpLeft>(leftCapturers & ~TRank7BB) & enemies);
+
+        // An en passant capture cannot resolve a discovered check
+        if (pos.ep_square() != SQ_NONE && !(checkers && (target & (pos.ep_square() + Up))))
+            for (Bitboard b = pawns & ~TRank7BB & attacks_bb<PAWN>(pos.ep_square(), Them); b;)
+            {
+                Move m = Move::make<EN_PASSANT>(pop_lsb(b), pos.ep_square());
+                if (pos.legal(m))
+                    list.add(m);
+            }
+
+        // A pinned knight cannot move, other pinned pieces stay on the line of the pin
+        for (Bitboard bb = pos.pieces(Us, KNIGHT) & ~pinned; bb;)
+        {
+            Square from = pop_lsb(bb);
+            list.moves(from, attacks_bb<KNIGHT>(from) & target);
+        }
+
+        generate_legal_moves<Us, BISHOP>(pos, list, target, pinned);
+        generate_legal_moves<Us, ROOK>(pos, list, target, pinned);
+        generate_legal_moves<Us, QUEEN>(pos, list, target, pinned);
+    }
+
+    Bitboard kingMoves = attacks_bb<KING>(ksq) & ~pos.pieces(Us);
+
+    for (Bitboard b = kingMoves; b;)
+    {
+        Square to = pop_lsb(b);
+        if (pos.attackers_to_exist(to, pos.pieces() ^ ksq, Them))
+            kingMoves ^= to;
+    }
+
+    list.moves(ksq, kingMoves);
+
+    if (!checkers && pos.can_castle(Us & ANY_CASTLING))
+        for (CastlingRights cr : {Us & KING_SIDE, Us & QUEEN_SIDE})
+            if (!pos.castling_impeded(cr) && pos.can_castle(cr))
+            {
+                Move m = Move::make<CASTLING>(ksq, pos.castling_rook_square(cr));
+                if (pos.legal(m))
+                    list.add(m);
+            }
+}
+
 }  // namespace
 
 
@@ -288,25 +450,30 @@ template Move* generate<EVASIONS>(const Position&, Move*);
 template Move* generate<NON_EVASIONS>(const Position&, Move*);
 
 // generate<LEGAL> generates all the legal moves in the given position
-
 template<>
 Move* generate<LEGAL>(const Position& pos, Move* moveList) {
 
-    Color    us     = pos.side_to_move();
-    Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-    Square   ksq    = pos.square<KING>(us);
-    Move*    cur    = moveList;
+    LegalMoves<false> list{moveList};
 
-    moveList =
-      pos.checkers() ? generate<EVASIONS>(pos, moveList) : generate<NON_EVASIONS>(pos, moveList);
-    while (cur != moveList)
-        if (((pinned & cur->from_sq()) || cur->from_sq() == ksq || cur->type_of() == EN_PASSANT)
-            && !pos.legal(*cur))
-            *cur = *(--moveList);
-        else
-            ++cur;
+    if (pos.side_to_move() == WHITE)
+        generate_legal<WHITE>(pos, list);
+    else
+        generate_legal<BLACK>(pos, list);
 
-    return moveList;
+    return list.moveList;
+}
+
+// Counts the legal moves with generate<LEGAL>, but without writing them
+size_t legal_move_count(const Position& pos) {
+
+    LegalMoves<true> list{nullptr};
+
+    if (pos.side_to_move() == WHITE)
+        generate_legal<WHITE>(pos, list);
+    else
+        generate_legal<BLACK>(pos, list);
+
+    return list.count;
 }
 
 }  // namespace Stockfish
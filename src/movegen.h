@@ -21,6 +21,7 @@
 
 #include <algorithm>  // IWYU pragma: keep
 #include <cstddef>
+#include <cstdint>
 
 #include "types.h"
 
@@ -37,7 +38,8 @@ enum GenType {
 };
 
 struct ExtMove: public Move {
-    int value;
+    std::int16_t see;  // Static exchange of a capture, cached by MovePicker in the padding
+    int          value;
 
     void operator=(Move m) { data = m.raw(); }
 
@@ -51,6 +53,8 @@ inline bool operator<(const ExtMove& f, const ExtMove& s) { return f.value < s.v
 template<GenType>
 Move* generate(const Position& pos, Move* moveList);
 
+size_t legal_move_count(const Position& pos);
+
 // The MoveList struct wraps the generate() function and returns a convenient
 // list of moves. Using MoveList is sometimes preferable to directly calling
 // the lower level generate() function.
@@ -18,6 +18,7 @@
 
 #include "movepick.h"
 
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <utility>
@@ -25,6 +26,11 @@
 #include "bitboard.h"
 #include "misc.h"
 #include "position.h"
+#include "tt.h"
+
+#if defined(USE_AVX2)
+    #include <immintrin.h>
+#endif
 
 namespace Stockfish {
 
@@ -56,21 +62,68 @@ enum Stages {
     QCAPTURE
 };
 
+// The static exchange of a capture that has not been computed yet
+constexpr std::int16_t SeeUnknown = std::numeric_limits<std::int16_t>::min();
+
+
+// Inserts the move at p into the sorted moves up to sortedEnd, keeping the
+// move after them at p.
+inline void insert_sorted(ExtMove* begin, ExtMove*& sortedEnd, ExtMove* p) {
+
+    ExtMove tmp = *p, *q;
+    *p          = *++sortedEnd;
+    for (q = sortedEnd; q != begin && *(q - 1) < tmp; --q)
+        *q = *(q - 1);
+    *q = tmp;
+}
 
 // Sort moves in descending order up to and including a given limit.
 // The order of moves smaller than the limit is left unspecified.
 void partial_insertion_sort(ExtMove* begin, ExtMove* end, int limit) {
 
-    for (ExtMove *sortedEnd = begin, *p = begin + 1; p < end; ++p)
+    ExtMove *sortedEnd = begin, *p = begin + 1;
+
+#if defined(USE_AVX2)
+    // Moves below the limit are left in place, as long as they are not moved
+    // by an insertion, so only the moves at or above it are visited, found 8 at
+    // a time. The moves after p are not touched yet, so the masks stay valid.
+    static_assert(sizeof(ExtMove) == 8 && sizeof(Move) == 2 && alignof(ExtMove) == 4);
+
+    const __m256i limits  = _mm256_set1_epi32(limit);
+    const __m256i toOrder = _mm256_setr_epi32(1, 3, 5, 7, 0, 2, 4, 6);
+
+    for (; p + 8 <= end; p += 8)
+    {
+        __m256i lo = _mm256_permutevar8x32_epi32(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), toOrder);
+        __m256i hi = _mm256_permutevar8x32_epi32(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 4)), toOrder);
+        __m256i below = _mm256_cmpgt_epi32(limits, _mm256_permute2x128_si256(lo, hi, 0x20));
+
+        for (uint32_t mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(below)) & 0xFF; mask;
+             mask &= mask - 1)
+            insert_sorted(begin, sortedEnd, p + lsb(mask));
+    }
+#endif
+
+    for (; p < end; ++p)
         if (p->value >= limit)
-        {
-            ExtMove tmp = *p, *q;
-            *p          = *++sortedEnd;
-            for (q = sortedEnd; q != begin && *(q - 1) < tmp; --q)
-                *q = *(q - 1);
-            *q = tmp;
-        }
+            insert_sorted(begin, sortedEnd, p);
+}
+
+#if defined(USE_AVX2)
+// Gathers the int16 entries at the given indices of a history table, for 8
+// moves at a time. A gather loads 4 bytes, which stays within the table, as
+// no quiet move indexes its last entry: from == to for a butterfly table, no
+// piece for a [piece][to] one.
+template<int D>
+__m256i gather_history(const StatsEntry<std::int16_t, D>* table, __m256i index) {
+    static_assert(sizeof(*table) == 2);
+
+    __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 2);
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
 }
+#endif
 
 }  // namespace
 
@@ -104,6 +157,10 @@ MovePicker::MovePicker(const Position&              p,
 
     else
         stage = (depth > 0 ? MAIN_TT : QSEARCH_TT) + !(ttm && pos.pseudo_legal(ttm));
+
+#ifdef USE_STATS
+    firstStage = stage;
+#endif
 }
 
 // MovePicker constructor for ProbCut: we generate captures with Static Exchange
@@ -116,7 +173,39 @@ MovePicker::MovePicker(const Position& p, Move ttm, int th, const CapturePieceTo
     assert(!pos.checkers());
 
     stage = PROBCUT_TT + !(ttm && pos.capture_stage(ttm) && pos.pseudo_legal(ttm));
+
+#ifdef USE_STATS
+    firstStage = stage;
+#endif
+}
+
+#ifdef USE_STATS
+// Counts the stages reached, from the first one to the current one. An init stage
+// is only current when the picker is left after its TT move, before the init.
+MovePicker::~MovePicker() {
+    if (!stats)
+        return;
+
+    const int last = stage
+                   - (stage == CAPTURE_INIT || stage == EVASION_INIT || stage == PROBCUT_INIT
+                      || stage == QCAPTURE_INIT);
+
+    for (int s = firstStage; s <= last; ++s)
+        stats->stagesReached[s]++;
+}
+
+const char* MovePickerStats::stage_name(int s) {
+    static_assert(QCAPTURE + 1 == PickerStageNB);
+
+    constexpr const char* Names[PickerStageNB] = {
+      "main tt",       "capture init",  "good capture",  "quiet init",
+      "good quiet",    "bad capture",   "bad quiet",     "evasion tt",
+      "evasion init",  "evasion",       "probcut tt",    "probcut init",
+      "probcut",       "qsearch tt",    "qcapture init", "qcapture"};
+
+    return Names[s];
 }
+#endif
 
 // Assigns a numerical value to each move in a list, used for sorting.
 // Captures are ordered by Most Valuable Victim (MVV), preferring captures
@@ -124,7 +213,8 @@ MovePicker::MovePicker(const Position& p, Move ttm, int th, const CapturePieceTo
 template<GenType Type>
 ExtMove* MovePicker::score(MoveList<Type>& ml) {
 
-    static_assert(Type == CAPTURES || Type == QUIETS || Type == EVASIONS, "Wrong type");
+    // LEGAL is only generated in check, as the legal evasions
+    static_assert(Type == CAPTURES || Type == QUIETS || Type == LEGAL, "Wrong type");
 
     Color us = pos.side_to_move();
 
@@ -139,6 +229,19 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
         threatByLesser[KING]  = pos.attacks_by<QUEEN>(~us) | threatByLesser[QUEEN];
     }
 
+#ifdef USE_STATS
+    // Touched lines of a [piece][to] table, two per piece, and of the
+    // interleaved table, with the 5 entries of a [piece][to] on 10 bytes.
+    [[maybe_unused]] uint32_t packedLines         = 0;
+    [[maybe_unused]] uint64_t interleavedLines[3] = {};
+#endif
+
+#if defined(USE_AVX2)
+    // Indices of the quiet moves in the history tables, for the gathers
+    [[maybe_unused]] alignas(32) int fromTo[MAX_MOVES];
+    [[maybe_unused]] alignas(32) int pieceTo[MAX_MOVES];
+#endif
+
     ExtMove* it = cur;
     for (auto move : ml)
     {
@@ -152,12 +255,20 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
         const Piece     capturedPiece = pos.piece_on(to);
 
         if constexpr (Type == CAPTURES)
+        {
             m.value = (*captureHistory)[pc][to][type_of(capturedPiece)]
                     + 7 * int(PieceValue[capturedPiece]) + 1024 * bool(pos.check_squares(pt) & to);
+            m.see = SeeUnknown;
+        }
 
         else if constexpr (Type == QUIETS)
         {
-            // histories
+            // histories, added after the loop when they are gathered
+#if defined(USE_AVX2)
+            fromTo[it - 1 - cur]  = m.from_to();
+            pieceTo[it - 1 - cur] = pc * SQUARE_NB + to;
+            m.value               = 0;
+#else
             m.value = 2 * (*mainHistory)[us][m.from_to()];
             m.value += 2 * (*pawnHistory)[pawn_history_index(pos)][pc][to];
             m.value += (*continuationHistory[0])[pc][to];
@@ -165,6 +276,14 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
             m.value += (*continuationHistory[2])[pc][to];
             m.value += (*continuationHistory[3])[pc][to];
             m.value += (*continuationHistory[5])[pc][to];
+#endif
+
+#ifdef USE_STATS
+            packedLines |= 1u << (2 * pc + to / 32);
+            const int offset = (pc * SQUARE_NB + to) * 10;
+            for (int line : {offset / 64, (offset + 9) / 64})
+                interleavedLines[line / 64] |= 1ULL << (line % 64);
+#endif
 
             // bonus for checks
             m.value += (bool(pos.check_squares(pt) & to) && pos.see_ge(m, -75)) * 16384;
@@ -180,7 +299,7 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
                 m.value += 8 * (*lowPlyHistory)[ply][m.from_to()] / (1 + ply);
         }
 
-        else  // Type == EVASIONS
+        else  // Type == LEGAL
         {
             if (pos.capture_stage(m))
                 m.value = PieceValue[capturedPiece] + (1 << 28);
@@ -192,6 +311,47 @@ ExtMove* MovePicker::score(MoveList<Type>& ml) {
             }
         }
     }
+
+#if defined(USE_AVX2)
+    if constexpr (Type == QUIETS)
+    {
+        const int n = int(it - cur);
+        for (int i = n; i % 8; ++i)
+            fromTo[i] = pieceTo[i] = 0;
+
+        const auto* main = &(*mainHistory)[us][0];
+        const auto* pawn = &(*pawnHistory)[pawn_history_index(pos)][0][0];
+
+        for (int i = 0; i < n; i += 8)
+        {
+            __m256i ft = _mm256_load_si256(reinterpret_cast<const __m256i*>(&fromTo[i]));
+            __m256i pt = _mm256_load_si256(reinterpret_cast<const __m256i*>(&pieceTo[i]));
+
+            __m256i sum = _mm256_add_epi32(gather_history(main, ft), gather_history(pawn, pt));
+            sum         = _mm256_slli_epi32(sum, 1);
+            for (int k : {0, 1, 2, 3, 5})
+                sum = _mm256_add_epi32(sum, gather_history(&(*continuationHistory[k])[0][0], pt));
+
+            alignas(32) int values[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(values), sum);
+            for (int j = 0; j < std::min(8, n - i); ++j)
+                cur[i + j].value += values[j];
+        }
+    }
+#endif
+
+#ifdef USE_STATS
+    if constexpr (Type == QUIETS)
+        if (stats)
+        {
+            ContHistLineCounters& lines = stats->contHistLines;
+            lines.moves += it - cur;
+            lines.packed += 5 * popcount(packedLines);
+            lines.interleaved += popcount(interleavedLines[0]) + popcount(interleavedLines[1])
+                               + popcount(interleavedLines[2]);
+        }
+#endif
+
     return it;
 }
 
@@ -202,11 +362,47 @@ Move MovePicker::select(Pred filter) {
 
     for (; cur < endCur; ++cur)
         if (*cur != ttMove && filter())
+        {
+            // Keep the TT clusters of the next moves in flight while this one is searched
+            if (tt && cur + prefetchDistance < endCur)
+                prefetch_children(cur + prefetchDistance, cur + prefetchDistance + 1);
+
             return *cur++;
+        }
 
     return Move::none();
 }
 
+// Prefetches the TT clusters of the positions after the given moves
+void MovePicker::prefetch_children(const ExtMove* first, const ExtMove* last) const {
+    for (; first < last; ++first)
+        prefetch(tt->first_entry(pos.key_after(*first)));
+}
+
+// Starts timing one in SampleInterval calls of a stage, when collecting stats
+std::chrono::steady_clock::time_point MovePicker::stage_start(MovePickerStats::Stage s) const {
+    return stats && stats->calls[s] % MovePickerStats::SampleInterval == 0
+           ? std::chrono::steady_clock::now()
+           : std::chrono::steady_clock::time_point{};
+}
+
+// Counts the call and the moves of a stage, whose moves are [cur, endCur)
+void MovePicker::stage_end(MovePickerStats::Stage s, std::chrono::steady_clock::time_point start) {
+    if (!stats)
+        return;
+
+    if (start != std::chrono::steady_clock::time_point{})
+    {
+        stats->sampledNs[s] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        stats->sampledCalls[s]++;
+    }
+
+    stats->calls[s]++;
+    stats->moves[s] += endCur - cur;
+}
+
 // This is the most important method of the MovePicker class. We emit one
 // new pseudo-legal move on every call until there are no more moves left,
 // picking the move with the highest score from a list of generated moves.
@@ -227,19 +423,27 @@ top:
     case CAPTURE_INIT :
     case PROBCUT_INIT :
     case QCAPTURE_INIT : {
+        const auto start = stage_start(MovePickerStats::Captures);
+
         MoveList<CAPTURES> ml(pos);
 
         cur = endBadCaptures = moves;
         endCur = endCaptures = score<CAPTURES>(ml);
 
         partial_insertion_sort(cur, endCur, std::numeric_limits<int>::min());
+
+        stage_end(MovePickerStats::Captures, start);
+
+        if (tt)
+            prefetch_children(cur + 1, std::min(cur + prefetchDistance, endCur));
+
         ++stage;
         goto top;
     }
 
     case GOOD_CAPTURE :
         if (select([&]() {
-                if (pos.see_ge(*cur, -cur->value / 18))
+                if (see_ge(*cur, -cur->value / 18))
                     return true;
                 std::swap(*endBadCaptures++, *cur);
                 return false;
@@ -252,11 +456,18 @@ top:
     case QUIET_INIT :
         if (!skipQuiets)
         {
+            const auto start = stage_start(MovePickerStats::Quiets);
+
             MoveList<QUIETS> ml(pos);
 
             endCur = endGenerated = score<QUIETS>(ml);
 
             partial_insertion_sort(cur, endCur, -3560 * depth);
+
+            stage_end(MovePickerStats::Quiets, start);
+
+            if (tt)
+                prefetch_children(cur + 1, std::min(cur + prefetchDistance, endCur));
         }
 
         ++stage;
@@ -291,12 +502,21 @@ top:
         return Move::none();
 
     case EVASION_INIT : {
-        MoveList<EVASIONS> ml(pos);
+        const auto start = stage_start(MovePickerStats::Evasions);
+
+        // Only the legal evasions, so that no illegal one is scored and sorted
+        MoveList<LEGAL> ml(pos);
 
         cur    = moves;
-        endCur = endGenerated = score<EVASIONS>(ml);
+        endCur = endGenerated = score<LEGAL>(ml);
 
         partial_insertion_sort(cur, endCur, std::numeric_limits<int>::min());
+
+        stage_end(MovePickerStats::Evasions, start);
+
+        if (tt)
+            prefetch_children(cur + 1, std::min(cur + prefetchDistance, endCur));
+
         ++stage;
         [[fallthrough]];
     }
@@ -306,7 +526,7 @@ top:
         return select([]() { return true; });
 
     case PROBCUT :
-        return select([&]() { return pos.see_ge(*cur, threshold); });
+        return select([&]() { return see_ge(*cur, threshold); });
     }
 
     assert(false);
@@ -315,4 +535,61 @@ top:
 
 void MovePicker::skip_quiet_moves() { skipQuiets = true; }
 
+bool MovePicker::see_ge(Move m, int limit) {
+
+    switch (stage)
+    {
+    case GOOD_CAPTURE :
+    case BAD_CAPTURE :
+    case PROBCUT :
+    case QCAPTURE :
+        if (cur > moves && *(cur - 1) == m)
+            return see_ge(*(cur - 1), limit);
+        [[fallthrough]];
+
+    default :
+        return pos.see_ge(m, limit);
+    }
+}
+
+// Decides the bounds of Position::see_ge() directly, otherwise computes the exact
+// static exchange of a capture once. The attackers of each target square are
+// looked up once for all the captures to it.
+bool MovePicker::see_ge(ExtMove& m, int limit) {
+
+    if (m.see == SeeUnknown)
+    {
+        if (m.type_of() != NORMAL)
+            return VALUE_ZERO >= limit;
+
+        int captured = PieceValue[pos.piece_on(m.to_sq())];
+
+        if (captured < limit)
+            return false;
+
+        if (captured - PieceValue[pos.piece_on(m.from_sq())] >= limit)
+            return true;
+
+        Square to = m.to_sq();
+
+        if (!(seeTargets & to))
+        {
+            seeTargets |= to;
+            seeAttackers[to] = pos.attackers_to(to);
+        }
+
+        m.see = pos.see(m, seeAttackers[to]);
+    }
+
+    return m.see >= limit;
+}
+
+// Once the moves of a stage are scored, the TT clusters of the positions after
+// the next `distance` moves are prefetched, so that their latency overlaps the
+// search of the current child. A distance of 0 disables it.
+void MovePicker::prefetch_tt(const TranspositionTable* table, int distance) {
+    tt               = distance > 0 ? table : nullptr;
+    prefetchDistance = distance;
+}
+
 }  // namespace Stockfish
@@ -19,6 +19,9 @@
 #ifndef MOVEPICK_H_INCLUDED
 #define MOVEPICK_H_INCLUDED
 
+#include <chrono>
+#include <cstdint>
+
 #include "history.h"
 #include "movegen.h"
 #include "types.h"
@@ -26,6 +29,54 @@
 namespace Stockfish {
 
 class Position;
+class TranspositionTable;
+
+// Statistics of the stages that generate, score and sort moves, collected for
+// bench in a 'stats=yes' build. Only one call in SampleInterval is timed, to keep
+// the reads of the clock out of the measurement.
+struct MovePickerStats {
+    enum Stage {
+        Captures,
+        Quiets,
+        Evasions,
+        STAGE_NB
+    };
+    static constexpr std::uint64_t SampleInterval = 64;
+
+    std::uint64_t        calls[STAGE_NB]        = {};
+    std::uint64_t        moves[STAGE_NB]        = {};
+    std::uint64_t        sampledCalls[STAGE_NB] = {};
+    std::uint64_t        sampledNs[STAGE_NB]    = {};
+    ContHistLineCounters contHistLines;
+
+#ifdef USE_STATS
+    // The pickers that reached each of their stages, see movepick.cpp
+    static constexpr int PickerStageNB = 16;
+    static const char*   stage_name(int s);
+    std::uint64_t        stagesReached[PickerStageNB] = {};
+#endif
+
+    MovePickerStats& operator+=(const MovePickerStats& s) {
+        for (int i = 0; i < STAGE_NB; ++i)
+        {
+            calls[i] += s.calls[i];
+            moves[i] += s.moves[i];
+            sampledCalls[i] += s.sampledCalls[i];
+            sampledNs[i] += s.sampledNs[i];
+        }
+        contHistLines += s.contHistLines;
+#ifdef USE_STATS
+        for (int i = 0; i < PickerStageNB; ++i)
+            stagesReached[i] += s.stagesReached[i];
+#endif
+        return *this;
+    }
+
+    // Estimated time spent in the stage, over all the calls
+    double nanoseconds(Stage s) const {
+        return sampledCalls[s] ? double(sampledNs[s]) * calls[s] / sampledCalls[s] : 0;
+    }
+};
 
 // The MovePicker class is used to pick one pseudo-legal move at a time from the
 // current position. The most important method is next_move(), which emits one
@@ -48,12 +99,29 @@ class MovePicker {
                const PawnHistory*,
                int);
     MovePicker(const Position&, Move, int, const CapturePieceToHistory*);
+#ifdef USE_STATS
+    ~MovePicker();
+#endif
     Move next_move();
     void skip_quiet_moves();
+    // Same as Position::see_ge() for the move last returned, reusing the static
+    // exchange computed for it and the attackers of its target square
+    bool see_ge(Move m, int limit);
+    void prefetch_tt(const TranspositionTable* tt, int distance);
+    // Counted in a 'stats=yes' build only, see MovePickerStats
+#ifdef USE_STATS
+    void collect_stats(MovePickerStats* s) { stats = s; }
+#else
+    void collect_stats(MovePickerStats*) {}
+#endif
 
    private:
     template<typename Pred>
     Move select(Pred);
+    bool see_ge(ExtMove& m, int limit);
+    void prefetch_children(const ExtMove* first, const ExtMove* last) const;
+    std::chrono::steady_clock::time_point stage_start(MovePickerStats::Stage s) const;
+    void stage_end(MovePickerStats::Stage s, std::chrono::steady_clock::time_point start);
     template<GenType T>
     ExtMove* score(MoveList<T>&);
     ExtMove* begin() { return cur; }
@@ -68,10 +136,22 @@ class MovePicker {
     Move                         ttMove;
     ExtMove *                    cur, *endCur, *endBadCaptures, *endCaptures, *endGenerated;
     int                          stage;
+#ifdef USE_STATS
+    int firstStage;
+#endif
     int                          threshold;
     Depth                        depth;
     int                          ply;
-    bool                         skipQuiets = false;
+    bool                         skipQuiets       = false;
+    const TranspositionTable*    tt               = nullptr;
+    int                          prefetchDistance = 0;
+#ifdef USE_STATS
+    MovePickerStats* stats = nullptr;
+#else
+    static constexpr MovePickerStats* stats = nullptr;
+#endif
+    Bitboard                     seeTargets       = 0;
+    Bitboard                     seeAttackers[SQUARE_NB];
     ExtMove                      moves[MAX_MOVES];
 };
 
@@ -157,13 +157,15 @@ FullThreats::make_index(Piece attacker, Square from, Square to, Piece attacked,
     return index;
 }
 
-// Get a list of indices for active features in ascending order
+// Get a list of indices for active features. This is make_index() for all the
+// targets of an attacker, with the lookups that only depend on the king square,
+// the attacker and its square hoisted out of the loop over the targets.
 template<Color Perspective>
 void FullThreats::append_active_indices(const Position& pos, IndexList& active) {
     static constexpr Color order[2][2] = {{WHITE, BLACK}, {BLACK, WHITE}};
 
-    Square   ksq      = pos.square<KING>(Perspective);
-    Bitboard occupied = pos.pieces();
+    const int      orient   = OrientTBL[Perspective][pos.square<KING>(Perspective)];
+    const Bitboard occupied = pos.pieces();
 
     for (Color color : {WHITE, BLACK})
     {
@@ -173,6 +175,28 @@ void FullThreats::append_active_indices(const Position& pos, IndexList& active)
             Piece    attacker = make_piece(c, pt);
             Bitboard bb       = pos.pieces(c, pt);
 
+            if (Perspective == BLACK)
+                attacker = ~attacker;
+
+            const PiecePairData* pairs = index_lut1[attacker];
+
+            // Appends the index of the threat of the attacker on 'from' against the
+            // piece on 'to', unless the pair is excluded. See make_index().
+            const auto append = [&](Square from, Square to, const uint8_t* targets) {
+                const int f        = int(from) ^ orient;
+                const int t        = int(to) ^ orient;
+                Piece     attacked = pos.piece_on(to);
+
+                if (Perspective == BLACK)
+                    attacked = ~attacked;
+
+                const PiecePairData pair = pairs[attacked];
+                if ((pair.excluded_pair_info() + (f < t)) & 2)
+                    return;
+
+                active.push_back(pair.feature_index_base() + offsets[attacker][f] + targets[t]);
+            };
+
             if (pt == PAWN)
             {
                 auto right = (c == WHITE) ? NORTH_EAST : SOUTH_WEST;
@@ -184,43 +208,28 @@ void FullThreats::append_active_indices(const Position& pos, IndexList& active)
 
                 while (attacks_left)
                 {
-                    Square    to       = pop_lsb(attacks_left);
-                    Square    from     = to - right;
-                    Piece     attacked = pos.piece_on(to);
-                    IndexType index    = make_index<Perspective>(attacker, from, to, attacked, ksq);
-
-                    if (index < Dimensions)
-                        active.push_back(index);
+                    Square to   = pop_lsb(attacks_left);
+                    Square from = to - right;
+                    append(from, to, index_lut2[attacker][int(from) ^ orient]);
                 }
 
                 while (attacks_right)
                 {
-                    Square    to       = pop_lsb(attacks_right);
-                    Square    from     = to - left;
-                    Piece     attacked = pos.piece_on(to);
-                    IndexType index    = make_index<Perspective>(attacker, from, to, attacked, ksq);
-
-                    if (index < Dimensions)
-                        active.push_back(index);
+                    Square to   = pop_lsb(attacks_right);
+                    Square from = to - left;
+                    append(from, to, index_lut2[attacker][int(from) ^ orient]);
                 }
             }
             else
             {
                 while (bb)
                 {
-                    Square   from    = pop_lsb(bb);
-                    Bitboard attacks = (attacks_bb(pt, from, occupied)) & occupied;
+                    Square         from    = pop_lsb(bb);
+                    Bitboard       attacks = attacks_bb(pt, from, occupied) & occupied;
+                    const uint8_t* targets = index_lut2[attacker][int(from) ^ orient];
 
                     while (attacks)
-                    {
-                        Square    to       = pop_lsb(attacks);
-                        Piece     attacked = pos.piece_on(to);
-                        IndexType index =
-                          make_index<Perspective>(attacker, from, to, attacked, ksq);
-
-                        if (index < Dimensions)
-                            active.push_back(index);
-                    }
+                        append(from, pop_lsb(attacks), targets);
                 }
             }
         }
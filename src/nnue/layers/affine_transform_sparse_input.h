@@ -29,6 +29,7 @@
 #include "../../bitboard.h"
 #include "../simd.h"
 #include "../nnue_common.h"
+#include "../nnue_kernels.h"
 
 /*
   This file contains the definition for a fully connected layer (aka affine transform) with block sparse input.
@@ -133,6 +134,56 @@ void find_nnz(const std::int32_t* RESTRICT input,
     }
     count_out = count;
 
+    #elif defined(USE_SVE)
+
+    // svcompact works on 32-bit lanes, the truncating store then writes the
+    // indices as 16-bit values. Full vectors are stored, as on AVX-512.
+    constexpr IndexType SimdWidth = __ARM_FEATURE_SVE_BITS / 32;
+    constexpr IndexType NumChunks = InputDimensions / SimdWidth;
+    static_assert(InputDimensions % SimdWidth == 0);
+
+    const auto     input32 = reinterpret_cast<const std::uint32_t*>(input);
+    const svbool_t all     = svptrue_b32();
+    svuint32_t     base    = svindex_u32(0, 1);
+
+    IndexType count = 0;
+    for (IndexType i = 0; i < NumChunks; ++i)
+    {
+        const svuint32_t inputV  = svld1_u32(all, input32 + i * SimdWidth);
+        const svbool_t   nnzMask = svcmpne_n_u32(all, inputV, 0);
+        svst1h_u32(all, out + count, svcompact_u32(nnzMask, base));
+        count += svcntp_b32(all, nnzMask);
+        base = svadd_n_u32_x(all, base, SimdWidth);
+    }
+    count_out = count;
+
+    #elif USE_NEON >= 8 && defined(USE_NEON_EXPERIMENTAL)
+
+    // Narrow 8 inputs to 16-bit lanes with saturation, so that a nonzero input
+    // stays nonzero, and build the 8-bit mask with a single horizontal add.
+    // Opt-in with neonexp=yes until it has been benched on ARM hardware.
+    static constexpr std::uint16_t Bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    constexpr IndexType            NumChunks = InputDimensions / 8;
+
+    const auto       input32   = reinterpret_cast<const std::uint32_t*>(input);
+    const uint16x8_t bits      = vld1q_u16(Bits);
+    const uint16x8_t increment = vdupq_n_u16(8);
+    uint16x8_t       base      = vdupq_n_u16(0);
+
+    IndexType count = 0;
+    for (IndexType i = 0; i < NumChunks; ++i)
+    {
+        const uint16x8_t inputV = vcombine_u16(vqmovn_u32(vld1q_u32(input32 + i * 8)),
+                                               vqmovn_u32(vld1q_u32(input32 + i * 8 + 4)));
+        const unsigned   nnz    = vaddvq_u16(vandq_u16(vtstq_u16(inputV, inputV), bits));
+        const uint16x8_t offsets =
+          vld1q_u16(reinterpret_cast<const std::uint16_t*>(&Lookup.offset_indices[nnz]));
+        vst1q_u16(reinterpret_cast<std::uint16_t*>(out + count), vaddq_u16(base, offsets));
+        count += popcount(nnz);
+        base = vaddq_u16(base, increment);
+    }
+    count_out = count;
+
     #else
 
     using namespace SIMD;
@@ -253,42 +304,66 @@ class AffineTransformSparseInput {
     // Forward propagation
     void propagate(const InputType* input, OutputType* output) const {
 
-#if (USE_SSSE3 | (USE_NEON >= 8))
+#if defined(USE_NNUE_DISPATCH)
+        static_assert(OutputDimensions == 16 && ChunkSize == 4);
+        static_assert(InputDimensions % 128 == 0
+                      && InputDimensions <= KernelMaxSparseInputDimensions);
+
+        kernels->sparse_affine_16(input, weights, biases, output, InputDimensions);
+#elif (USE_SSSE3 | (USE_NEON >= 8))
     #if defined(USE_AVX512)
         using invec_t  = __m512i;
         using outvec_t = __m512i;
         #define vec_add_32 _mm512_add_epi32
+        #define vec_zero_32 _mm512_setzero_si512
         #define vec_set_32 _mm512_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m512_add_dpbusd_epi32
     #elif defined(USE_AVX2)
         using invec_t  = __m256i;
         using outvec_t = __m256i;
         #define vec_add_32 _mm256_add_epi32
+        #define vec_zero_32 _mm256_setzero_si256
         #define vec_set_32 _mm256_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m256_add_dpbusd_epi32
     #elif defined(USE_SSSE3)
         using invec_t  = __m128i;
         using outvec_t = __m128i;
+        #define vec_zero_32 _mm_setzero_si128
         #define vec_set_32 _mm_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m128_add_dpbusd_epi32
+    #elif defined(USE_SVE)
+        using invec_t  = SIMD::sve_i8_t;
+        using outvec_t = SIMD::sve_i32_t;
+        #define vec_add_32(a, b) svadd_s32_x(svptrue_b32(), a, b)
+        #define vec_zero_32() svdup_n_s32(0)
+        #define vec_set_32(a) svreinterpret_s8_s32(svdup_n_s32(a))
+        #define vec_add_dpbusd_32 SIMD::sve_add_dpbusd_epi32
     #elif defined(USE_NEON_DOTPROD)
         using invec_t  = int8x16_t;
         using outvec_t = int32x4_t;
+        #define vec_add_32 vaddq_s32
+        #define vec_zero_32() vdupq_n_s32(0)
         #define vec_set_32(a) vreinterpretq_s8_u32(vdupq_n_u32(a))
         #define vec_add_dpbusd_32 SIMD::dotprod_m128_add_dpbusd_epi32
     #elif defined(USE_NEON)
         using invec_t  = int8x16_t;
         using outvec_t = int32x4_t;
+        #define vec_zero_32() vdupq_n_s32(0)
         #define vec_set_32(a) vreinterpretq_s8_u32(vdupq_n_u32(a))
         #define vec_add_dpbusd_32 SIMD::neon_m128_add_dpbusd_epi32
     #endif
         constexpr IndexType OutputSimdWidth = sizeof(outvec_t) / sizeof(OutputType);
         constexpr IndexType NumChunks = ceil_to_multiple<IndexType>(InputDimensions, 8) / ChunkSize;
         constexpr IndexType NumAccums = OutputDimensions / OutputSimdWidth;
+        static_assert(OutputDimensions % OutputSimdWidth == 0);
         // If we're using high-latency dot product instructions, split the accumulators
         // to create 3 separate dependency chains and merge at the end
+    #if defined(USE_VNNI) || defined(USE_SVE) \
+      || (defined(USE_NEON_DOTPROD) && defined(USE_NEON_EXPERIMENTAL))
+        #define SPLIT_ACCUMULATORS
+    #endif
         constexpr IndexType NumRegs =
-    #if defined(USE_VNNI)
+    #if defined(SPLIT_ACCUMULATORS)
           3 * NumAccums;
     #else
           NumAccums;
@@ -311,9 +386,9 @@ class AffineTransformSparseInput {
 
         // convince GCC to not do weird pointer arithmetic in the following loop
         const std::int8_t* weights_cp = weights;
-    #if defined(USE_VNNI)
+    #if defined(SPLIT_ACCUMULATORS)
         for (IndexType k = NumAccums; k < NumRegs; ++k)
-            acc[k] = vec_zero();
+            acc[k] = vec_zero_32();
 
         while (start < end - 2)
         {
@@ -353,8 +428,10 @@ class AffineTransformSparseInput {
         for (IndexType k = 0; k < NumAccums; ++k)
             outptr[k] = acc[k];
 
+    #undef vec_zero_32
     #undef vec_set_32
     #undef vec_add_dpbusd_32
+    #undef SPLIT_ACCUMULATORS
     #ifdef vec_add_32
         #undef vec_add_32
     #endif
@@ -18,18 +18,25 @@
 
 #include "network.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <atomic>
 #include <optional>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #define INCBIN_SILENCE_BITCODE_WARNING
 #include "../incbin/incbin.h"
 
 #include "../evaluate.h"
+#include "../memory.h"
 #include "../misc.h"
+#include "../numa.h"
 #include "../position.h"
 #include "../types.h"
 #include "nnue_architecture.h"
@@ -43,9 +50,18 @@
 //     const unsigned char *const gEmbeddedNNUEEnd;     // a marker to the end
 //     const unsigned int         gEmbeddedNNUESize;    // the size of the embedded file
 // Note that this does not work in Microsoft Visual Studio.
+// Another file can be embedded in place of a default net, in particular a
+// compressed one (VersionNativeCompressed), with 'make embedbig=...'.
+#ifndef EMBEDDED_NNUE_BIG
+    #define EMBEDDED_NNUE_BIG EvalFileDefaultNameBig
+#endif
+#ifndef EMBEDDED_NNUE_SMALL
+    #define EMBEDDED_NNUE_SMALL EvalFileDefaultNameSmall
+#endif
+
 #if !defined(_MSC_VER) && !defined(NNUE_EMBEDDING_OFF)
-INCBIN(EmbeddedNNUEBig, EvalFileDefaultNameBig);
-INCBIN(EmbeddedNNUESmall, EvalFileDefaultNameSmall);
+INCBIN(EmbeddedNNUEBig, EMBEDDED_NNUE_BIG);
+INCBIN(EmbeddedNNUESmall, EMBEDDED_NNUE_SMALL);
 #else
 const unsigned char        gEmbeddedNNUEBigData[1]   = {0x0};
 const unsigned char* const gEmbeddedNNUEBigEnd       = &gEmbeddedNNUEBigData[1];
@@ -71,6 +87,17 @@ struct EmbeddedNNUE {
 
 using namespace Stockfish::Eval::NNUE;
 
+// C++ way to prepare a buffer for a memory stream
+class MemoryBuffer: public std::basic_streambuf<char> {
+   public:
+    MemoryBuffer(char* p, size_t n) {
+        setg(p, p, p + n);
+        setp(p, p + n);
+    }
+
+    void rewind() { setg(eback(), eback(), egptr()); }
+};
+
 EmbeddedNNUE get_embedded(EmbeddedNNUEType type) {
     if (type == EmbeddedNNUEType::BIG)
         return EmbeddedNNUE(gEmbeddedNNUEBigData, gEmbeddedNNUEBigEnd, gEmbeddedNNUEBigSize);
@@ -87,26 +114,88 @@ namespace Stockfish::Eval::NNUE {
 namespace Detail {
 
 // Read evaluation function parameters
-template<typename T>
-bool read_parameters(std::istream& stream, T& reference) {
+template<typename T, typename... Args>
+bool read_parameters(std::istream& stream, T& reference, Args... args) {
 
     std::uint32_t header;
     header = read_little_endian<std::uint32_t>(stream);
     if (!stream || header != T::get_hash_value())
         return false;
-    return reference.read_parameters(stream);
+    return reference.read_parameters(stream, args...);
 }
 
 // Write evaluation function parameters
-template<typename T>
-bool write_parameters(std::ostream& stream, const T& reference) {
+template<typename T, typename... Args>
+bool write_parameters(std::ostream& stream, const T& reference, Args... args) {
 
     write_little_endian<std::uint32_t>(stream, T::get_hash_value());
-    return reference.write_parameters(stream);
+    return reference.write_parameters(stream, args...);
 }
 
 }  // namespace Detail
 
+namespace {
+
+// The chunks of a compressed net, none of them across two of the objects
+std::vector<std::pair<char*, std::size_t>>
+split_chunks(std::initializer_list<std::pair<char*, std::size_t>> objects) {
+    std::vector<std::pair<char*, std::size_t>> chunks;
+    for (auto [data, size] : objects)
+        for (std::size_t offset = 0; offset < size; offset += CompressedChunkSize)
+            chunks.emplace_back(data + offset, std::min(CompressedChunkSize, size - offset));
+    return chunks;
+}
+
+// Codes each 16-bit word of the chunk as its zigzag value in LEB128. Returns an
+// empty string when this does not make the chunk smaller.
+std::string compress_chunk(const char* data, std::size_t size) {
+    std::string out;
+    if (size % 2)
+        return out;
+
+    for (std::size_t i = 0; i < size && out.size() < size; i += 2)
+    {
+        std::int16_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+
+        std::uint32_t value = (std::uint32_t(word) << 1) ^ std::uint32_t(word >> 15);
+        for (; value >= 0x80; value >>= 7)
+            out += char(value | 0x80);
+        out += char(value);
+    }
+
+    if (out.size() >= size)
+        out.clear();
+    return out;
+}
+
+bool decompress_chunk(const char* in, std::size_t inSize, char* out, std::size_t outSize) {
+    const auto* p   = reinterpret_cast<const unsigned char*>(in);
+    const auto* end = p + inSize;
+
+    for (std::size_t i = 0; i < outSize; i += 2)
+    {
+        std::uint32_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (p == end || shift > 14)
+                return false;
+
+            value |= std::uint32_t(*p & 0x7F) << shift;
+            if (!(*p++ & 0x80))
+                break;
+        }
+
+        const auto word = std::uint16_t((value >> 1) ^ (0 - (value & 1)));
+        std::memcpy(out + i, &word, sizeof(word));
+    }
+
+    return p == end;
+}
+
+}  // namespace
+
+
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load(const std::string& rootDirectory, std::string evalfilePath) {
 #if defined(DEFAULT_NNUE_DIRECTORY)
@@ -138,12 +227,19 @@ void Network<Arch, Transformer>::load(const std::string& rootDirectory, std::str
 
 
 template<typename Arch, typename Transformer>
-bool Network<Arch, Transformer>::save(const std::optional<std::string>& filename) const {
+bool Network<Arch, Transformer>::save(const std::optional<std::string>& filename,
+                                      std::uint32_t                     version) const {
     std::string actualFilename;
     std::string msg;
 
     if (filename.has_value())
         actualFilename = filename.value();
+    else if (version != Version)
+    {
+        // The default name is the hash of the file in the standard format
+        sync_cout << "Failed to export a net. A filename is needed for this format" << sync_endl;
+        return false;
+    }
     else
     {
         if (std::string(evalFile.current) != std::string(evalFile.defaultName))
@@ -159,7 +255,7 @@ bool Network<Arch, Transformer>::save(const std::optional<std::string>& filename
     }
 
     std::ofstream stream(actualFilename, std::ios_base::binary);
-    bool          saved = save(stream, evalFile.current, evalFile.netDescription);
+    bool          saved = save(stream, evalFile.current, evalFile.netDescription, version);
 
     msg = saved ? "Network saved successfully to " + actualFilename : "Failed to export a net";
 
@@ -189,6 +285,86 @@ Network<Arch, Transformer>::evaluate(const Position&                         pos
 }
 
 
+template<typename Arch, typename Transformer>
+void Network<Arch, Transformer>::update_accumulators(
+  const Position&                         pos,
+  AccumulatorStack&                       accumulatorStack,
+  AccumulatorCaches::Cache<FTDimensions>* cache) const {
+
+    accumulatorStack.evaluate(pos, featureTransformer, *cache);
+}
+
+
+template<typename Arch, typename Transformer>
+void Network<Arch, Transformer>::prefetch(int pieceCount) const {
+
+    const int   bucket = (pieceCount - 1) / 4;
+    const char* stack  = reinterpret_cast<const char*>(&network[bucket]);
+
+    for (std::size_t offset = 0; offset < sizeof(Arch); offset += CacheLineSize)
+        Stockfish::prefetch(stack + offset);
+}
+
+
+template<typename Arch, typename Transformer>
+void Network<Arch, Transformer>::evaluate_batch(const Position* const* positions,
+                                                std::size_t            count,
+                                                AccumulatorStack&      accumulatorStack,
+                                                NetworkOutput*         output) const {
+
+    constexpr std::size_t MaxBatch   = Arch::MaxBatchSize;
+    constexpr std::size_t BufferSize = FeatureTransformer<FTDimensions>::BufferSize;
+
+    static_assert(MaxBatch <= AccumulatorStack::MaxSize);
+
+    alignas(CacheLineSize) static thread_local TransformedFeatureType
+      transformedFeatures[MaxBatch][BufferSize];
+
+    for (std::size_t start = 0; start < count; start += MaxBatch)
+    {
+        const std::size_t n = std::min(MaxBatch, count - start);
+
+        const TransformedFeatureType* features[LayerStacks][MaxBatch];
+        std::size_t                   index[LayerStacks][MaxBatch];
+        std::size_t                   stackSize[LayerStacks] = {};
+        std::int32_t                  psqt[MaxBatch], positional[MaxBatch];
+
+        // Refresh the accumulators of the whole batch at once and sort the
+        // transformed features by the layer stack that will consume them.
+        accumulatorStack.refresh_batch(positions + start, n, featureTransformer);
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Position& pos    = *positions[start + i];
+            const int       bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+
+            psqt[i] = featureTransformer.transform(
+              pos, accumulatorStack.batch_state<PSQFeatureSet>(i),
+              accumulatorStack.batch_state<ThreatFeatureSet>(i), transformedFeatures[i], bucket);
+
+            features[bucket][stackSize[bucket]] = transformedFeatures[i];
+            index[bucket][stackSize[bucket]++]  = i;
+        }
+
+        for (IndexType bucket = 0; bucket < LayerStacks; ++bucket)
+        {
+            std::int32_t out[MaxBatch];
+
+            network[bucket].propagate_batch(features[bucket], stackSize[bucket], out);
+
+            for (std::size_t j = 0; j < stackSize[bucket]; ++j)
+                positional[index[bucket][j]] = out[j];
+        }
+
+        for (std::size_t i = 0; i < n; ++i)
+            output[start + i] = {static_cast<Value>(psqt[i] / OutputScale),
+                                 static_cast<Value>(positional[i] / OutputScale)};
+    }
+
+    accumulatorStack.reset();
+}
+
+
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::verify(std::string                                  evalfilePath,
                                         const std::function<void(std::string_view)>& f) const {
@@ -262,8 +438,11 @@ Network<Arch, Transformer>::trace_evaluate(const Position&
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load_user_net(const std::string& dir,
                                                const std::string& evalfilePath) {
-    std::ifstream stream(dir + evalfilePath, std::ios::binary);
-    auto          description = load(stream);
+    MappedFile file(dir + evalfilePath);
+    if (!file.is_open())
+        return;
+
+    auto description = load(file.data(), file.size());
 
     if (description.has_value())
     {
@@ -275,22 +454,10 @@ void Network<Arch, Transformer>::load_user_net(const std::string& dir,
 
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load_internal() {
-    // C++ way to prepare a buffer for a memory stream
-    class MemoryBuffer: public std::basic_streambuf<char> {
-       public:
-        MemoryBuffer(char* p, size_t n) {
-            setg(p, p, p + n);
-            setp(p, p + n);
-        }
-    };
 
     const auto embedded = get_embedded(embeddedType);
-
-    MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(embedded.data)),
-                        size_t(embedded.size));
-
-    std::istream stream(&buffer);
-    auto         description = load(stream);
+    auto       description =
+      load(reinterpret_cast<const char*>(embedded.data), size_t(embedded.size));
 
     if (description.has_value())
     {
@@ -309,20 +476,156 @@ void Network<Arch, Transformer>::initialize() {
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::save(std::ostream&      stream,
                                       const std::string& name,
-                                      const std::string& netDescription) const {
+                                      const std::string& netDescription,
+                                      std::uint32_t      version) const {
     if (name.empty() || name == "None")
         return false;
 
-    return write_parameters(stream, netDescription);
+    return write_parameters(stream, netDescription, version);
 }
 
 
 template<typename Arch, typename Transformer>
-std::optional<std::string> Network<Arch, Transformer>::load(std::istream& stream) {
+std::optional<std::string> Network<Arch, Transformer>::load(const char* data, std::size_t size) {
     initialize();
     std::string description;
 
-    return read_parameters(stream, description) ? std::make_optional(description) : std::nullopt;
+    MemoryBuffer buffer(const_cast<char*>(data), size);
+    std::istream stream(&buffer);
+
+    const auto version = read_little_endian<std::uint32_t>(stream);
+    if (version == VersionNative)
+        return load_native(data, size);
+    if (version == VersionNativeCompressed)
+        return load_compressed(data, size);
+
+    buffer.rewind();
+    stream.clear();
+
+    if (!read_parameters(stream, description))
+        return std::nullopt;
+
+    parametersHash = compute_parameters_hash();
+    return description;
+}
+
+
+// A net in native layout only needs its header to be checked. The parameters
+// are then copied as a whole into the network, with no decoding or permutation,
+// and their hash is read from the header instead of being computed. This copy
+// from the page cache is the only one before the replicas are made.
+template<typename Arch, typename Transformer>
+std::optional<std::string> Network<Arch, Transformer>::load_native(const char* data,
+                                                                   std::size_t size) {
+    MemoryBuffer  buffer(const_cast<char*>(data), size);
+    std::istream  stream(&buffer);
+    std::uint32_t version, hashValue;
+    std::string   description;
+
+    if (!read_header(stream, &version, &hashValue, &description) || version != VersionNative
+        || hashValue != Network::hash
+        || read_little_endian<std::uint32_t>(stream) != Network::layoutHash)
+        return std::nullopt;
+
+    const auto digest = read_little_endian<std::uint64_t>(stream);
+    if (!stream)
+        return std::nullopt;
+
+    // Version, hash, description size, description, layout hash and digest
+    const std::size_t headerSize =
+      4 * sizeof(std::uint32_t) + description.size() + sizeof(std::uint64_t);
+    const std::size_t offset     = ceil_to_multiple(headerSize, NativeAlignment);
+
+    if (size != offset + sizeof(featureTransformer) + sizeof(network))
+        return std::nullopt;
+
+    std::memcpy(&featureTransformer, data + offset, sizeof(featureTransformer));
+    std::memcpy(network, data + offset + sizeof(featureTransformer), sizeof(network));
+
+    parametersHash = std::size_t(digest);
+    return description;
+}
+
+
+// The header of a compressed net is the one of a native net followed by the size
+// of the chunks and the stored size of each chunk, with the highest bit set for
+// a raw one. The chunks follow, and are decompressed by several threads in
+// place, so that the parameters are read once and never copied.
+template<typename Arch, typename Transformer>
+std::optional<std::string> Network<Arch, Transformer>::load_compressed(const char* data,
+                                                                       std::size_t size) {
+    MemoryBuffer  buffer(const_cast<char*>(data), size);
+    std::istream  stream(&buffer);
+    std::uint32_t version, hashValue;
+    std::string   description;
+
+    if (!read_header(stream, &version, &hashValue, &description)
+        || version != VersionNativeCompressed || hashValue != Network::hash
+        || read_little_endian<std::uint32_t>(stream) != Network::layoutHash)
+        return std::nullopt;
+
+    const auto digest    = read_little_endian<std::uint64_t>(stream);
+    const auto chunkSize = read_little_endian<std::uint32_t>(stream);
+    const auto count     = read_little_endian<std::uint32_t>(stream);
+
+    const auto chunks =
+      split_chunks({{reinterpret_cast<char*>(&featureTransformer), sizeof(featureTransformer)},
+                            {reinterpret_cast<char*>(network), sizeof(network)}});
+
+    if (!stream || chunkSize != CompressedChunkSize || count != chunks.size())
+        return std::nullopt;
+
+    // Version, hash, description size, description, layout hash, digest, chunk
+    // size, chunk count and the stored sizes
+    std::vector<std::uint32_t> stored(count);
+    std::vector<std::size_t>   offsets(count);
+    std::size_t offset = 6 * sizeof(std::uint32_t) + description.size() + sizeof(std::uint64_t)
+                       + count * sizeof(std::uint32_t);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        stored[i]  = read_little_endian<std::uint32_t>(stream);
+        offsets[i] = offset;
+        offset += stored[i] & 0x7FFFFFFF;
+    }
+
+    if (!stream || offset != size)
+        return std::nullopt;
+
+    // The threads take the next chunk until there is none left
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool>        valid{true};
+    const auto               decompress = [&]() {
+        for (std::size_t i; (i = next++) < count;)
+        {
+            const auto [out, outSize] = chunks[i];
+            const char*       in      = data + offsets[i];
+            const std::size_t inSize  = stored[i] & 0x7FFFFFFF;
+
+            if (stored[i] & 0x80000000)
+            {
+                if (inSize == outSize)
+                    std::memcpy(out, in, outSize);
+                else
+                    valid = false;
+            }
+            else if (!decompress_chunk(in, inSize, out, outSize))
+                valid = false;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const std::size_t numThreads = std::min<std::size_t>(SYSTEM_THREADS_NB, count);
+    for (std::size_t t = 1; t < numThreads; ++t)
+        threads.emplace_back(decompress);
+    decompress();
+    for (auto& th : threads)
+        th.join();
+
+    if (!valid)
+        return std::nullopt;
+
+    parametersHash = std::size_t(digest);
+    return description;
 }
 
 
@@ -331,26 +634,36 @@ std::size_t Network<Arch, Transformer>::get_content_hash() const {
     if (!initialized)
         return 0;
 
+    std::size_t h = parametersHash;
+    hash_combine(h, evalFile);
+    hash_combine(h, static_cast<int>(embeddedType));
+    return h;
+}
+
+
+template<typename Arch, typename Transformer>
+std::size_t Network<Arch, Transformer>::compute_parameters_hash() const {
     std::size_t h = 0;
     hash_combine(h, featureTransformer);
     for (auto&& layerstack : network)
         hash_combine(h, layerstack);
-    hash_combine(h, evalFile);
-    hash_combine(h, static_cast<int>(embeddedType));
     return h;
 }
 
 // Read network header
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::read_header(std::istream&  stream,
+                                             std::uint32_t* version,
                                              std::uint32_t* hashValue,
                                              std::string*   desc) const {
-    std::uint32_t version, size;
+    std::uint32_t size;
 
-    version    = read_little_endian<std::uint32_t>(stream);
+    *version   = read_little_endian<std::uint32_t>(stream);
     *hashValue = read_little_endian<std::uint32_t>(stream);
     size       = read_little_endian<std::uint32_t>(stream);
-    if (!stream || version != Version)
+    if (!stream
+        || (*version != Version && *version != VersionInt8Threats && *version != VersionNative
+            && *version != VersionNativeCompressed))
         return false;
     desc->resize(size);
     stream.read(&(*desc)[0], size);
@@ -361,9 +674,10 @@ bool Network<Arch, Transformer>::read_header(std::istream&  stream,
 // Write network header
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::write_header(std::ostream&      stream,
+                                              std::uint32_t      version,
                                               std::uint32_t      hashValue,
                                               const std::string& desc) const {
-    write_little_endian<std::uint32_t>(stream, Version);
+    write_little_endian<std::uint32_t>(stream, version);
     write_little_endian<std::uint32_t>(stream, hashValue);
     write_little_endian<std::uint32_t>(stream, std::uint32_t(desc.size()));
     stream.write(&desc[0], desc.size());
@@ -374,12 +688,13 @@ bool Network<Arch, Transformer>::write_header(std::ostream&      stream,
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::read_parameters(std::istream& stream,
                                                  std::string&  netDescription) {
-    std::uint32_t hashValue;
-    if (!read_header(stream, &hashValue, &netDescription))
+    std::uint32_t version, hashValue;
+    if (!read_header(stream, &version, &hashValue, &netDescription))
         return false;
-    if (hashValue != Network::hash)
+    if (hashValue != Network::hash || version == VersionNative
+        || version == VersionNativeCompressed)
         return false;
-    if (!Detail::read_parameters(stream, featureTransformer))
+    if (!Detail::read_parameters(stream, featureTransformer, version == VersionInt8Threats))
         return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
     {
@@ -392,10 +707,52 @@ bool Network<Arch, Transformer>::read_parameters(std::istream& stream,
 
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::write_parameters(std::ostream&      stream,
-                                                  const std::string& netDescription) const {
-    if (!write_header(stream, Network::hash, netDescription))
+                                                  const std::string& netDescription,
+                                                  std::uint32_t      version) const {
+    if (!write_header(stream, version, Network::hash, netDescription))
         return false;
-    if (!Detail::write_parameters(stream, featureTransformer))
+    if (version == VersionNative)
+    {
+        write_little_endian<std::uint32_t>(stream, Network::layoutHash);
+        write_little_endian<std::uint64_t>(stream, parametersHash);
+
+        const std::size_t pos = std::size_t(stream.tellp());
+        const std::string padding(ceil_to_multiple(pos, NativeAlignment) - pos, '\0');
+
+        stream.write(padding.data(), padding.size());
+        stream.write(reinterpret_cast<const char*>(&featureTransformer), sizeof(featureTransformer));
+        stream.write(reinterpret_cast<const char*>(network), sizeof(network));
+        return bool(stream);
+    }
+    if (version == VersionNativeCompressed)
+    {
+        write_little_endian<std::uint32_t>(stream, Network::layoutHash);
+        write_little_endian<std::uint64_t>(stream, parametersHash);
+
+        const auto chunks = split_chunks(
+          {{reinterpret_cast<char*>(const_cast<Transformer*>(&featureTransformer)),
+            sizeof(featureTransformer)},
+           {reinterpret_cast<char*>(const_cast<Arch*>(network)), sizeof(network)}});
+
+        std::vector<std::string> compressed;
+        for (auto [data, size] : chunks)
+            compressed.emplace_back(compress_chunk(data, size));
+
+        write_little_endian<std::uint32_t>(stream, std::uint32_t(CompressedChunkSize));
+        write_little_endian<std::uint32_t>(stream, std::uint32_t(chunks.size()));
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            write_little_endian<std::uint32_t>(
+              stream, compressed[i].empty() ? std::uint32_t(chunks[i].second) | 0x80000000
+                                            : std::uint32_t(compressed[i].size()));
+
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            if (compressed[i].empty())
+                stream.write(chunks[i].first, chunks[i].second);
+            else
+                stream.write(compressed[i].data(), compressed[i].size());
+        return bool(stream);
+    }
+    if (!Detail::write_parameters(stream, featureTransformer, version == VersionInt8Threats))
         return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
     {
@@ -70,7 +70,8 @@ class Network {
     Network& operator=(Network&& other)      = default;
 
     void load(const std::string& rootDirectory, std::string evalfilePath);
-    bool save(const std::optional<std::string>& filename) const;
+    // Writes the net in the format of the given file version, see nnue_common.h
+    bool save(const std::optional<std::string>& filename, std::uint32_t version = Version) const;
 
     std::size_t get_content_hash() const;
 
@@ -78,6 +79,21 @@ class Network {
                            AccumulatorStack&                       accumulatorStack,
                            AccumulatorCaches::Cache<FTDimensions>* cache) const;
 
+    // Evaluates `count` unrelated positions at once. Their accumulators are refreshed
+    // together, see AccumulatorStack::refresh_batch(), and the positions sharing a
+    // layer stack are run through it together, see NetworkArchitecture::propagate_batch().
+    void evaluate_batch(const Position* const* positions,
+                        std::size_t            count,
+                        AccumulatorStack&      accumulatorStack,
+                        NetworkOutput*         output) const;
+
+    // Brings the accumulators of the position up to date without evaluating it
+    void update_accumulators(const Position&                         pos,
+                             AccumulatorStack&                       accumulatorStack,
+                             AccumulatorCaches::Cache<FTDimensions>* cache) const;
+
+    // Prefetches the layer stack that evaluates the positions with this many pieces
+    void prefetch(int pieceCount) const;
 
     void verify(std::string evalfilePath, const std::function<void(std::string_view)>&) const;
     NnueEvalTrace trace_evaluate(const Position&                         pos,
@@ -90,14 +106,18 @@ class Network {
 
     void initialize();
 
-    bool                       save(std::ostream&, const std::string&, const std::string&) const;
-    std::optional<std::string> load(std::istream&);
+    bool save(std::ostream&, const std::string&, const std::string&, std::uint32_t) const;
+    std::optional<std::string> load(const char*, std::size_t);
+    std::optional<std::string> load_native(const char*, std::size_t);
+    std::optional<std::string> load_compressed(const char*, std::size_t);
+
+    std::size_t compute_parameters_hash() const;
 
-    bool read_header(std::istream&, std::uint32_t*, std::string*) const;
-    bool write_header(std::ostream&, std::uint32_t, const std::string&) const;
+    bool read_header(std::istream&, std::uint32_t*, std::uint32_t*, std::string*) const;
+    bool write_header(std::ostream&, std::uint32_t, std::uint32_t, const std::string&) const;
 
     bool read_parameters(std::istream&, std::string&);
-    bool write_parameters(std::ostream&, const std::string&) const;
+    bool write_parameters(std::ostream&, const std::string&, std::uint32_t) const;
 
     // Input feature converter
     Transformer featureTransformer;
@@ -110,9 +130,17 @@ class Network {
 
     bool initialized = false;
 
+    // Hash of the parameters, computed once on load or read from a native net,
+    // so that replicating the network does not hash all the weights again.
+    std::size_t parametersHash = 0;
+
     // Hash value of evaluation function structure
     static constexpr std::uint32_t hash = Transformer::get_hash_value() ^ Arch::get_hash_value();
 
+    // Hash value of the layout of the parameters in memory
+    static constexpr std::uint32_t layoutHash =
+      Transformer::get_layout_hash() ^ Arch::get_layout_hash();
+
     template<IndexType Size>
     friend struct AccumulatorCaches::Cache;
 };
@@ -22,6 +22,7 @@
 #include <cassert>
 #include <cstdint>
 #include <type_traits>
+#include <vector>
 
 #include "../bitboard.h"
 #include "../misc.h"
@@ -31,6 +32,7 @@
 #include "nnue_architecture.h"
 #include "nnue_common.h"
 #include "nnue_feature_transformer.h"  // IWYU pragma: keep
+#include "nnue_kernels.h"
 #include "simd.h"
 
 namespace Stockfish::Eval::NNUE {
@@ -64,6 +66,28 @@ void update_accumulator_incremental(
   AccumulatorState<FeatureSet>&                           target_state,
   const AccumulatorState<FeatureSet>&                     computed);
 
+#ifdef USE_FUSED_UPDATE
+// Number of plies at which forward updates switch to fused_update_incremental(),
+// and the most updates it does in one pass.
+constexpr std::size_t FusedUpdateMinPlies = 3;
+constexpr std::size_t FusedUpdateMaxSteps = 6;
+
+// One update of a fused pass: either a single ply, or two plies that are done
+// together like double_inc_update() does
+template<typename FeatureSet>
+struct FusedUpdateStep {
+    std::size_t                    target;
+    typename FeatureSet::IndexList removed, added;
+};
+
+template<Color Perspective, typename FeatureSet, IndexType Dimensions>
+void fused_update_incremental(const FeatureTransformer<Dimensions>& featureTransformer,
+                              AccumulatorState<FeatureSet>*         accumulators,
+                              const std::size_t                     from,
+                              const FusedUpdateStep<FeatureSet>*    steps,
+                              const std::size_t                     count);
+#endif
+
 template<Color Perspective, IndexType Dimensions>
 void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& featureTransformer,
                                       const Position&                       pos,
@@ -74,6 +98,16 @@ template<Color Perspective, IndexType Dimensions>
 void update_threats_accumulator_full(const FeatureTransformer<Dimensions>& featureTransformer,
                                      const Position&                       pos,
                                      AccumulatorState<ThreatFeatureSet>&   accumulatorState);
+
+// Computes the accumulators of one perspective from scratch for `count` positions,
+// out of their active features: the biases plus the weight column of every active
+// feature. The positions are run through each tile in turn, so a weight tile shared
+// by several of them is loaded from memory only once.
+template<Color Perspective, typename FeatureSet, IndexType Dimensions>
+void accumulate_active(const FeatureTransformer<Dimensions>&         featureTransformer,
+                       const typename FeatureSet::IndexList* const* active,
+                       AccumulatorState<FeatureSet>*                 accumulatorStates,
+                       std::size_t                                   count);
 }
 
 template<typename T>
@@ -85,6 +119,17 @@ const AccumulatorState<T>& AccumulatorStack::latest() const noexcept {
 template const AccumulatorState<PSQFeatureSet>&    AccumulatorStack::latest() const noexcept;
 template const AccumulatorState<ThreatFeatureSet>& AccumulatorStack::latest() const noexcept;
 
+template<typename T>
+const AccumulatorState<T>& AccumulatorStack::batch_state(std::size_t i) const noexcept {
+    return accumulators<T>()[i];
+}
+
+// Explicit template instantiations
+template const AccumulatorState<PSQFeatureSet>&
+AccumulatorStack::batch_state(std::size_t i) const noexcept;
+template const AccumulatorState<ThreatFeatureSet>&
+AccumulatorStack::batch_state(std::size_t i) const noexcept;
+
 template<typename T>
 AccumulatorState<T>& AccumulatorStack::mut_latest() noexcept {
     return mut_accumulators<T>()[size - 1];
@@ -119,19 +164,73 @@ AccumulatorStack::mut_accumulators() noexcept {
 void AccumulatorStack::reset() noexcept {
     psq_accumulators[0].reset({});
     threat_accumulators[0].reset({});
-    size = 1;
+    deferredMoves[0] = Move::none();
+    size             = 1;
 }
 
 void AccumulatorStack::push(const DirtyBoardData& dirtyBoardData) noexcept {
     assert(size < MaxSize);
     psq_accumulators[size].reset(dirtyBoardData.dp);
     threat_accumulators[size].reset(dirtyBoardData.dts);
+    deferredMoves[size] = Move::none();
+    consumed[size]      = false;
+    size++;
+    diffCounters.pushed++;
+}
+
+void AccumulatorStack::push_deferred(Move m) noexcept {
+    assert(size < MaxSize);
+    psq_accumulators[size].accumulatorBig.computed.fill(false);
+    psq_accumulators[size].accumulatorSmall.computed.fill(false);
+    threat_accumulators[size].accumulatorBig.computed.fill(false);
+    threat_accumulators[size].accumulatorSmall.computed.fill(false);
+    deferredMoves[size] = m;
+    consumed[size]      = false;
     size++;
+    diffCounters.pushed++;
 }
 
 void AccumulatorStack::pop() noexcept {
     assert(size > 1);
     size--;
+
+    if (deferredMoves[size] != Move::none())
+        diffCounters.skipped++;
+    else if (!consumed[size])
+        diffCounters.unconsumed++;
+}
+
+// Deferred plies are always on top of built ones, because evaluating a position
+// materializes the whole stack below it. The StateInfo objects of the plies are
+// reused when making their moves again, so the position ends up unchanged.
+void AccumulatorStack::materialize(Position& pos) noexcept {
+
+    std::size_t first = size;
+    while (first > 1 && deferredMoves[first - 1] != Move::none())
+        first--;
+
+    if (first == size)
+        return;
+
+    StateInfo* states[MaxSize];
+
+    for (std::size_t idx = size - 1; idx >= first; idx--)
+    {
+        states[idx] = pos.state();
+        pos.undo_move(deferredMoves[idx]);
+    }
+
+    for (std::size_t idx = first; idx < size; idx++)
+    {
+        // The checkers of the redone move are still in its old StateInfo
+        const bool           givesCheck = states[idx]->checkersBB;
+        const DirtyBoardData dirty =
+          pos.do_move(deferredMoves[idx], *states[idx], givesCheck, nullptr, true);
+
+        psq_accumulators[idx].diff    = dirty.dp;
+        threat_accumulators[idx].diff = dirty.dts;
+        deferredMoves[idx]            = Move::none();
+    }
 }
 
 template<IndexType Dimensions>
@@ -151,6 +250,62 @@ void AccumulatorStack::evaluate(const Position&                       pos,
         evaluate_side<BLACK, ThreatFeatureSet>(pos, featureTransformer, cache);
 }
 
+template<IndexType Dimensions>
+void AccumulatorStack::refresh_batch(const Position* const*                positions,
+                                     std::size_t                           count,
+                                     const FeatureTransformer<Dimensions>& featureTransformer) noexcept {
+    constexpr bool UseThreats = (Dimensions == TransformedFeatureDimensionsBig);
+
+    assert(count <= MaxSize);
+
+    std::vector<PSQFeatureSet::IndexList>    psqFeatures(COLOR_NB * count);
+    std::vector<ThreatFeatureSet::IndexList> threatFeatures(UseThreats ? COLOR_NB * count : 0);
+
+    std::vector<const PSQFeatureSet::IndexList*>    psqActive[COLOR_NB];
+    std::vector<const ThreatFeatureSet::IndexList*> threatActive[COLOR_NB];
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto* psq = &psqFeatures[COLOR_NB * i];
+
+        PSQFeatureSet::append_active_indices<WHITE>(*positions[i], psq[WHITE]);
+        PSQFeatureSet::append_active_indices<BLACK>(*positions[i], psq[BLACK]);
+
+        psqActive[WHITE].push_back(&psq[WHITE]);
+        psqActive[BLACK].push_back(&psq[BLACK]);
+
+        if (UseThreats)
+        {
+            auto* threats = &threatFeatures[COLOR_NB * i];
+
+            ThreatFeatureSet::append_active_indices<WHITE>(*positions[i], threats[WHITE]);
+            ThreatFeatureSet::append_active_indices<BLACK>(*positions[i], threats[BLACK]);
+
+            threatActive[WHITE].push_back(&threats[WHITE]);
+            threatActive[BLACK].push_back(&threats[BLACK]);
+        }
+    }
+
+    accumulate_active<WHITE, PSQFeatureSet>(featureTransformer, psqActive[WHITE].data(),
+                                            psq_accumulators.data(), count);
+    accumulate_active<BLACK, PSQFeatureSet>(featureTransformer, psqActive[BLACK].data(),
+                                            psq_accumulators.data(), count);
+
+    if (UseThreats)
+    {
+        accumulate_active<WHITE, ThreatFeatureSet>(featureTransformer, threatActive[WHITE].data(),
+                                                   threat_accumulators.data(), count);
+        accumulate_active<BLACK, ThreatFeatureSet>(featureTransformer, threatActive[BLACK].data(),
+                                                   threat_accumulators.data(), count);
+    }
+
+#ifdef USE_STATS
+    constexpr int Net = Dimensions == TransformedFeatureDimensionsBig ? 0 : 1;
+
+    diffCounters.refreshes[Net] += count * (UseThreats ? 4 : 2);
+#endif
+}
+
 template<Color Perspective, typename FeatureSet, IndexType Dimensions>
 void AccumulatorStack::evaluate_side(const Position&                       pos,
                                      const FeatureTransformer<Dimensions>& featureTransformer,
@@ -159,6 +314,19 @@ void AccumulatorStack::evaluate_side(const Position&                       pos,
     const auto last_usable_accum =
       find_last_usable_accumulator<Perspective, FeatureSet, Dimensions>();
 
+    for (std::size_t idx = last_usable_accum + 1; idx < size; idx++)
+        consumed[idx] = true;
+
+#ifdef USE_STATS
+    // Either way, every ply but the last usable one gets an incremental update
+    constexpr int Net = Dimensions == TransformedFeatureDimensionsBig ? 0 : 1;
+
+    diffCounters.refreshes[Net] += !(accumulators<FeatureSet>()[last_usable_accum]
+                                       .template acc<Dimensions>())
+                                      .computed[Perspective];
+    diffCounters.updates[Net] += size - 1 - last_usable_accum;
+#endif
+
     if ((accumulators<FeatureSet>()[last_usable_accum].template acc<Dimensions>())
           .computed[Perspective])
         forward_update_incremental<Perspective, FeatureSet>(pos, featureTransformer,
@@ -206,41 +374,111 @@ void AccumulatorStack::forward_update_incremental(
 
     const Square ksq = pos.square<KING>(Perspective);
 
-    for (std::size_t next = begin + 1; next < size; next++)
-    {
-        if (next + 1 < size)
+    // Whether the plies next and next + 1 are done by a single double_inc_update()
+    const auto double_update = [&](const std::size_t next) {
+        const DirtyPiece& dp2 = accumulators<PSQFeatureSet>()[next + 1].diff;
+
+        if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+        {
+            const Bitboard threatening = accumulators<FeatureSet>()[next].diff.threateningSqs;
+            return dp2.remove_sq != SQ_NONE && (threatening & square_bb(dp2.remove_sq));
+        }
+        else
         {
-            DirtyPiece& dp1 = mut_accumulators<PSQFeatureSet>()[next].diff;
-            DirtyPiece& dp2 = mut_accumulators<PSQFeatureSet>()[next + 1].diff;
+            const DirtyPiece& dp1 = accumulators<PSQFeatureSet>()[next].diff;
+            return dp1.to != SQ_NONE && dp1.to == dp2.remove_sq;
+        }
+    };
 
-            auto& accumulators = mut_accumulators<FeatureSet>();
+#ifdef USE_FUSED_UPDATE
+    // The same updates as below are made, but up to FusedUpdateMaxSteps of them
+    // at a time, so that each tile of the accumulator is loaded only once
+    if (size - 1 - begin >= FusedUpdateMinPlies)
+    {
+        auto&       states = mut_accumulators<FeatureSet>();
+        std::size_t from = begin, next = begin + 1;
 
-            if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+        while (next < size)
+        {
+            FusedUpdateStep<FeatureSet> steps[FusedUpdateMaxSteps];
+            std::size_t                 count = 0;
+
+            for (; next < size && count < FusedUpdateMaxSteps; count++)
             {
-                if (dp2.remove_sq != SQ_NONE
-                    && (accumulators[next].diff.threateningSqs & square_bb(dp2.remove_sq)))
+                FusedUpdateStep<FeatureSet>& step = steps[count];
+
+                if (next + 1 < size && double_update(next))
                 {
-                    double_inc_update<Perspective>(featureTransformer, ksq, accumulators[next],
-                                                   accumulators[next + 1], accumulators[next - 1],
-                                                   dp2);
-                    next++;
-                    continue;
+                    if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+                    {
+                        ThreatFeatureSet::FusedUpdateData fusedData;
+                        fusedData.dp2removed =
+                          accumulators<PSQFeatureSet>()[next + 1].diff.remove_sq;
+
+                        ThreatFeatureSet::append_changed_indices<Perspective>(
+                          ksq, states[next].diff, step.removed, step.added, &fusedData, true);
+                        ThreatFeatureSet::append_changed_indices<Perspective>(
+                          ksq, states[next + 1].diff, step.removed, step.added, &fusedData,
+                          false);
+                    }
+                    else
+                    {
+                        DirtyPiece dp1 = states[next].diff;
+                        DirtyPiece dp2 = states[next + 1].diff;
+                        dp1.to = dp2.remove_sq = SQ_NONE;
+
+                        PSQFeatureSet::append_changed_indices<Perspective>(ksq, dp1, step.removed,
+                                                                           step.added);
+                        PSQFeatureSet::append_changed_indices<Perspective>(ksq, dp2, step.removed,
+                                                                           step.added);
+                    }
+
+                    step.target = next + 1;
+                    next += 2;
+                }
+                else
+                {
+                    FeatureSet::template append_changed_indices<Perspective>(
+                      ksq, states[next].diff, step.removed, step.added);
+
+                    step.target = next++;
                 }
             }
 
-            if constexpr (std::is_same_v<FeatureSet, PSQFeatureSet>)
+            fused_update_incremental<Perspective, FeatureSet>(featureTransformer,
+                                                              states.data(), from, steps,
+                                                              count);
+            from = steps[count - 1].target;
+        }
+
+        assert((latest<FeatureSet>().template acc<Dimensions>()).computed[Perspective]);
+        return;
+    }
+#endif
+
+    for (std::size_t next = begin + 1; next < size; next++)
+    {
+        if (next + 1 < size && double_update(next))
+        {
+            auto& accumulators = mut_accumulators<FeatureSet>();
+
+            if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+                double_inc_update<Perspective>(featureTransformer, ksq, accumulators[next],
+                                               accumulators[next + 1], accumulators[next - 1],
+                                               mut_accumulators<PSQFeatureSet>()[next + 1].diff);
+            else
             {
-                if (dp1.to != SQ_NONE && dp1.to == dp2.remove_sq)
-                {
-                    const Square captureSq = dp1.to;
-                    dp1.to = dp2.remove_sq = SQ_NONE;
-                    double_inc_update<Perspective>(featureTransformer, ksq, accumulators[next],
-                                                   accumulators[next + 1], accumulators[next - 1]);
-                    dp1.to = dp2.remove_sq = captureSq;
-                    next++;
-                    continue;
-                }
+                DirtyPiece&  dp1       = mut_accumulators<PSQFeatureSet>()[next].diff;
+                DirtyPiece&  dp2       = mut_accumulators<PSQFeatureSet>()[next + 1].diff;
+                const Square captureSq = dp1.to;
+                dp1.to = dp2.remove_sq = SQ_NONE;
+                double_inc_update<Perspective>(featureTransformer, ksq, accumulators[next],
+                                               accumulators[next + 1], accumulators[next - 1]);
+                dp1.to = dp2.remove_sq = captureSq;
             }
+
+            next++;
+            continue;
         }
 
         update_accumulator_incremental<Perspective, true>(featureTransformer, ksq,
@@ -280,6 +518,14 @@ template void AccumulatorStack::evaluate<TransformedFeatureDimensionsSmall>(
   const Position&                                              pos,
   const FeatureTransformer<TransformedFeatureDimensionsSmall>& featureTransformer,
   AccumulatorCaches::Cache<TransformedFeatureDimensionsSmall>& cache) noexcept;
+template void AccumulatorStack::refresh_batch<TransformedFeatureDimensionsBig>(
+  const Position* const*                                     positions,
+  std::size_t                                                count,
+  const FeatureTransformer<TransformedFeatureDimensionsBig>& featureTransformer) noexcept;
+template void AccumulatorStack::refresh_batch<TransformedFeatureDimensionsSmall>(
+  const Position* const*                                       positions,
+  std::size_t                                                  count,
+  const FeatureTransformer<TransformedFeatureDimensionsSmall>& featureTransformer) noexcept;
 
 
 namespace {
@@ -301,6 +547,93 @@ void fused_row_reduce(const ElementType* in, ElementType* out, const Ts* const..
           vecIn[i], reinterpret_cast<const typename VectorWrapper::type*>(rows)[i]...);
 }
 
+// Weights of the feature sets, threat weights are 8 bit and need to be widened
+template<typename FeatureSet, IndexType Dimensions>
+const PSQTWeightType* psqt_weights(const FeatureTransformer<Dimensions>& featureTransformer) {
+    if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+        return featureTransformer.threatPsqtWeights.data();
+    else
+        return featureTransformer.psqtWeights.data();
+}
+
+#if defined(USE_NNUE_DISPATCH)
+// Accumulator in, plus the weights of the added features, minus those of the
+// removed ones, written to out with the kernel picked at startup
+template<typename FeatureSet, IndexType Dimensions, typename IndexListType>
+void update_rows(const FeatureTransformer<Dimensions>& featureTransformer,
+                 const BiasType*                       in,
+                 BiasType*                             out,
+                 const IndexListType&                  added,
+                 const IndexListType&                  removed) {
+
+    constexpr bool IsThreat = std::is_same_v<FeatureSet, ThreatFeatureSet>;
+
+    const auto* weights = [&]() {
+        if constexpr (IsThreat)
+            return featureTransformer.threatWeights.data();
+        else
+            return featureTransformer.weights.data();
+    }();
+
+    const std::remove_pointer_t<decltype(weights)>* rows[2 * FeatureSet::MaxActiveDimensions];
+    std::size_t                                     n = 0;
+
+    for (const auto index : added)
+        rows[n++] = weights + Dimensions * index;
+    for (const auto index : removed)
+        rows[n++] = weights + Dimensions * index;
+
+    if constexpr (IsThreat)
+        kernels->update_i8(in, out, Dimensions, rows, added.size(), removed.size());
+    else
+        kernels->update_i16(in, out, Dimensions, rows, added.size(), removed.size());
+}
+#endif
+
+#ifdef VECTOR
+// Adds or subtracts the weights at the given offset to a tile of registers
+template<typename FeatureSet, typename Tiling, bool Add, IndexType Dimensions>
+void update_tile(const FeatureTransformer<Dimensions>& featureTransformer,
+                 vec_t*                                acc,
+                 const IndexType                       offset) {
+    if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+    {
+        auto* column = reinterpret_cast<const vec_i8_t*>(&featureTransformer.threatWeights[offset]);
+
+    #ifdef USE_NEON
+        for (IndexType k = 0; k < Tiling::NumRegs; k += 2)
+        {
+            const vec_t lo = vmovl_s8(vget_low_s8(column[k / 2]));
+            const vec_t hi = vmovl_high_s8(column[k / 2]);
+            acc[k]         = Add ? vec_add_16(acc[k], lo) : vec_sub_16(acc[k], lo);
+            acc[k + 1]     = Add ? vec_add_16(acc[k + 1], hi) : vec_sub_16(acc[k + 1], hi);
+        }
+    #else
+        for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+        {
+            const vec_t w = vec_convert_8_16(column[k]);
+            acc[k]        = Add ? vec_add_16(acc[k], w) : vec_sub_16(acc[k], w);
+        }
+    #endif
+    }
+    else
+    {
+        auto* column = reinterpret_cast<const vec_t*>(&featureTransformer.weights[offset]);
+
+        for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+            acc[k] = Add ? vec_add_16(acc[k], column[k]) : vec_sub_16(acc[k], column[k]);
+    }
+}
+#else
+template<typename FeatureSet, IndexType Dimensions>
+BiasType weight(const FeatureTransformer<Dimensions>& featureTransformer, const IndexType offset) {
+    if constexpr (std::is_same_v<FeatureSet, ThreatFeatureSet>)
+        return featureTransformer.threatWeights[offset];
+    else
+        return featureTransformer.weights[offset];
+}
+#endif
+
 template<typename FeatureSet, Color Perspective, IndexType Dimensions>
 struct AccumulatorUpdateContext {
     const FeatureTransformer<Dimensions>& featureTransformer;
@@ -326,9 +659,28 @@ struct AccumulatorUpdateContext {
             return &featureTransformer.psqtWeights[index * PSQTBuckets];
         };
 
+#if defined(USE_NNUE_DISPATCH)
+        static_assert(
+          [] {
+              const UpdateOperation o[] = {ops...};
+              for (std::size_t i = 1; i < sizeof...(ops); ++i)
+                  if (o[i] < o[i - 1])
+                      return false;
+              return true;
+          }(),
+          "The added features come first");
+
+        const WeightType* rows[] = {to_weight_vector(indices)...};
+        constexpr auto    added  = ((ops == Add) + ...);
+
+        kernels->update_i16((from.template acc<Dimensions>()).accumulation[Perspective],
+                            (to.template acc<Dimensions>()).accumulation[Perspective], Dimensions,
+                            rows, added, sizeof...(ops) - added);
+#else
         fused_row_reduce<Vec16Wrapper, Dimensions, ops...>(
           (from.template acc<Dimensions>()).accumulation[Perspective],
           (to.template acc<Dimensions>()).accumulation[Perspective], to_weight_vector(indices)...);
+#endif
 
         fused_row_reduce<Vec32Wrapper, PSQTBuckets, ops...>(
           (from.template acc<Dimensions>()).psqtAccumulation[Perspective],
@@ -336,18 +688,27 @@ struct AccumulatorUpdateContext {
           to_psqt_weight_vector(indices)...);
     }
 
-    void apply(typename FeatureSet::IndexList added, typename FeatureSet::IndexList removed) {
+    // Applies lists of features whose length is only known at runtime, one tile
+    // of the accumulator at a time. The weights of the feature set are used.
+    template<typename IndexListType>
+    void apply(const IndexListType& added, const IndexListType& removed) {
         const auto fromAcc = from.template acc<Dimensions>().accumulation[Perspective];
         const auto toAcc   = to.template acc<Dimensions>().accumulation[Perspective];
 
         const auto fromPsqtAcc = from.template acc<Dimensions>().psqtAccumulation[Perspective];
         const auto toPsqtAcc   = to.template acc<Dimensions>().psqtAccumulation[Perspective];
 
+        const PSQTWeightType* psqtWeights = psqt_weights<FeatureSet>(featureTransformer);
+
 #ifdef VECTOR
         using Tiling = SIMDTiling<Dimensions, Dimensions, PSQTBuckets>;
-        vec_t      acc[Tiling::NumRegs];
         psqt_vec_t psqt[Tiling::NumPsqtRegs];
 
+    #if defined(USE_NNUE_DISPATCH)
+        update_rows<FeatureSet>(featureTransformer, fromAcc, toAcc, added, removed);
+    #else
+        vec_t acc[Tiling::NumRegs];
+
         for (IndexType j = 0; j < Dimensions / Tiling::TileHeight; ++j)
         {
             auto* fromTile = reinterpret_cast<const vec_t*>(&fromAcc[j * Tiling::TileHeight]);
@@ -357,46 +718,17 @@ struct AccumulatorUpdateContext {
                 acc[k] = fromTile[k];
 
             for (IndexType i = 0; i < removed.size(); ++i)
-            {
-                IndexType       index  = removed[i];
-                const IndexType offset = Dimensions * index + j * Tiling::TileHeight;
-                auto*           column =
-                  reinterpret_cast<const vec_i8_t*>(&featureTransformer.threatWeights[offset]);
-
-    #ifdef USE_NEON
-                for (IndexType k = 0; k < Tiling::NumRegs; k += 2)
-                {
-                    acc[k]     = vec_sub_16(acc[k], vmovl_s8(vget_low_s8(column[k / 2])));
-                    acc[k + 1] = vec_sub_16(acc[k + 1], vmovl_high_s8(column[k / 2]));
-                }
-    #else
-                for (IndexType k = 0; k < Tiling::NumRegs; ++k)
-                    acc[k] = vec_sub_16(acc[k], vec_convert_8_16(column[k]));
-    #endif
-            }
+                update_tile<FeatureSet, Tiling, false>(
+                  featureTransformer, acc, Dimensions * removed[i] + j * Tiling::TileHeight);
 
             for (IndexType i = 0; i < added.size(); ++i)
-            {
-                IndexType       index  = added[i];
-                const IndexType offset = Dimensions * index + j * Tiling::TileHeight;
-                auto*           column =
-                  reinterpret_cast<const vec_i8_t*>(&featureTransformer.threatWeights[offset]);
-
-    #ifdef USE_NEON
-                for (IndexType k = 0; k < Tiling::NumRegs; k += 2)
-                {
-                    acc[k]     = vec_add_16(acc[k], vmovl_s8(vget_low_s8(column[k / 2])));
-                    acc[k + 1] = vec_add_16(acc[k + 1], vmovl_high_s8(column[k / 2]));
-                }
-    #else
-                for (IndexType k = 0; k < Tiling::NumRegs; ++k)
-                    acc[k] = vec_add_16(acc[k], vec_convert_8_16(column[k]));
-    #endif
-            }
+                update_tile<FeatureSet, Tiling, true>(
+                  featureTransformer, acc, Dimensions * added[i] + j * Tiling::TileHeight);
 
             for (IndexType k = 0; k < Tiling::NumRegs; k++)
                 vec_store(&toTile[k], acc[k]);
         }
+    #endif
 
         for (IndexType j = 0; j < PSQTBuckets / Tiling::PsqtTileHeight; ++j)
         {
@@ -412,8 +744,8 @@ struct AccumulatorUpdateContext {
             {
                 IndexType       index      = removed[i];
                 const IndexType offset     = PSQTBuckets * index + j * Tiling::PsqtTileHeight;
-                auto*           columnPsqt = reinterpret_cast<const psqt_vec_t*>(
-                  &featureTransformer.threatPsqtWeights[offset]);
+                auto*           columnPsqt =
+                  reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
 
                 for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
                     psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
@@ -423,8 +755,8 @@ struct AccumulatorUpdateContext {
             {
                 IndexType       index      = added[i];
                 const IndexType offset     = PSQTBuckets * index + j * Tiling::PsqtTileHeight;
-                auto*           columnPsqt = reinterpret_cast<const psqt_vec_t*>(
-                  &featureTransformer.threatPsqtWeights[offset]);
+                auto*           columnPsqt =
+                  reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
 
                 for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
                     psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
@@ -444,10 +776,10 @@ struct AccumulatorUpdateContext {
             const IndexType offset = Dimensions * index;
 
             for (IndexType j = 0; j < Dimensions; ++j)
-                toAcc[j] -= featureTransformer.threatWeights[offset + j];
+                toAcc[j] -= weight<FeatureSet>(featureTransformer, offset + j);
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-                toPsqtAcc[k] -= featureTransformer.threatPsqtWeights[index * PSQTBuckets + k];
+                toPsqtAcc[k] -= psqtWeights[index * PSQTBuckets + k];
         }
 
         for (const auto index : added)
@@ -455,14 +787,15 @@ struct AccumulatorUpdateContext {
             const IndexType offset = Dimensions * index;
 
             for (IndexType j = 0; j < Dimensions; ++j)
-                toAcc[j] += featureTransformer.threatWeights[offset + j];
+                toAcc[j] += weight<FeatureSet>(featureTransformer, offset + j);
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-                toPsqtAcc[k] += featureTransformer.threatPsqtWeights[index * PSQTBuckets + k];
+                toPsqtAcc[k] += psqtWeights[index * PSQTBuckets + k];
         }
 
 #endif
     }
+
 };
 
 template<Color Perspective, typename FeatureSet, IndexType Dimensions>
@@ -617,6 +950,141 @@ void update_accumulator_incremental(
     (target_state.template acc<TransformedFeatureDimensions>()).computed[Perspective] = true;
 }
 
+#ifdef USE_FUSED_UPDATE
+// Makes the given updates starting from the computed accumulator at index from,
+// in one pass over the accumulator: each tile is loaded once, the changes of the
+// steps are applied to it in turn, and the tile of every step target is stored.
+template<Color Perspective, typename FeatureSet, IndexType Dimensions>
+void fused_update_incremental(const FeatureTransformer<Dimensions>& featureTransformer,
+                              AccumulatorState<FeatureSet>*         accumulators,
+                              const std::size_t                     from,
+                              const FusedUpdateStep<FeatureSet>*    steps,
+                              const std::size_t                     count) {
+
+    assert(count <= FusedUpdateMaxSteps);
+    assert((accumulators[from].template acc<Dimensions>()).computed[Perspective]);
+
+    const PSQTWeightType* psqtWeights = psqt_weights<FeatureSet>(featureTransformer);
+
+    auto accumulation = [&](const std::size_t idx) {
+        return (accumulators[idx].template acc<Dimensions>()).accumulation[Perspective];
+    };
+    auto psqtAccumulation = [&](const std::size_t idx) {
+        return (accumulators[idx].template acc<Dimensions>()).psqtAccumulation[Perspective];
+    };
+
+    #ifdef VECTOR
+    using Tiling = SIMDTiling<Dimensions, Dimensions, PSQTBuckets>;
+    vec_t      acc[Tiling::NumRegs];
+    psqt_vec_t psqt[Tiling::NumPsqtRegs];
+
+    for (IndexType j = 0; j < Dimensions / Tiling::TileHeight; ++j)
+    {
+        auto* fromTile =
+          reinterpret_cast<const vec_t*>(&accumulation(from)[j * Tiling::TileHeight]);
+
+        for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+            acc[k] = fromTile[k];
+
+        for (std::size_t s = 0; s < count; ++s)
+        {
+            const auto& step = steps[s];
+
+            for (IndexType i = 0; i < step.removed.size(); ++i)
+                update_tile<FeatureSet, Tiling, false>(
+                  featureTransformer, acc, Dimensions * step.removed[i] + j * Tiling::TileHeight);
+
+            for (IndexType i = 0; i < step.added.size(); ++i)
+                update_tile<FeatureSet, Tiling, true>(
+                  featureTransformer, acc, Dimensions * step.added[i] + j * Tiling::TileHeight);
+
+            auto* toTile =
+              reinterpret_cast<vec_t*>(&accumulation(step.target)[j * Tiling::TileHeight]);
+
+            for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+                vec_store(&toTile[k], acc[k]);
+        }
+    }
+
+    for (IndexType j = 0; j < PSQTBuckets / Tiling::PsqtTileHeight; ++j)
+    {
+        auto* fromTilePsqt =
+          reinterpret_cast<const psqt_vec_t*>(&psqtAccumulation(from)[j * Tiling::PsqtTileHeight]);
+
+        for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
+            psqt[k] = fromTilePsqt[k];
+
+        for (std::size_t s = 0; s < count; ++s)
+        {
+            const auto& step = steps[s];
+
+            for (IndexType i = 0; i < step.removed.size(); ++i)
+            {
+                auto* columnPsqt = reinterpret_cast<const psqt_vec_t*>(
+                  &psqtWeights[PSQTBuckets * step.removed[i] + j * Tiling::PsqtTileHeight]);
+
+                for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
+                    psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
+            }
+
+            for (IndexType i = 0; i < step.added.size(); ++i)
+            {
+                auto* columnPsqt = reinterpret_cast<const psqt_vec_t*>(
+                  &psqtWeights[PSQTBuckets * step.added[i] + j * Tiling::PsqtTileHeight]);
+
+                for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
+                    psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
+            }
+
+            auto* toTilePsqt = reinterpret_cast<psqt_vec_t*>(
+              &psqtAccumulation(step.target)[j * Tiling::PsqtTileHeight]);
+
+            for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
+                vec_store_psqt(&toTilePsqt[k], psqt[k]);
+        }
+    }
+
+    #else
+
+    std::size_t prev = from;
+
+    for (std::size_t s = 0; s < count; ++s)
+    {
+        const auto& step = steps[s];
+
+        std::copy_n(accumulation(prev), Dimensions, accumulation(step.target));
+        std::copy_n(psqtAccumulation(prev), PSQTBuckets, psqtAccumulation(step.target));
+
+        for (const auto index : step.removed)
+        {
+            for (IndexType j = 0; j < Dimensions; ++j)
+                accumulation(step.target)[j] -=
+                  weight<FeatureSet>(featureTransformer, Dimensions * index + j);
+
+            for (std::size_t k = 0; k < PSQTBuckets; ++k)
+                psqtAccumulation(step.target)[k] -= psqtWeights[index * PSQTBuckets + k];
+        }
+
+        for (const auto index : step.added)
+        {
+            for (IndexType j = 0; j < Dimensions; ++j)
+                accumulation(step.target)[j] +=
+                  weight<FeatureSet>(featureTransformer, Dimensions * index + j);
+
+            for (std::size_t k = 0; k < PSQTBuckets; ++k)
+                psqtAccumulation(step.target)[k] += psqtWeights[index * PSQTBuckets + k];
+        }
+
+        prev = step.target;
+    }
+
+    #endif
+
+    for (std::size_t s = 0; s < count; ++s)
+        (accumulators[steps[s].target].template acc<Dimensions>()).computed[Perspective] = true;
+}
+#endif
+
 Bitboard get_changed_pieces(const Piece old[SQUARE_NB], const Piece new_[SQUARE_NB]) {
 #if defined(USE_AVX512) || defined(USE_AVX2)
     static_assert(sizeof(Piece) == 1);
@@ -649,7 +1117,7 @@ void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& feat
     using Tiling [[maybe_unused]] = SIMDTiling<Dimensions, Dimensions, PSQTBuckets>;
 
     const Square             ksq   = pos.square<KING>(Perspective);
-    auto&                    entry = cache[ksq][Perspective];
+    auto&                    entry = cache.entry(ksq, Perspective, featureTransformer.biases);
     PSQFeatureSet::IndexList removed, added;
 
     const Bitboard changed_bb = get_changed_pieces(entry.pieces, pos.piece_array().data());
@@ -674,9 +1142,16 @@ void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& feat
     accumulator.computed[Perspective] = true;
 
 #ifdef VECTOR
-    vec_t      acc[Tiling::NumRegs];
     psqt_vec_t psqt[Tiling::NumPsqtRegs];
 
+    #if defined(USE_NNUE_DISPATCH)
+    update_rows<PSQFeatureSet>(featureTransformer, entry.accumulation.data(),
+                               entry.accumulation.data(), added, removed);
+    std::memcpy(accumulator.accumulation[Perspective], entry.accumulation.data(),
+                sizeof(BiasType) * Dimensions);
+    #else
+    vec_t acc[Tiling::NumRegs];
+
     for (IndexType j = 0; j < Dimensions / Tiling::TileHeight; ++j)
     {
         auto* accTile =
@@ -723,6 +1198,7 @@ void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& feat
         for (IndexType k = 0; k < Tiling::NumRegs; k++)
             vec_store(&accTile[k], acc[k]);
     }
+    #endif
 
     for (IndexType j = 0; j < PSQTBuckets / Tiling::PsqtTileHeight; ++j)
     {
@@ -797,93 +1273,141 @@ template<Color Perspective, IndexType Dimensions>
 void update_threats_accumulator_full(const FeatureTransformer<Dimensions>& featureTransformer,
                                      const Position&                       pos,
                                      AccumulatorState<ThreatFeatureSet>&   accumulatorState) {
-    using Tiling [[maybe_unused]] = SIMDTiling<Dimensions, Dimensions, PSQTBuckets>;
-
     ThreatFeatureSet::IndexList active;
     ThreatFeatureSet::append_active_indices<Perspective>(pos, active);
 
-    auto& accumulator                 = accumulatorState.acc<Dimensions>();
-    accumulator.computed[Perspective] = true;
+    const ThreatFeatureSet::IndexList* list = &active;
+
+    accumulate_active<Perspective, ThreatFeatureSet>(featureTransformer, &list, &accumulatorState, 1);
+}
+
+template<Color Perspective, typename FeatureSet, IndexType Dimensions>
+void accumulate_active(const FeatureTransformer<Dimensions>&         featureTransformer,
+                       const typename FeatureSet::IndexList* const* active,
+                       AccumulatorState<FeatureSet>*                 accumulatorStates,
+                       std::size_t                                   count) {
+    using Tiling [[maybe_unused]] = SIMDTiling<Dimensions, Dimensions, PSQTBuckets>;
+
+    constexpr bool IsThreat = std::is_same_v<FeatureSet, ThreatFeatureSet>;
+
+    const auto& psqtWeights = [&]() -> const auto& {
+        if constexpr (IsThreat)
+            return featureTransformer.threatPsqtWeights;
+        else
+            return featureTransformer.psqtWeights;
+    }();
+
+    for (std::size_t p = 0; p < count; ++p)
+        (accumulatorStates[p].template acc<Dimensions>()).computed[Perspective] = true;
 
 #ifdef VECTOR
     vec_t      acc[Tiling::NumRegs];
     psqt_vec_t psqt[Tiling::NumPsqtRegs];
 
     for (IndexType j = 0; j < Dimensions / Tiling::TileHeight; ++j)
-    {
-        auto* accTile =
-          reinterpret_cast<vec_t*>(&accumulator.accumulation[Perspective][j * Tiling::TileHeight]);
+        for (std::size_t p = 0; p < count; ++p)
+        {
+            auto& accumulator = accumulatorStates[p].template acc<Dimensions>();
+            auto* accTile     = reinterpret_cast<vec_t*>(
+              &accumulator.accumulation[Perspective][j * Tiling::TileHeight]);
 
-        for (IndexType k = 0; k < Tiling::NumRegs; ++k)
-            acc[k] = vec_zero();
+            if constexpr (IsThreat)
+                for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+                    acc[k] = vec_zero();
+            else
+            {
+                auto* biasTile = reinterpret_cast<const vec_t*>(
+                  &featureTransformer.biases[j * Tiling::TileHeight]);
 
-        IndexType i = 0;
+                for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+                    acc[k] = biasTile[k];
+            }
 
-        for (; i < active.size(); ++i)
-        {
-            IndexType       index  = active[i];
-            const IndexType offset = Dimensions * index + j * Tiling::TileHeight;
-            auto*           column =
-              reinterpret_cast<const vec_i8_t*>(&featureTransformer.threatWeights[offset]);
+            for (const auto index : *active[p])
+            {
+                const IndexType offset = Dimensions * index + j * Tiling::TileHeight;
+
+                if constexpr (IsThreat)
+                {
+                    auto* column =
+                      reinterpret_cast<const vec_i8_t*>(&featureTransformer.threatWeights[offset]);
 
     #ifdef USE_NEON
-            for (IndexType k = 0; k < Tiling::NumRegs; k += 2)
-            {
-                acc[k]     = vec_add_16(acc[k], vmovl_s8(vget_low_s8(column[k / 2])));
-                acc[k + 1] = vec_add_16(acc[k + 1], vmovl_high_s8(column[k / 2]));
-            }
+                    for (IndexType k = 0; k < Tiling::NumRegs; k += 2)
+                    {
+                        acc[k]     = vec_add_16(acc[k], vmovl_s8(vget_low_s8(column[k / 2])));
+                        acc[k + 1] = vec_add_16(acc[k + 1], vmovl_high_s8(column[k / 2]));
+                    }
     #else
-            for (IndexType k = 0; k < Tiling::NumRegs; ++k)
-                acc[k] = vec_add_16(acc[k], vec_convert_8_16(column[k]));
+                    for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+                        acc[k] = vec_add_16(acc[k], vec_convert_8_16(column[k]));
     #endif
-        }
-
-        for (IndexType k = 0; k < Tiling::NumRegs; k++)
-            vec_store(&accTile[k], acc[k]);
-    }
+                }
+                else
+                {
+                    auto* column =
+                      reinterpret_cast<const vec_t*>(&featureTransformer.weights[offset]);
 
-    for (IndexType j = 0; j < PSQTBuckets / Tiling::PsqtTileHeight; ++j)
-    {
-        auto* accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-          &accumulator.psqtAccumulation[Perspective][j * Tiling::PsqtTileHeight]);
+                    for (IndexType k = 0; k < Tiling::NumRegs; ++k)
+                        acc[k] = vec_add_16(acc[k], column[k]);
+                }
+            }
 
-        for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
-            psqt[k] = vec_zero_psqt();
+            for (IndexType k = 0; k < Tiling::NumRegs; k++)
+                vec_store(&accTile[k], acc[k]);
+        }
 
-        for (IndexType i = 0; i < active.size(); ++i)
+    for (IndexType j = 0; j < PSQTBuckets / Tiling::PsqtTileHeight; ++j)
+        for (std::size_t p = 0; p < count; ++p)
         {
-            IndexType       index  = active[i];
-            const IndexType offset = PSQTBuckets * index + j * Tiling::PsqtTileHeight;
-            auto*           columnPsqt =
-              reinterpret_cast<const psqt_vec_t*>(&featureTransformer.threatPsqtWeights[offset]);
+            auto& accumulator = accumulatorStates[p].template acc<Dimensions>();
+            auto* accTilePsqt = reinterpret_cast<psqt_vec_t*>(
+              &accumulator.psqtAccumulation[Perspective][j * Tiling::PsqtTileHeight]);
 
-            for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
-                psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
-        }
+            for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
+                psqt[k] = vec_zero_psqt();
 
-        for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
-            vec_store_psqt(&accTilePsqt[k], psqt[k]);
-    }
+            for (const auto index : *active[p])
+            {
+                const IndexType offset     = PSQTBuckets * index + j * Tiling::PsqtTileHeight;
+                auto*           columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
 
-#else
+                for (std::size_t k = 0; k < Tiling::NumPsqtRegs; ++k)
+                    psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
+            }
 
-    for (IndexType j = 0; j < Dimensions; ++j)
-        accumulator.accumulation[Perspective][j] = 0;
+            for (IndexType k = 0; k < Tiling::NumPsqtRegs; ++k)
+                vec_store_psqt(&accTilePsqt[k], psqt[k]);
+        }
 
-    for (std::size_t k = 0; k < PSQTBuckets; ++k)
-        accumulator.psqtAccumulation[Perspective][k] = 0;
+#else
 
-    for (const auto index : active)
+    for (std::size_t p = 0; p < count; ++p)
     {
-        const IndexType offset = Dimensions * index;
+        auto& accumulator = accumulatorStates[p].template acc<Dimensions>();
 
         for (IndexType j = 0; j < Dimensions; ++j)
-            accumulator.accumulation[Perspective][j] +=
-              featureTransformer.threatWeights[offset + j];
+            accumulator.accumulation[Perspective][j] = IsThreat ? 0 : featureTransformer.biases[j];
 
         for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            accumulator.psqtAccumulation[Perspective][k] +=
-              featureTransformer.threatPsqtWeights[index * PSQTBuckets + k];
+            accumulator.psqtAccumulation[Perspective][k] = 0;
+
+        for (const auto index : *active[p])
+        {
+            const IndexType offset = Dimensions * index;
+
+            for (IndexType j = 0; j < Dimensions; ++j)
+                if constexpr (IsThreat)
+                    accumulator.accumulation[Perspective][j] +=
+                      featureTransformer.threatWeights[offset + j];
+                else
+                    accumulator.accumulation[Perspective][j] +=
+                      featureTransformer.weights[offset + j];
+
+            for (std::size_t k = 0; k < PSQTBuckets; ++k)
+                accumulator.psqtAccumulation[Perspective][k] +=
+                  psqtWeights[index * PSQTBuckets + k];
+        }
     }
 
 #endif
@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <cstring>
 
+#include "../memory.h"
 #include "../types.h"
 #include "nnue_architecture.h"
 #include "nnue_common.h"
@@ -57,11 +58,16 @@ struct alignas(CacheLineSize) Accumulator {
 // efficiently update the accumulator, instead of rebuilding it from scratch.
 // This idea, was first described by Luecx (author of Koivisto) and
 // is commonly referred to as "Finny Tables".
+//
+// By default there is an entry for every king square. In compact mode, each
+// perspective has a few slots only, which are shared by the king squares in
+// least recently used order. An evicted slot is reset to an empty board, so a
+// refresh into it has to add all the pieces again.
 struct AccumulatorCaches {
 
     template<typename Networks>
-    AccumulatorCaches(const Networks& networks) {
-        clear(networks);
+    AccumulatorCaches(const Networks& networks, std::size_t slots = 0) {
+        resize(networks, slots);
     }
 
     template<IndexType Size>
@@ -72,6 +78,8 @@ struct AccumulatorCaches {
             std::array<PSQTWeightType, PSQTBuckets> psqtAccumulation;
             Piece                                   pieces[SQUARE_NB];
             Bitboard                                pieceBB;
+            Square                                  ksq;      // Compact mode only
+            std::uint32_t                           lastUse;  // Likewise
 
             // To initialize a refresh entry, we set all its bitboards empty,
             // so we put the biases in the accumulation, without any weights on top
@@ -83,24 +91,80 @@ struct AccumulatorCaches {
             }
         };
 
+        // Slots per perspective, 0 for one entry per king square
+        void resize(std::size_t slotCount) {
+            if (entries && slotCount == slots)
+                return;
+
+            slots   = slotCount;
+            entries = make_unique_aligned<Entry[]>(entry_count(slots));
+        }
+
         template<typename Network>
         void clear(const Network& network) {
-            for (auto& entries1D : entries)
-                for (auto& entry : entries1D)
-                    entry.clear(network.featureTransformer.biases);
+            for (std::size_t i = 0; i < entry_count(slots); ++i)
+            {
+                entries[i].clear(network.featureTransformer.biases);
+                entries[i].ksq = SQ_NONE;
+            }
+            useCount = 0;
         }
 
-        std::array<Entry, COLOR_NB>& operator[](Square sq) { return entries[sq]; }
+        Entry& entry(Square sq, Color perspective, const std::array<BiasType, Size>& biases) {
+            if (!slots)
+                return entries[sq * COLOR_NB + perspective];
+
+            Entry* slot = &entries[perspective * slots];
+            Entry* lru  = slot;
 
-        std::array<std::array<Entry, COLOR_NB>, SQUARE_NB> entries;
+            for (std::size_t i = 0; i < slots; ++i, ++slot)
+            {
+                if (slot->ksq == sq)
+                {
+                    slot->lastUse = ++useCount;
+                    return *slot;
+                }
+
+                if (slot->lastUse < lru->lastUse)
+                    lru = slot;
+            }
+
+            lru->clear(biases);
+            lru->ksq     = sq;
+            lru->lastUse = ++useCount;
+            return *lru;
+        }
+
+        static std::size_t entry_count(std::size_t slotCount) {
+            return (slotCount ? slotCount : std::size_t(SQUARE_NB)) * COLOR_NB;
+        }
+
+        AlignedPtr<Entry[]> entries;
+        std::size_t         slots    = 0;
+        std::uint32_t       useCount = 0;
     };
 
+    template<typename Networks>
+    void resize(const Networks& networks, std::size_t slots) {
+        big.resize(slots);
+        small.resize(slots);
+        clear(networks);
+    }
+
     template<typename Networks>
     void clear(const Networks& networks) {
         big.clear(networks.big);
         small.clear(networks.small);
     }
 
+    // Memory of the caches of one thread with the given number of slots
+    static std::size_t memory_usage(std::size_t slots) {
+        return Cache<TransformedFeatureDimensionsBig>::entry_count(slots)
+               * sizeof(Cache<TransformedFeatureDimensionsBig>::Entry)
+             + Cache<TransformedFeatureDimensionsSmall>::entry_count(slots)
+                 * sizeof(Cache<TransformedFeatureDimensionsSmall>::Entry);
+    }
+
     Cache<TransformedFeatureDimensionsBig>   big;
     Cache<TransformedFeatureDimensionsSmall> small;
 };
@@ -143,6 +207,34 @@ struct AccumulatorState {
     }
 };
 
+// Counters of the diffs pushed since the last reset_counters(). A diff is
+// consumed when an update walks over it. Skipped diffs were pushed deferred
+// and popped before anything asked for them, so they were never built.
+struct AccumulatorDiffCounters {
+    std::uint64_t pushed     = 0;
+    std::uint64_t skipped    = 0;
+    std::uint64_t unconsumed = 0;
+#ifdef USE_STATS
+    // Indexed by network, the big one first
+    std::uint64_t refreshes[2] = {};  // Of a perspective, from the refresh cache or in full
+    std::uint64_t updates[2]   = {};  // Incremental, one per ply and perspective
+#endif
+
+    AccumulatorDiffCounters& operator+=(const AccumulatorDiffCounters& c) {
+        pushed += c.pushed;
+        skipped += c.skipped;
+        unconsumed += c.unconsumed;
+#ifdef USE_STATS
+        for (int net = 0; net < 2; ++net)
+        {
+            refreshes[net] += c.refreshes[net];
+            updates[net] += c.updates[net];
+        }
+#endif
+        return *this;
+    }
+};
+
 class AccumulatorStack {
    public:
     static constexpr std::size_t MaxSize = MAX_PLY + 1;
@@ -154,11 +246,33 @@ class AccumulatorStack {
     void push(const DirtyBoardData& dirtyBoardData) noexcept;
     void pop() noexcept;
 
+    // A deferred push only records the move. Its diffs are built by materialize(),
+    // which takes back the deferred moves on top of the stack and makes them again
+    // with threat tracking, so it must be called before evaluating the position.
+    void push_deferred(Move m) noexcept;
+    void materialize(Position& pos) noexcept;
+
+    const AccumulatorDiffCounters& counters() const noexcept { return diffCounters; }
+    void                           reset_counters() noexcept { diffCounters = {}; }
+
     template<IndexType Dimensions>
     void evaluate(const Position&                       pos,
                   const FeatureTransformer<Dimensions>& featureTransformer,
                   AccumulatorCaches::Cache<Dimensions>& cache) noexcept;
 
+    // Refreshes the accumulators of a batch of unrelated positions from scratch
+    // into the states [0, count), for a batched evaluation. The weights are walked
+    // tile by tile over the whole batch, so the columns of the features that the
+    // positions share are reused from the cache. The stack must be reset before it
+    // is used for a search again.
+    template<IndexType Dimensions>
+    void refresh_batch(const Position* const*                positions,
+                       std::size_t                           count,
+                       const FeatureTransformer<Dimensions>& featureTransformer) noexcept;
+
+    template<typename T>
+    [[nodiscard]] const AccumulatorState<T>& batch_state(std::size_t i) const noexcept;
+
    private:
     template<typename T>
     [[nodiscard]] AccumulatorState<T>& mut_latest() noexcept;
@@ -189,7 +303,10 @@ class AccumulatorStack {
 
     std::array<AccumulatorState<PSQFeatureSet>, MaxSize>    psq_accumulators;
     std::array<AccumulatorState<ThreatFeatureSet>, MaxSize> threat_accumulators;
+    std::array<Move, MaxSize>                               deferredMoves;  // Move::none() once built
+    std::array<bool, MaxSize>                               consumed;
     std::size_t                                             size = 1;
+    AccumulatorDiffCounters                                 diffCounters;
 };
 
 }  // namespace Stockfish::Eval::NNUE
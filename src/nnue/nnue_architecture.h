@@ -21,9 +21,12 @@
 #ifndef NNUE_ARCHITECTURE_H_INCLUDED
 #define NNUE_ARCHITECTURE_H_INCLUDED
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iosfwd>
+#include <memory>
 
 #include "features/half_ka_v2_hm.h"
 #include "features/full_threats.h"
@@ -85,6 +88,16 @@ struct NetworkArchitecture {
         return hashValue;
     }
 
+    // Hash value of the layout of the parameters in memory, which depends on
+    // whether the affine layers scramble their weights, see VersionNative
+    static constexpr std::uint32_t get_layout_hash() {
+        std::uint32_t hashValue = 0x2B7E1516u ^ std::uint32_t(sizeof(NetworkArchitecture));
+        hashValue = hashValue * 31 + decltype(fc_0)::get_weight_index(4);
+        hashValue = hashValue * 31 + decltype(fc_1)::get_weight_index(4);
+        hashValue = hashValue * 31 + decltype(fc_2)::get_weight_index(4);
+        return hashValue;
+    }
+
     // Read network parameters
     bool read_parameters(std::istream& stream) {
         return fc_0.read_parameters(stream) && ac_0.read_parameters(stream)
@@ -99,18 +112,32 @@ struct NetworkArchitecture {
             && fc_2.write_parameters(stream);
     }
 
+    // Largest number of positions handled by one call of propagate_batch()
+    static constexpr std::size_t MaxBatchSize = 32;
+
+   private:
+    struct alignas(CacheLineSize) Buffer {
+        alignas(CacheLineSize) typename decltype(fc_0)::OutputBuffer fc_0_out;
+        alignas(CacheLineSize) typename decltype(ac_sqr_0)::OutputType
+          ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
+        alignas(CacheLineSize) typename decltype(ac_0)::OutputBuffer ac_0_out;
+        alignas(CacheLineSize) typename decltype(fc_1)::OutputBuffer fc_1_out;
+        alignas(CacheLineSize) typename decltype(ac_1)::OutputBuffer ac_1_out;
+        alignas(CacheLineSize) typename decltype(fc_2)::OutputBuffer fc_2_out;
+
+        Buffer() { std::memset(this, 0, sizeof(*this)); }
+    };
+
+    // buffer.fc_0_out[FC_0_OUTPUTS] is such that 1.0 is equal to 127*(1<<WeightScaleBits) in
+    // quantized form, but we want 1.0 to be equal to 600*OutputScale
+    static std::int32_t output_value(const Buffer& buffer) {
+        std::int32_t fwdOut =
+          (buffer.fc_0_out[FC_0_OUTPUTS]) * (600 * OutputScale) / (127 * (1 << WeightScaleBits));
+        return buffer.fc_2_out[0] + fwdOut;
+    }
+
+   public:
     std::int32_t propagate(const TransformedFeatureType* transformedFeatures) const {
-        struct alignas(CacheLineSize) Buffer {
-            alignas(CacheLineSize) typename decltype(fc_0)::OutputBuffer fc_0_out;
-            alignas(CacheLineSize) typename decltype(ac_sqr_0)::OutputType
-              ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
-            alignas(CacheLineSize) typename decltype(ac_0)::OutputBuffer ac_0_out;
-            alignas(CacheLineSize) typename decltype(fc_1)::OutputBuffer fc_1_out;
-            alignas(CacheLineSize) typename decltype(ac_1)::OutputBuffer ac_1_out;
-            alignas(CacheLineSize) typename decltype(fc_2)::OutputBuffer fc_2_out;
-
-            Buffer() { std::memset(this, 0, sizeof(*this)); }
-        };
 
 #if defined(__clang__) && (__APPLE__)
         // workaround for a bug reported with xcode 12
@@ -130,13 +157,44 @@ struct NetworkArchitecture {
         ac_1.propagate(buffer.fc_1_out, buffer.ac_1_out);
         fc_2.propagate(buffer.ac_1_out, buffer.fc_2_out);
 
-        // buffer.fc_0_out[FC_0_OUTPUTS] is such that 1.0 is equal to 127*(1<<WeightScaleBits) in
-        // quantized form, but we want 1.0 to be equal to 600*OutputScale
-        std::int32_t fwdOut =
-          (buffer.fc_0_out[FC_0_OUTPUTS]) * (600 * OutputScale) / (127 * (1 << WeightScaleBits));
-        std::int32_t outputValue = buffer.fc_2_out[0] + fwdOut;
+        return output_value(buffer);
+    }
+
+    // Same as propagate() for up to MaxBatchSize positions, but layer by layer:
+    // each layer runs over the whole batch before the next one starts, so its
+    // weights are loaded into the cache once per batch rather than once per position.
+    void propagate_batch(const TransformedFeatureType* const* transformedFeatures,
+                         std::size_t                          count,
+                         std::int32_t*                        output) const {
+        assert(count <= MaxBatchSize);
+
+#if defined(__clang__) && (__APPLE__)
+        static thread_local auto tlsBuffers = std::make_unique<Buffer[]>(MaxBatchSize);
+        Buffer*                  buffers    = tlsBuffers.get();
+#else
+        alignas(CacheLineSize) static thread_local Buffer buffers[MaxBatchSize];
+#endif
 
-        return outputValue;
+        for (std::size_t i = 0; i < count; ++i)
+            fc_0.propagate(transformedFeatures[i], buffers[i].fc_0_out);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ac_sqr_0.propagate(buffers[i].fc_0_out, buffers[i].ac_sqr_0_out);
+            ac_0.propagate(buffers[i].fc_0_out, buffers[i].ac_0_out);
+            std::memcpy(buffers[i].ac_sqr_0_out + FC_0_OUTPUTS, buffers[i].ac_0_out,
+                        FC_0_OUTPUTS * sizeof(typename decltype(ac_0)::OutputType));
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+            fc_1.propagate(buffers[i].ac_sqr_0_out, buffers[i].fc_1_out);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ac_1.propagate(buffers[i].fc_1_out, buffers[i].ac_1_out);
+            fc_2.propagate(buffers[i].ac_1_out, buffers[i].fc_2_out);
+            output[i] = output_value(buffers[i]);
+        }
     }
 
     std::size_t get_content_hash() const {
@@ -57,6 +57,32 @@ using IndexType        = std::uint32_t;
 // Version of the evaluation file
 constexpr std::uint32_t Version = 0x7AF32F20u;
 
+// Version of an evaluation file that stores the threat weights of the feature
+// transformer as raw 8-bit integers, in a block of their own, instead of LEB128
+// compressing them as 16-bit integers together with the piece-square weights
+constexpr std::uint32_t VersionInt8Threats = 0x7AF32F21u;
+
+// Version of an evaluation file that stores the parameters as they are laid out
+// in memory, after the permutations and scrambling done on load. Such a file is
+// tied to the SIMD code paths of the binary that wrote it, is page aligned and
+// is loaded with a single copy from a mapping of the file instead of being
+// decoded. It is not used in place: the parameters are members of the network.
+// The header also stores the hash of the parameters, so that it is not recomputed.
+constexpr std::uint32_t VersionNative = 0x7AF32F22u;
+
+// Alignment of the parameters in a file of version VersionNative
+constexpr std::size_t NativeAlignment = 4096;
+
+// Version of an evaluation file that stores the parameters in the layout of
+// VersionNative, compressed in chunks that are decompressed in parallel straight
+// into the network. A chunk is either stored raw or as its 16-bit words, zigzag
+// and LEB128 coded, so that most weights take a single byte.
+constexpr std::uint32_t VersionNativeCompressed = 0x7AF32F23u;
+
+// Size of the chunks of a file of version VersionNativeCompressed, the last chunk
+// of the feature transformer and of the layers can be smaller
+constexpr std::size_t CompressedChunkSize = 1 << 20;
+
 // Constant used in evaluation value calculation
 constexpr int OutputScale     = 16;
 constexpr int WeightScaleBits = 6;
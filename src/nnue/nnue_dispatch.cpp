@@ -0,0 +1,154 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Picks the table of NNUE kernels of a dispatch=yes binary, see nnue_kernels.h
+
+#include "nnue_kernels.h"
+
+#if defined(USE_NNUE_DISPATCH)
+
+    #include <cstdlib>
+    #include <iostream>
+
+namespace Stockfish::Eval::NNUE {
+
+namespace {
+
+[[maybe_unused]] bool has_ssse3() { return __builtin_cpu_supports("ssse3"); }
+
+[[maybe_unused]] bool has_sse41_popcnt() {
+    return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+}
+
+[[maybe_unused]] bool has_avx2() {
+    return has_sse41_popcnt() && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+}
+
+// pext is microcoded on AMD Zen 1 and Zen 2, as in get_native_properties.sh
+[[maybe_unused]] bool has_bmi2() {
+    return has_avx2() && __builtin_cpu_supports("bmi2") && !__builtin_cpu_is("znver1")
+        && !__builtin_cpu_is("znver2");
+}
+
+[[maybe_unused]] bool has_avxvnni() { return has_bmi2() && __builtin_cpu_supports("avxvnni"); }
+
+[[maybe_unused]] bool has_avx512() {
+    return has_avx2() && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("avx512f")
+        && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")
+        && __builtin_cpu_supports("avx512vl");
+}
+
+[[maybe_unused]] bool has_vnni512() { return has_avx512() && __builtin_cpu_supports("avx512vnni"); }
+
+[[maybe_unused]] bool has_avx512icl() {
+    return has_vnni512() && __builtin_cpu_supports("avx512cd")
+        && __builtin_cpu_supports("avx512ifma") && __builtin_cpu_supports("avx512vbmi")
+        && __builtin_cpu_supports("avx512vbmi2") && __builtin_cpu_supports("avx512vpopcntdq")
+        && __builtin_cpu_supports("avx512bitalg") && __builtin_cpu_supports("vpclmulqdq")
+        && __builtin_cpu_supports("gfni") && __builtin_cpu_supports("vaes");
+}
+
+struct Variant {
+    const Kernels* kernels;
+    bool (*supported)();
+};
+
+}  // namespace
+
+// The tables built from nnue_kernels.cpp, one for each ARCH of dispatch_archs
+    #define DISPATCH_KERNELS(name) extern const Kernels Kernels_##name;
+
+    #if defined(DISPATCH_x86_64_avx512icl)
+DISPATCH_KERNELS(x86_64_avx512icl)
+    #endif
+    #if defined(DISPATCH_x86_64_vnni512)
+DISPATCH_KERNELS(x86_64_vnni512)
+    #endif
+    #if defined(DISPATCH_x86_64_avx512)
+DISPATCH_KERNELS(x86_64_avx512)
+    #endif
+    #if defined(DISPATCH_x86_64_avxvnni)
+DISPATCH_KERNELS(x86_64_avxvnni)
+    #endif
+    #if defined(DISPATCH_x86_64_bmi2)
+DISPATCH_KERNELS(x86_64_bmi2)
+    #endif
+    #if defined(DISPATCH_x86_64_avx2)
+DISPATCH_KERNELS(x86_64_avx2)
+    #endif
+    #if defined(DISPATCH_x86_64_sse41_popcnt)
+DISPATCH_KERNELS(x86_64_sse41_popcnt)
+    #endif
+    #if defined(DISPATCH_x86_64_ssse3)
+DISPATCH_KERNELS(x86_64_ssse3)
+    #endif
+
+namespace {
+
+// From the most to the least specific
+const Variant Variants[] = {
+    #if defined(DISPATCH_x86_64_avx512icl)
+  {&Kernels_x86_64_avx512icl, has_avx512icl},
+    #endif
+    #if defined(DISPATCH_x86_64_vnni512)
+  {&Kernels_x86_64_vnni512, has_vnni512},
+    #endif
+    #if defined(DISPATCH_x86_64_avx512)
+  {&Kernels_x86_64_avx512, has_avx512},
+    #endif
+    #if defined(DISPATCH_x86_64_avxvnni)
+  {&Kernels_x86_64_avxvnni, has_avxvnni},
+    #endif
+    #if defined(DISPATCH_x86_64_bmi2)
+  {&Kernels_x86_64_bmi2, has_bmi2},
+    #endif
+    #if defined(DISPATCH_x86_64_avx2)
+  {&Kernels_x86_64_avx2, has_avx2},
+    #endif
+    #if defined(DISPATCH_x86_64_sse41_popcnt)
+  {&Kernels_x86_64_sse41_popcnt, has_sse41_popcnt},
+    #endif
+    #if defined(DISPATCH_x86_64_ssse3)
+  {&Kernels_x86_64_ssse3, has_ssse3},
+    #endif
+};
+
+}  // namespace
+
+const Kernels* kernels = nullptr;
+
+void select_kernels() {
+
+    __builtin_cpu_init();
+
+    for (const Variant& v : Variants)
+        if (v.supported())
+        {
+            kernels = v.kernels;
+            return;
+        }
+
+    // The rest of the engine is built for the least specific ARCH, so this
+    // CPU could not have run it either.
+    std::cerr << "This CPU supports none of the NNUE kernels of this binary" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+}  // namespace Stockfish::Eval::NNUE
+
+#endif  // #if defined(USE_NNUE_DISPATCH)
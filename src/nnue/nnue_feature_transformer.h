@@ -32,6 +32,7 @@
 #include "nnue_accumulator.h"
 #include "nnue_architecture.h"
 #include "nnue_common.h"
+#include "nnue_kernels.h"
 #include "simd.h"
 
 namespace Stockfish::Eval::NNUE {
@@ -103,7 +104,10 @@ class FeatureTransformer {
     // be permuted so that calling packus on adjacent vectors of 16-bit
     // integers loaded from the data results in the pre-permutation order
     static constexpr auto PackusEpi16Order = []() -> std::array<std::size_t, 8> {
-#if defined(USE_AVX512)
+#if defined(USE_NNUE_DISPATCH)
+        // The kernels picked at startup put the packed result back in order
+        return {0, 1, 2, 3, 4, 5, 6, 7};
+#elif defined(USE_AVX512)
         // _mm512_packus_epi16 after permutation:
         // |   0   |   2   |   4   |   6   | // Vector 0
         // |   1   |   3   |   5   |   7   | // Vector 1
@@ -128,6 +132,15 @@ class FeatureTransformer {
              ^ (OutputDimensions * 2);
     }
 
+    // Hash value of the layout of the parameters in memory, which depends on the
+    // permutation of the blocks, see VersionNative
+    static constexpr std::uint32_t get_layout_hash() {
+        std::uint32_t hashValue = 0x5D1F0C3Bu ^ std::uint32_t(sizeof(FeatureTransformer));
+        for (std::size_t i : PackusEpi16Order)
+            hashValue = hashValue * 31 + std::uint32_t(i);
+        return hashValue;
+    }
+
     void permute_weights() {
         permute<16>(biases, PackusEpi16Order);
         permute<16>(weights, PackusEpi16Order);
@@ -159,10 +172,23 @@ class FeatureTransformer {
     // Read network parameters
     // TODO: This is ugly. Currently LEB128 on the entire L1 necessitates
     // reading the weights into a combined array, and then splitting.
-    bool read_parameters(std::istream& stream) {
+    // With int8Threats (VersionInt8Threats), every block is read on its own and
+    // the threat weights are stored raw, one byte each.
+    bool read_parameters(std::istream& stream, bool int8Threats = false) {
+        if (int8Threats && !UseThreats)
+            return false;
+
         read_leb_128<BiasType>(stream, biases);
 
-        if (UseThreats)
+        if (int8Threats)
+        {
+            read_little_endian<ThreatWeightType>(stream, threatWeights.data(),
+                                                 threatWeights.size());
+            read_leb_128<WeightType>(stream, weights);
+            read_leb_128<PSQTWeightType>(stream, threatPsqtWeights);
+            read_leb_128<PSQTWeightType>(stream, psqtWeights);
+        }
+        else if (UseThreats)
         {
             auto combinedWeights =
               std::make_unique<std::array<WeightType, HalfDimensions * TotalInputDimensions>>();
@@ -171,6 +197,12 @@ class FeatureTransformer {
 
             read_leb_128<WeightType>(stream, *combinedWeights);
 
+            // The threat weights are narrowed, which must not lose any value
+            if (std::any_of(combinedWeights->begin(),
+                            combinedWeights->begin() + ThreatInputDimensions * HalfDimensions,
+                            [](WeightType w) { return w != ThreatWeightType(w); }))
+                return false;
+
             std::copy(combinedWeights->begin(),
                       combinedWeights->begin() + ThreatInputDimensions * HalfDimensions,
                       std::begin(threatWeights));
@@ -206,7 +238,10 @@ class FeatureTransformer {
     }
 
     // Write network parameters
-    bool write_parameters(std::ostream& stream) const {
+    bool write_parameters(std::ostream& stream, bool int8Threats = false) const {
+        if (int8Threats && !UseThreats)
+            return false;
+
         std::unique_ptr<FeatureTransformer> copy = std::make_unique<FeatureTransformer>(*this);
 
         copy->unpermute_weights();
@@ -216,7 +251,15 @@ class FeatureTransformer {
 
         write_leb_128<BiasType>(stream, copy->biases);
 
-        if (UseThreats)
+        if (int8Threats)
+        {
+            write_little_endian<ThreatWeightType>(stream, copy->threatWeights.data(),
+                                                  copy->threatWeights.size());
+            write_leb_128<WeightType>(stream, copy->weights);
+            write_leb_128<PSQTWeightType>(stream, copy->threatPsqtWeights);
+            write_leb_128<PSQTWeightType>(stream, copy->psqtWeights);
+        }
+        else if (UseThreats)
         {
             auto combinedWeights =
               std::make_unique<std::array<WeightType, HalfDimensions * TotalInputDimensions>>();
@@ -255,8 +298,13 @@ class FeatureTransformer {
     std::size_t get_content_hash() const {
         std::size_t h = 0;
         hash_combine(h, get_raw_data_hash(biases));
-        hash_combine(h, get_raw_data_hash(weights));
+        hash_combine(h, get_raw_data_hash_parallel(weights));
         hash_combine(h, get_raw_data_hash(psqtWeights));
+        if constexpr (UseThreats)
+        {
+            hash_combine(h, get_raw_data_hash_parallel(threatWeights));
+            hash_combine(h, get_raw_data_hash(threatPsqtWeights));
+        }
         hash_combine(h, get_hash_value());
         return h;
     }
@@ -268,10 +316,20 @@ class FeatureTransformer {
                            OutputType*                               output,
                            int                                       bucket) const {
 
-        using namespace SIMD;
         accumulatorStack.evaluate(pos, *this, *cache);
-        const auto& accumulatorState       = accumulatorStack.latest<PSQFeatureSet>();
-        const auto& threatAccumulatorState = accumulatorStack.latest<ThreatFeatureSet>();
+
+        return transform(pos, accumulatorStack.latest<PSQFeatureSet>(),
+                         accumulatorStack.latest<ThreatFeatureSet>(), output, bucket);
+    }
+
+    // Convert the features of already computed accumulators
+    std::int32_t transform(const Position&                           pos,
+                           const AccumulatorState<PSQFeatureSet>&    accumulatorState,
+                           const AccumulatorState<ThreatFeatureSet>& threatAccumulatorState,
+                           OutputType*                               output,
+                           int                                       bucket) const {
+
+        using namespace SIMD;
 
         const Color perspectives[2]  = {pos.side_to_move(), ~pos.side_to_move()};
         const auto& psqtAccumulation = (accumulatorState.acc<HalfDimensions>()).psqtAccumulation;
@@ -297,7 +355,13 @@ class FeatureTransformer {
         {
             const IndexType offset = (HalfDimensions / 2) * p;
 
-#if defined(VECTOR)
+#if defined(USE_NNUE_DISPATCH)
+
+            kernels->transform(accumulation[perspectives[p]],
+                               UseThreats ? threatAccumulation[perspectives[p]] : nullptr,
+                               output + offset, HalfDimensions);
+
+#elif defined(VECTOR)
 
             constexpr IndexType OutputChunkSize = MaxChunkSize;
             static_assert((HalfDimensions / 2) % OutputChunkSize == 0);
@@ -0,0 +1,427 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// NNUE kernels of a dispatch=yes binary. The Makefile builds this file once for
+// each ARCH of dispatch_archs, with the table named NNUE_KERNELS_NAME. Everything
+// else is in an anonymous namespace and only system headers are included, so
+// no code built here for one ISA can be shared with the rest of the binary.
+
+#include "nnue_kernels.h"
+
+#if defined(USE_NNUE_DISPATCH)
+
+    #include <cstddef>
+    #include <cstdint>
+    #include <immintrin.h>
+
+namespace Stockfish::Eval::NNUE {
+
+namespace {
+
+    #if defined(USE_AVX512)
+
+using vec_t = __m512i;
+
+constexpr std::uint32_t TileRegs = 16;
+
+inline vec_t vec_load(const void* p) { return _mm512_loadu_si512(p); }
+inline void  vec_store(void* p, vec_t v) { _mm512_storeu_si512(p, v); }
+inline vec_t vec_load_i8(const std::int8_t* p) {
+    return _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+}
+inline vec_t vec_zero() { return _mm512_setzero_si512(); }
+inline vec_t vec_set_16(int a) { return _mm512_set1_epi16(a); }
+inline vec_t vec_set_32(int a) { return _mm512_set1_epi32(a); }
+inline vec_t vec_add_16(vec_t a, vec_t b) { return _mm512_add_epi16(a, b); }
+inline vec_t vec_sub_16(vec_t a, vec_t b) { return _mm512_sub_epi16(a, b); }
+inline vec_t vec_min_16(vec_t a, vec_t b) { return _mm512_min_epi16(a, b); }
+inline vec_t vec_max_16(vec_t a, vec_t b) { return _mm512_max_epi16(a, b); }
+inline vec_t vec_slli_16(vec_t a) { return _mm512_slli_epi16(a, 7); }
+inline vec_t vec_mulhi_16(vec_t a, vec_t b) { return _mm512_mulhi_epi16(a, b); }
+inline vec_t vec_add_32(vec_t a, vec_t b) { return _mm512_add_epi32(a, b); }
+
+// packus works within 128 bit lanes, the 64 bit halves are put back in order.
+// The zero-masking form avoids a false uninitialized warning of GCC 12.
+inline vec_t vec_packus_16(vec_t a, vec_t b) {
+    return _mm512_maskz_permutexvar_epi64(0xFF, _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7),
+                                          _mm512_packus_epi16(a, b));
+}
+
+inline void vec_add_dpbusd_32(vec_t& acc, vec_t a, vec_t b) {
+        #if defined(USE_VNNI)
+    acc = _mm512_dpbusd_epi32(acc, a, b);
+        #else
+    const vec_t product = _mm512_madd_epi16(_mm512_maddubs_epi16(a, b), _mm512_set1_epi16(1));
+    acc                 = _mm512_add_epi32(acc, product);
+        #endif
+}
+
+    #elif defined(USE_AVX2)
+
+using vec_t = __m256i;
+
+constexpr std::uint32_t TileRegs = 16;
+
+inline vec_t vec_load(const void* p) { return _mm256_loadu_si256(static_cast<const vec_t*>(p)); }
+inline void  vec_store(void* p, vec_t v) { _mm256_storeu_si256(static_cast<vec_t*>(p), v); }
+inline vec_t vec_load_i8(const std::int8_t* p) {
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+inline vec_t vec_zero() { return _mm256_setzero_si256(); }
+inline vec_t vec_set_16(int a) { return _mm256_set1_epi16(a); }
+inline vec_t vec_set_32(int a) { return _mm256_set1_epi32(a); }
+inline vec_t vec_add_16(vec_t a, vec_t b) { return _mm256_add_epi16(a, b); }
+inline vec_t vec_sub_16(vec_t a, vec_t b) { return _mm256_sub_epi16(a, b); }
+inline vec_t vec_min_16(vec_t a, vec_t b) { return _mm256_min_epi16(a, b); }
+inline vec_t vec_max_16(vec_t a, vec_t b) { return _mm256_max_epi16(a, b); }
+inline vec_t vec_slli_16(vec_t a) { return _mm256_slli_epi16(a, 7); }
+inline vec_t vec_mulhi_16(vec_t a, vec_t b) { return _mm256_mulhi_epi16(a, b); }
+inline vec_t vec_add_32(vec_t a, vec_t b) { return _mm256_add_epi32(a, b); }
+
+// packus works within 128 bit lanes, the 64 bit halves are put back in order
+inline vec_t vec_packus_16(vec_t a, vec_t b) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+}
+
+inline void vec_add_dpbusd_32(vec_t& acc, vec_t a, vec_t b) {
+        #if defined(USE_VNNI)
+    acc = _mm256_dpbusd_epi32(acc, a, b);
+        #else
+    const vec_t product = _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), _mm256_set1_epi16(1));
+    acc                 = _mm256_add_epi32(acc, product);
+        #endif
+}
+
+inline unsigned vec_nnz(vec_t a) {
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, _mm256_setzero_si256())));
+}
+
+    #else
+
+using vec_t = __m128i;
+
+constexpr std::uint32_t TileRegs = 8;
+
+inline vec_t vec_load(const void* p) { return _mm_loadu_si128(static_cast<const vec_t*>(p)); }
+inline void  vec_store(void* p, vec_t v) { _mm_storeu_si128(static_cast<vec_t*>(p), v); }
+inline vec_t vec_load_i8(const std::int8_t* p) {
+    const vec_t v = _mm_loadl_epi64(reinterpret_cast<const vec_t*>(p));
+        #if defined(USE_SSE41)
+    return _mm_cvtepi8_epi16(v);
+        #else
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        #endif
+}
+inline vec_t vec_zero() { return _mm_setzero_si128(); }
+inline vec_t vec_set_16(int a) { return _mm_set1_epi16(a); }
+inline vec_t vec_set_32(int a) { return _mm_set1_epi32(a); }
+inline vec_t vec_add_16(vec_t a, vec_t b) { return _mm_add_epi16(a, b); }
+inline vec_t vec_sub_16(vec_t a, vec_t b) { return _mm_sub_epi16(a, b); }
+inline vec_t vec_min_16(vec_t a, vec_t b) { return _mm_min_epi16(a, b); }
+inline vec_t vec_max_16(vec_t a, vec_t b) { return _mm_max_epi16(a, b); }
+inline vec_t vec_slli_16(vec_t a) { return _mm_slli_epi16(a, 7); }
+inline vec_t vec_mulhi_16(vec_t a, vec_t b) { return _mm_mulhi_epi16(a, b); }
+inline vec_t vec_add_32(vec_t a, vec_t b) { return _mm_add_epi32(a, b); }
+inline vec_t vec_packus_16(vec_t a, vec_t b) { return _mm_packus_epi16(a, b); }
+
+inline void vec_add_dpbusd_32(vec_t& acc, vec_t a, vec_t b) {
+    const vec_t product = _mm_madd_epi16(_mm_maddubs_epi16(a, b), _mm_set1_epi16(1));
+    acc                 = _mm_add_epi32(acc, product);
+}
+
+inline unsigned vec_nnz(vec_t a) {
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, _mm_setzero_si128())));
+}
+
+    #endif
+
+constexpr std::uint32_t Lanes16 = sizeof(vec_t) / 2;
+constexpr std::uint32_t Lanes32 = sizeof(vec_t) / 4;
+
+inline vec_t load_row(const std::int16_t* p) { return vec_load(p); }
+inline vec_t load_row(const std::int8_t* p) { return vec_load_i8(p); }
+
+// Updates the accumulator from element j on, in tiles of Regs registers, then
+// of half as many for what is left.
+template<std::uint32_t Regs, typename RowType>
+void update_tiles(const std::int16_t*   in,
+                  std::int16_t*         out,
+                  std::uint32_t         dims,
+                  std::uint32_t         j,
+                  const RowType* const* rows,
+                  std::uint32_t         added,
+                  std::uint32_t         removed) {
+
+    for (; j + Regs * Lanes16 <= dims; j += Regs * Lanes16)
+    {
+        vec_t acc[Regs];
+
+        for (std::uint32_t k = 0; k < Regs; ++k)
+            acc[k] = vec_load(in + j + k * Lanes16);
+
+        for (std::uint32_t i = 0; i < added; ++i)
+            for (std::uint32_t k = 0; k < Regs; ++k)
+                acc[k] = vec_add_16(acc[k], load_row(rows[i] + j + k * Lanes16));
+
+        for (std::uint32_t i = added; i < added + removed; ++i)
+            for (std::uint32_t k = 0; k < Regs; ++k)
+                acc[k] = vec_sub_16(acc[k], load_row(rows[i] + j + k * Lanes16));
+
+        for (std::uint32_t k = 0; k < Regs; ++k)
+            vec_store(out + j + k * Lanes16, acc[k]);
+    }
+
+    if constexpr (Regs > 1)
+        update_tiles<Regs / 2>(in, out, dims, j, rows, added, removed);
+}
+
+void update_i16(const std::int16_t*        in,
+                std::int16_t*              out,
+                std::uint32_t              dims,
+                const std::int16_t* const* rows,
+                std::uint32_t              added,
+                std::uint32_t              removed) {
+    update_tiles<TileRegs>(in, out, dims, 0, rows, added, removed);
+}
+
+void update_i8(const std::int16_t*       in,
+               std::int16_t*             out,
+               std::uint32_t             dims,
+               const std::int8_t* const* rows,
+               std::uint32_t             added,
+               std::uint32_t             removed) {
+    update_tiles<TileRegs>(in, out, dims, 0, rows, added, removed);
+}
+
+// See FeatureTransformer::transform() for the clipping through packus and the
+// shift before mulhi.
+template<bool Threats>
+void transform_half(const std::int16_t* acc,
+                    const std::int16_t* threatAcc,
+                    std::uint8_t*       output,
+                    std::uint32_t       halfDims) {
+
+    const vec_t Zero = vec_zero();
+    const vec_t One  = vec_set_16(Threats ? 255 : 127 * 2);
+
+    const std::uint32_t half = halfDims / 2;
+
+    for (std::uint32_t j = 0; j < half; j += 2 * Lanes16)
+    {
+        vec_t acc0a = vec_load(acc + j);
+        vec_t acc0b = vec_load(acc + j + Lanes16);
+        vec_t acc1a = vec_load(acc + half + j);
+        vec_t acc1b = vec_load(acc + half + j + Lanes16);
+
+        if constexpr (Threats)
+        {
+            acc0a = vec_add_16(acc0a, vec_load(threatAcc + j));
+            acc0b = vec_add_16(acc0b, vec_load(threatAcc + j + Lanes16));
+            acc1a = vec_add_16(acc1a, vec_load(threatAcc + half + j));
+            acc1b = vec_add_16(acc1b, vec_load(threatAcc + half + j + Lanes16));
+        }
+
+        const vec_t sum0a = vec_slli_16(vec_max_16(vec_min_16(acc0a, One), Zero));
+        const vec_t sum0b = vec_slli_16(vec_max_16(vec_min_16(acc0b, One), Zero));
+        const vec_t sum1a = vec_min_16(acc1a, One);
+        const vec_t sum1b = vec_min_16(acc1b, One);
+
+        const vec_t pa = vec_mulhi_16(sum0a, sum1a);
+        const vec_t pb = vec_mulhi_16(sum0b, sum1b);
+
+        vec_store(output + j, vec_packus_16(pa, pb));
+    }
+}
+
+void transform(const std::int16_t* acc,
+               const std::int16_t* threatAcc,
+               std::uint8_t*       output,
+               std::uint32_t       halfDims) {
+    if (threatAcc)
+        transform_half<true>(acc, threatAcc, output, halfDims);
+    else
+        transform_half<false>(acc, threatAcc, output, halfDims);
+}
+
+    #if !defined(USE_AVX512)
+alignas(64) constexpr struct OffsetIndices {
+
+    std::uint16_t offset_indices[256][8];
+
+    constexpr OffsetIndices() :
+        offset_indices() {
+        for (int i = 0; i < 256; ++i)
+        {
+            int k = 0;
+            for (int b = 0; b < 8; ++b)
+                if (i & (1 << b))
+                    offset_indices[i][k++] = b;
+            while (k < 8)
+                offset_indices[i][k++] = 0;
+        }
+    }
+
+} Lookup;
+    #endif
+
+// Writes the indices of the nonzero inputs, in ascending order, and returns their
+// count. Whole vectors are stored, so out must have room for inputs + 32 indices.
+std::uint32_t find_nnz(const std::int32_t* input, std::uint32_t inputs, std::uint16_t* out) {
+
+    std::uint32_t count = 0;
+
+    #if defined(USE_AVX512ICL)
+
+    const __m512i increment = _mm512_set1_epi16(32);
+    __m512i       base      = _mm512_set_epi16(  // Same permute order as _mm512_packus_epi32()
+      31, 30, 29, 28, 15, 14, 13, 12, 27, 26, 25, 24, 11, 10, 9, 8, 23, 22, 21, 20, 7, 6, 5, 4, 19,
+      18, 17, 16, 3, 2, 1, 0);
+
+    for (std::uint32_t i = 0; i < inputs; i += 32)
+    {
+        const __m512i inputV0 = _mm512_loadu_si512(input + i);
+        const __m512i inputV1 = _mm512_loadu_si512(input + i + 16);
+
+        const __m512i   inputV01 = _mm512_packus_epi32(inputV0, inputV1);
+        const __mmask32 nnzMask  = _mm512_test_epi16_mask(inputV01, inputV01);
+
+        // Avoid _mm512_mask_compressstoreu_epi16() as it's 256 uOps on Zen4
+        _mm512_storeu_si512(out + count, _mm512_maskz_compress_epi16(nnzMask, base));
+        count += __builtin_popcount(nnzMask);
+        base = _mm512_add_epi16(base, increment);
+    }
+
+    #elif defined(USE_AVX512)
+
+    const __m512i increment = _mm512_set1_epi32(16);
+    __m512i       base = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    for (std::uint32_t i = 0; i < inputs; i += 16)
+    {
+        const __m512i   inputV  = _mm512_loadu_si512(input + i);
+        const __mmask16 nnzMask = _mm512_test_epi32_mask(inputV, inputV);
+        _mm512_mask_cvtepi32_storeu_epi16(out + count, 0xFFFF,
+                                          _mm512_maskz_compress_epi32(nnzMask, base));
+        count += __builtin_popcount(nnzMask);
+        base = _mm512_add_epi32(base, increment);
+    }
+
+    #else
+
+    const __m128i increment = _mm_set1_epi16(8);
+    __m128i       base      = _mm_setzero_si128();
+
+    for (std::uint32_t i = 0; i < inputs; i += 8)
+    {
+        unsigned nnz = 0;
+        for (std::uint32_t j = 0; j < 8; j += Lanes32)
+            nnz |= vec_nnz(vec_load(input + i + j)) << j;
+
+        const __m128i offsets =
+          _mm_load_si128(reinterpret_cast<const __m128i*>(&Lookup.offset_indices[nnz]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + count), _mm_add_epi16(base, offsets));
+        count += __builtin_popcount(nnz);
+        base = _mm_add_epi16(base, increment);
+    }
+
+    #endif
+
+    return count;
+}
+
+// Only the inputs of the nonzero 32 bit blocks are multiplied, see
+// AffineTransformSparseInput::propagate().
+void sparse_affine_16(const std::uint8_t* input,
+                      const std::int8_t*  weights,
+                      const std::int32_t* biases,
+                      std::int32_t*       output,
+                      std::uint32_t       inputDims) {
+
+    constexpr std::uint32_t OutputDimensions = 16;
+    constexpr std::uint32_t ChunkSize        = 4;
+    constexpr std::uint32_t NumAccums        = OutputDimensions / Lanes32;
+    // High-latency dot product instructions get 3 separate dependency chains
+    #if defined(USE_VNNI)
+    constexpr std::uint32_t NumRegs = 3 * NumAccums;
+    #else
+    constexpr std::uint32_t NumRegs = NumAccums;
+    #endif
+
+    alignas(64) std::uint16_t nnz[KernelMaxSparseInputDimensions / ChunkSize + 32];
+
+    const auto          input32 = reinterpret_cast<const std::int32_t*>(input);
+    const std::uint32_t count   = find_nnz(input32, inputDims / ChunkSize, nnz);
+
+    vec_t acc[NumRegs];
+    for (std::uint32_t k = 0; k < NumAccums; ++k)
+        acc[k] = vec_load(biases + k * Lanes32);
+    for (std::uint32_t k = NumAccums; k < NumRegs; ++k)
+        acc[k] = vec_zero();
+
+    const std::uint16_t* start = nnz;
+    const std::uint16_t* end   = nnz + count;
+
+    auto column = [&](std::ptrdiff_t i, std::uint32_t k) {
+        return vec_load(weights + i * OutputDimensions * ChunkSize + k * sizeof(vec_t));
+    };
+
+    #if defined(USE_VNNI)
+    while (start + 2 < end)
+    {
+        const std::ptrdiff_t i0  = *start++;
+        const std::ptrdiff_t i1  = *start++;
+        const std::ptrdiff_t i2  = *start++;
+        const vec_t          in0 = vec_set_32(input32[i0]);
+        const vec_t          in1 = vec_set_32(input32[i1]);
+        const vec_t          in2 = vec_set_32(input32[i2]);
+        for (std::uint32_t k = 0; k < NumAccums; ++k)
+        {
+            vec_add_dpbusd_32(acc[k], in0, column(i0, k));
+            vec_add_dpbusd_32(acc[k + NumAccums], in1, column(i1, k));
+            vec_add_dpbusd_32(acc[k + 2 * NumAccums], in2, column(i2, k));
+        }
+    }
+    for (std::uint32_t k = 0; k < NumAccums; ++k)
+        acc[k] = vec_add_32(vec_add_32(acc[k], acc[k + NumAccums]), acc[k + 2 * NumAccums]);
+    #endif
+
+    while (start < end)
+    {
+        const std::ptrdiff_t i  = *start++;
+        const vec_t          in = vec_set_32(input32[i]);
+        for (std::uint32_t k = 0; k < NumAccums; ++k)
+            vec_add_dpbusd_32(acc[k], in, column(i, k));
+    }
+
+    for (std::uint32_t k = 0; k < NumAccums; ++k)
+        vec_store(output + k * Lanes32, acc[k]);
+}
+
+}  // namespace
+
+    #define stringify2(x) #x
+    #define stringify(x) stringify2(x)
+
+extern const Kernels NNUE_KERNELS_NAME;
+
+const Kernels NNUE_KERNELS_NAME = {stringify(ARCH), update_i16, update_i8, transform,
+                                   sparse_affine_16};
+
+}  // namespace Stockfish::Eval::NNUE
+
+#endif  // #if defined(USE_NNUE_DISPATCH)
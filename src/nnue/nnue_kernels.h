@@ -0,0 +1,88 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Table of the NNUE kernels of a binary built with dispatch=yes. The engine is
+// built for the most portable ARCH of dispatch_archs, nnue_kernels.cpp for each
+// of them, and the most specific table the CPU supports is picked at startup.
+// This header is also included by nnue_kernels.cpp, so it must not include any
+// engine header: an inline function emitted there could otherwise be kept by
+// the linker in place of the copy built for the baseline.
+
+#ifndef NNUE_KERNELS_H_INCLUDED
+#define NNUE_KERNELS_H_INCLUDED
+
+#if defined(USE_NNUE_DISPATCH)
+
+    #include <cstdint>
+
+    #if !defined(USE_SSSE3)
+        #error "The NNUE kernels of a dispatch build need at least SSSE3"
+    #endif
+
+namespace Stockfish::Eval::NNUE {
+
+// Largest input of the sparse affine transform, the first layer of the network
+constexpr std::uint32_t KernelMaxSparseInputDimensions = 4096;
+
+struct Kernels {
+    const char* arch;
+
+    // out = in + the first `added` rows - the next `removed` rows, over `dims`
+    // elements. The weights are in their natural order, in and out may alias.
+    void (*update_i16)(const std::int16_t*        in,
+                       std::int16_t*              out,
+                       std::uint32_t              dims,
+                       const std::int16_t* const* rows,
+                       std::uint32_t              added,
+                       std::uint32_t              removed);
+
+    // Same with the 8 bit rows of the threat features, widened to 16 bit
+    void (*update_i8)(const std::int16_t*       in,
+                      std::int16_t*             out,
+                      std::uint32_t             dims,
+                      const std::int8_t* const* rows,
+                      std::uint32_t             added,
+                      std::uint32_t             removed);
+
+    // Pairwise product of the clipped halves of the accumulator of one perspective,
+    // plus the threat accumulator if not null, as in FeatureTransformer::transform().
+    // The weights of the feature transformer are in their natural order.
+    void (*transform)(const std::int16_t* acc,
+                      const std::int16_t* threatAcc,
+                      std::uint8_t*       output,
+                      std::uint32_t       halfDims);
+
+    // AffineTransformSparseInput::propagate() with 16 outputs, the weights
+    // scrambled in chunks of 4 as for SSSE3
+    void (*sparse_affine_16)(const std::uint8_t* input,
+                             const std::int8_t*  weights,
+                             const std::int32_t* biases,
+                             std::int32_t*       output,
+                             std::uint32_t       inputDims);
+};
+
+// Set by select_kernels(), which main() calls before any evaluation
+extern const Kernels* kernels;
+
+void select_kernels();
+
+}  // namespace Stockfish::Eval::NNUE
+
+#endif  // #if defined(USE_NNUE_DISPATCH)
+
+#endif  // #ifndef NNUE_KERNELS_H_INCLUDED
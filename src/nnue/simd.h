@@ -35,6 +35,16 @@
     #include <arm_neon.h>
 #endif
 
+#if defined(USE_SVE)
+    #include <arm_sve.h>
+
+    // The sparse layer keeps arrays of SVE registers, so the vector length
+    // must be fixed at compile time with -msve-vector-bits.
+    #if !defined(__ARM_FEATURE_SVE_BITS) || __ARM_FEATURE_SVE_BITS == 0
+        #error "SVE builds need a fixed vector length, see sve_bits in the Makefile"
+    #endif
+#endif
+
 #include "../types.h"
 #include "nnue_common.h"
 
@@ -349,6 +359,17 @@ dotprod_m128_add_dpbusd_epi32(int32x4_t& acc, int8x16_t a, int8x16_t b) {
 }
 #endif
 
+#if defined(USE_SVE)
+
+typedef svint8_t sve_i8_t __attribute__((arm_sve_vector_bits(__ARM_FEATURE_SVE_BITS)));
+typedef svint32_t sve_i32_t __attribute__((arm_sve_vector_bits(__ARM_FEATURE_SVE_BITS)));
+
+[[maybe_unused]] static void sve_add_dpbusd_epi32(sve_i32_t& acc, sve_i8_t a, sve_i8_t b) {
+
+    acc = svdot_s32(acc, a, b);
+}
+#endif
+
 #if defined(USE_NEON)
 
 [[maybe_unused]] static int neon_m128_reduce_add_epi32(int32x4_t s) {
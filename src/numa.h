@@ -33,6 +33,7 @@
 #include <sstream>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 #include <cstring>
@@ -644,6 +645,110 @@ class NumaConfig {
         return cfg;
     }
 
+    // As from_system, but also reads the physical cores and the processors that
+    // share the cache of the highest level (the L3 slice of a CCX on Zen) from the
+    // kernel sysfs, on Linux only. The cores are ordered by NUMA node, by type on
+    // hybrid processors, the performance cores first, and by cache domain, so
+    // that the first threads get the fastest cores and consecutive ones share
+    // their cache.
+    // https://www.kernel.org/doc/Documentation/ABI/stable/sysfs-devices-system-cpu
+    static NumaConfig from_system_cache_topology() {
+        NumaConfig cfg = from_system();
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+        // The efficiency cores of Intel hybrid processors have a PMU of their own,
+        // the ones of ARM have a lower capacity. This is what the CPUID hybrid leaf
+        // tells, without running a thread on each processor.
+        std::set<CpuIndex> efficiencyCpus;
+        if (auto atomCpus = read_file_to_string("/sys/devices/cpu_atom/cpus"))
+        {
+            remove_whitespace(*atomCpus);
+            for (size_t c : indices_from_shortened_string(*atomCpus))
+                efficiencyCpus.insert(c);
+        }
+        else
+        {
+            std::map<CpuIndex, size_t> capacities;
+            size_t                     highestCapacity = 0;
+            for (auto&& [c, n] : cfg.nodeByCpu)
+                if (auto capacity = read_file_to_string("/sys/devices/system/cpu/cpu"
+                                                        + std::to_string(c) + "/cpu_capacity"))
+                {
+                    remove_whitespace(*capacity);
+                    capacities[c]   = str_to_size_t(*capacity);
+                    highestCapacity = std::max(highestCapacity, capacities[c]);
+                }
+
+            for (auto&& [c, capacity] : capacities)
+                if (capacity < highestCapacity)
+                    efficiencyCpus.insert(c);
+        }
+
+        std::map<std::pair<NumaIndex, std::string>, size_t> domainByCpus;
+        std::set<CpuIndex>                                  assigned;
+
+        for (NumaIndex n = 0; n < cfg.nodes.size(); ++n)
+            for (CpuIndex c : cfg.nodes[n])
+            {
+                if (assigned.count(c))
+                    continue;
+
+                const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(c);
+
+                Core core{n, 0, efficiencyCpus.count(c) == 1, {c}};
+                if (auto siblings = read_file_to_string(path + "/topology/thread_siblings_list"))
+                {
+                    remove_whitespace(*siblings);
+                    for (size_t s : indices_from_shortened_string(*siblings))
+                        if (cfg.nodes[n].count(s))
+                            core.cpus.insert(s);
+                }
+
+                // The cache indices are not ordered by level, the L1 has two
+                std::string sharedCpus = std::to_string(c);
+                size_t      highestLevel = 0;
+                for (size_t i = 0;; ++i)
+                {
+                    const std::string cache = path + "/cache/index" + std::to_string(i);
+                    auto              level = read_file_to_string(cache + "/level");
+                    auto              cpus  = read_file_to_string(cache + "/shared_cpu_list");
+                    if (!level.has_value() || !cpus.has_value())
+                        break;
+
+                    remove_whitespace(*level);
+                    remove_whitespace(*cpus);
+                    if (str_to_size_t(*level) > highestLevel)
+                    {
+                        highestLevel = str_to_size_t(*level);
+                        sharedCpus   = *cpus;
+                    }
+                }
+
+                // A cache shared by several NUMA nodes is split between them
+                auto [it, inserted] =
+                  domainByCpus.emplace(std::make_pair(n, sharedCpus), cfg.cacheDomains.size());
+                if (inserted)
+                    cfg.cacheDomains.emplace_back();
+
+                core.cacheDomain = it->second;
+                cfg.cacheDomains[core.cacheDomain].insert(core.cpus.begin(), core.cpus.end());
+                assigned.insert(core.cpus.begin(), core.cpus.end());
+                cfg.cores.emplace_back(std::move(core));
+            }
+
+        // The domains are numbered in the order of the nodes and the cpus, and the
+        // cores of a domain stay in the order of their cpus
+        std::stable_sort(cfg.cores.begin(), cfg.cores.end(), [](const Core& a, const Core& b) {
+            return std::tie(a.node, a.efficiency, a.cacheDomain)
+                 < std::tie(b.node, b.efficiency, b.cacheDomain);
+        });
+
+#endif
+
+        return cfg;
+    }
+
     // ':'-separated numa nodes
     // ','-separated cpu indices
     // supports "first-last" range syntax for cpu indices
@@ -699,36 +804,45 @@ class NumaConfig {
             if (!isFirstNode)
                 str += ":";
 
-            bool isFirstSet = true;
-            auto rangeStart = cpus.begin();
-            for (auto it = cpus.begin(); it != cpus.end(); ++it)
-            {
-                auto next = std::next(it);
-                if (next == cpus.end() || *next != *it + 1)
-                {
-                    // cpus[i] is at the end of the range (may be of size 1)
-                    if (!isFirstSet)
-                        str += ",";
+            str += cpus_to_string(cpus);
 
-                    const CpuIndex last = *it;
+            isFirstNode = false;
+        }
 
-                    if (it != rangeStart)
-                    {
-                        const CpuIndex first = *rangeStart;
+        return str;
+    }
 
-                        str += std::to_string(first);
-                        str += "-";
-                        str += std::to_string(last);
-                    }
-                    else
-                        str += std::to_string(last);
+    // ','-separated cpu indices, with the "first-last" range syntax
+    static std::string cpus_to_string(const std::set<CpuIndex>& cpus) {
+        std::string str;
+
+        bool isFirstSet = true;
+        auto rangeStart = cpus.begin();
+        for (auto it = cpus.begin(); it != cpus.end(); ++it)
+        {
+            auto next = std::next(it);
+            if (next == cpus.end() || *next != *it + 1)
+            {
+                // cpus[i] is at the end of the range (may be of size 1)
+                if (!isFirstSet)
+                    str += ",";
+
+                const CpuIndex last = *it;
+
+                if (it != rangeStart)
+                {
+                    const CpuIndex first = *rangeStart;
 
-                    rangeStart = next;
-                    isFirstSet = false;
+                    str += std::to_string(first);
+                    str += "-";
+                    str += std::to_string(last);
                 }
-            }
+                else
+                    str += std::to_string(last);
 
-            isFirstNode = false;
+                rangeStart = next;
+                isFirstSet = false;
+            }
         }
 
         return str;
@@ -813,10 +927,88 @@ class NumaConfig {
         return ns;
     }
 
+    // Gives each thread a core in the order of the cores, so that the threads fill
+    // a cache domain before the next one, and only then the second SMT siblings
+    // of the cores, and so on. Empty without the cores.
+    std::vector<size_t> distribute_threads_among_cores(CpuIndex numThreads) const {
+        std::vector<size_t> cs;
+
+        size_t maxSiblings = 0;
+        for (auto&& core : cores)
+            maxSiblings = std::max(maxSiblings, core.cpus.size());
+
+        for (size_t round = 0; !cores.empty() && cs.size() < numThreads; ++round)
+            for (size_t i = 0; i < cores.size() && cs.size() < numThreads; ++i)
+                if (cores[i].cpus.size() > round % maxSiblings)
+                    cs.emplace_back(i);
+
+        return cs;
+    }
+
     NumaReplicatedAccessToken bind_current_thread_to_numa_node(NumaIndex n) const {
         if (n >= nodes.size() || nodes[n].size() == 0)
             std::exit(EXIT_FAILURE);
 
+        bind_current_thread_to_cpus(nodes[n]);
+
+        return NumaReplicatedAccessToken(n);
+    }
+
+    // Binds to the SMT siblings of the core, the thread uses the replicas of the
+    // NUMA node of the core
+    NumaReplicatedAccessToken bind_current_thread_to_core(size_t i) const {
+        if (i >= cores.size())
+            std::exit(EXIT_FAILURE);
+
+        bind_current_thread_to_cpus(cores[i].cpus);
+
+        return NumaReplicatedAccessToken(cores[i].node);
+    }
+
+    template<typename FuncT>
+    void execute_on_numa_node(NumaIndex n, FuncT&& f) const {
+        std::thread th([this, &f, n]() {
+            bind_current_thread_to_numa_node(n);
+            std::forward<FuncT>(f)();
+        });
+
+        th.join();
+    }
+
+    std::vector<std::set<CpuIndex>> nodes;
+    std::map<CpuIndex, NumaIndex>   nodeByCpu;
+
+    // The physical cores and the processors sharing the last level cache, only
+    // known with from_system_cache_topology()
+    struct Core {
+        NumaIndex          node;
+        size_t             cacheDomain;  // Index in cacheDomains
+        bool               efficiency;   // An E-core of a hybrid processor
+        std::set<CpuIndex> cpus;         // The SMT siblings
+    };
+    std::vector<Core>               cores;
+    std::vector<std::set<CpuIndex>> cacheDomains;
+
+    size_t num_efficiency_cores() const {
+        return std::count_if(cores.begin(), cores.end(),
+                             [](const Core& core) { return core.efficiency; });
+    }
+    size_t num_performance_cores() const { return cores.size() - num_efficiency_cores(); }
+
+   private:
+    CpuIndex highestCpuIndex;
+
+    bool customAffinity;
+
+    static NumaConfig empty() { return NumaConfig(EmptyNodeTag{}); }
+
+    struct EmptyNodeTag {};
+
+    NumaConfig(EmptyNodeTag) :
+        highestCpuIndex(0),
+        customAffinity(false) {}
+
+    void bind_current_thread_to_cpus(const std::set<CpuIndex>& cpus) const {
 #if defined(__linux__) && !defined(__ANDROID__)
 
         cpu_set_t* mask = CPU_ALLOC(highestCpuIndex + 1);
@@ -827,7 +1019,7 @@ class NumaConfig {
 
         CPU_ZERO_S(masksize, mask);
 
-        for (CpuIndex c : nodes[n])
+        for (CpuIndex c : cpus)
             CPU_SET_S(c, masksize, mask);
 
         const int status = sched_setaffinity(0, masksize, mask);
@@ -863,7 +1055,7 @@ class NumaConfig {
             for (WORD i = 0; i < numProcGroups; ++i)
                 groupAffinities[i].Group = i;
 
-            for (CpuIndex c : nodes[n])
+            for (CpuIndex c : cpus)
             {
                 const size_t procGroupIndex     = c / WIN_PROCESSOR_GROUP_SIZE;
                 const size_t idxWithinProcGroup = c % WIN_PROCESSOR_GROUP_SIZE;
@@ -887,7 +1079,7 @@ class NumaConfig {
         {
             // On earlier windows version (since windows 7) we cannot run a single thread
             // on multiple processor groups, so we need to restrict the group.
-            // We assume the group of the first processor listed for this node.
+            // We assume the group of the first processor listed.
             // Processors from outside this group will not be assigned for this thread.
             // Normally this won't be an issue because windows used to assign NUMA nodes
             // such that they cannot span processor groups. However, since Windows 10
@@ -904,9 +1096,9 @@ class NumaConfig {
             GROUP_AFFINITY affinity;
             std::memset(&affinity, 0, sizeof(GROUP_AFFINITY));
             // We use an ordered set to be sure to get the smallest cpu number here.
-            const size_t forcedProcGroupIndex = *(nodes[n].begin()) / WIN_PROCESSOR_GROUP_SIZE;
+            const size_t forcedProcGroupIndex = *(cpus.begin()) / WIN_PROCESSOR_GROUP_SIZE;
             affinity.Group                    = static_cast<WORD>(forcedProcGroupIndex);
-            for (CpuIndex c : nodes[n])
+            for (CpuIndex c : cpus)
             {
                 const size_t procGroupIndex     = c / WIN_PROCESSOR_GROUP_SIZE;
                 const size_t idxWithinProcGroup = c % WIN_PROCESSOR_GROUP_SIZE;
@@ -931,36 +1123,8 @@ class NumaConfig {
         }
 
 #endif
-
-        return NumaReplicatedAccessToken(n);
-    }
-
-    template<typename FuncT>
-    void execute_on_numa_node(NumaIndex n, FuncT&& f) const {
-        std::thread th([this, &f, n]() {
-            bind_current_thread_to_numa_node(n);
-            std::forward<FuncT>(f)();
-        });
-
-        th.join();
     }
 
-    std::vector<std::set<CpuIndex>> nodes;
-    std::map<CpuIndex, NumaIndex>   nodeByCpu;
-
-   private:
-    CpuIndex highestCpuIndex;
-
-    bool customAffinity;
-
-    static NumaConfig empty() { return NumaConfig(EmptyNodeTag{}); }
-
-    struct EmptyNodeTag {};
-
-    NumaConfig(EmptyNodeTag) :
-        highestCpuIndex(0),
-        customAffinity(false) {}
-
     void remove_empty_numa_nodes() {
         std::vector<std::set<CpuIndex>> newNodes;
         for (auto&& cpus : nodes)
@@ -1325,6 +1489,17 @@ class LazyNumaReplicatedSystemWide: public NumaReplicatedBase {
         return status;
     }
 
+    // Replicas of NUMA nodes that have not used the value yet are not allocated
+    std::vector<SystemWideSharedConstantInfo> get_info() const {
+        std::vector<SystemWideSharedConstantInfo> info;
+        info.reserve(instances.size());
+
+        for (const auto& instance : instances)
+            info.push_back(instance.get_info());
+
+        return info;
+    }
+
     template<typename FuncT>
     void modify_and_replicate(FuncT&& f) {
         auto source = std::make_unique<T>(*instances[0]);
@@ -19,10 +19,20 @@
 #ifndef PERFT_H_INCLUDED
 #define PERFT_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "memory.h"
+#include "misc.h"
 #include "movegen.h"
 #include "position.h"
+#include "thread.h"
 #include "types.h"
 #include "uci.h"
 
@@ -45,7 +55,7 @@ uint64_t perft(Position& pos, Depth depth) {
         else
         {
             pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
+            cnt = leaf ? legal_move_count(pos) : perft<false>(pos, depth - 1);
             nodes += cnt;
             pos.undo_move(m);
         }
@@ -62,6 +72,153 @@ inline uint64_t perft(const std::string& fen, Depth depth, bool isChess960) {
 
     return perft<true>(p, depth);
 }
+
+// Same as perft(), without printing the counts of the root moves
+inline uint64_t perft_count(const std::string& fen, Depth depth, bool isChess960) {
+    StateInfo st;
+    Position  p;
+    p.set(fen, isChess960, &st);
+
+    return depth <= 1 ? MoveList<LEGAL>(p).size() : perft<false>(p, depth);
+}
+
+// The node counts of the subtrees, keyed by the position and the depth, for the
+// parallel perft. The key is stored xor-ed with the count, so that an entry torn
+// by the writes of two threads reads as a miss.
+class PerftTable {
+   public:
+    explicit PerftTable(size_t mbSize) :
+        entryCount(mbSize * 1024 * 1024 / sizeof(Entry)),
+        table(make_unique_large_page<Entry[]>(entryCount)) {}
+
+    bool probe(Key key, Depth depth, uint64_t& nodes) const {
+        const Key      k = key ^ depth_key(depth);
+        const Entry&   e = table[mul_hi64(k, entryCount)];
+        const uint64_t n = e.nodes.load(std::memory_order_relaxed);
+
+        if ((e.check.load(std::memory_order_relaxed) ^ n) != k)
+            return false;
+
+        nodes = n;
+        return true;
+    }
+
+    void save(Key key, Depth depth, uint64_t nodes) {
+        const Key k = key ^ depth_key(depth);
+        Entry&    e = table[mul_hi64(k, entryCount)];
+
+        e.check.store(k ^ nodes, std::memory_order_relaxed);
+        e.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> nodes{0};
+    };
+
+    static Key depth_key(Depth depth) { return uint64_t(depth) * 0x9E3779B97F4A7C15ULL; }
+
+    size_t                entryCount;
+    LargePagePtr<Entry[]> table;
+};
+
+inline uint64_t perft(Position& pos, Depth depth, PerftTable* tt) {
+
+    if (depth == 1)
+        return legal_move_count(pos);
+
+    uint64_t nodes = 0;
+
+    if (tt && tt->probe(pos.key(), depth, nodes))
+        return nodes;
+
+    StateInfo st;
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, tt);
+        pos.undo_move(m);
+    }
+
+    if (tt)
+        tt->save(pos.key(), depth, nodes);
+
+    return nodes;
+}
+
+// Like perft() above, with the subtrees of the positions at ply 2 spread over the
+// first threadCount threads of the pool, and with a hash table of hashMB if not 0.
+// A thread takes the next subtree when it is done with one, so that the threads
+// that get the small ones do not wait for the others. The threads must be idle.
+inline uint64_t perft(const std::string& fen,
+                      Depth              depth,
+                      bool               isChess960,
+                      ThreadPool&        threads,
+                      size_t             threadCount,
+                      size_t             hashMB) {
+
+    StateInfo st, st1;
+    Position  pos;
+    pos.set(fen, isChess960, &st);
+
+    const MoveList<LEGAL> rootMoves(pos);
+
+    std::unique_ptr<PerftTable>          tt;
+    std::vector<std::pair<size_t, Move>> subtrees;  // Index of the root move, reply
+    std::vector<std::atomic<uint64_t>>   counts(rootMoves.size());
+    std::atomic<size_t>                  next{0};
+
+    if (hashMB)
+        tt = std::make_unique<PerftTable>(hashMB);
+
+    if (depth >= 2)
+        for (size_t i = 0; i < rootMoves.size(); ++i)
+        {
+            pos.do_move(rootMoves.begin()[i], st1);
+            for (const auto& m : MoveList<LEGAL>(pos))
+                subtrees.emplace_back(i, m);
+            pos.undo_move(rootMoves.begin()[i]);
+        }
+
+    threadCount = std::clamp(threadCount, size_t(1), threads.num_threads());
+
+    for (size_t t = 0; t < threadCount; ++t)
+        threads.run_on_thread(t, [&]() {
+            StateInfo rootSt, st2, st3;
+            Position  p;
+            p.set(fen, isChess960, &rootSt);
+
+            size_t i;
+
+            while ((i = next.fetch_add(1, std::memory_order_relaxed)) < subtrees.size())
+            {
+                const auto [root, reply] = subtrees[i];
+                const Move rootMove      = rootMoves.begin()[root];
+
+                p.do_move(rootMove, st2);
+                p.do_move(reply, st3);
+                counts[root] += depth == 2 ? 1 : perft(p, depth - 2, tt.get());
+                p.undo_move(reply);
+                p.undo_move(rootMove);
+            }
+        });
+
+    for (size_t t = 0; t < threadCount; ++t)
+        threads.wait_on_thread(t);
+
+    uint64_t nodes = 0;
+
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        const uint64_t cnt = depth <= 1 ? 1 : counts[i].load();
+        nodes += cnt;
+        sync_cout << UCIEngine::move(rootMoves.begin()[i], isChess960) << ": " << cnt << sync_endl;
+    }
+
+    return nodes;
+}
 }
 
 #endif  // PERFT_H_INCLUDED
@@ -266,14 +266,7 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si) {
         && ((ss >> row) && (row == (sideToMove == WHITE ? '6' : '3'))))
     {
         st->epSquare = make_square(File(col - 'a'), Rank(row - '1'));
-
-        // En passant square will be considered only if
-        // a) side to move have a pawn threatening epSquare
-        // b) there is an enemy pawn in front of epSquare
-        // c) there is no piece on epSquare or behind epSquare
-        enpassant = attacks_bb<PAWN>(st->epSquare, ~sideToMove) & pieces(sideToMove, PAWN)
-                 && (pieces(~sideToMove, PAWN) & (st->epSquare + pawn_push(~sideToMove)))
-                 && !(pieces() & (st->epSquare | (st->epSquare + pawn_push(sideToMove))));
+        enpassant    = is_valid_ep_square(st->epSquare);
     }
 
     if (!enpassant)
@@ -295,6 +288,195 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si) {
 }
 
 
+// Sets the position from its packed form, as set() from a FEN string
+bool Position::is_valid_fen(const string& fenStr) {
+
+    std::istringstream ss(fenStr);
+    string             placement, color, castling;
+
+    if (!(ss >> placement >> color) || (color != "w" && color != "b"))
+        return false;
+
+    ss >> castling;  // Optional, as in set()
+
+    std::array<Piece, SQUARE_NB> board{};
+    int                          kings[COLOR_NB] = {};
+    int                          rank = 7, file = 0;
+    size_t                       idx;
+
+    for (char token : placement)
+    {
+        if (token == '/')
+        {
+            if (file != 8 || --rank < 0)
+                return false;
+            file = 0;
+        }
+        else if (token >= '1' && token <= '8')
+            file += token - '0';
+
+        else if ((idx = PieceToChar.find(token)) != string::npos && token != ' ' && file < 8)
+        {
+            const Piece pc = Piece(idx);
+
+            if (type_of(pc) == PAWN && (rank == 0 || rank == 7))
+                return false;
+
+            kings[color_of(pc)] += type_of(pc) == KING;
+            board[make_square(File(file++), Rank(rank))] = pc;
+        }
+        else
+            return false;
+
+        if (file > 8)
+            return false;
+    }
+
+    if (rank != 0 || file != 8 || kings[WHITE] != 1 || kings[BLACK] != 1)
+        return false;
+
+    for (char token : castling)
+    {
+        if (token == '-')
+            continue;
+
+        const Color c     = islower(token) ? BLACK : WHITE;
+        const Rank  r     = relative_rank(c, RANK_1);
+        const Piece rook  = make_piece(c, ROOK);
+        File        kfile = FILE_NB;
+
+        for (File f = FILE_A; f <= FILE_H; ++f)
+            if (board[make_square(f, r)] == make_piece(c, KING))
+                kfile = f;
+
+        if (kfile == FILE_NB)
+            return false;
+
+        bool found = false;
+        token      = char(toupper(token));
+
+        for (File f = FILE_A; f <= FILE_H; ++f)
+            if (board[make_square(f, r)] == rook)
+                found |= token == 'K'   ? f > kfile
+                       : token == 'Q'   ? f < kfile
+                       : token - 'A' == f;
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+Position& Position::set(const PackedPosition& pp, bool isChess960, StateInfo* si) {
+
+    assert(pp.is_valid());
+
+    std::memset(this, 0, sizeof(Position));
+    std::memset(si, 0, sizeof(StateInfo));
+    st = si;
+
+    Bitboard b = pp.occupied;
+    for (int i = 0; b; ++i)
+        put_piece(Piece((pp.pieces[i / 2] >> (4 * (i & 1))) & 0xF), pop_lsb(b));
+
+    gamePly    = pp.gamePly;
+    sideToMove = Color(gamePly & 1);
+
+    for (int i = 0; i < 4; ++i)
+        if (pp.castlingRooks[i] != SQ_NONE)
+            set_castling_right(i < 2 ? WHITE : BLACK, Square(pp.castlingRooks[i]));
+
+    const Square ep = Square(pp.epSquare);
+    st->epSquare    = ep != SQ_NONE && rank_of(ep) == relative_rank(sideToMove, RANK_6)
+                    && is_valid_ep_square(ep)
+                      ? ep
+                      : SQ_NONE;
+    st->rule50      = pp.rule50;
+
+    chess960 = isChess960;
+    set_state();
+
+    assert(pos_is_ok());
+
+    return *this;
+}
+
+PackedPosition Position::pack() const {
+
+    PackedPosition pp{};
+    pp.occupied = pieces();
+
+    Bitboard b = pieces();
+    for (int i = 0; b; ++i)
+        pp.pieces[i / 2] |= std::uint8_t(piece_on(pop_lsb(b)) << (4 * (i & 1)));
+
+    constexpr CastlingRights Rights[] = {WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO};
+    for (int i = 0; i < 4; ++i)
+        pp.castlingRooks[i] =
+          std::uint8_t(can_castle(Rights[i]) ? castling_rook_square(Rights[i]) : SQ_NONE);
+
+    pp.epSquare = std::uint8_t(ep_square());
+    pp.rule50   = std::uint8_t(std::min(rule50_count(), 255));
+    pp.gamePly  = std::uint16_t(gamePly);
+
+    return pp;
+}
+
+bool PackedPosition::is_valid() const {
+
+    if (popcount(occupied) > 32 || epSquare > SQ_NONE)
+        return false;
+
+    int      kings[COLOR_NB] = {};
+    Bitboard b               = occupied;
+    Bitboard rooks[COLOR_NB] = {}, kingSq[COLOR_NB] = {};
+
+    for (int i = 0; b; ++i)
+    {
+        const Square s  = pop_lsb(b);
+        const Piece  pc = Piece((pieces[i / 2] >> (4 * (i & 1))) & 0xF);
+
+        if (type_of(pc) < PAWN || type_of(pc) > KING)
+            return false;
+        if (type_of(pc) == PAWN && (rank_of(s) == RANK_1 || rank_of(s) == RANK_8))
+            return false;
+        if (type_of(pc) == KING)
+            ++kings[color_of(pc)], kingSq[color_of(pc)] |= s;
+        if (type_of(pc) == ROOK)
+            rooks[color_of(pc)] |= s;
+    }
+
+    if (kings[WHITE] != 1 || kings[BLACK] != 1)
+        return false;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const Color    c     = i < 2 ? WHITE : BLACK;
+        const Bitboard rank1 = rank_bb(relative_rank(c, RANK_1));
+
+        if (castlingRooks[i] == SQ_NONE)
+            continue;
+
+        // The rook is on the king side for the OO rights
+        if (castlingRooks[i] > SQ_NONE || !(rooks[c] & rank1 & square_bb(Square(castlingRooks[i])))
+            || !(kingSq[c] & rank1) || (lsb(kingSq[c]) < castlingRooks[i]) != (i % 2 == 0))
+            return false;
+    }
+
+    return true;
+}
+
+// En passant square will be considered only if
+// a) side to move have a pawn threatening epSquare
+// b) there is an enemy pawn in front of epSquare
+// c) there is no piece on epSquare or behind epSquare
+bool Position::is_valid_ep_square(Square ep) const {
+    return attacks_bb<PAWN>(ep, ~sideToMove) & pieces(sideToMove, PAWN)
+        && (pieces(~sideToMove, PAWN) & (ep + pawn_push(~sideToMove)))
+        && !(pieces() & (ep | (ep + pawn_push(sideToMove))));
+}
+
 // Helper function used to set castling
 // rights given the corresponding color and the rook starting square.
 void Position::set_castling_right(Color c, Square rfrom) {
@@ -687,11 +869,13 @@ bool Position::gives_check(Move m) const {
 // to a StateInfo object. The move is assumed to be legal. Pseudo-legal
 // moves should be filtered out before this function is called.
 // If a pointer to the TT table is passed, the entry for the new position
-// will be prefetched
+// will be prefetched. Threat changes are only recorded with trackThreats,
+// otherwise the returned DirtyThreats list is empty.
 DirtyBoardData Position::do_move(Move                      m,
                                  StateInfo&                newSt,
                                  bool                      givesCheck,
-                                 const TranspositionTable* tt = nullptr) {
+                                 const TranspositionTable* tt,
+                                 bool                      trackThreats) {
 
     assert(m.is_ok());
     assert(&newSt != st);
@@ -730,6 +914,8 @@ DirtyBoardData Position::do_move(Move                      m,
     dts.prevKsq       = square<KING>(us);
     dts.threatenedSqs = dts.threateningSqs = 0;
 
+    DirtyThreats* const dirtyThreats = trackThreats ? &dts : nullptr;
+
     assert(color_of(pc) == us);
     assert(captured == NO_PIECE || color_of(captured) == (m.type_of() != CASTLING ? them : us));
     assert(type_of(captured) != KING);
@@ -740,7 +926,7 @@ DirtyBoardData Position::do_move(Move                      m,
         assert(captured == make_piece(us, ROOK));
 
         Square rfrom, rto;
-        do_castling<true>(us, from, to, rfrom, rto, &dts, &dp);
+        do_castling<true>(us, from, to, rfrom, rto, dirtyThreats, &dp);
 
         k ^= Zobrist::psq[captured][rfrom] ^ Zobrist::psq[captured][rto];
         st->nonPawnKey[us] ^= Zobrist::psq[captured][rfrom] ^ Zobrist::psq[captured][rto];
@@ -765,7 +951,7 @@ DirtyBoardData Position::do_move(Move                      m,
                 assert(piece_on(capsq) == make_piece(them, PAWN));
 
                 // Update board and piece lists in ep case, normal captures are updated later
-                remove_piece(capsq, &dts);
+                remove_piece(capsq, dirtyThreats);
             }
 
             st->pawnKey ^= Zobrist::psq[captured][capsq];
@@ -815,11 +1001,11 @@ DirtyBoardData Position::do_move(Move                      m,
     {
         if (captured && m.type_of() != EN_PASSANT)
         {
-            remove_piece(from, &dts);
-            swap_piece(to, pc, &dts);
+            remove_piece(from, dirtyThreats);
+            swap_piece(to, pc, dirtyThreats);
         }
         else
-            move_piece(from, to, &dts);
+            move_piece(from, to, dirtyThreats);
     }
 
     // If the moving piece is a pawn do some special extra work
@@ -837,7 +1023,7 @@ DirtyBoardData Position::do_move(Move                      m,
             assert(relative_rank(us, to) == RANK_8);
             assert(type_of(promotion) >= KNIGHT && type_of(promotion) <= QUEEN);
 
-            swap_piece(to, promotion, &dts);
+            swap_piece(to, promotion, dirtyThreats);
 
             dp.add_pc = promotion;
             dp.add_sq = to;
@@ -1177,9 +1363,11 @@ void Position::do_null_move(StateInfo& newSt, const TranspositionTable& tt) {
     assert(!checkers());
     assert(&newSt != st);
 
-    std::memcpy(&newSt, st, sizeof(StateInfo));
+    // The pins and the check squares are recomputed below
+    std::memcpy(&newSt, st, offsetof(StateInfo, previous));
 
-    newSt.previous = st;
+    newSt.capturedPiece = st->capturedPiece;
+    newSt.previous      = st;
     st             = &newSt;
 
     if (st->epSquare != SQ_NONE)
@@ -1213,6 +1401,34 @@ void Position::undo_null_move() {
 }
 
 
+// Computes the hash key of the position after the given move, as used by the
+// TT, for speculative prefetching. Castling and promotions only change the
+// squares of the moving piece, so the key may be wrong for them, and for moves
+// that enable an en passant capture.
+Key Position::key_after(Move m) const {
+
+    Square from     = m.from_sq();
+    Square to       = m.to_sq();
+    Piece  pc       = piece_on(from);
+    Piece  captured = m.type_of() == NORMAL ? piece_on(to) : NO_PIECE;
+    Key    k        = st->key ^ Zobrist::side ^ Zobrist::psq[pc][from] ^ Zobrist::psq[pc][to];
+
+    if (captured)
+        k ^= Zobrist::psq[captured][to];
+
+    if (st->epSquare != SQ_NONE)
+        k ^= Zobrist::enpassant[file_of(st->epSquare)];
+
+    if (int cr = castlingRightsMask[from] | castlingRightsMask[to]; st->castlingRights & cr)
+        k ^= Zobrist::castling[st->castlingRights] ^ Zobrist::castling[st->castlingRights & ~cr];
+
+    // Captures and pawn moves reset the rule50 counter, other moves increment it
+    const int rule50 = captured || type_of(pc) == PAWN ? 0 : st->rule50 + 1;
+
+    return rule50 < 14 ? k : k ^ make_key((rule50 - 14) / 8);
+}
+
+
 // Tests if the SEE (Static Exchange Evaluation)
 // value of move is greater or equal to the given threshold. We'll use an
 // algorithm similar to alpha-beta pruning with a null window.
@@ -1320,6 +1536,98 @@ bool Position::see_ge(Move m, int threshold) const {
     return bool(res);
 }
 
+// Computes the exact value of the static exchange of a move, for which
+// see_ge(m, threshold) is the same as see(m) >= threshold.
+int Position::see(Move m) const { return see(m, attackers_to(m.to_sq())); }
+
+
+// Same algorithm as see_ge(), but each capture of the exchange is recorded so
+// that the best point to stop can be found for each side afterwards. The
+// attackers are attackers_to(m.to_sq()), which callers evaluating several
+// moves to the same square can look up once.
+int Position::see(Move m, Bitboard attackers) const {
+
+    assert(m.is_ok());
+
+    // Only deal with normal moves, assume others have a zero value
+    if (m.type_of() != NORMAL)
+        return VALUE_ZERO;
+
+    Square from = m.from_sq(), to = m.to_sq();
+
+    assert(piece_on(from) != NO_PIECE);
+    assert(color_of(piece_on(from)) == sideToMove);
+
+    Bitboard occupied = pieces() ^ from ^ to;
+    Color    stm      = sideToMove;
+    Bitboard stmAttackers, bb;
+    int      gain[32];
+    int      d        = 0;
+    int      onTarget = PieceValue[piece_on(from)];
+
+    gain[0] = PieceValue[piece_on(to)];
+
+    // Add the X-ray attacker behind the moving piece, if any
+    if (attacks_bb<BISHOP>(to) & from)
+        attackers |= attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN);
+    else if (attacks_bb<ROOK>(to) & from)
+        attackers |= attacks_bb<ROOK>(to, occupied) & pieces(ROOK, QUEEN);
+
+    while (true)
+    {
+        stm = ~stm;
+        attackers &= occupied;
+
+        if (!(stmAttackers = attackers & pieces(stm)))
+            break;
+
+        if (pinners(~stm) & occupied)
+        {
+            stmAttackers &= ~blockers_for_king(stm);
+
+            if (!stmAttackers)
+                break;
+        }
+
+        // The king can only capture when the opponent has no attackers left
+        if (!(stmAttackers & ~pieces(KING)))
+        {
+            if (!(attackers & ~pieces(stm)))
+            {
+                ++d;
+                gain[d] = onTarget - gain[d - 1];
+            }
+            break;
+        }
+
+        PieceType pt = PAWN;
+        while (!(bb = stmAttackers & pieces(pt)))
+            ++pt;
+
+        occupied ^= least_significant_square_bb(bb);
+
+        if (pt == PAWN || pt == BISHOP || pt == QUEEN)
+            attackers |= attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN);
+
+        if (pt == ROOK || pt == QUEEN)
+            attackers |= attacks_bb<ROOK>(to, occupied) & pieces(ROOK, QUEEN);
+
+        ++d;
+        gain[d]  = onTarget - gain[d - 1];
+        onTarget = PieceValue[pt];
+    }
+
+    // Each side stops capturing when it does not gain from it
+    while (d)
+    {
+        gain[d - 1] = std::min(gain[d - 1], -gain[d]);
+        --d;
+    }
+
+    return gain[0];
+}
+
+
 // Tests whether the position is drawn by 50-move rule
 // or by repetition. It does not detect stalemates.
 bool Position::is_draw(int ply) const {
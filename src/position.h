@@ -21,6 +21,7 @@
 
 #include <array>
 #include <cassert>
+#include <cstddef>
 #include <deque>
 #include <iosfwd>
 #include <memory>
@@ -37,9 +38,9 @@ class TranspositionTable;
 // its previous state when we retract a move. Whenever a move is made on the
 // board (by calling Position::do_move), a StateInfo object must be passed.
 
-struct StateInfo {
+struct alignas(64) StateInfo {
 
-    // Copied when making a move
+    // Copied when making a move, one cache line
     Key    materialKey;
     Key    pawnKey;
     Key    minorPieceKey;
@@ -50,23 +51,51 @@ struct StateInfo {
     int    pliesFromNull;
     Square epSquare;
 
-    // Not copied when making a move (will be recomputed anyhow)
+    // Not copied when making a move (will be recomputed anyhow). The fields read
+    // by the search at every node share the second cache line.
     Key        key;
     Bitboard   checkersBB;
     StateInfo* previous;
     Bitboard   blockersForKing[COLOR_NB];
     Bitboard   pinners[COLOR_NB];
-    Bitboard   checkSquares[PIECE_TYPE_NB];
     Piece      capturedPiece;
     int        repetition;
+
+    // Only read by gives_check(), in a cache line of its own
+    alignas(64) Bitboard checkSquares[PIECE_TYPE_NB];
 };
 
+static_assert(offsetof(StateInfo, key) == 64 && sizeof(StateInfo) == 192,
+              "StateInfo should span three cache lines");
+
+
+// A position in 32 bytes, for clients that send positions at a high rate and do not
+// want to go through FEN strings. The pieces are the ones of the occupied squares,
+// in square order, two per byte with the first one in the low nibble. A castling
+// right is given by the square of its rook, for Chess960, in the order WHITE_OO,
+// WHITE_OOO, BLACK_OO, BLACK_OOO. The side to move is the parity of gamePly.
+// Unused squares are SQ_NONE.
+struct PackedPosition {
+    std::uint64_t occupied;
+    std::uint8_t  pieces[16];
+    std::uint8_t  castlingRooks[4];
+    std::uint8_t  epSquare;
+    std::uint8_t  rule50;
+    std::uint16_t gamePly;
+
+    // Whether set() can take it: one king of each color, no pawns on the first
+    // and last ranks, and castling rooks on the first rank of their king
+    bool is_valid() const;
+};
+static_assert(sizeof(PackedPosition) == 32);
 
 // A list to keep track of the position states along the setup moves (from the
 // start position to the position just before the search starts). Needed by
 // 'draw by repetition' detection. Use a std::deque because pointers to
-// elements are not invalidated upon list resizing.
-using StateListPtr = std::unique_ptr<std::deque<StateInfo>>;
+// elements are not invalidated upon list resizing. The list is shared by the
+// engine, which may extend it with the next moves of the game, and the search
+// that last started from it.
+using StateListPtr = std::shared_ptr<std::deque<StateInfo>>;
 
 
 // Position class stores information regarding the board representation as
@@ -85,6 +114,14 @@ class Position {
     Position&   set(const std::string& fenStr, bool isChess960, StateInfo* si);
     Position&   set(const std::string& code, Color c, StateInfo* si);
     std::string fen() const;
+    // Whether set() can take the FEN: eight ranks of eight squares, one king of each
+    // color, no pawns on the first and last ranks, a side to move, and castling
+    // rooks on the first rank of their king. Does not check that it is legal.
+    static bool is_valid_fen(const std::string& fenStr);
+
+    // Packed input/output, see PackedPosition
+    Position&      set(const PackedPosition& pp, bool isChess960, StateInfo* si);
+    PackedPosition pack() const;
 
     // Position representation
     Bitboard pieces() const;  // All pieces
@@ -134,16 +171,23 @@ class Position {
 
     // Doing and undoing moves
     void           do_move(Move m, StateInfo& newSt, const TranspositionTable* tt);
-    DirtyBoardData do_move(Move m, StateInfo& newSt, bool givesCheck, const TranspositionTable* tt);
+    DirtyBoardData do_move(Move                      m,
+                           StateInfo&                newSt,
+                           bool                      givesCheck,
+                           const TranspositionTable* tt           = nullptr,
+                           bool                      trackThreats = true);
     void           undo_move(Move m);
     void           do_null_move(StateInfo& newSt, const TranspositionTable& tt);
     void           undo_null_move();
 
     // Static Exchange Evaluation
     bool see_ge(Move m, int threshold = 0) const;
+    int  see(Move m) const;
+    int  see(Move m, Bitboard attackers) const;
 
     // Accessing hash keys
     Key key() const;
+    Key key_after(Move m) const;
     Key material_key() const;
     Key pawn_key() const;
     Key minor_piece_key() const;
@@ -174,6 +218,7 @@ class Position {
    private:
     // Initialization helpers (used while setting up a position)
     void set_castling_right(Color c, Square rfrom);
+    bool is_valid_ep_square(Square ep) const;
     void set_state() const;
     void set_check_info() const;
 
@@ -389,7 +434,7 @@ inline void Position::swap_piece(Square s, Piece pc, DirtyThreats* const dts) {
 }
 
 inline void Position::do_move(Move m, StateInfo& newSt, const TranspositionTable* tt = nullptr) {
-    do_move(m, newSt, gives_check(m), tt);
+    do_move(m, newSt, gives_check(m), tt, false);
 }
 
 inline StateInfo* Position::state() const { return st; }
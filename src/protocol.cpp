@@ -0,0 +1,195 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "protocol.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "engine.h"
+#include "misc.h"
+#include "position.h"
+#include "score.h"
+#include "search.h"
+#include "types.h"
+
+namespace Stockfish::BinaryProtocol {
+
+namespace {
+
+// Longer requests are taken as a broken stream
+constexpr std::uint32_t MaxMessageSize = 1 << 20;
+
+// The centipawns of a tablebase win, as in the UCI output
+constexpr int TB_CP = 20000;
+
+void send(std::ostream& out, MessageType type, const void* payload, std::uint32_t size) {
+    const std::uint32_t length = size + 1;
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.put(char(type));
+    out.write(static_cast<const char*>(payload), size);
+    out.flush();
+}
+
+void send_error(std::ostream& out, std::string_view message) {
+    send(out, MessageType::Error, message.data(), std::uint32_t(message.size()));
+}
+
+void set_score(SearchResult& r, const Score& score) {
+    const auto set = [&](ScoreKind kind, int value) {
+        r.scoreKind = kind;
+        r.score     = value;
+    };
+    score.visit([&](auto s) {
+        using T = decltype(s);
+        if constexpr (std::is_same_v<T, Score::Mate>)
+            set(MateIn, (s.plies > 0 ? (s.plies + 1) : s.plies) / 2);
+        else if constexpr (std::is_same_v<T, Score::Tablebase>)
+            set(Centipawns, s.win ? TB_CP - s.plies : -TB_CP - s.plies);
+        else
+            set(Centipawns, s.value);
+    });
+}
+
+}  // namespace
+
+void loop(Engine& engine, std::istream& in, std::ostream& out) {
+    std::vector<char> message;
+    std::vector<Move> moves;
+    SearchResult      result{};
+    std::string       bestMove;
+
+    // Only the replies go to the output, the networks report to stderr
+    engine.get_options().add_info_listener([](const auto&) {});
+    engine.set_on_iter([](const auto&) {});
+    engine.set_on_verify_networks([](std::string_view s) { std::cerr << s << std::endl; });
+    engine.set_on_update_no_moves([&](const Engine::InfoShort& i) { set_score(result, i.score); });
+    engine.set_on_update_full([&](const Engine::InfoFull& i) {
+        if (i.multiPV != 1)
+            return;
+        set_score(result, i.score);
+        result.depth    = i.depth;
+        result.selDepth = i.selDepth;
+    });
+    engine.set_on_bestmove([&](std::string_view bm, std::string_view) { bestMove = bm; });
+
+    std::uint32_t size;
+    while (in.read(reinterpret_cast<char*>(&size), sizeof(size)) && size && size <= MaxMessageSize)
+    {
+        message.resize(size);
+        if (!in.read(message.data(), size))
+            break;
+
+        const char*       payload     = message.data() + 1;
+        const std::size_t payloadSize = size - 1;
+
+        switch (MessageType(message[0]))
+        {
+        case MessageType::Position : {
+            PackedPosition pp;
+            std::uint16_t  count;
+
+            if (payloadSize < sizeof(pp) + sizeof(count))
+            {
+                send_error(out, "Truncated position");
+                break;
+            }
+            std::memcpy(&pp, payload, sizeof(pp));
+            std::memcpy(&count, payload + sizeof(pp), sizeof(count));
+
+            if (payloadSize != sizeof(pp) + sizeof(count) + count * sizeof(std::uint16_t))
+            {
+                send_error(out, "Truncated position");
+                break;
+            }
+            if (!pp.is_valid())
+            {
+                send_error(out, "Invalid position");
+                break;
+            }
+
+            moves.clear();
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                std::uint16_t m;
+                std::memcpy(&m, payload + sizeof(pp) + sizeof(count) + 2 * i, sizeof(m));
+                moves.push_back(Move(m));
+            }
+
+            if (!engine.set_position(pp, moves))
+                send_error(out, "Illegal move");
+            break;
+        }
+
+        case MessageType::Go : {
+            GoRequest request;
+            if (payloadSize != sizeof(request))
+            {
+                send_error(out, "Truncated go");
+                break;
+            }
+            std::memcpy(&request, payload, sizeof(request));
+
+            Search::LimitsType limits;
+            limits.startTime = now();
+            limits.nodes     = request.nodes;
+            limits.depth     = request.depth;
+            limits.movetime  = request.movetime;
+
+            result = {};
+            engine.go(limits);
+            engine.wait_for_search_finished();
+
+            const TimePoint elapsed = now() - limits.startTime;
+            result.bestMove         = engine.to_move(bestMove).raw();
+            result.nodes            = engine.nodes_searched();
+            result.timeMs           = std::uint32_t(elapsed);
+            send(out, MessageType::Result, &result, sizeof(result));
+            break;
+        }
+
+        case MessageType::SetOption : {
+            engine.wait_for_search_finished();
+            std::istringstream is(std::string(payload, payloadSize));
+            engine.get_options().setoption(is);
+            break;
+        }
+
+        case MessageType::NewGame :
+            engine.search_clear();
+            break;
+
+        case MessageType::IsReady :
+            engine.wait_for_search_finished();
+            send(out, MessageType::ReadyOk, nullptr, 0);
+            break;
+
+        case MessageType::Quit :
+            return;
+
+        default :
+            send_error(out, "Unknown message");
+        }
+    }
+}
+
+}  // namespace Stockfish::BinaryProtocol
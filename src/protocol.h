@@ -0,0 +1,92 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROTOCOL_H_INCLUDED
+#define PROTOCOL_H_INCLUDED
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace Stockfish {
+
+class Engine;
+
+// A binary protocol for analysis clients that send positions and searches at a
+// high rate, entered with the 'binary' command and left with a Quit message or at
+// the end of the input. It carries packed positions and results instead of UCI
+// text, so nothing is tokenized and the moves are not matched against generated
+// move lists. Nothing else is written to the output in this mode.
+//
+// Each message, in both directions, is a 32 bit length followed by that many
+// bytes: the message type and its payload. Integers are in the byte order of the
+// machine, and moves are in the Move encoding (to | from << 6 | promotion piece
+// minus knight << 12 | type << 14, castling as the king taking its rook).
+//
+// Requests and their replies:
+//   Position  PackedPosition, uint16 move count, the moves  -> Error if not valid
+//   Go        GoRequest                                     -> Result
+//   SetOption the text of 'setoption' after the command     -> none
+//   NewGame   empty, as 'ucinewgame'                        -> none
+//   IsReady   empty                                         -> ReadyOk
+//   Quit      empty                                         -> none, leaves the mode
+namespace BinaryProtocol {
+
+enum class MessageType : std::uint8_t {
+    Position  = 'P',
+    Go        = 'G',
+    SetOption = 'O',
+    NewGame   = 'N',
+    IsReady   = 'I',
+    Quit      = 'Q',
+
+    Result  = 'R',
+    ReadyOk = 'K',
+    Error   = 'E'  // Followed by the text of the error
+};
+
+// The limits of a search, 0 for none
+struct GoRequest {
+    std::uint64_t nodes;
+    std::int32_t  depth;
+    std::int32_t  movetime;
+};
+
+enum ScoreKind : std::uint8_t {
+    Centipawns,
+    MateIn  // Negative when mated
+};
+
+struct SearchResult {
+    std::uint16_t bestMove;  // 0 without a legal move
+    ScoreKind     scoreKind;
+    std::uint8_t  reserved;
+    std::int32_t  score;
+    std::int32_t  depth, selDepth;
+    std::uint64_t nodes;
+    std::uint32_t timeMs;
+    std::uint32_t reserved2;
+};
+static_assert(sizeof(SearchResult) == 32);
+
+void loop(Engine& engine, std::istream& in, std::ostream& out);
+
+}  // namespace BinaryProtocol
+
+}  // namespace Stockfish
+
+#endif  // #ifndef PROTOCOL_H_INCLUDED
@@ -28,7 +28,9 @@
 #include <cstdlib>
 #include <initializer_list>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <mutex>
 #include <ratio>
 #include <string>
 #include <utility>
@@ -62,11 +64,44 @@ void syzygy_extend_pv(const OptionsMap&            options,
 
 using namespace Search;
 
+// Counts an event of the search in the worker's statistics, see SearchStats
+#ifdef USE_STATS
+    #define STATS_INC(counter) (++searchStats.counts[SearchStats::counter])
+    #define STATS_TT_PROBE(hit, bound) (++searchStats.counts[(hit) ? (bound) : BOUND_NONE])
+#else
+    #define STATS_INC(counter)
+    #define STATS_TT_PROBE(hit, bound)
+#endif
+
 namespace {
 
 constexpr int SEARCHEDLIST_CAPACITY = 32;
 using SearchedList                  = ValueList<Move, SEARCHEDLIST_CAPACITY>;
 
+// Nodes shallower than this are not marked in the BusyTable, as the cost of the
+// shared accesses would outweigh the duplicated work.
+constexpr Depth AbdadaDepth      = 4;
+constexpr int   MaxDeferredMoves = 32;
+
+// Marks a node in the BusyTable for the lifetime of the object
+class BusyMarker {
+   public:
+    BusyMarker(BusyTable& bt, Key k, size_t threadIdx, bool enabled) :
+        table(bt),
+        key(k),
+        owning(enabled && bt.mark(k, threadIdx)) {}
+
+    ~BusyMarker() {
+        if (owning)
+            table.unmark(key);
+    }
+
+   private:
+    BusyTable& table;
+    Key        key;
+    bool       owning;
+};
+
 // (*Scalers):
 // The values with Scaler asterisks have proven non-linear scaling.
 // They are optimized to time controls of 180 + 1.8 and longer,
@@ -79,10 +114,10 @@ using SearchedList                  = ValueList<Move, SEARCHEDLIST_CAPACITY>;
 int correction_value(const Worker& w, const Position& pos, const Stack* const ss) {
     const Color us    = pos.side_to_move();
     const auto  m     = (ss - 1)->currentMove;
-    const auto  pcv   = w.pawnCorrectionHistory[pawn_correction_history_index(pos)][us];
-    const auto  micv  = w.minorPieceCorrectionHistory[minor_piece_index(pos)][us];
-    const auto  wnpcv = w.nonPawnCorrectionHistory[non_pawn_index<WHITE>(pos)][WHITE][us];
-    const auto  bnpcv = w.nonPawnCorrectionHistory[non_pawn_index<BLACK>(pos)][BLACK][us];
+    const auto  pcv   = w.correctionHistories->pawn[pawn_correction_history_index(pos)][us];
+    const auto  micv  = w.correctionHistories->minorPiece[minor_piece_index(pos)][us];
+    const auto  wnpcv = w.correctionHistories->nonPawn[non_pawn_index<WHITE>(pos)][WHITE][us];
+    const auto  bnpcv = w.correctionHistories->nonPawn[non_pawn_index<BLACK>(pos)][BLACK][us];
     const auto  cntcv =
       m.is_ok() ? (*(ss - 2)->continuationCorrectionHistory)[pos.piece_on(m.to_sq())][m.to_sq()]
                     + (*(ss - 4)->continuationCorrectionHistory)[pos.piece_on(m.to_sq())][m.to_sq()]
@@ -106,11 +141,11 @@ void update_correction_history(const Position& pos,
 
     constexpr int nonPawnWeight = 165;
 
-    workerThread.pawnCorrectionHistory[pawn_correction_history_index(pos)][us] << bonus;
-    workerThread.minorPieceCorrectionHistory[minor_piece_index(pos)][us] << bonus * 145 / 128;
-    workerThread.nonPawnCorrectionHistory[non_pawn_index<WHITE>(pos)][WHITE][us]
+    workerThread.correctionHistories->pawn[pawn_correction_history_index(pos)][us] << bonus;
+    workerThread.correctionHistories->minorPiece[minor_piece_index(pos)][us] << bonus * 145 / 128;
+    workerThread.correctionHistories->nonPawn[non_pawn_index<WHITE>(pos)][WHITE][us]
       << bonus * nonPawnWeight / 128;
-    workerThread.nonPawnCorrectionHistory[non_pawn_index<BLACK>(pos)][BLACK][us]
+    workerThread.correctionHistories->nonPawn[non_pawn_index<BLACK>(pos)][BLACK][us]
       << bonus * nonPawnWeight / 128;
 
     if (m.is_ok())
@@ -122,6 +157,29 @@ void update_correction_history(const Position& pos,
     }
 }
 
+// Records a node of search() in the search trace if it is the sampled one, when
+// the node returns. The reason of the return is set by leave().
+struct NodeTrace {
+    NodeTrace(SearchTrace::Ring* r, int& countdown, int rate) :
+        ring(r && --countdown == 0 ? r : nullptr) {
+        if (ring)
+            countdown = rate;
+    }
+    ~NodeTrace() {
+        if (ring)
+            ring->try_push(TraceRecord(rec));
+    }
+
+    template<typename T>
+    T leave(TraceReason reason, T value) {
+        rec.reason = reason;
+        return value;
+    }
+
+    SearchTrace::Ring* ring;
+    TraceRecord        rec{};
+};
+
 // Add a small random component to draw evaluations to avoid 3-fold blindness
 Value value_draw(size_t nodes) { return VALUE_DRAW - 1 + Value(nodes & 0x2); }
 Value value_to_tt(Value v, int ply);
@@ -154,6 +212,8 @@ Search::Worker::Worker(SharedState&                    sharedState,
     options(sharedState.options),
     threads(sharedState.threads),
     tt(sharedState.tt),
+    evalCache(sharedState.evalCache),
+    trace(sharedState.trace),
     networks(sharedState.networks),
     refreshTable(networks[token]) {
     clear();
@@ -169,10 +229,20 @@ void Search::Worker::start_searching() {
 
     accumulatorStack.reset();
 
+    if (limits.perfCounters)
+        perfCounters.open();
+
+    traceRing      = trace.ring(threadIdx);
+    traceRate      = trace.sample_rate();
+    traceCountdown = traceRate;
+
     // Non-main threads go directly to iterative_deepening()
     if (!is_mainthread())
     {
         iterative_deepening();
+        if (reproducible)
+            threads.epoch_leave(false);
+        perfCounters.close();
         return;
     }
 
@@ -180,6 +250,12 @@ void Search::Worker::start_searching() {
                             main_manager()->originalTimeAdjust);
     tt.new_search();
 
+    if (options["Adaptive Move Overhead"] && main_manager()->tm.link_latency() >= 0)
+        sync_cout << "info string Move overhead " << main_manager()->tm.move_overhead()
+                  << " ms, link latency " << main_manager()->tm.link_latency()
+                  << " ms, stop latency " << main_manager()->tm.stop_latency()
+                  << " ms, go delay " << now() - limits.startTime << " ms" << sync_endl;
+
     if (rootMoves.empty())
     {
         rootMoves.emplace_back(Move::none());
@@ -190,6 +266,10 @@ void Search::Worker::start_searching() {
     {
         threads.start_searching();  // start non-main threads
         iterative_deepening();      // main thread start searching
+
+        // The other threads of a reproducible search stop at the end of the epoch
+        if (reproducible)
+            threads.epoch_leave(true);
     }
 
     // When we reach the maximum depth, we can arrive here without a raise of
@@ -203,15 +283,64 @@ void Search::Worker::start_searching() {
     // Stop the threads if not already stopped (also raise the stop if
     // "ponderhit" just reset threads.ponder)
     threads.stop = true;
+    main_manager()->timer.stop();
 
     // Wait until all threads have finished
     threads.wait_for_search_finished();
+    perfCounters.close();
+
+    main_manager()->ttProbeStats   = {};
+    main_manager()->accDiffCounters = {};
+    main_manager()->movePickerStats = {};
+#ifdef USE_STATS
+    main_manager()->searchStats = {};
+#endif
+    main_manager()->perfCounts.clear();
+    for (auto&& th : threads)
+    {
+        main_manager()->ttProbeStats += th->worker->ttProbeStats;
+        main_manager()->accDiffCounters += th->worker->accumulatorStack.counters();
+        main_manager()->movePickerStats += th->worker->movePickerStats;
+#ifdef USE_STATS
+        main_manager()->searchStats += th->worker->searchStats;
+#endif
+        if (limits.perfCounters)
+            main_manager()->perfCounts.push_back(th->worker->perfCounters.counts());
+    }
 
     // When playing in 'nodes as time' mode, subtract the searched nodes from
-    // the available ones before exiting.
+    // the available ones before exiting. The real speed is reported, so that the
+    // budget of a game can be set for the machine.
     if (limits.npmsec)
-        main_manager()->tm.advance_nodes_time(threads.nodes_searched()
-                                              - limits.inc[rootPos.side_to_move()]);
+    {
+        const uint64_t  nodes = threads.nodes_searched();
+        const TimePoint time  = std::max(TimePoint(1), elapsed_time());
+
+        main_manager()->tm.advance_nodes_time(nodes - limits.inc[rootPos.side_to_move()]);
+
+        sync_cout << "info string Nodes as time: nodes " << nodes << " time " << time << " nps "
+                  << nodes * 1000 / time << " nodes left " << main_manager()->tm.available_nodes()
+                  << sync_endl;
+    }
+
+    // On a hybrid processor, the speed of the threads of each type of core
+    const auto [performance, efficiency] = threads.nodes_searched_by_core_type();
+    if (performance.second + efficiency.second > 0)
+    {
+        const TimePoint time = std::max(TimePoint(1), elapsed_time());
+
+        sync_cout << "info string Nodes per second by core type: performance "
+                  << performance.first * 1000 / time << " (" << performance.second
+                  << " threads), efficiency " << efficiency.first * 1000 / time << " ("
+                  << efficiency.second << " threads)" << sync_endl;
+    }
+
+    // The lines of the other groups may have been found after the last output
+    if (parallelMultiPV)
+    {
+        threads.multiPVTable.merge(rootMoves);
+        main_manager()->pv(*this, threads, tt, completedDepth);
+    }
 
     Worker* bestThread = this;
     Skill   skill =
@@ -228,6 +357,26 @@ void Search::Worker::start_searching() {
     if (bestThread != this)
         main_manager()->pv(*bestThread, threads, tt, bestThread->completedDepth);
 
+    // Remember the expected line, in case the opponent plays the expected reply
+    const auto& bestPV           = bestThread->rootMoves[0].pv;
+    main_manager()->continuation = {};
+    if (bestPV.size() > 2 && bestThread->completedDepth > 2)
+    {
+        auto&     cont = main_manager()->continuation;
+        StateInfo st[2];
+
+        rootPos.do_move(bestPV[0], st[0]);
+        rootPos.do_move(bestPV[1], st[1]);
+        cont.key = rootPos.key();
+        rootPos.undo_move(bestPV[1]);
+        rootPos.undo_move(bestPV[0]);
+
+        cont.pv.assign(bestPV.begin() + 2, bestPV.end());
+        cont.averageScore     = bestThread->rootMoves[0].averageScore;
+        cont.meanSquaredScore = bestThread->rootMoves[0].meanSquaredScore;
+        cont.depth            = bestThread->completedDepth - 2;
+    }
+
     std::string ponder;
 
     if (bestThread->rootMoves[0].pv.size() > 1
@@ -236,6 +385,7 @@ void Search::Worker::start_searching() {
 
     auto bestmove = UCIEngine::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
     main_manager()->updates.onBestmove(bestmove, ponder);
+    main_manager()->tm.bestmove_sent();
 }
 
 // Main iterative deepening loop. It calls search()
@@ -247,9 +397,10 @@ void Search::Worker::iterative_deepening() {
 
     Move pv[MAX_PLY + 1];
 
-    Depth lastBestMoveDepth = 0;
-    Value lastBestScore     = -VALUE_INFINITE;
-    auto  lastBestPV        = std::vector{Move::none()};
+    // A continued search starts with the line of the last one as its best move
+    Depth lastBestMoveDepth = rootDepth;
+    Value lastBestScore     = rootDepth ? rootMoves[0].score : -VALUE_INFINITE;
+    auto  lastBestPV        = rootDepth ? rootMoves[0].pv : std::vector{Move::none()};
 
     Value  alpha, beta;
     Value  bestValue     = -VALUE_INFINITE;
@@ -263,6 +414,24 @@ void Search::Worker::iterative_deepening() {
     Stack  stack[MAX_PLY + 10] = {};
     Stack* ss                  = stack + 7;
 
+    if (useThreadTT)
+        threadTT.new_search();
+
+    ttPrefetchMoves     = int(options["TT Prefetch Moves"]);
+    lazyAccumulators    = bool(options["Lazy Accumulator"]);
+    speculativeSmallNet = bool(options["Speculative Small Net"]);
+    reproducible        = bool(options["Reproducible Search"]);
+    abdada              = options["Parallel Search"] == "ABDADA" && threads.size() > 1
+           && !reproducible;
+    nextCheckpoint      = EpochNodes;
+    deferredTT.clear();
+    ttProbeStats     = {};
+    movePickerStats  = {};
+    accumulatorStack.reset_counters();
+#ifdef USE_STATS
+    searchStats = {};
+#endif
+
     for (int i = 7; i > 0; --i)
     {
         (ss - i)->continuationHistory =
@@ -294,14 +463,48 @@ void Search::Worker::iterative_deepening() {
 
     multiPV = std::min(multiPV, rootMoves.size());
 
+    // In a parallel MultiPV search, the thread searches the lines of its group,
+    // one every 'groups' lines. Not with a root in the tablebases, whose lines
+    // are searched by rank.
+    parallelMultiPV = options["Parallel MultiPV"] && multiPV > 1 && threads.size() > 1
+                   && !skill.enabled() && !tbConfig.rootInTB && !reproducible;
+    size_t groups    = parallelMultiPV ? std::min(multiPV, threads.size()) : 1;
+    size_t firstLine = threadIdx % groups;
+
     int searchAgainCounter = 0;
 
+    bool useTimer = mainThread && options["Timer Thread"]
+                 && (limits.use_time_management() || limits.movetime) && !limits.npmsec;
+
     lowPlyHistory.fill(97);
 
     // Iterative deepening loop until requested to stop or the target depth is reached
     while (++rootDepth < MAX_PLY && !threads.stop
-           && !(limits.depth && mainThread && rootDepth > limits.depth))
+           && !(limits.depth && (mainThread || parallelMultiPV) && rootDepth > limits.depth))
     {
+        // Armed once there is a best move to send, which a continued search has
+        // from its start
+        if (useTimer && completedDepth >= 1)
+        {
+            mainThread->timer.start(threads, *mainThread, limits);
+            useTimer = false;
+        }
+
+        // The last iteration of a parallel MultiPV search to a given depth is done
+        // by the main thread alone, once the other groups have finished it, so that
+        // the lines are the ones of a sequential search. The TT holds their trees.
+        if (mainThread && parallelMultiPV && rootDepth == limits.depth)
+        {
+            threads.wait_for_search_finished();
+            if (threads.stop)
+                break;
+
+            threads.multiPVTable.merge(rootMoves);
+            parallelMultiPV = false;
+            groups          = 1;
+            firstLine       = 0;
+        }
+
         // Age out PV variability metric
         if (mainThread)
             totBestMoveChanges /= 2;
@@ -312,14 +515,18 @@ void Search::Worker::iterative_deepening() {
             rm.previousScore = rm.score;
 
         size_t pvFirst = 0;
-        pvLast         = 0;
+        pvLast         = parallelMultiPV ? rootMoves.size() : 0;
 
         if (!threads.increaseDepth)
             searchAgainCounter++;
 
         // MultiPV loop. We perform a full root search for each PV line
-        for (pvIdx = 0; pvIdx < multiPV; ++pvIdx)
+        for (pvIdx = firstLine; pvIdx < multiPV; pvIdx += groups)
         {
+            // Exclude the best lines found so far by all the groups
+            if (parallelMultiPV)
+                threads.multiPVTable.merge(rootMoves);
+
             if (pvIdx == pvLast)
             {
                 pvFirst = pvLast;
@@ -329,7 +536,7 @@ void Search::Worker::iterative_deepening() {
             }
 
             // Reset UCI info selDepth for each depth and each PV line
-            selDepth = 0;
+            counters.selDepth = 0;
 
             // Reset aspiration window starting size
             delta     = 5 + threadIdx % 8 + std::abs(rootMoves[pvIdx].meanSquaredScore) / 9000;
@@ -372,7 +579,7 @@ void Search::Worker::iterative_deepening() {
                 // excessive output that could hang GUIs like Fritz 19, only start
                 // at nodes > 10M (rather than depth N, which can be reached quickly)
                 if (mainThread && multiPV == 1 && (bestValue <= alpha || bestValue >= beta)
-                    && nodes > 10000000)
+                    && counters.nodes > 10000000)
                     main_manager()->pv(*this, threads, tt, rootDepth);
 
                 // In case of failing low/high increase aspiration window and re-search,
@@ -400,11 +607,18 @@ void Search::Worker::iterative_deepening() {
                 assert(alpha >= -VALUE_INFINITE && beta <= VALUE_INFINITE);
             }
 
+            if (parallelMultiPV && !threads.stop)
+            {
+                threads.multiPVTable.publish(rootMoves, pvIdx, rootDepth);
+                if (mainThread)
+                    threads.multiPVTable.merge(rootMoves);
+            }
+
             // Sort the PV lines searched so far and update the GUI
             std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
             if (mainThread
-                && (threads.stop || pvIdx + 1 == multiPV || nodes > 10000000)
+                && (threads.stop || pvIdx + groups >= multiPV || counters.nodes > 10000000)
                 // A thread that aborted search can have mated-in/TB-loss PV and
                 // score that cannot be trusted, i.e. it can be delayed or refuted
                 // if we would have had time to fully search other root-moves. Thus
@@ -448,7 +662,12 @@ void Search::Worker::iterative_deepening() {
                 || (rootMoves[0].score != -VALUE_INFINITE
                     && rootMoves[0].score <= VALUE_MATED_IN_MAX_PLY
                     && VALUE_MATE + rootMoves[0].score <= 2 * limits.mate)))
+        {
+            // The other threads of a reproducible search stop at the end of the epoch
+            if (reproducible)
+                break;
             threads.stop = true;
+        }
 
         // If the skill level is enabled and time is up, pick a sub-optimal best move
         if (skill.enabled() && skill.time_to_pick(rootDepth))
@@ -457,15 +676,15 @@ void Search::Worker::iterative_deepening() {
         // Use part of the gained time from a previous stable move for the current move
         for (auto&& th : threads)
         {
-            totBestMoveChanges += th->worker->bestMoveChanges;
-            th->worker->bestMoveChanges = 0;
+            totBestMoveChanges += th->worker->counters.bestMoveChanges;
+            th->worker->counters.bestMoveChanges = 0;
         }
 
         // Do we have time for the next iteration? Can we stop searching now?
         if (limits.use_time_management() && !threads.stop && !mainThread->stopOnPonderhit)
         {
             uint64_t nodesEffort =
-              rootMoves[0].effort * 100000 / std::max(size_t(1), size_t(nodes));
+              rootMoves[0].effort * 100000 / std::max(size_t(1), size_t(counters.nodes));
 
             double fallingEval =
               (11.325 + 2.115 * (mainThread->bestPreviousAverageScore - bestValue)
@@ -499,7 +718,10 @@ void Search::Worker::iterative_deepening() {
                 if (mainThread->ponder)
                     mainThread->stopOnPonderhit = true;
                 else
+                {
                     threads.stop = true;
+                    mainThread->tm.note_stop();
+                }
             }
             else
                 threads.increaseDepth = mainThread->ponder || elapsedTime <= totalTime * 0.503;
@@ -529,10 +751,25 @@ void Search::Worker::do_move(Position& pos, const Move move, StateInfo& st, Stac
 void Search::Worker::do_move(
   Position& pos, const Move move, StateInfo& st, const bool givesCheck, Stack* const ss) {
     bool capture = pos.capture_stage(move);
-    nodes.fetch_add(1, std::memory_order_relaxed);
 
-    DirtyBoardData dirtyBoardData = pos.do_move(move, st, givesCheck, &tt);
-    accumulatorStack.push(dirtyBoardData);
+    if ((counters.nodes.fetch_add(1, std::memory_order_relaxed) + 1) % NodesPublishInterval == 0)
+        threads.publishedNodes.fetch_add(NodesPublishInterval, std::memory_order_relaxed);
+
+    // Only captures and promotions change the material, and so the network used
+    // to evaluate. The switch is known before the move, which hides the prefetch.
+    if (speculativeSmallNet && (capture || move.type_of() == PROMOTION)
+        && Eval::use_smallnet(pos, move) != Eval::use_smallnet(pos))
+    {
+        STATS_INC(NetworkPrefetches);
+        Eval::prefetch_network(networks[numaAccessToken], pos, move);
+    }
+
+    DirtyBoardData dirtyBoardData = pos.do_move(move, st, givesCheck, &tt, !lazyAccumulators);
+
+    if (lazyAccumulators)
+        accumulatorStack.push_deferred(move);
+    else
+        accumulatorStack.push(dirtyBoardData);
 
     if (ss != nullptr)
     {
@@ -544,7 +781,12 @@ void Search::Worker::do_move(
     }
 }
 
-void Search::Worker::do_null_move(Position& pos, StateInfo& st) { pos.do_null_move(st, tt); }
+// The accumulator stack has no entry for a null move, so deferred diffs are built
+// first: materialize() could not take their moves back past it.
+void Search::Worker::do_null_move(Position& pos, StateInfo& st) {
+    accumulatorStack.materialize(pos);
+    pos.do_null_move(st, tt);
+}
 
 void Search::Worker::undo_move(Position& pos, const Move move) {
     pos.undo_move(move);
@@ -558,27 +800,74 @@ void Search::Worker::undo_null_move(Position& pos) { pos.undo_null_move(); }
 void Search::Worker::clear() {
     mainHistory.fill(68);
     captureHistory.fill(-689);
-    pawnHistory.fill(-1238);
-    pawnCorrectionHistory.fill(5);
-    minorPieceCorrectionHistory.fill(0);
-    nonPawnCorrectionHistory.fill(0);
+    // The shared correction histories are cleared by the thread pool
+    if (setup_correction_histories())
+        correctionHistories->clear();
 
     ttMoveHistory = 0;
 
+    // The largest tables are cleared without going through the caches
+    pawnHistory.fill_non_temporal(-1238);
+
     for (auto& to : continuationCorrectionHistory)
         for (auto& h : to)
-            h.fill(8);
+            h.fill_non_temporal(8);
 
     for (bool inCheck : {false, true})
         for (StatsType c : {NoCaptures, Captures})
             for (auto& to : continuationHistory[inCheck][c])
                 for (auto& h : to)
-                    h.fill(-529);
+                    h.fill_non_temporal(-529);
+
+    init_tables();
+}
 
+void Search::Worker::copy_histories(const Worker& from) {
+    mainHistory                   = from.mainHistory;
+    captureHistory                = from.captureHistory;
+    pawnHistory                   = from.pawnHistory;
+    continuationCorrectionHistory = from.continuationCorrectionHistory;
+    ttMoveHistory                 = from.ttMoveHistory;
+
+    for (bool inCheck : {false, true})
+        for (StatsType c : {NoCaptures, Captures})
+            continuationHistory[inCheck][c] = from.continuationHistory[inCheck][c];
+
+    if (setup_correction_histories())
+        *correctionHistories = *from.correctionHistories;
+
+    init_tables();
+}
+
+// Points the worker to the correction histories of its NUMA node when they are
+// shared, or to its own ones, which are allocated if needed. Returns whether the
+// worker has its own correction histories.
+bool Search::Worker::setup_correction_histories() {
+    // Shared tables would be updated by the threads in no fixed order
+    if (options["Shared Correction History"] && !options["Reproducible Search"])
+    {
+        ownCorrectionHistories.reset();
+        correctionHistories =
+          &threads.shared_correction_histories(numaAccessToken.get_numa_index());
+        return false;
+    }
+
+    if (!ownCorrectionHistories)
+        ownCorrectionHistories = make_unique_large_page<CorrectionHistories>();
+
+    correctionHistories = ownCorrectionHistories.get();
+    return true;
+}
+
+// Tables of the worker that are not learned by the search
+void Search::Worker::init_tables() {
     for (size_t i = 1; i < reductions.size(); ++i)
         reductions[i] = int(2809 / 128.0 * std::log(i));
 
-    refreshTable.clear(networks[numaAccessToken]);
+    refreshTable.resize(networks[numaAccessToken], size_t(options["Refresh Cache Slots"]));
+
+    threadTT.resize_private(size_t(options["Thread Hash"]));
+    useThreadTT = int(options["Thread Hash"]) > 0;
 }
 
 
@@ -601,7 +890,7 @@ Value Search::Worker::search(
     // Check if we have an upcoming move that draws by repetition
     if (!rootNode && alpha < VALUE_DRAW && pos.upcoming_repetition(ss->ply))
     {
-        alpha = value_draw(nodes);
+        alpha = value_draw(counters.nodes);
         if (alpha >= beta)
             return alpha;
     }
@@ -611,8 +900,8 @@ Value Search::Worker::search(
     assert(0 < depth && depth < MAX_PLY);
     assert(!(PvNode && cutNode));
 
-    Move      pv[MAX_PLY + 1];
-    StateInfo st;
+    Move       pv[MAX_PLY + 1];
+    StateInfo& st = states[ss->ply];
 
     Key   posKey;
     Move  move, excludedMove, bestMove;
@@ -634,20 +923,43 @@ Value Search::Worker::search(
     bestValue     = -VALUE_INFINITE;
     maxValue      = VALUE_INFINITE;
 
+    NodeTrace nodeTrace(traceRing, traceCountdown, traceRate);
+    if (nodeTrace.ring)
+    {
+        nodeTrace.rec.alpha  = std::int16_t(alpha);
+        nodeTrace.rec.beta   = std::int16_t(beta);
+        nodeTrace.rec.nodes  = std::uint32_t(counters.nodes.load(std::memory_order_relaxed));
+        nodeTrace.rec.thread = std::uint8_t(threadIdx);
+        nodeTrace.rec.ply    = std::uint8_t(ss->ply);
+        nodeTrace.rec.depth  = std::int8_t(depth);
+        nodeTrace.rec.flags  = (PvNode ? TraceRecord::PvNode : 0)
+                            | (cutNode ? TraceRecord::CutNode : 0)
+                            | (ss->inCheck ? TraceRecord::InCheck : 0);
+    }
+
     // Check for the available remaining time
     if (is_mainthread())
         main_manager()->check_time(*this);
 
+    if (reproducible && counters.nodes.load(std::memory_order_relaxed) >= nextCheckpoint
+        && !threads.stop.load(std::memory_order_relaxed))
+    {
+        nextCheckpoint += EpochNodes;
+        threads.epoch_checkpoint();
+    }
+
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
-    if (PvNode && selDepth < ss->ply + 1)
-        selDepth = ss->ply + 1;
+    if (PvNode && counters.selDepth < ss->ply + 1)
+        counters.selDepth = ss->ply + 1;
 
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
         if (threads.stop.load(std::memory_order_relaxed) || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
-            return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos) : value_draw(nodes);
+            return nodeTrace.leave(TraceReason::Draw, (ss->ply >= MAX_PLY && !ss->inCheck)
+                                                        ? evaluate(pos)
+                                                        : value_draw(counters.nodes));
 
         // Step 3. Mate distance pruning. Even if we mate at the next move our score
         // would be at best mate_in(ss->ply + 1), but if alpha is already bigger because
@@ -658,7 +970,7 @@ Value Search::Worker::search(
         alpha = std::max(mated_in(ss->ply), alpha);
         beta  = std::min(mate_in(ss->ply + 1), beta);
         if (alpha >= beta)
-            return alpha;
+            return nodeTrace.leave(TraceReason::MateDistance, alpha);
     }
 
     assert(0 <= ss->ply && ss->ply < MAX_PLY);
@@ -673,7 +985,10 @@ Value Search::Worker::search(
     // Step 4. Transposition table lookup
     excludedMove                   = ss->excludedMove;
     posKey                         = pos.key();
-    auto [ttHit, ttData, ttWriter] = tt.probe(posKey);
+    auto [ttHit, ttData, ttWriter] = probe_tt(posKey);
+    ttProbeStats.record(ttHit, ttWriter);
+    STATS_TT_PROBE(ttHit, ttData.bound);
+    nodeTrace.rec.ttBound = ttHit ? ttData.bound : BOUND_NONE;
     // Need further processing of the saved data
     ss->ttHit    = ttHit;
     ttData.move  = rootNode ? rootMoves[pvIdx].pv[0] : ttHit ? ttData.move : Move::none();
@@ -712,17 +1027,17 @@ Value Search::Worker::search(
             {
                 pos.do_move(ttData.move, st);
                 Key nextPosKey                             = pos.key();
-                auto [ttHitNext, ttDataNext, ttWriterNext] = tt.probe(nextPosKey);
+                auto [ttHitNext, ttDataNext, ttWriterNext] = probe_tt(nextPosKey);
                 pos.undo_move(ttData.move);
 
                 // Check that the ttValue after the tt move would also trigger a cutoff
                 if (!is_valid(ttDataNext.value))
-                    return ttData.value;
+                    return nodeTrace.leave(TraceReason::TTCutoff, ttData.value);
                 if ((ttData.value >= beta) == (-ttDataNext.value >= beta))
-                    return ttData.value;
+                    return nodeTrace.leave(TraceReason::TTCutoff, ttData.value);
             }
             else
-                return ttData.value;
+                return nodeTrace.leave(TraceReason::TTCutoff, ttData.value);
         }
     }
 
@@ -735,8 +1050,16 @@ Value Search::Worker::search(
             && (piecesCount < tbConfig.cardinality || depth >= tbConfig.probeDepth)
             && pos.rule50_count() == 0 && !pos.can_castle(ANY_CASTLING))
         {
-            TB::ProbeState err;
-            TB::WDLScore   wdl = Tablebases::probe_wdl(pos, &err);
+            TB::ProbeState   err;
+            TB::ProbeContext ctx;
+            ctx.nonBlocking  = true;  // Rather search on than wait for the disk
+            TB::WDLScore wdl = Tablebases::probe_wdl(pos, &err, &ctx);
+
+            if (ctx.cacheProbes)
+            {
+                counters.tbCacheProbes.fetch_add(ctx.cacheProbes, std::memory_order_relaxed);
+                counters.tbCacheHits.fetch_add(ctx.cacheHits, std::memory_order_relaxed);
+            }
 
             // Force check of time on the next occasion
             if (is_mainthread())
@@ -744,7 +1067,7 @@ Value Search::Worker::search(
 
             if (err != TB::ProbeState::FAIL)
             {
-                tbHits.fetch_add(1, std::memory_order_relaxed);
+                counters.tbHits.fetch_add(1, std::memory_order_relaxed);
 
                 int drawScore = tbConfig.useRule50 ? 1 : 0;
 
@@ -765,7 +1088,7 @@ Value Search::Worker::search(
                                    std::min(MAX_PLY - 1, depth + 6), Move::none(), VALUE_NONE,
                                    tt.generation());
 
-                    return value;
+                    return nodeTrace.leave(TraceReason::Tablebase, value);
                 }
 
                 if (PvNode)
@@ -841,7 +1164,7 @@ Value Search::Worker::search(
     // If eval is really low, skip search entirely and return the qsearch value.
     // For PvNodes, we must have a guard against mates being returned.
     if (!PvNode && eval < alpha - 514 - 294 * depth * depth)
-        return qsearch<NonPV>(pos, ss, alpha, beta);
+        return nodeTrace.leave(TraceReason::Razoring, qsearch<NonPV>(pos, ss, alpha, beta));
 
     // Step 8. Futility pruning: child node
     // The depth condition is important for mate finding.
@@ -857,7 +1180,7 @@ Value Search::Worker::search(
 
         if (!ss->ttPv && depth < 14 && eval - futility_margin(depth) >= beta && eval >= beta
             && (!ttData.move || ttCapture) && !is_loss(beta) && !is_win(eval))
-            return (2 * beta + eval) / 3;
+            return nodeTrace.leave(TraceReason::Futility, (2 * beta + eval) / 3);
     }
 
     // Step 9. Null move search with verification search
@@ -874,6 +1197,7 @@ Value Search::Worker::search(
         ss->continuationCorrectionHistory = &continuationCorrectionHistory[NO_PIECE][0];
 
         do_null_move(pos, st);
+        STATS_INC(NullMoveTries);
 
         Value nullValue = -search<NonPV>(pos, ss + 1, -beta, -beta + 1, depth - R, false);
 
@@ -883,7 +1207,10 @@ Value Search::Worker::search(
         if (nullValue >= beta && !is_win(nullValue))
         {
             if (nmpMinPly || depth < 16)
-                return nullValue;
+            {
+                STATS_INC(NullMoveCutoffs);
+                return nodeTrace.leave(TraceReason::NullMove, nullValue);
+            }
 
             assert(!nmpMinPly);  // Recursive verification is not allowed
 
@@ -896,7 +1223,10 @@ Value Search::Worker::search(
             nmpMinPly = 0;
 
             if (v >= beta)
-                return nullValue;
+            {
+                STATS_INC(NullMoveCutoffs);
+                return nodeTrace.leave(TraceReason::NullMove, nullValue);
+            }
         }
     }
 
@@ -921,6 +1251,7 @@ Value Search::Worker::search(
         assert(probCutBeta < VALUE_INFINITE && probCutBeta > beta);
 
         MovePicker mp(pos, ttData.move, probCutBeta - ss->staticEval, &captureHistory);
+        mp.collect_stats(&movePickerStats);
         Depth      probCutDepth = std::clamp(depth - 5 - (ss->staticEval - beta) / 306, 0, depth);
 
         while ((move = mp.next_move()) != Move::none())
@@ -951,7 +1282,7 @@ Value Search::Worker::search(
                                probCutDepth + 1, move, unadjustedStaticEval, tt.generation());
 
                 if (!is_decisive(value))
-                    return value - (probCutBeta - beta);
+                    return nodeTrace.leave(TraceReason::ProbCut, value - (probCutBeta - beta));
             }
         }
     }
@@ -962,7 +1293,7 @@ moves_loop:  // When in check, search starts here
     probCutBeta = beta + 418;
     if ((ttData.bound & BOUND_LOWER) && ttData.depth >= depth - 4 && ttData.value >= probCutBeta
         && !is_decisive(beta) && is_valid(ttData.value) && !is_decisive(ttData.value))
-        return probCutBeta;
+        return nodeTrace.leave(TraceReason::SmallProbCut, probCutBeta);
 
     const PieceToHistory* contHist[] = {
       (ss - 1)->continuationHistory, (ss - 2)->continuationHistory, (ss - 3)->continuationHistory,
@@ -971,14 +1302,31 @@ moves_loop:  // When in check, search starts here
 
     MovePicker mp(pos, ttData.move, depth, &mainHistory, &lowPlyHistory, &captureHistory, contHist,
                   &pawnHistory, ss->ply);
+    mp.prefetch_tt(&tt, ttPrefetchMoves);
+    mp.collect_stats(&movePickerStats);
 
     value = bestValue;
 
     int moveCount = 0;
 
+    // With ABDADA, the moves leading to nodes searched by other threads are put
+    // aside and searched once the move picker runs out of moves.
+    const bool useAbdada = abdada && !rootNode && depth >= AbdadaDepth && !excludedMove;
+    BusyMarker busyMarker(threads.busyTable, posKey, threadIdx, useAbdada);
+
+    Move deferredMoves[MaxDeferredMoves];
+    int  deferredCount = 0, deferredIdx = 0;
+
+    auto next_move = [&]() {
+        Move m = mp.next_move();
+        return m != Move::none()           ? m
+             : deferredIdx < deferredCount ? deferredMoves[deferredIdx++]
+                                           : Move::none();
+    };
+
     // Step 13. Loop through all pseudo-legal moves until no moves remain
     // or a beta cutoff occurs.
-    while ((move = mp.next_move()) != Move::none())
+    while ((move = next_move()) != Move::none())
     {
         assert(move.is_ok());
 
@@ -995,9 +1343,18 @@ moves_loop:  // When in check, search starts here
         if (rootNode && !std::count(rootMoves.begin() + pvIdx, rootMoves.begin() + pvLast, move))
             continue;
 
+        // Defer the move if another thread is searching its subtree. The first
+        // move is always searched, so that the node gets a score right away.
+        if (useAbdada && moveCount && deferredIdx == 0 && deferredCount < MaxDeferredMoves
+            && threads.busyTable.is_busy(pos.key_after(move), threadIdx))
+        {
+            deferredMoves[deferredCount++] = move;
+            continue;
+        }
+
         ss->moveCount = ++moveCount;
 
-        if (rootNode && is_mainthread() && nodes > 10000000)
+        if (rootNode && is_mainthread() && counters.nodes > 10000000)
         {
             main_manager()->updates.onIter(
               {depth, UCIEngine::move(move, pos.is_chess960()), moveCount + pvIdx});
@@ -1053,7 +1410,7 @@ moves_loop:  // When in check, search starts here
                 // Avoid pruning sacrifices of our last piece for stalemate
                 int margin = std::max(157 * depth + captHist / 29, 0);
                 if ((alpha >= VALUE_DRAW || pos.non_pawn_material(us) != PieceValue[movedPiece])
-                    && !pos.see_ge(move, -margin))
+                    && !mp.see_ge(move, -margin))
                     continue;
             }
             else
@@ -1138,7 +1495,7 @@ moves_loop:  // When in check, search starts here
             else if (value >= beta && !is_decisive(value))
             {
                 ttMoveHistory << std::max(-400 - 100 * depth, -4000);
-                return value;
+                return nodeTrace.leave(TraceReason::MultiCut, value);
             }
 
             // Negative extensions
@@ -1163,7 +1520,7 @@ moves_loop:  // When in check, search starts here
 
         // Add extension to new depth
         newDepth += extension;
-        uint64_t nodeCount = rootNode ? uint64_t(nodes) : 0;
+        uint64_t nodeCount = rootNode ? uint64_t(counters.nodes) : 0;
 
         // Decrease reduction for PvNodes (*Scaler)
         if (ss->ttPv)
@@ -1213,8 +1570,9 @@ moves_loop:  // When in check, search starts here
             // std::clamp has been replaced by a more robust implementation.
             Depth d = std::max(1, std::min(newDepth - r / 1024, newDepth + 2)) + PvNode;
 
-            ss->reduction = newDepth - d;
-            value         = -search<NonPV>(pos, ss + 1, -(alpha + 1), -alpha, d, true);
+            ss->reduction       = newDepth - d;
+            nodeTrace.rec.reduction = std::int8_t(ss->reduction);
+            value               = -search<NonPV>(pos, ss + 1, -(alpha + 1), -alpha, d, true);
             ss->reduction = 0;
 
             // Do a full-depth search when reduced LMR search fails high
@@ -1230,7 +1588,10 @@ moves_loop:  // When in check, search starts here
                 newDepth += doDeeperSearch - doShallowerSearch;
 
                 if (newDepth > d)
+                {
+                    STATS_INC(LMRResearches);
                     value = -search<NonPV>(pos, ss + 1, -(alpha + 1), -alpha, newDepth, !cutNode);
+                }
 
                 // Post LMR continuation history updates
                 update_continuation_histories(ss, movedPiece, move.to_sq(), 1365);
@@ -1276,13 +1637,16 @@ moves_loop:  // When in check, search starts here
         // the search cannot be trusted, and we return immediately without updating
         // best move, principal variation nor transposition table.
         if (threads.stop.load(std::memory_order_relaxed))
-            return VALUE_ZERO;
+        {
+            nodeTrace.rec.moveCount = std::uint8_t(std::min(moveCount, 255));
+            return nodeTrace.leave(TraceReason::Aborted, VALUE_ZERO);
+        }
 
         if (rootNode)
         {
             RootMove& rm = *std::find(rootMoves.begin(), rootMoves.end(), move);
 
-            rm.effort += nodes - nodeCount;
+            rm.effort += counters.nodes - nodeCount;
 
             rm.averageScore =
               rm.averageScore != -VALUE_INFINITE ? (value + rm.averageScore) / 2 : value;
@@ -1295,7 +1659,7 @@ moves_loop:  // When in check, search starts here
             if (moveCount == 1 || value > alpha)
             {
                 rm.score = rm.uciScore = value;
-                rm.selDepth            = selDepth;
+                rm.selDepth            = counters.selDepth;
                 rm.scoreLowerbound = rm.scoreUpperbound = false;
 
                 if (value >= beta)
@@ -1320,7 +1684,7 @@ moves_loop:  // When in check, search starts here
                 // This information is used for time management. In MultiPV mode,
                 // we must take care to only do this for the first PV line.
                 if (moveCount > 1 && !pvIdx)
-                    ++bestMoveChanges;
+                    ++counters.bestMoveChanges;
             }
             else
                 // All other moves but the PV, are set to the lowest value: this
@@ -1331,7 +1695,7 @@ moves_loop:  // When in check, search starts here
 
         // In case we have an alternative move equal in eval to the current bestmove,
         // promote it to bestmove by pretending it just exceeds alpha (but not beta).
-        int inc = (value == bestValue && ss->ply + 2 >= rootDepth && (int(nodes) & 14) == 0
+        int inc = (value == bestValue && ss->ply + 2 >= rootDepth && (int(counters.nodes) & 14) == 0
                    && !is_win(std::abs(value) + 1));
 
         if (value + inc > bestValue)
@@ -1460,7 +1824,12 @@ moves_loop:  // When in check, search starts here
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
-    return bestValue;
+    nodeTrace.rec.moveCount = std::uint8_t(std::min(moveCount, 255));
+    return nodeTrace.leave(!moveCount           ? TraceReason::NoMoves
+                           : bestValue >= beta  ? TraceReason::FailHigh
+                           : PvNode && bestMove ? TraceReason::Exact
+                                                : TraceReason::FailLow,
+                           bestValue);
 }
 
 
@@ -1482,13 +1851,13 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     // Check if we have an upcoming move that draws by repetition
     if (alpha < VALUE_DRAW && pos.upcoming_repetition(ss->ply))
     {
-        alpha = value_draw(nodes);
+        alpha = value_draw(counters.nodes);
         if (alpha >= beta)
             return alpha;
     }
 
-    Move      pv[MAX_PLY + 1];
-    StateInfo st;
+    Move       pv[MAX_PLY + 1];
+    StateInfo& st = states[ss->ply];
 
     Key   posKey;
     Move  move, bestMove;
@@ -1508,8 +1877,8 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     moveCount   = 0;
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
-    if (PvNode && selDepth < ss->ply + 1)
-        selDepth = ss->ply + 1;
+    if (PvNode && counters.selDepth < ss->ply + 1)
+        counters.selDepth = ss->ply + 1;
 
     // Step 2. Check for an immediate draw or maximum ply reached
     if (pos.is_draw(ss->ply) || ss->ply >= MAX_PLY)
@@ -1517,9 +1886,24 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
 
     assert(0 <= ss->ply && ss->ply < MAX_PLY);
 
-    // Step 3. Transposition table lookup
+    // Step 3. Transposition table lookup. With a thread hash, the entries of
+    // qsearch stay in the private table, and hits from the main search are
+    // taken from the shared table when the private one has none.
+    const TranspositionTable& qsTT = useThreadTT ? threadTT : tt;
+
     posKey                         = pos.key();
-    auto [ttHit, ttData, ttWriter] = tt.probe(posKey);
+    auto [ttHit, ttData, ttWriter] = useThreadTT ? threadTT.probe(posKey) : probe_tt(posKey);
+
+    if (useThreadTT && !ttHit)
+        if (auto [sharedHit, sharedData, sharedWriter] = probe_tt(posKey); sharedHit)
+        {
+            ttHit  = true;
+            ttData = sharedData;
+        }
+
+    ttProbeStats.record(ttHit, ttWriter);
+    STATS_TT_PROBE(ttHit, ttData.bound);
+
     // Need further processing of the saved data
     ss->ttHit    = ttHit;
     ttData.move  = ttHit ? ttData.move : Move::none();
@@ -1570,7 +1954,7 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
             if (!ss->ttHit)
                 ttWriter.write(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
                                DEPTH_UNSEARCHED, Move::none(), unadjustedStaticEval,
-                               tt.generation());
+                               qsTT.generation());
             return bestValue;
         }
 
@@ -1590,6 +1974,8 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     // captures, or evasions only when in check.
     MovePicker mp(pos, ttData.move, DEPTH_QS, &mainHistory, &lowPlyHistory, &captureHistory,
                   contHist, &pawnHistory, ss->ply);
+    mp.prefetch_tt(&qsTT, ttPrefetchMoves);
+    mp.collect_stats(&movePickerStats);
 
     // Step 5. Loop through all pseudo-legal moves until no moves remain or a beta
     // cutoff occurs.
@@ -1627,7 +2013,7 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
 
                 // If static exchange evaluation is low enough
                 // we can prune this move.
-                if (!pos.see_ge(move, alpha - futilityBase))
+                if (!mp.see_ge(move, alpha - futilityBase))
                 {
                     bestValue = std::min(alpha, futilityBase);
                     continue;
@@ -1639,7 +2025,7 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
                 continue;
 
             // Do not search moves with bad enough SEE values
-            if (!pos.see_ge(move, -78))
+            if (!mp.see_ge(move, -78))
                 continue;
         }
 
@@ -1703,7 +2089,7 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     // is saved as it was before adjustment by correction history.
     ttWriter.write(posKey, value_to_tt(bestValue, ss->ply), pvHit,
                    bestValue >= beta ? BOUND_LOWER : BOUND_UPPER, DEPTH_QS, bestMove,
-                   unadjustedStaticEval, tt.generation());
+                   unadjustedStaticEval, qsTT.generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1729,9 +2115,50 @@ TimePoint Search::Worker::elapsed() const {
 
 TimePoint Search::Worker::elapsed_time() const { return main_manager()->tm.elapsed_time(); }
 
-Value Search::Worker::evaluate(const Position& pos) {
-    return Eval::evaluate(networks[numaAccessToken], pos, accumulatorStack, refreshTable,
-                          optimism[pos.side_to_move()]);
+// The network outputs are looked up in the eval cache first, if there is one.
+// The key leaves out the rule50 counter, which only affects blend().
+Value Search::Worker::evaluate(Position& pos) {
+    STATS_INC(EvalCalls);
+    PerfCounters::EvalScope perfScope(perfCounters);
+
+    accumulatorStack.materialize(pos);
+
+    if (!evalCache.enabled())
+    {
+        const Value v = Eval::evaluate(networks[numaAccessToken], pos, accumulatorStack,
+                                       refreshTable, optimism[pos.side_to_move()]);
+        speculate_small_net(pos);
+        return v;
+    }
+
+    const Key       key  = pos.state()->key;
+    const NumaIndex node = numaAccessToken.get_numa_index();
+    Value           psqt, positional;
+
+    counters.evalCacheProbes.fetch_add(1, std::memory_order_relaxed);
+
+    if (evalCache.probe(key, node, psqt, positional))
+        counters.evalCacheHits.fetch_add(1, std::memory_order_relaxed);
+    else
+    {
+        std::tie(psqt, positional) =
+          Eval::network_output(networks[numaAccessToken], pos, accumulatorStack, refreshTable);
+        evalCache.save(key, node, psqt, positional);
+        speculate_small_net(pos);
+    }
+
+    return Eval::blend(pos, psqt, positional, optimism[pos.side_to_move()]);
+}
+
+// With the Speculative Small Net option, the small net accumulators are kept up
+// to date along the lines close to the use_smallnet() threshold.
+void Search::Worker::speculate_small_net(const Position& pos) {
+    if (!speculativeSmallNet
+        || !Eval::speculate_smallnet(networks[numaAccessToken], pos, accumulatorStack,
+                                     refreshTable))
+        return;
+
+    STATS_INC(SmallNetSpeculations);
 }
 
 namespace {
@@ -1912,6 +2339,10 @@ Move Skill::pick_best(const RootMoves& rootMoves, size_t multiPV) {
 // Used to print debug info and, more importantly, to detect
 // when we are out of available time and thus stop the search.
 void SearchManager::check_time(Search::Worker& worker) {
+    // The time limits are enforced by the timer thread
+    if (timer.armed() && !worker.limits.nodes)
+        return;
+
     if (--callsCnt > 0)
         return;
 
@@ -1920,7 +2351,16 @@ void SearchManager::check_time(Search::Worker& worker) {
 
     static TimePoint lastInfoTime = now();
 
-    TimePoint elapsed = tm.elapsed([&worker]() { return worker.threads.nodes_searched(); });
+    // The exact node count, ThreadPool::nodes_searched(), reads the counters of
+    // every worker, i.e. one cache line per thread. The published count is one
+    // cache line for any number of threads, plus the counters of this worker that
+    // are local. It misses less than NodesPublishInterval nodes per other thread.
+    auto nodes = [&worker]() {
+        return worker.threads.publishedNodes.load(std::memory_order_relaxed)
+             + worker.counters.nodes % NodesPublishInterval;
+    };
+
+    TimePoint elapsed = tm.elapsed(nodes);
     TimePoint tick    = worker.limits.startTime + elapsed;
 
     if (tick - lastInfoTime >= 1000)
@@ -1939,8 +2379,86 @@ void SearchManager::check_time(Search::Worker& worker) {
       worker.completedDepth >= 1
       && ((worker.limits.use_time_management() && (elapsed > tm.maximum() || stopOnPonderhit))
           || (worker.limits.movetime && elapsed >= worker.limits.movetime)
-          || (worker.limits.nodes && worker.threads.nodes_searched() >= worker.limits.nodes)))
+          || (worker.limits.nodes && !worker.reproducible && nodes() >= worker.limits.nodes)))
+    {
         worker.threads.stop = worker.threads.abortedSearch = true;
+        tm.note_stop();
+    }
+}
+
+SearchTimer::~SearchTimer() {
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exit = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+void SearchTimer::start(ThreadPool& pool, SearchManager& sm, const LimitsType& l) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads = &pool;
+        manager = &sm;
+        limits  = &l;
+        isArmed = true;
+    }
+
+    // Created on the first search that uses it
+    if (!thread.joinable())
+        thread = std::thread(&SearchTimer::idle_loop, this);
+
+    cv.notify_one();
+}
+
+void SearchTimer::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    isArmed = false;
+}
+
+void SearchTimer::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    cv.notify_one();
+}
+
+// The conditions of check_time(), but waited for instead of polled
+void SearchTimer::idle_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!exit)
+    {
+        // We should not stop pondering until told so by the GUI
+        if (!isArmed || manager->ponder)
+        {
+            cv.wait(lock);
+            continue;
+        }
+
+        TimePoint deadline = std::numeric_limits<TimePoint>::max();
+
+        if (limits->movetime)
+            deadline = limits->startTime + limits->movetime;
+
+        if (limits->use_time_management())
+            deadline = std::min(deadline, manager->stopOnPonderhit
+                                            ? limits->startTime
+                                            : limits->startTime + manager->tm.maximum() + 1);
+
+        if (TimePoint left = deadline - now(); left > 0)
+        {
+            cv.wait_for(lock, std::chrono::milliseconds(left));
+            continue;
+        }
+
+        threads->stop = threads->abortedSearch = true;
+        manager->tm.note_stop();
+        isArmed = false;
+    }
 }
 
 // Used to correct and extend PVs for moves that have a TB (but not a mate) score.
@@ -2079,6 +2597,53 @@ void syzygy_extend_pv(const OptionsMap&         options,
           << sync_endl;
 }
 
+void MultiPVTable::publish(const RootMoves& rootMoves, size_t pvIdx, Depth depth) {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    const Move best = rootMoves[pvIdx].pv[0];
+    const auto it   = std::find(lines.begin(), lines.end(), best);
+
+    // A deeper line of the move was found by another group
+    if (it != lines.end() && it->lineDepth > depth)
+        return;
+
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [&](const RootMove& line) {
+                                   return line == best
+                                       || (line.lineDepth < depth
+                                           && std::find(rootMoves.begin() + pvIdx + 1,
+                                                        rootMoves.end(), line.pv[0])
+                                                != rootMoves.end());
+                               }),
+                lines.end());
+
+    RootMove line  = rootMoves[pvIdx];
+    line.lineDepth = depth;
+    lines.insert(std::upper_bound(lines.begin(), lines.end(), line), std::move(line));
+}
+
+void MultiPVTable::merge(RootMoves& rootMoves) const {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    auto front = rootMoves.begin();
+    for (const auto& line : lines)
+    {
+        auto rm = std::find(front, rootMoves.end(), line.pv[0]);
+        if (rm == rootMoves.end())
+            continue;
+
+        const uint64_t effort = rm->effort;
+        *rm                   = line;
+        rm->effort            = effort;
+        std::rotate(front, rm, rm + 1);
+        ++front;
+    }
+
+    // The results of the other moves are the ones of the thread
+    for (; front != rootMoves.end(); ++front)
+        front->lineDepth = 0;
+}
+
 void SearchManager::pv(Search::Worker&           worker,
                        const ThreadPool&         threads,
                        const TranspositionTable& tt,
@@ -2091,6 +2656,11 @@ void SearchManager::pv(Search::Worker&           worker,
     size_t     multiPV   = std::min(size_t(worker.options["MultiPV"]), rootMoves.size());
     uint64_t   tbHits    = threads.tb_hits() + (worker.tbConfig.rootInTB ? rootMoves.size() : 0);
 
+    // At depth 1 only the lines already searched are sent
+    size_t lastLine = multiPV - 1;
+    while (depth == 1 && lastLine > 0 && rootMoves[lastLine].score == -VALUE_INFINITE)
+        --lastLine;
+
     for (size_t i = 0; i < multiPV; ++i)
     {
         bool updated = rootMoves[i].score != -VALUE_INFINITE;
@@ -2098,7 +2668,9 @@ void SearchManager::pv(Search::Worker&           worker,
         if (depth == 1 && !updated && i > 0)
             continue;
 
-        Depth d = updated ? depth : std::max(1, depth - 1);
+        Depth d = worker.parallelMultiPV && rootMoves[i].lineDepth ? rootMoves[i].lineDepth
+                : updated                                          ? depth
+                                                                   : std::max(1, depth - 1);
         Value v = updated ? rootMoves[i].uciScore : rootMoves[i].previousScore;
 
         if (v == -VALUE_INFINITE)
@@ -2114,13 +2686,13 @@ void SearchManager::pv(Search::Worker&           worker,
             && ((!rootMoves[i].scoreLowerbound && !rootMoves[i].scoreUpperbound) || isExact))
             syzygy_extend_pv(worker.options, worker.limits, pos, rootMoves[i], v);
 
-        std::string pv;
+        pvLine.clear();
         for (Move m : rootMoves[i].pv)
-            pv += UCIEngine::move(m, pos.is_chess960()) + " ";
+            (pvLine += UCIEngine::move(m, pos.is_chess960())) += ' ';
 
         // Remove last whitespace
-        if (!pv.empty())
-            pv.pop_back();
+        if (!pvLine.empty())
+            pvLine.pop_back();
 
         auto wdl   = worker.options["UCI_ShowWDL"] ? UCIEngine::wdl(v, pos) : "";
         auto bound = rootMoves[i].scoreLowerbound
@@ -2138,13 +2710,14 @@ void SearchManager::pv(Search::Worker&           worker,
         if (!isExact)
             info.bound = bound;
 
-        TimePoint time = std::max(TimePoint(1), tm.elapsed_time());
-        info.timeMs    = time;
-        info.nodes     = nodes;
-        info.nps       = nodes * 1000 / time;
-        info.tbHits    = tbHits;
-        info.pv        = pv;
-        info.hashfull  = tt.hashfull();
+        TimePoint time  = std::max(TimePoint(1), tm.elapsed_time());
+        info.timeMs     = time;
+        info.nodes      = nodes;
+        info.nps        = nodes * 1000 / time;
+        info.tbHits     = tbHits;
+        info.pv         = pvLine;
+        info.hashfull   = tt.hashfull();
+        info.endOfBatch = i == lastLine;
 
         updates.onUpdateFull(info);
     }
@@ -23,23 +23,32 @@
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include "evalcache.h"
 #include "history.h"
+#include "memory.h"
 #include "misc.h"
+#include "movepick.h"
 #include "nnue/network.h"
 #include "nnue/nnue_accumulator.h"
 #include "numa.h"
 #include "position.h"
 #include "score.h"
+#include "searchtrace.h"
 #include "syzygy/tbprobe.h"
 #include "timeman.h"
+#include "tt.h"
 #include "types.h"
 
 namespace Stockfish {
@@ -51,7 +60,6 @@ enum NodeType {
     Root
 };
 
-class TranspositionTable;
 class ThreadPool;
 class OptionsMap;
 
@@ -102,6 +110,7 @@ struct RootMove {
     bool              scoreUpperbound  = false;
     int               selDepth         = 0;
     int               tbRank           = 0;
+    Depth             lineDepth        = 0;  // Of the score in a parallel MultiPV search
     Value             tbScore;
     std::vector<Move> pv;
 };
@@ -116,8 +125,10 @@ struct LimitsType {
     LimitsType() {
         time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
         movestogo = depth = mate = perft = infinite = 0;
+        perftThreads = perftHash                    = 0;
         nodes                                       = 0;
-        ponderMode                                  = false;
+        ponderMode = perfCounters                   = false;
+        bookMove                                    = Move::none();
     }
 
     bool use_time_management() const { return time[WHITE] || time[BLACK]; }
@@ -125,26 +136,156 @@ struct LimitsType {
     std::vector<std::string> searchmoves;
     TimePoint                time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
     int                      movestogo, depth, mate, perft, infinite;
+    size_t                   perftThreads, perftHash;  // 0 for the single threaded perft
     uint64_t                 nodes;
     bool                     ponderMode;
+    bool                     perfCounters;  // Count the hardware events of each thread
+    Move                     bookMove;      // Searched first at the root, see "Book Mode"
 };
 
 
+// BusyTable keeps the nodes that are currently being searched, for the ABDADA
+// parallel search mode. A thread marks the nodes it enters, and the moves leading
+// to a node marked by another thread are deferred until all the other moves have
+// been searched, so that the threads spread over different subtrees instead of
+// searching the same ones at the same time. The table only holds hints: a slot
+// that is already taken is not marked again, and a node may be missed.
+class BusyTable {
+   public:
+    static constexpr std::size_t Size = 1 << 14;
+
+    // Marks the node as being searched by the thread, returns false if the slot
+    // is in use. A successful mark must be undone with unmark().
+    bool mark(Key key, std::size_t threadIdx) {
+        std::uint64_t empty = 0;
+        return slot(key).compare_exchange_strong(empty, pack(key, threadIdx),
+                                                 std::memory_order_relaxed);
+    }
+
+    void unmark(Key key) { slot(key).store(0, std::memory_order_relaxed); }
+
+    // Whether the node is being searched by a thread other than the given one
+    bool is_busy(Key key, std::size_t threadIdx) const {
+        std::uint64_t v = slot(key).load(std::memory_order_relaxed);
+        return v && (v & ~OwnerMask) == (key & ~OwnerMask) && v != pack(key, threadIdx);
+    }
+
+   private:
+    static constexpr std::uint64_t OwnerMask = 0xFFFF;
+
+    // The low bits of the key, also used for the index, hold the thread index
+    static std::uint64_t pack(Key key, std::size_t threadIdx) {
+        return (key & ~OwnerMask) | ((threadIdx + 1) & OwnerMask);
+    }
+
+    std::atomic<std::uint64_t>& slot(Key key) { return table[key & (Size - 1)]; }
+    const std::atomic<std::uint64_t>& slot(Key key) const { return table[key & (Size - 1)]; }
+
+    std::array<std::atomic<std::uint64_t>, Size> table = {};
+};
+
+
+// MultiPVTable holds the lines of a parallel MultiPV search, where the threads
+// are split into groups that each search some of the lines at the same depth
+// instead of all of them one after the other. The line of a move is the last one
+// found for it, with the depth it was searched to, and the lines are kept sorted
+// by score. Before searching line 'pvIdx', a thread takes the first 'pvIdx' lines
+// of the table as the ones to exclude, so the groups need not wait for each other.
+class MultiPVTable {
+   public:
+    void clear() {
+        std::lock_guard<std::mutex> lk(mutex);
+        lines.clear();
+    }
+
+    // Records the line searched at rootMoves[pvIdx] to the given depth. The moves
+    // after it were searched below its score, so their lines of a lower depth are
+    // dropped.
+    void publish(const RootMoves& rootMoves, std::size_t pvIdx, Depth depth);
+
+    // Copies the lines to the root moves and brings them to the front in the order
+    // of the table, the other moves keep their order. The effort of the moves is
+    // the one of the thread.
+    void merge(RootMoves& rootMoves) const;
+
+   private:
+    mutable std::mutex    mutex;
+    std::vector<RootMove> lines;
+};
+
+
+// The counters a worker updates on every node. They take a cache line of their
+// own, so that the reads of the other threads, which turn the line into a shared
+// one, do not slow down the writes to the other members of the worker.
+struct alignas(64) WorkerCounters {
+    std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+    std::atomic<uint64_t> evalCacheProbes, evalCacheHits;
+    std::atomic<uint64_t> tbCacheProbes, tbCacheHits;
+    int                   selDepth;
+};
+
+#ifdef USE_STATS
+// Counters of the search compiled in with 'make stats=yes'. Each worker counts
+// in its own with plain increments, and they are merged when the search ends.
+struct SearchStats {
+    enum Counter {
+        TTMiss,  // The TT hits are indexed by their bound
+        TTHitUpper,
+        TTHitLower,
+        TTHitExact,
+        NullMoveTries,
+        NullMoveCutoffs,
+        LMRResearches,
+        EvalCalls,
+        SmallNetSpeculations,
+        NetworkPrefetches,
+        COUNTER_NB
+    };
+    static constexpr const char* Names[COUNTER_NB] = {
+      "TT misses",          "TT hits, upper",    "TT hits, lower",
+      "TT hits, exact",     "Null moves",        "Null move cutoffs",
+      "LMR re-searches",    "Evaluations",       "Speculative small net updates",
+      "Network prefetches"};
+
+    std::uint64_t counts[COUNTER_NB] = {};
+
+    SearchStats& operator+=(const SearchStats& s) {
+        for (int i = 0; i < COUNTER_NB; ++i)
+            counts[i] += s.counts[i];
+        return *this;
+    }
+};
+#endif
+
+// Each worker adds its nodes to ThreadPool::publishedNodes in steps of this size
+constexpr uint64_t NodesPublishInterval = 1024;
+
+// The nodes of each thread between two checkpoints of a reproducible search, see
+// ThreadPool::epoch_checkpoint()
+constexpr uint64_t EpochNodes = 4096;
+
+
 // The UCI stores the uci options, thread pool, and transposition table.
 // This struct is used to easily forward data to the Search::Worker class.
 struct SharedState {
     SharedState(const OptionsMap&                                         optionsMap,
                 ThreadPool&                                               threadPool,
                 TranspositionTable&                                       transpositionTable,
+                EvalCache&                                                evaluationCache,
+                SearchTrace&                                              searchTrace,
                 const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& nets) :
         options(optionsMap),
         threads(threadPool),
         tt(transpositionTable),
+        evalCache(evaluationCache),
+        trace(searchTrace),
         networks(nets) {}
 
     const OptionsMap&                                         options;
     ThreadPool&                                               threads;
     TranspositionTable&                                       tt;
+    EvalCache&                                                evalCache;
+    SearchTrace&                                              trace;
     const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& networks;
 };
 
@@ -174,6 +315,9 @@ struct InfoFull: InfoShort {
     size_t           tbHits;
     std::string_view pv;
     int              hashfull;
+    // Whether this is the last of the multi-PV lines sent together, after which
+    // the output can be flushed
+    bool endOfBatch = true;
 };
 
 struct InfoIteration {
@@ -210,6 +354,41 @@ struct Skill {
     Move   best = Move::none();
 };
 
+class SearchManager;
+
+// With 'Timer Thread', the time limits of a search are enforced by a thread of
+// their own, which sleeps until the deadline and then raises the stop, so that a
+// main thread that is descheduled under load does not delay the best move. The
+// main thread then only polls the node limit. The timer takes over once the
+// first iteration is completed, since the search must not stop before.
+class SearchTimer {
+   public:
+    ~SearchTimer();
+
+    // Watches the search with these limits, called by the main thread
+    void start(ThreadPool& threads, SearchManager& manager, const LimitsType& limits);
+    // Returns once the timer no longer touches the search
+    void stop();
+    // The deadline may have changed, on a ponderhit
+    void wake();
+
+    bool armed() const { return isArmed.load(std::memory_order_relaxed); }
+
+   private:
+    void idle_loop();
+
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::atomic_bool        isArmed{false};
+    bool                    exit = false;
+
+    // The search being watched, while armed
+    ThreadPool*       threads = nullptr;
+    SearchManager*    manager = nullptr;
+    const LimitsType* limits  = nullptr;
+};
+
 // SearchManager manages the search from the main thread. It is responsible for
 // keeping track of the time, and storing data strictly related to the main thread.
 class SearchManager: public ISearchManager {
@@ -237,16 +416,37 @@ class SearchManager: public ISearchManager {
             const TranspositionTable& tt,
             Depth                     depth);
 
-    Stockfish::TimeManagement tm;
-    double                    originalTimeAdjust;
-    int                       callsCnt;
-    std::atomic_bool          ponder;
+    Stockfish::TimeManagement           tm;
+    double                              originalTimeAdjust;
+    TTProbeStats                        ttProbeStats;     // Of all threads, in the last search
+    Eval::NNUE::AccumulatorDiffCounters accDiffCounters;  // Likewise
+    MovePickerStats                     movePickerStats;  // Likewise
+#ifdef USE_STATS
+    SearchStats searchStats;  // Likewise
+#endif
+    std::vector<PerfCounters::Counts>   perfCounts;  // Of each thread, in the last search
+    int                                 callsCnt;
+    std::atomic_bool                    ponder;
+    SearchTimer                         timer;
 
     std::array<Value, 4> iterValue;
+    std::string          pvLine;  // Reused by pv() to build the moves of the lines
     double               previousTimeReduction;
     Value                bestPreviousScore;
     Value                bestPreviousAverageScore;
-    bool                 stopOnPonderhit;
+    std::atomic_bool     stopOnPonderhit;
+
+    // The line expected by the last search, from the position two plies later,
+    // which the next search can continue from if the opponent plays as expected.
+    struct Continuation {
+        Key               key = 0;
+        std::vector<Move> pv;
+        Value             averageScore     = -VALUE_INFINITE;
+        Value             meanSquaredScore = -VALUE_INFINITE * VALUE_INFINITE;
+        Depth             depth            = 0;
+    };
+
+    Continuation continuation;
 
     size_t id;
 
@@ -269,6 +469,12 @@ class Worker {
     // Called at instantiation to initialize reductions tables.
     // Reset histories, usually before a new game.
     void clear();
+    // Starts from the histories of another worker instead, for a thread that is
+    // added in the middle of a game.
+    void copy_histories(const Worker& from);
+    // Reallocates the tables that are not learned by the search, such as the
+    // thread hash, after their size options changed. The histories are kept.
+    void init_tables();
 
     // Called when the program receives the UCI 'go' command.
     // It searches from the root position and outputs the "bestmove".
@@ -286,14 +492,14 @@ class Worker {
     ContinuationHistory   continuationHistory[2][2];
     PawnHistory           pawnHistory;
 
-    CorrectionHistory<Pawn>         pawnCorrectionHistory;
-    CorrectionHistory<Minor>        minorPieceCorrectionHistory;
-    CorrectionHistory<NonPawn>      nonPawnCorrectionHistory;
+    // Private, or shared by the threads of the NUMA node
+    CorrectionHistories*            correctionHistories = nullptr;
     CorrectionHistory<Continuation> continuationCorrectionHistory;
 
     TTMoveHistory ttMoveHistory;
 
    private:
+    bool setup_correction_histories();
     void iterative_deepening();
 
     void do_move(Position& pos, const Move move, StateInfo& st, Stack* const ss);
@@ -322,18 +528,39 @@ class Worker {
     TimePoint elapsed() const;
     TimePoint elapsed_time() const;
 
-    Value evaluate(const Position&);
+    Value evaluate(Position&);
+    void  speculate_small_net(const Position& pos);
 
     LimitsType limits;
 
-    size_t                pvIdx, pvLast;
-    std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
-    int                   selDepth, nmpMinPly;
+    int  ttPrefetchMoves     = 0;      // See MovePicker::prefetch_tt()
+    bool lazyAccumulators    = false;  // Push accumulator diffs, built only when evaluating
+    bool speculativeSmallNet = false;  // See Eval::speculate_smallnet()
+    bool abdada              = false;  // Defer moves other threads are searching, see BusyTable
+    bool parallelMultiPV     = false;  // Search the lines in groups of threads, see MultiPVTable
+    bool reproducible        = false;  // Wait for the others at checkpoints, see EpochNodes
+
+    uint64_t         nextCheckpoint;
+    DeferredTTWrites deferredTT;  // The TT writes of the epoch of a reproducible search
+
+    // The shared TT, whose writes are deferred to the end of the epoch in a
+    // reproducible search
+    std::tuple<bool, TTData, TTWriter> probe_tt(Key key) {
+        return reproducible ? tt.probe(key, deferredTT) : tt.probe(key);
+    }
+
+    size_t pvIdx, pvLast;
+    int    nmpMinPly;
+
+    WorkerCounters counters;
 
     Value optimism[COLOR_NB];
 
     Position  rootPos;
     StateInfo rootState;
+    // The states of the moves made by search() and qsearch() at each ply, kept
+    // here rather than in their stack frames
+    std::array<StateInfo, MAX_PLY + 1> states;
     RootMoves rootMoves;
     Depth     rootDepth, completedDepth;
     Value     rootDelta;
@@ -341,6 +568,8 @@ class Worker {
     size_t                    threadIdx;
     NumaReplicatedAccessToken numaAccessToken;
 
+    LargePagePtr<CorrectionHistories> ownCorrectionHistories;
+
     // Reductions lookup table initialized at startup
     std::array<int, MAX_MOVES> reductions;  // [depth or moveNumber]
 
@@ -352,8 +581,27 @@ class Worker {
     const OptionsMap&                                         options;
     ThreadPool&                                               threads;
     TranspositionTable&                                       tt;
+    EvalCache&                                                evalCache;
+    SearchTrace&                                              trace;
     const LazyNumaReplicatedSystemWide<Eval::NNUE::Networks>& networks;
 
+    // The ring of this thread in the search trace, and the nodes until the next
+    // sampled one, see SearchTrace
+    SearchTrace::Ring* traceRing = nullptr;
+    int                traceCountdown, traceRate;
+
+    // With Thread Hash set, qsearch entries are stored in this private table
+    // and the shared one is only read on a miss, see qsearch().
+    TranspositionTable threadTT;
+    bool               useThreadTT = false;
+
+    TTProbeStats    ttProbeStats;
+    MovePickerStats movePickerStats;
+#ifdef USE_STATS
+    SearchStats searchStats;
+#endif
+    PerfCounters perfCounters;
+
     // Used by NNUE
     Eval::NNUE::AccumulatorStack  accumulatorStack;
     Eval::NNUE::AccumulatorCaches refreshTable;
@@ -0,0 +1,202 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchtrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "types.h"
+
+namespace Stockfish {
+
+namespace {
+
+constexpr char          Magic[8] = {'S', 'F', 'T', 'R', 'A', 'C', 'E', 0};
+constexpr std::uint32_t Version  = 1;
+
+constexpr const char* ReasonNames[] = {
+  "draw",      "mate distance", "tt cutoff", "tablebase", "razoring", "futility",
+  "null move", "probcut",       "small probcut", "multicut", "aborted",  "fail low",
+  "fail high", "exact",         "no moves"};
+static_assert(std::size(ReasonNames) == size_t(TraceReason::REASON_NB));
+
+constexpr const char* BoundNames[] = {"none", "upper", "lower", "exact"};
+
+// The node returned at least beta without searching all its moves, or was pruned
+bool is_cutoff(TraceReason r) {
+    return (r >= TraceReason::TTCutoff && r <= TraceReason::MultiCut) || r == TraceReason::FailHigh;
+}
+
+}  // namespace
+
+bool SearchTrace::start(const std::string& fileName, int sampleRate) {
+    stop();
+
+    file = std::fopen(fileName.c_str(), "wb");
+    if (!file)
+        return false;
+
+    rate = std::max(sampleRate, 1);
+
+    TraceHeader header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version    = Version;
+    header.recordSize = sizeof(TraceRecord);
+    header.rate       = std::uint32_t(rate);
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    written = 0;
+    exit    = false;
+    flusher = std::thread([this] { flush_loop(); });
+    return true;
+}
+
+std::pair<std::uint64_t, std::uint64_t> SearchTrace::stop() {
+    if (!file)
+        return {0, 0};
+
+    exit = true;
+    flusher.join();
+    drain();
+
+    std::uint64_t dropped = 0;
+    for (const auto& r : rings)
+        dropped += r->dropped_count();
+
+    std::fclose(file);
+    file = nullptr;
+    rings.clear();
+
+    return {written, dropped};
+}
+
+SearchTrace::Ring* SearchTrace::ring(std::size_t threadIdx) {
+    if (!file)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lk(mutex);
+    while (rings.size() <= threadIdx)
+        rings.push_back(std::make_unique<Ring>());
+    return rings[threadIdx].get();
+}
+
+void SearchTrace::flush_loop() {
+    while (!exit)
+    {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+// Moves the records of all the rings to the file. The records of a ring stay in
+// order, but the ones of different threads are interleaved by drain.
+void SearchTrace::drain() {
+    std::vector<TraceRecord> buffer;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        TraceRecord                 rec;
+        for (auto& r : rings)
+            while (r->try_pop(rec))
+                buffer.push_back(rec);
+    }
+
+    if (!buffer.empty())
+        written += std::fwrite(buffer.data(), sizeof(TraceRecord), buffer.size(), file);
+}
+
+bool SearchTrace::decode(const std::string& fileName, std::ostream& out, bool csv) {
+    std::ifstream in(fileName, std::ios::binary);
+    TraceHeader   header;
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, Magic, sizeof(Magic)) || header.version != Version
+        || header.recordSize != sizeof(TraceRecord))
+        return false;
+
+    constexpr int ReasonNB = int(TraceReason::REASON_NB);
+
+    std::uint64_t total = 0, reasonCount[ReasonNB] = {}, depthCount[MAX_PLY] = {},
+                  depthCutoffs[MAX_PLY] = {};
+    double reasonDepth[ReasonNB] = {}, reasonMoves[ReasonNB] = {};
+
+    if (csv)
+        out << "thread,ply,depth,alpha,beta,nodes,tt_bound,move_count,reduction,reason,pv,cut,"
+               "in_check\n";
+
+    TraceRecord r;
+    while (in.read(reinterpret_cast<char*>(&r), sizeof(r)))
+    {
+        const int reason = std::min(int(r.reason), ReasonNB - 1);
+        const int depth  = std::clamp(int(r.depth), 0, MAX_PLY - 1);
+
+        if (csv)
+        {
+            out << int(r.thread) << ',' << int(r.ply) << ',' << depth << ',' << r.alpha << ','
+                << r.beta << ',' << r.nodes << ',' << BoundNames[r.ttBound & 3] << ','
+                << int(r.moveCount) << ',' << int(r.reduction) << ',' << ReasonNames[reason]
+                << ',' << bool(r.flags & TraceRecord::PvNode) << ','
+                << bool(r.flags & TraceRecord::CutNode) << ','
+                << bool(r.flags & TraceRecord::InCheck) << '\n';
+            continue;
+        }
+
+        ++total;
+        ++reasonCount[reason];
+        reasonDepth[reason] += depth;
+        reasonMoves[reason] += r.moveCount;
+        ++depthCount[depth];
+        depthCutoffs[depth] += is_cutoff(TraceReason(reason));
+    }
+
+    if (csv)
+        return true;
+
+    out << "Trace of " << total << " nodes, sampled 1 in " << header.rate << "\n\n"
+        << std::left << std::setw(16) << "Reason" << std::right << std::setw(12) << "Nodes"
+        << std::setw(9) << "%" << std::setw(11) << "Avg depth" << std::setw(11) << "Avg moves"
+        << '\n'
+        << std::fixed << std::setprecision(1);
+
+    for (int i = 0; i < ReasonNB; ++i)
+        if (reasonCount[i])
+            out << std::left << std::setw(16) << ReasonNames[i] << std::right << std::setw(12)
+                << reasonCount[i] << std::setw(9) << 100.0 * reasonCount[i] / total
+                << std::setw(11) << reasonDepth[i] / reasonCount[i] << std::setw(11)
+                << reasonMoves[i] / reasonCount[i] << '\n';
+
+    // The share of the nodes of each depth that were cut off or pruned
+    out << '\n'
+        << std::setw(5) << "Depth" << std::setw(12) << "Nodes" << std::setw(9) << "%"
+        << std::setw(11) << "Cutoff %" << '\n';
+
+    for (int d = 0; d < MAX_PLY; ++d)
+        if (depthCount[d])
+            out << std::setw(5) << d << std::setw(12) << depthCount[d] << std::setw(9)
+                << 100.0 * depthCount[d] / total << std::setw(11)
+                << 100.0 * depthCutoffs[d] / depthCount[d] << '\n';
+
+    out << std::defaultfloat;
+    return true;
+}
+
+}  // namespace Stockfish
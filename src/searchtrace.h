@@ -0,0 +1,130 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEARCHTRACE_H_INCLUDED
+#define SEARCHTRACE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "misc.h"
+
+namespace Stockfish {
+
+// How a traced node of search() ended
+enum class TraceReason : std::uint8_t {
+    Draw,          // Stopped search, draw or maximum ply
+    MateDistance,  // Mate distance pruning
+    TTCutoff,
+    Tablebase,
+    Razoring,
+    Futility,  // Futility pruning of the node
+    NullMove,
+    ProbCut,
+    SmallProbCut,
+    MultiCut,  // Found by the singular extension search
+    Aborted,   // The search stopped while the moves were searched
+    FailLow,
+    FailHigh,
+    Exact,
+    NoMoves,  // Mate or stalemate
+    REASON_NB
+};
+
+// A sampled node of search(), recorded when the node returns. The window is the
+// one at the entry of the node, and the reduction is the one of the last move
+// searched with LMR, 0 if there is none.
+struct TraceRecord {
+    std::int16_t  alpha, beta;
+    std::uint32_t nodes;  // Nodes of the thread before the node, the low 32 bits
+    std::uint8_t  thread, ply;
+    std::int8_t   depth;
+    std::uint8_t  ttBound;    // Bound of the TT entry, BOUND_NONE on a miss
+    std::uint8_t  moveCount;  // Moves searched, at most 255
+    std::int8_t   reduction;
+    TraceReason   reason;
+    std::uint8_t  flags;  // See the flags below
+
+    static constexpr std::uint8_t PvNode = 1, CutNode = 2, InCheck = 4;
+};
+static_assert(sizeof(TraceRecord) == 16);
+
+// Writes the sampled nodes of the searches to a binary file, for offline analysis
+// of where the nodes went. Each search thread pushes its records into its own
+// lock-free ring, and a background thread moves them to the file, so the search
+// never waits for the disk. When a ring is full the records are dropped and
+// counted. The file is a TraceHeader followed by the TraceRecords, in the byte
+// order of the machine, see decode().
+class SearchTrace {
+   public:
+    static constexpr std::size_t RingSize = 1 << 14;
+    using Ring                            = SpscRing<TraceRecord, RingSize>;
+
+    struct TraceHeader {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t recordSize;
+        std::uint32_t rate;
+        std::uint32_t reserved;
+    };
+
+    SearchTrace() = default;
+    SearchTrace(const SearchTrace&) = delete;
+    ~SearchTrace() { stop(); }
+
+    // Samples one node of search() in 'rate', returns false if the file cannot be
+    // written. Must not be called during a search.
+    bool start(const std::string& file, int rate);
+    // Writes the last records and closes the file. Returns the records written and
+    // the ones dropped. Must not be called during a search.
+    std::pair<std::uint64_t, std::uint64_t> stop();
+
+    bool active() const { return file != nullptr; }
+    int  sample_rate() const { return rate; }
+
+    // The ring of a thread, created as needed, nullptr without a trace
+    Ring* ring(std::size_t threadIdx);
+
+    // Prints a summary of a trace file, or all its records as CSV. Returns false if
+    // the file is not a trace.
+    static bool decode(const std::string& file, std::ostream& out, bool csv);
+
+   private:
+    void flush_loop();
+    void drain();
+
+    std::mutex                         mutex;  // Guards rings
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::FILE*                         file = nullptr;
+    int                                rate = 0;
+    std::uint64_t                      written = 0;
+    std::atomic<bool>                  exit{false};
+    std::thread                        flusher;
+};
+
+}  // namespace Stockfish
+
+#endif  // #ifndef SEARCHTRACE_H_INCLUDED
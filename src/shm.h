@@ -156,6 +156,17 @@ enum class SystemWideSharedConstantAllocationStatus {
     SharedMemory
 };
 
+// Description of the memory holding a SystemWideSharedConstant, for diagnostics
+struct SystemWideSharedConstantInfo {
+    SystemWideSharedConstantAllocationStatus status = SystemWideSharedConstantAllocationStatus::NoAllocation;
+    std::string   name;
+    std::size_t   size          = 0;
+    bool          largePages    = false;
+    bool          attached      = false;  // Mapped from a region created by another instance
+    std::uint32_t refCount      = 0;      // Number of instances mapping it, 0 if unknown
+    std::size_t   hugePageBytes = 0;      // As far as the OS lets us know
+};
+
 #if defined(_WIN32)
 
 inline std::string GetLastErrorAsString(DWORD error) {
@@ -247,7 +258,10 @@ class SharedMemoryBackend {
         pMap(other.pMap),
         hMapFile(other.hMapFile),
         status(other.status),
-        last_error_message(std::move(other.last_error_message)) {
+        last_error_message(std::move(other.last_error_message)),
+        name(std::move(other.name)),
+        largePages(other.largePages),
+        attached(other.attached) {
 
         other.pMap     = nullptr;
         other.hMapFile = 0;
@@ -262,6 +276,9 @@ class SharedMemoryBackend {
             hMapFile           = other.hMapFile;
             status             = other.status;
             last_error_message = std::move(other.last_error_message);
+            name               = std::move(other.name);
+            largePages         = other.largePages;
+            attached           = other.attached;
 
             other.pMap     = nullptr;
             other.hMapFile = 0;
@@ -275,10 +292,17 @@ class SharedMemoryBackend {
                                          : SystemWideSharedConstantAllocationStatus::NoAllocation;
     }
 
+    // Windows does not expose the number of processes mapping a section
+    SystemWideSharedConstantInfo get_info() const {
+        return {get_status(), name, sizeof(T), largePages, attached, 0, largePages ? sizeof(T) : 0};
+    }
+
    private:
     void initialize(const std::string& shm_name, const T& value) {
         const size_t total_size = sizeof(T) + sizeof(IS_INITIALIZED_VALUE);
 
+        name = shm_name;
+
         // Try allocating with large pages first.
         hMapFile = windows_try_with_large_page_priviliges(
           [&](size_t largePageSize) {
@@ -299,6 +323,8 @@ class SharedMemoryBackend {
           },
           []() { return (void*) nullptr; });
 
+        largePages = hMapFile != 0;
+
         // Fallback to normal allocation if no large pages available.
         if (!hMapFile)
         {
@@ -352,7 +378,9 @@ class SharedMemoryBackend {
           std::launder(reinterpret_cast<DWORD*>(reinterpret_cast<char*>(pMap) + sizeof(T)));
         T* object = std::launder(reinterpret_cast<T*>(pMap));
 
-        if (*is_initialized != IS_INITIALIZED_VALUE)
+        attached = *is_initialized == IS_INITIALIZED_VALUE;
+
+        if (!attached)
         {
             // First time initialization, message for debug purposes
             new (object) T{value};
@@ -404,6 +432,9 @@ class SharedMemoryBackend {
     HANDLE      hMapFile = 0;
     Status      status   = Status::NotInitialized;
     std::string last_error_message;
+    std::string name;
+    bool        largePages = false;
+    bool        attached   = false;
 };
 
 #elif !defined(__ANDROID__)
@@ -428,6 +459,19 @@ class SharedMemoryBackend {
                           : SystemWideSharedConstantAllocationStatus::NoAllocation;
     }
 
+    SystemWideSharedConstantInfo get_info() const {
+        if (!is_valid())
+            return {};
+
+        return {get_status(),
+                shm1->name(),
+                shm1->size(),
+                is_large_page_backed(get()),
+                !shm1->created(),
+                shm1->ref_count(),
+                huge_page_bytes(get(), shm1->size())};
+    }
+
     std::optional<std::string> get_error_message() const {
         if (!shm1)
             return "Shared memory not initialized";
@@ -466,6 +510,8 @@ class SharedMemoryBackend {
     }
 
     std::optional<std::string> get_error_message() const { return "Dummy SharedMemoryBackend"; }
+
+    SystemWideSharedConstantInfo get_info() const { return {}; }
 };
 
 #endif
@@ -474,8 +520,9 @@ template<typename T>
 struct SharedMemoryBackendFallback {
     SharedMemoryBackendFallback() = default;
 
-    SharedMemoryBackendFallback(const std::string&, const T& value) :
-        fallback_object(make_unique_large_page<T>(value)) {}
+    SharedMemoryBackendFallback(const std::string& shm_name, const T& value) :
+        fallback_object(make_unique_large_page<T>(value)),
+        name(shm_name) {}
 
     void* get() const { return fallback_object.get(); }
 
@@ -483,10 +530,12 @@ struct SharedMemoryBackendFallback {
     SharedMemoryBackendFallback& operator=(const SharedMemoryBackendFallback&) = delete;
 
     SharedMemoryBackendFallback(SharedMemoryBackendFallback&& other) noexcept :
-        fallback_object(std::move(other.fallback_object)) {}
+        fallback_object(std::move(other.fallback_object)),
+        name(std::move(other.name)) {}
 
     SharedMemoryBackendFallback& operator=(SharedMemoryBackendFallback&& other) noexcept {
         fallback_object = std::move(other.fallback_object);
+        name            = std::move(other.name);
         return *this;
     }
 
@@ -502,8 +551,23 @@ struct SharedMemoryBackendFallback {
         return "Shared memory not supported by the OS. Local allocation fallback.";
     }
 
+    // The name is the one the shared memory would have had
+    SystemWideSharedConstantInfo get_info() const {
+        if (fallback_object == nullptr)
+            return {};
+
+        return {get_status(),
+                name,
+                sizeof(T),
+                is_large_page_backed(get()),
+                false,
+                1,
+                huge_page_bytes(get(), sizeof(T))};
+    }
+
    private:
     LargePagePtr<T> fallback_object;
+    std::string     name;
 };
 
 // Platform-independent wrapper
@@ -609,6 +673,21 @@ struct SystemWideSharedConstant {
           backend);
     }
 
+    SystemWideSharedConstantInfo get_info() const {
+        return std::visit(
+          [](const auto& end) -> SystemWideSharedConstantInfo {
+              if constexpr (std::is_same_v<std::decay_t<decltype(end)>, std::monostate>)
+              {
+                  return {};
+              }
+              else
+              {
+                  return end.get_info();
+              }
+          },
+          backend);
+    }
+
    private:
     auto get_ptr() const {
         return std::visit(
@@ -162,6 +162,7 @@ class SharedMemory: public detail::SharedMemoryBase {
     T*                 data_ptr_   = nullptr;
     detail::ShmHeader* header_ptr_ = nullptr;
     size_t             total_size_ = 0;
+    bool               created_    = false;
     std::string        sentinel_base_;
     std::string        sentinel_path_;
 
@@ -197,6 +198,7 @@ class SharedMemory: public detail::SharedMemoryBase {
         data_ptr_(other.data_ptr_),
         header_ptr_(other.header_ptr_),
         total_size_(other.total_size_),
+        created_(other.created_),
         sentinel_base_(std::move(other.sentinel_base_)),
         sentinel_path_(std::move(other.sentinel_path_)) {
 
@@ -217,6 +219,7 @@ class SharedMemory: public detail::SharedMemoryBase {
             data_ptr_      = other.data_ptr_;
             header_ptr_    = other.header_ptr_;
             total_size_    = other.total_size_;
+            created_       = other.created_;
             sentinel_base_ = std::move(other.sentinel_base_);
             sentinel_path_ = std::move(other.sentinel_path_);
 
@@ -310,6 +313,7 @@ class SharedMemory: public detail::SharedMemoryBase {
             }
 
             header_ptr_->ref_count.fetch_add(1, std::memory_order_acq_rel);
+            created_ = created_new;
 
             unlock_shared_mutex();
             unlock_file();
@@ -376,6 +380,11 @@ class SharedMemory: public detail::SharedMemoryBase {
         return header_ptr_ ? header_ptr_->ref_count.load(std::memory_order_acquire) : 0;
     }
 
+    [[nodiscard]] size_t size() const noexcept { return total_size_; }
+
+    // Whether this instance created the region rather than attached to it
+    [[nodiscard]] bool created() const noexcept { return created_; }
+
     [[nodiscard]] bool is_initialized() const noexcept {
         return header_ptr_ ? header_ptr_->initialized.load(std::memory_order_acquire) : false;
     }
@@ -388,6 +397,7 @@ class SharedMemory: public detail::SharedMemoryBase {
         mapped_ptr_ = nullptr;
         data_ptr_   = nullptr;
         header_ptr_ = nullptr;
+        created_    = false;
         sentinel_path_.clear();
     }
 
@@ -595,6 +605,12 @@ class SharedMemory: public detail::SharedMemoryBase {
             return false;
         }
 
+#if defined(MADV_HUGEPAGE)
+        // Only honored if shmem_enabled allows it, but the region is large and
+        // read all over by the evaluation
+        madvise(mapped_ptr_, total_size_, MADV_HUGEPAGE);
+#endif
+
         data_ptr_ = static_cast<T*>(mapped_ptr_);
         header_ptr_ =
           reinterpret_cast<detail::ShmHeader*>(static_cast<char*>(mapped_ptr_) + sizeof(T));
@@ -628,6 +644,10 @@ class SharedMemory: public detail::SharedMemoryBase {
             return false;
         }
 
+#if defined(MADV_HUGEPAGE)
+        madvise(mapped_ptr_, total_size_, MADV_HUGEPAGE);
+#endif
+
         data_ptr_   = static_cast<T*>(mapped_ptr_);
         header_ptr_ = std::launder(
           reinterpret_cast<detail::ShmHeader*>(static_cast<char*>(mapped_ptr_) + sizeof(T)));
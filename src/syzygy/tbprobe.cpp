@@ -21,6 +21,8 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -32,15 +34,18 @@
 #include <sstream>
 #include <string_view>
 #include <sys/stat.h>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "../bitboard.h"
+#include "../memory.h"
 #include "../misc.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../ucioption.h"
 
@@ -201,13 +206,26 @@ class TBFile: public std::ifstream {
     // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
     static std::string Paths;
 
-    TBFile(const std::string& f) {
+    // Whether the accesses to the mapped files are advised to be random, which
+    // disables the readahead of the pages around the faulting one.
+    static bool RandomAccess;
 
 #ifndef _WIN32
-        constexpr char SepChar = ':';
+    static constexpr char SepChar = ':';
 #else
-        constexpr char SepChar = ';';
+    static constexpr char SepChar = ';';
 #endif
+
+    // With a full path, as found by an earlier lookup, the file is opened directly
+    TBFile(const std::string& f, const std::string& fullPath = "") {
+
+        if (!fullPath.empty())
+        {
+            fname = fullPath;
+            std::ifstream::open(fname);
+            return;
+        }
+
         std::stringstream ss(Paths);
         std::string       path;
 
@@ -220,8 +238,16 @@ class TBFile: public std::ifstream {
         }
     }
 
-    // Memory map the file and check it.
-    uint8_t* map(void** baseAddress, uint64_t* mapping, TBType type) {
+    const std::string& path() const { return fname; }
+
+    uint64_t size() {
+        seekg(0, std::ios::end);
+        return uint64_t(tellg());
+    }
+
+    // Memory map the file and check it. A non-zero expected size is the one the
+    // file had when it was indexed.
+    uint8_t* map(void** baseAddress, uint64_t* mapping, TBType type, uint64_t expectedSize) {
         if (is_open())
             close();  // Need to re-open to get native file descriptor
 
@@ -240,11 +266,16 @@ class TBFile: public std::ifstream {
             exit(EXIT_FAILURE);
         }
 
+        if (expectedSize && uint64_t(statbuf.st_size) != expectedSize)
+        {
+            sync_cout << "info string Tablebase file " << fname
+                      << " changed since it was indexed, ignoring it" << sync_endl;
+            ::close(fd);
+            return *baseAddress = nullptr, nullptr;
+        }
+
         *mapping     = statbuf.st_size;
         *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    #if defined(MADV_RANDOM)
-        madvise(*baseAddress, statbuf.st_size, MADV_RANDOM);
-    #endif
         ::close(fd);
 
         if (*baseAddress == MAP_FAILED)
@@ -252,6 +283,8 @@ class TBFile: public std::ifstream {
             std::cerr << "Could not mmap() " << fname << std::endl;
             exit(EXIT_FAILURE);
         }
+
+        advise(*baseAddress, *mapping);
 #else
         // Note FILE_FLAG_RANDOM_ACCESS is only a hint to Windows and as such may get ignored.
         HANDLE fd = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
@@ -269,6 +302,14 @@ class TBFile: public std::ifstream {
             exit(EXIT_FAILURE);
         }
 
+        if (expectedSize && (uint64_t(size_high) << 32 | size_low) != expectedSize)
+        {
+            sync_cout << "info string Tablebase file " << fname
+                      << " changed since it was indexed, ignoring it" << sync_endl;
+            CloseHandle(fd);
+            return *baseAddress = nullptr, nullptr;
+        }
+
         HANDLE mmap = CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
         CloseHandle(fd);
 
@@ -302,6 +343,12 @@ class TBFile: public std::ifstream {
         return data + 4;  // Skip Magics's header
     }
 
+    static void advise([[maybe_unused]] void* baseAddress, [[maybe_unused]] uint64_t mapping) {
+#if defined(MADV_RANDOM)
+        madvise(baseAddress, mapping, RandomAccess ? MADV_RANDOM : MADV_NORMAL);
+#endif
+    }
+
     static void unmap(void* baseAddress, uint64_t mapping) {
 
 #ifndef _WIN32
@@ -314,6 +361,15 @@ class TBFile: public std::ifstream {
 };
 
 std::string TBFile::Paths;
+bool        TBFile::RandomAccess = true;
+
+// Pages of a file found missing by the probes that must not wait for the disk,
+// and the time the I/O threads spent reading them.
+struct IOStats {
+    std::atomic<uint64_t> faults{0};
+    std::atomic<uint64_t> readNs{0};
+    std::atomic<uint64_t> remaps{0};  // After an unmapping by the mapping limit
+};
 
 // struct PairsData contains low-level indexing information to access TB data.
 // There are 8, 4, or 2 PairsData records for each TBTable, according to the type
@@ -352,17 +408,24 @@ struct TBTable {
 
     static constexpr int Sides = Type == WDL ? 2 : 1;
 
-    std::atomic_bool ready;
-    void*            baseAddress;
-    uint8_t*         map;
-    uint64_t         mapping;
-    Key              key;
-    Key              key2;
-    int              pieceCount;
-    bool             hasPawns;
-    bool             hasUniquePieces;
-    uint8_t          pawnCount[2];     // [Lead color / other color]
-    PairsData        items[Sides][4];  // [wtm / btm][FILE_A..FILE_D or 0]
+    std::atomic_bool      ready;
+    void*                 baseAddress;
+    uint8_t*              map;
+    uint64_t              mapping;
+    Key                   key;
+    Key                   key2;
+    int                   pieceCount;
+    bool                  hasPawns;
+    bool                  hasUniquePieces;
+    uint8_t               pawnCount[2];      // [Lead color / other color]
+    PairsData             items[Sides][4];   // [wtm / btm][FILE_A..FILE_D or 0]
+    std::string           name;              // Like "KRvK"
+    std::string           path;              // Of the file, once found
+    uint64_t              fileSize = 0;      // When read from the index, checked at mapping
+    IOStats               io;
+    std::atomic<int>      users{0};          // Probes reading the mapping, with a mapping limit
+    std::atomic<uint64_t> lastUse{0};        // Of the clock of the mapping limit
+    bool                  unmapped = false;  // By the mapping limit, since the last mapping
 
     PairsData* get(int stm, int f) { return &items[stm % Sides][hasPawns ? f : 0]; }
 
@@ -385,6 +448,7 @@ TBTable<WDL>::TBTable(const std::string& code) :
     StateInfo st;
     Position  pos;
 
+    name       = code;
     key        = pos.set(code, WHITE, &st).material_key();
     pieceCount = pos.count<ALL_PIECES>();
     hasPawns   = pos.pieces(PAWN);
@@ -418,6 +482,7 @@ TBTable<DTZ>::TBTable(const TBTable<WDL>& wdl) :
     hasUniquePieces = wdl.hasUniquePieces;
     pawnCount[0]    = wdl.pawnCount[0];
     pawnCount[1]    = wdl.pawnCount[1];
+    name            = wdl.name;
 }
 
 // class TBTables creates and keeps ownership of the TBTable objects, one for
@@ -497,11 +562,291 @@ class TBTables {
                   << " DTZ tablebase files (up to " << MaxCardinality << "-man)." << sync_endl;
     }
 
+    // Calls f on each WDL and DTZ table, with the extension of its file
+    template<typename F>
+    void for_each(F f) {
+        for (auto& e : wdlTable)
+            f(e, ".rtbw");
+        for (auto& e : dtzTable)
+            f(e, ".rtbz");
+    }
+
     void add(const std::vector<PieceType>& pieces);
+    bool load_index(const std::string& file);
+    void save_index(const std::string& file) const;
 };
 
 TBTables TBTables;
 
+// Reads in the pages of the mapped files on a few I/O threads, for the probes that
+// must not wait for the disk. Such a probe fails when it finds a page it needs
+// missing, and queues it here, so that it succeeds when probed again once the page
+// is resident. Defined after TBTables, so that the threads are joined before the
+// files are unmapped at exit.
+class PageReader {
+   public:
+    PageReader() = default;
+    ~PageReader() { set_threads(0); }
+
+    void set_threads(size_t count);
+    void drain();  // Drops the queued reads and waits for the running ones
+
+    bool enabled() const { return !threads.empty(); }
+
+    // True if the pages of the range are resident. Otherwise they are queued.
+    bool resident(const void* addr, size_t size, IOStats& stats);
+
+   private:
+    struct Request {
+        uintptr_t first, last;  // Pages
+        IOStats*  stats;
+    };
+
+    static constexpr size_t MaxQueued = 256;
+
+    void idle_loop();
+
+    std::mutex               mutex;
+    std::condition_variable  cv, idle;
+    std::deque<Request>      queue;
+    size_t                   running = 0;
+    bool                     exit    = false;
+    std::vector<std::thread> threads;
+};
+
+#if defined(__linux__)
+const uintptr_t PageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+#endif
+
+void PageReader::set_threads(size_t count) {
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        exit = true;
+        queue.clear();
+    }
+    cv.notify_all();
+
+    for (auto& th : threads)
+        th.join();
+
+    threads.clear();
+    exit = false;
+
+#if defined(__linux__)
+    for (size_t i = 0; i < count; ++i)
+        threads.emplace_back(&PageReader::idle_loop, this);
+#else
+    (void) count;  // mincore() is needed to find the missing pages
+#endif
+}
+
+void PageReader::drain() {
+    std::unique_lock<std::mutex> lk(mutex);
+    queue.clear();
+    idle.wait(lk, [&] { return running == 0; });
+}
+
+bool PageReader::resident([[maybe_unused]] const void* addr,
+                          [[maybe_unused]] size_t      size,
+                          [[maybe_unused]] IOStats&    stats) {
+#if defined(__linux__)
+    constexpr size_t MaxPages = 8;
+
+    const uintptr_t first = uintptr_t(addr) & ~(PageSize - 1);
+    const uintptr_t last  = (uintptr_t(addr) + size - 1) & ~(PageSize - 1);
+    const size_t    pages = (last - first) / PageSize + 1;
+    unsigned char   vec[MaxPages];
+
+    // Larger ranges are not read by a probe. Let the probe fault if mincore() fails.
+    if (pages > MaxPages || mincore(reinterpret_cast<void*>(first), pages * PageSize, vec))
+        return true;
+
+    if (std::all_of(vec, vec + pages, [](unsigned char v) { return v & 1; }))
+        return true;
+
+    stats.faults.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        if (queue.size() < MaxQueued)
+            queue.push_back({first, last, &stats});
+    }
+    cv.notify_one();
+#endif
+    return false;
+}
+
+void PageReader::idle_loop() {
+    while (true)
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&] { return exit || !queue.empty(); });
+
+        if (exit)
+            return;
+
+        Request r = queue.front();
+        queue.pop_front();
+        ++running;
+        lk.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+
+#if defined(__linux__)
+        madvise(reinterpret_cast<void*>(r.first), r.last - r.first + PageSize, MADV_WILLNEED);
+
+        // Fault the pages in, in case the advice is ignored
+        for (uintptr_t page = r.first; page <= r.last; page += PageSize)
+            (void) *reinterpret_cast<const volatile uint8_t*>(page);
+#endif
+
+        r.stats->readNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count(),
+                                  std::memory_order_relaxed);
+
+        lk.lock();
+        --running;
+        idle.notify_all();
+    }
+}
+
+PageReader Reader;
+
+// Keeps the size of the mapped files under a limit, for hosts that count the pages
+// of the mappings against the memory of the process. When a new mapping exceeds it,
+// the least recently used tables are unmapped, and get mapped again at their next
+// probe. A probe pins its table while it reads the mapping: the pin is taken before
+// reading 'ready', and the unmapping clears 'ready' before reading the pins, so
+// either the probe takes the locked path or the table is not unmapped.
+class MappingLimit {
+   public:
+    // Called with the search stopped, so that the probes can read it without sync
+    void set(uint64_t bytes) {
+        std::scoped_lock<std::mutex> lk(mutex);
+        limit = bytes;
+        enforce(nullptr);
+    }
+
+    bool enabled() const { return limit != 0; }
+
+    template<TBType Type>
+    void pin(TBTable<Type>& e) {
+        e.users.fetch_add(1);
+
+        // The clock only moves when a table is mapped, so this rarely writes
+        const uint64_t now = clock.load(std::memory_order_relaxed);
+        if (e.lastUse.load(std::memory_order_relaxed) != now)
+            e.lastUse.store(now, std::memory_order_relaxed);
+    }
+
+    template<TBType Type>
+    void unpin(TBTable<Type>& e) {
+        e.users.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Called under the lock after the file of a table has been mapped
+    template<TBType Type>
+    void add(TBTable<Type>& e) {
+        mappedBytes += e.fileSize;
+        e.lastUse = ++clock;
+
+        if (e.unmapped)
+        {
+            e.unmapped = false;
+            e.io.remaps.fetch_add(1, std::memory_order_relaxed);
+            remaps++;
+        }
+
+        enforce(&e);
+    }
+
+    void clear() {
+        std::scoped_lock<std::mutex> lk(mutex);
+        mappedBytes = unmaps = remaps = 0;
+    }
+
+    uint64_t mapped() {
+        std::scoped_lock<std::mutex> lk(mutex);
+        return mappedBytes;
+    }
+
+    std::string info() {
+        std::scoped_lock<std::mutex> lk(mutex);
+        std::stringstream            ss;
+
+        ss << "Mapped " << mappedBytes / (1024 * 1024) << " MB";
+        if (limit)
+            ss << " of " << limit / (1024 * 1024) << " MB, " << unmaps << " unmaps, " << remaps
+               << " remaps";
+        return ss.str();
+    }
+
+    std::mutex mutex;  // Of the mapping of the tables
+
+   private:
+    template<TBType Type>
+    bool unmap(TBTable<Type>& e);
+    void enforce(const void* keep);
+
+    uint64_t              limit       = 0;  // 0 for no limit
+    uint64_t              mappedBytes = 0;
+    uint64_t              unmaps      = 0;
+    uint64_t              remaps      = 0;
+    std::atomic<uint64_t> clock{0};
+};
+
+template<TBType Type>
+bool MappingLimit::unmap(TBTable<Type>& e) {
+
+    e.ready.store(false);
+
+    if (e.users.load())
+    {
+        e.ready.store(true, std::memory_order_release);
+        return false;
+    }
+
+    // The I/O threads could still touch the pages of the queued reads
+    Reader.drain();
+
+    TBFile::unmap(e.baseAddress, e.mapping);
+    e.baseAddress = nullptr;
+    e.unmapped    = true;
+    mappedBytes -= e.fileSize;
+    unmaps++;
+    return true;
+}
+
+void MappingLimit::enforce(const void* keep) {
+
+    while (limit && mappedBytes > limit)
+    {
+        void*    lru     = nullptr;
+        bool     lruWDL  = false;
+        uint64_t lruTime = UINT64_MAX;
+
+        TBTables.for_each([&](auto& e, const char* ext) {
+            if (&e != keep && e.baseAddress && e.ready.load(std::memory_order_relaxed)
+                && !e.users.load(std::memory_order_relaxed)
+                && e.lastUse.load(std::memory_order_relaxed) < lruTime)
+            {
+                lru     = &e;
+                lruWDL  = ext[3] == 'w';
+                lruTime = e.lastUse.load(std::memory_order_relaxed);
+            }
+        });
+
+        // Give up until the next mapping if the tables in use do not fit
+        if (!lru
+            || !(lruWDL ? unmap(*static_cast<TBTable<WDL>*>(lru))
+                        : unmap(*static_cast<TBTable<DTZ>*>(lru))))
+            return;
+    }
+}
+
+MappingLimit MapLimit;
+
 // If the corresponding file exists two new objects TBTable<WDL> and TBTable<DTZ>
 // are created and added to the lists and hash table. Called at init time.
 void TBTables::add(const std::vector<PieceType>& pieces) {
@@ -512,9 +857,11 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
         code += PieceToChar[pt];
     code.insert(code.find('K', 1), "v");
 
-    TBFile file_dtz(code + ".rtbz");  // KRK -> KRvK
+    TBFile   file_dtz(code + ".rtbz");  // KRK -> KRvK
+    uint64_t dtzSize = 0;
     if (file_dtz.is_open())
     {
+        dtzSize = file_dtz.size();
         file_dtz.close();
         foundDTZFiles++;
     }
@@ -524,6 +871,7 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
     if (!file.is_open())  // Only WDL file is checked
         return;
 
+    uint64_t wdlSize = file.size();
     file.close();
     foundWDLFiles++;
 
@@ -532,11 +880,142 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
     wdlTable.emplace_back(code);
     dtzTable.emplace_back(wdlTable.back());
 
+    // Remember where the files are, so that mapping them does not search again
+    wdlTable.back().path     = file.path();
+    wdlTable.back().fileSize = wdlSize;
+    if (dtzSize)
+    {
+        dtzTable.back().path     = file_dtz.path();
+        dtzTable.back().fileSize = dtzSize;
+    }
+
     // Insert into the hash keys for both colors: KRvK with KR white and black
     insert(wdlTable.back().key, &wdlTable.back(), &dtzTable.back());
     insert(wdlTable.back().key2, &wdlTable.back(), &dtzTable.back());
 }
 
+// The index of the files found by add(), to skip the search of the files and the
+// setup of their positions at the next init(). A line per table, between a header
+// with the paths it was built for and a checksum of the lines before it.
+constexpr std::string_view IndexHeader = "Stockfish Syzygy index 1";
+
+uint64_t index_checksum(uint64_t h, const std::string& line) {
+    for (unsigned char c : line)
+        h = (h ^ c) * 0x100000001B3ULL;  // FNV-1a
+    return (h ^ '\n') * 0x100000001B3ULL;
+}
+
+bool TBTables::load_index(const std::string& file) {
+
+    std::ifstream in(file);
+    std::string   line;
+    uint64_t      checksum = 0xCBF29CE484222325ULL;
+
+    if (!std::getline(in, line) || line != std::string(IndexHeader) + '\t' + TBFile::Paths)
+        return false;
+
+    checksum = index_checksum(checksum, line);
+
+    while (std::getline(in, line))
+    {
+        std::istringstream ss(line);
+        std::string        token;
+
+        if (ss >> token && token == "checksum")
+        {
+            uint64_t stored;
+            if (!(ss >> std::hex >> stored) || stored != checksum)
+                break;
+
+            sync_cout << "info string Loaded the tablebase index " << file << sync_endl;
+            return true;
+        }
+
+        checksum = index_checksum(checksum, line);
+
+        // name key key2 pieceCount hasPawns hasUniquePieces pawnCount[2]
+        // wdlSize dtzSize, then the tab separated paths of the WDL and DTZ files
+        std::string name = token;
+        Key         key, key2;
+        int         pieceCount, hasPawns, hasUniquePieces, pawnCount0, pawnCount1;
+        uint64_t    wdlSize, dtzSize;
+        std::string paths;
+
+        if (!(ss >> std::hex >> key >> key2 >> std::dec >> pieceCount >> hasPawns
+              >> hasUniquePieces >> pawnCount0 >> pawnCount1 >> wdlSize >> dtzSize)
+            || !std::getline(ss, paths))
+            break;
+
+        auto tab1 = paths.find('\t'), tab2 = paths.find('\t', tab1 + 1);
+        if (tab1 == std::string::npos || tab2 == std::string::npos)
+            break;
+
+        wdlTable.emplace_back();
+        TBTable<WDL>& e   = wdlTable.back();
+        e.name            = name;
+        e.key             = key;
+        e.key2            = key2;
+        e.pieceCount      = pieceCount;
+        e.hasPawns        = hasPawns;
+        e.hasUniquePieces = hasUniquePieces;
+        e.pawnCount[0]    = uint8_t(pawnCount0);
+        e.pawnCount[1]    = uint8_t(pawnCount1);
+        e.path            = paths.substr(tab1 + 1, tab2 - tab1 - 1);
+        e.fileSize        = wdlSize;
+
+        dtzTable.emplace_back(e);
+        if (dtzSize)
+        {
+            dtzTable.back().path     = paths.substr(tab2 + 1);
+            dtzTable.back().fileSize = dtzSize;
+            foundDTZFiles++;
+        }
+
+        foundWDLFiles++;
+        MaxCardinality = std::max(pieceCount, MaxCardinality);
+
+        insert(e.key, &e, &dtzTable.back());
+        insert(e.key2, &e, &dtzTable.back());
+    }
+
+    // Truncated or corrupted, start over with a search of the files
+    sync_cout << "info string Ignoring the invalid tablebase index " << file << sync_endl;
+    clear();
+    MaxCardinality = 0;
+    return false;
+}
+
+void TBTables::save_index(const std::string& file) const {
+
+    std::ofstream out(file);
+    uint64_t      checksum = 0xCBF29CE484222325ULL;
+
+    auto write = [&](const std::string& line) {
+        out << line << '\n';
+        checksum = index_checksum(checksum, line);
+    };
+
+    write(std::string(IndexHeader) + '\t' + TBFile::Paths);
+
+    for (size_t i = 0; i < wdlTable.size(); ++i)
+    {
+        const TBTable<WDL>& e   = wdlTable[i];
+        const TBTable<DTZ>& dtz = dtzTable[i];
+        std::ostringstream  ss;
+
+        ss << e.name << std::hex << ' ' << e.key << ' ' << e.key2 << std::dec << ' '
+           << e.pieceCount << ' ' << e.hasPawns << ' ' << e.hasUniquePieces << ' '
+           << int(e.pawnCount[0]) << ' ' << int(e.pawnCount[1]) << ' ' << e.fileSize << ' '
+           << dtz.fileSize << '\t' << e.path << '\t' << dtz.path;
+        write(ss.str());
+    }
+
+    out << "checksum " << std::hex << checksum << std::endl;
+
+    if (!out)
+        sync_cout << "info string Could not write the tablebase index " << file << sync_endl;
+}
+
 // TB tables are compressed with canonical Huffman code. The compressed data is divided into
 // blocks of size d->sizeofBlock, and each block stores a variable number of symbols.
 // Each symbol represents either a WDL or a (remapped) DTZ value, or a pair of other symbols
@@ -552,11 +1031,10 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
 // Huffman codes are the same for all blocks in the table. A non-symmetric pawnless TB file
 // will have one table for wtm and one for btm, a TB file with pawns will have tables per
 // file a,b,c,d also, in this case, one set for wtm and one for btm.
-int decompress_pairs(PairsData* d, uint64_t idx) {
-
-    // Special case where all table positions store the same value
-    if (d->flags & TBFlag::SingleValue)
-        return d->minSymLen;
+//
+// Returns the block storing the value at index "idx", and the offset of the value
+// within the block.
+uint32_t find_block(PairsData* d, uint64_t idx, int& offset) {
 
     // First we need to locate the right block that stores the value at index "idx".
     // Because each block n stores blockLength[n] + 1 values, the index i of the block
@@ -576,8 +1054,8 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     uint32_t k = uint32_t(idx / d->span);
 
     // Then we read the corresponding SparseIndex[] entry
-    uint32_t block  = number<uint32_t, LittleEndian>(&d->sparseIndex[k].block);
-    int      offset = number<uint16_t, LittleEndian>(&d->sparseIndex[k].offset);
+    uint32_t block = number<uint32_t, LittleEndian>(&d->sparseIndex[k].block);
+    offset         = number<uint16_t, LittleEndian>(&d->sparseIndex[k].offset);
 
     // Now compute the difference idx - I(k). From the definition of k, we know that
     //
@@ -597,6 +1075,19 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     while (offset > d->blockLength[block])
         offset -= d->blockLength[block++] + 1;
 
+    return block;
+}
+
+// Decompresses the value at index "idx" of the table
+int decompress_pairs(PairsData* d, uint64_t idx) {
+
+    // Special case where all table positions store the same value
+    if (d->flags & TBFlag::SingleValue)
+        return d->minSymLen;
+
+    int      offset;
+    uint32_t block = find_block(d, idx, offset);
+
     // Finally, we find the start address of our block of canonical Huffman symbols
     uint32_t* ptr = (uint32_t*) (d->data + (uint64_t(block) * d->sizeofBlock));
 
@@ -725,9 +1216,29 @@ int map_score(TBTable<DTZ>* entry, File f, int value, WDLScore wdl) {
 //
 //      idx = Binomial[1][s1] + Binomial[2][s2] + ... + Binomial[k][sk]
 //
+// For a probe that must not wait for the disk, checks that the pages read by
+// decompress_pairs() are resident, in the order it reads them.
+bool pages_resident(PairsData* d, uint64_t idx, IOStats& stats) {
+
+    if (d->flags & TBFlag::SingleValue)
+        return true;
+
+    uint32_t k = uint32_t(idx / d->span);
+    if (!Reader.resident(&d->sparseIndex[k], sizeof(SparseEntry), stats))
+        return false;
+
+    uint32_t block = number<uint32_t, LittleEndian>(&d->sparseIndex[k].block);
+    if (!Reader.resident(&d->blockLength[block], sizeof(uint16_t), stats))
+        return false;
+
+    int offset;
+    block = find_block(d, idx, offset);
+    return Reader.resident(d->data + uint64_t(block) * d->sizeofBlock, d->sizeofBlock, stats);
+}
+
 template<typename T, typename Ret = typename T::Ret>
-CLANG_AVX512_BUG_FIX Ret
-do_probe_table(const Position& pos, T* entry, WDLScore wdl, ProbeState* result) {
+CLANG_AVX512_BUG_FIX Ret do_probe_table(
+  const Position& pos, T* entry, WDLScore wdl, ProbeState* result, bool nonBlocking) {
 
     Square     squares[TBPIECES];
     Piece      pieces[TBPIECES];
@@ -934,6 +1445,9 @@ encode_remaining:
         groupSq += d->groupLen[next];
     }
 
+    if (nonBlocking && Reader.enabled() && !pages_resident(d, idx, entry->io))
+        return *result = FAIL, Ret();
+
     // Now that we have the index, decompress the pair and get the score
     return map_score(entry, tbFile, decompress_pairs(d, idx), wdl);
 }
@@ -1213,14 +1727,12 @@ void set(T& e, uint8_t* data) {
 template<TBType Type>
 void* mapped(TBTable<Type>& e, const Position& pos) {
 
-    static std::mutex mutex;
-
-    // Use 'acquire' to avoid a thread reading 'ready' == true while
-    // another is still working. (compiler reordering may cause this).
-    if (e.ready.load(std::memory_order_acquire))
+    // At least 'acquire' to avoid a thread reading 'ready' == true while another
+    // is still working, and sequentially consistent with the pin of the caller.
+    if (e.ready.load())
         return e.baseAddress;  // Could be nullptr if file does not exist
 
-    std::scoped_lock<std::mutex> lk(mutex);
+    std::scoped_lock<std::mutex> lk(MapLimit.mutex);
 
     if (e.ready.load(std::memory_order_relaxed))  // Recheck under lock
         return e.baseAddress;
@@ -1236,27 +1748,135 @@ void* mapped(TBTable<Type>& e, const Position& pos) {
     fname =
       (e.key == pos.material_key() ? w + 'v' + b : b + 'v' + w) + (Type == WDL ? ".rtbw" : ".rtbz");
 
-    uint8_t* data = TBFile(fname).map(&e.baseAddress, &e.mapping, Type);
+    uint8_t* data = TBFile(fname, e.path).map(&e.baseAddress, &e.mapping, Type, e.fileSize);
 
     if (data)
+    {
         set(e, data);
+        MapLimit.add(e);
+    }
 
     e.ready.store(true, std::memory_order_release);
     return e.baseAddress;
 }
 
+// The results of the successful table probes, shared by all the threads, as the
+// same positions get probed over and over in endgames. An entry is a single 64 bit
+// word holding the low 32 bits of the key, the table type, whether the probe set
+// CHANGE_STM, and the value, so it is lock-free like the eval cache: a racing read
+// returns either a whole entry or a miss.
+class ProbeCache {
+   public:
+    ~ProbeCache() { aligned_large_pages_free(table); }
+
+    void resize(size_t mbSize) {
+        aligned_large_pages_free(table);
+        table      = nullptr;
+        entryCount = mbSize * 1024 * 1024 / sizeof(uint64_t);
+
+        if (!entryCount)
+            return;
+
+        table =
+          static_cast<std::atomic<uint64_t>*>(aligned_large_pages_alloc(entryCount * sizeof(uint64_t)));
+
+        if (!table)
+        {
+            std::cerr << "Failed to allocate " << mbSize << "MB for Syzygy cache." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        clear();
+    }
+
+    void clear() {
+        if (table)
+            std::memset(static_cast<void*>(table), 0, entryCount * sizeof(uint64_t));
+    }
+
+    bool   enabled() const { return entryCount != 0; }
+    size_t bytes() const { return entryCount * sizeof(uint64_t); }
+
+    template<TBType Type>
+    bool probe(Key key, int& value, ProbeState* result) const {
+        const uint64_t e = table[mul_hi64(key, entryCount)].load(std::memory_order_relaxed);
+
+        if (e != pack<Type>(key, int16_t(e), e & ChangeStm))
+            return false;
+
+        value = int16_t(e);
+        if (e & ChangeStm)
+            *result = CHANGE_STM;
+        return true;
+    }
+
+    template<TBType Type>
+    void save(Key key, int value, ProbeState result) {
+        if (value >= INT16_MIN && value <= INT16_MAX)
+            table[mul_hi64(key, entryCount)].store(pack<Type>(key, value, result == CHANGE_STM),
+                                                   std::memory_order_relaxed);
+    }
+
+   private:
+    // Entry layout: key 32 bit | unused 13 bit | valid, DTZ, CHANGE_STM | value 16 bit
+    static constexpr uint64_t Valid = 1 << 18, IsDTZ = 1 << 17, ChangeStm = 1 << 16;
+
+    template<TBType Type>
+    static uint64_t pack(Key key, int value, bool changeStm) {
+        return uint64_t(uint32_t(key)) << 32 | Valid | (Type == DTZ ? IsDTZ : 0)
+             | (changeStm ? ChangeStm : 0) | uint16_t(value);
+    }
+
+    std::atomic<uint64_t>* table      = nullptr;
+    size_t                 entryCount = 0;
+};
+
+ProbeCache TBCache;
+
 template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
-Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
+Ret probe_table(const Position& pos,
+                ProbeState*     result,
+                WDLScore        wdl = WDLDraw,
+                ProbeContext*   ctx = nullptr) {
 
     if (pos.count<ALL_PIECES>() == 2)  // KvK
         return Ret(WDLDraw);
 
+    if (TBCache.enabled())
+    {
+        int value;
+        if (ctx)
+            ctx->cacheProbes++;
+
+        if (TBCache.probe<Type>(pos.key(), value, result))
+        {
+            if (ctx)
+                ctx->cacheHits++;
+            return Ret(value);
+        }
+    }
+
     TBTable<Type>* entry = TBTables.get<Type>(pos.material_key());
 
-    if (!entry || !mapped(*entry, pos))
+    if (!entry)
         return *result = FAIL, Ret();
 
-    return do_probe_table(pos, entry, wdl, result);
+    // With a mapping limit, keep the table mapped until the probe is done
+    const bool pinned = MapLimit.enabled();
+    if (pinned)
+        MapLimit.pin(*entry);
+
+    Ret value = mapped(*entry, pos)
+                ? do_probe_table(pos, entry, wdl, result, ctx && ctx->nonBlocking)
+                : (*result = FAIL, Ret());
+
+    if (pinned)
+        MapLimit.unpin(*entry);
+
+    if (TBCache.enabled() && *result != FAIL)
+        TBCache.save<Type>(pos.key(), int(value), *result);
+
+    return value;
 }
 
 // For a position where the side to move has a winning capture it is not necessary
@@ -1273,7 +1893,7 @@ Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw)
 // where the best move is an ep-move (even if losing). So in all these cases set
 // the state to ZEROING_BEST_MOVE.
 template<bool CheckZeroingMoves>
-WDLScore search(Position& pos, ProbeState* result) {
+WDLScore search(Position& pos, ProbeState* result, ProbeContext* ctx) {
 
     WDLScore  value, bestValue = WDLLoss;
     StateInfo st;
@@ -1289,7 +1909,7 @@ WDLScore search(Position& pos, ProbeState* result) {
         moveCount++;
 
         pos.do_move(move, st);
-        value = -search<false>(pos, result);
+        value = -search<false>(pos, result, ctx);
         pos.undo_move(move);
 
         if (*result == FAIL)
@@ -1319,7 +1939,7 @@ WDLScore search(Position& pos, ProbeState* result) {
         value = bestValue;
     else
     {
-        value = probe_table<WDL>(pos, result);
+        value = probe_table<WDL>(pos, result, WDLDraw, ctx);
 
         if (*result == FAIL)
             return WDLDraw;
@@ -1337,10 +1957,14 @@ WDLScore search(Position& pos, ProbeState* result) {
 
 // Called at startup and after every change to
 // "SyzygyPath" UCI option to (re)create the various tables. It is not thread
-// safe, nor it needs to be.
-void Tablebases::init(const std::string& paths) {
+// safe, nor it needs to be. With an index file the tables are read from it when
+// it matches the paths, otherwise it is written after the search of the files.
+void Tablebases::init(const std::string& paths, const std::string& indexFile) {
 
+    Reader.drain();
     TBTables.clear();
+    TBCache.clear();
+    MapLimit.clear();
     MaxCardinality = 0;
     TBFile::Paths  = paths;
 
@@ -1441,6 +2065,12 @@ void Tablebases::init(const std::string& paths) {
             LeadPawnsSize[leadPawnsCnt][f] = idx;
         }
 
+    if (!indexFile.empty() && TBTables.load_index(indexFile))
+    {
+        TBTables.info();
+        return;
+    }
+
     // Add entries in TB tables if the corresponding ".rtbw" file exists
     for (PieceType p1 = PAWN; p1 < KING; ++p1)
     {
@@ -1484,6 +2114,9 @@ void Tablebases::init(const std::string& paths) {
         }
     }
 
+    if (!indexFile.empty())
+        TBTables.save_index(indexFile);
+
     TBTables.info();
 }
 
@@ -1495,10 +2128,10 @@ void Tablebases::init(const std::string& paths) {
 //  0 : draw
 //  1 : win, but draw under 50-move rule
 //  2 : win
-WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
+WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result, ProbeContext* ctx) {
 
     *result = OK;
-    return search<false>(pos, result);
+    return search<false>(pos, result, ctx);
 }
 
 // Probe the DTZ table for a particular position.
@@ -1527,10 +2160,10 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 //
 // In short, if a move is available resulting in dtz + 50-move-counter <= 99,
 // then do not accept moves leading to dtz + 50-move-counter == 100.
-int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
+int Tablebases::probe_dtz(Position& pos, ProbeState* result, ProbeContext* ctx) {
 
     *result      = OK;
-    WDLScore wdl = search<true>(pos, result);
+    WDLScore wdl = search<true>(pos, result, ctx);
 
     if (*result == FAIL || wdl == WDLDraw)  // DTZ tables don't store draws
         return 0;
@@ -1540,7 +2173,7 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     if (*result == ZEROING_BEST_MOVE)
         return dtz_before_zeroing(wdl);
 
-    int dtz = probe_table<DTZ>(pos, result, wdl);
+    int dtz = probe_table<DTZ>(pos, result, wdl, ctx);
 
     if (*result == FAIL)
         return 0;
@@ -1563,7 +2196,8 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
         // otherwise we will get the dtz of the next move sequence. Search the
         // position after the move to get the score sign (because even in a
         // winning position we could make a losing capture or go for a draw).
-        dtz = zeroing ? -dtz_before_zeroing(search<false>(pos, result)) : -probe_dtz(pos, result);
+        dtz = zeroing ? -dtz_before_zeroing(search<false>(pos, result, ctx))
+                      : -probe_dtz(pos, result, ctx);
 
         // If the move mates, force minDTZ to 1
         if (dtz == 1 && pos.checkers() && MoveList<LEGAL>(pos).size() == 0)
@@ -1589,16 +2223,114 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 }
 
 
+// Called at startup and after every change to the "SyzygyCache" UCI option. Like
+// init(), it is not thread safe.
+void Tablebases::resize_cache(size_t mbSize) { TBCache.resize(mbSize); }
+
+// Called after every change to the "SyzygyMaxMappedMB" UCI option, with the search
+// stopped. Unmaps the least recently used tables beyond the new limit at once.
+void Tablebases::set_max_mapped(size_t mbSize) { MapLimit.set(uint64_t(mbSize) * 1024 * 1024); }
+
+// Called at startup and after every change to the "SyzygyIOThreads" or
+// "SyzygyRandomAccess" UCI options. Like init(), it is not thread safe.
+void Tablebases::set_io(size_t ioThreads, bool randomAccess) {
+
+    Reader.set_threads(ioThreads);
+
+    if (TBFile::RandomAccess == randomAccess)
+        return;
+
+    TBFile::RandomAccess = randomAccess;
+    TBTables.for_each([](auto& e, const char*) {
+        if (e.ready && e.baseAddress)
+            TBFile::advise(e.baseAddress, e.mapping);
+    });
+}
+
+// The size of the mappings, then the page faults avoided by the non-blocking probes
+// and the mappings made again after an unmapping, for each file that had some
+std::vector<std::string> Tablebases::io_stats() {
+
+    std::vector<std::string> lines{MapLimit.info()};
+
+    TBTables.for_each([&](auto& e, const char* ext) {
+        uint64_t faults = e.io.faults.load(std::memory_order_relaxed);
+        uint64_t remaps = e.io.remaps.load(std::memory_order_relaxed);
+        if (faults || remaps)
+        {
+            std::stringstream ss;
+            ss << e.name << ext << ": " << faults << " faults, "
+               << e.io.readNs.load(std::memory_order_relaxed) / 1000000 << " ms of reads, "
+               << remaps << " remaps";
+            lines.push_back(ss.str());
+        }
+    });
+
+    if (lines.size() == 1)
+        lines.push_back("No tablebase page faults");
+
+    return lines;
+}
+
+size_t Tablebases::mapped_bytes() { return size_t(MapLimit.mapped()); }
+
+size_t Tablebases::cache_bytes() { return TBCache.bytes(); }
+
+
+namespace {
+
+// Calls f(pos, rootMove) for each root move and returns false if one of the calls
+// does. With a thread pool, the moves are spread over its idle threads, which
+// each set up a copy of the root position, since a cold probe can wait on the
+// disk for a long time.
+template<typename F>
+bool for_each_root_move(Position& pos, Search::RootMoves& rootMoves, ThreadPool* threads, F f) {
+
+    const size_t jobs = threads ? std::min(threads->num_threads(), rootMoves.size()) : 1;
+
+    if (jobs <= 1)
+    {
+        for (auto& m : rootMoves)
+            if (!f(pos, m))
+                return false;
+
+        return true;
+    }
+
+    const std::string fen = pos.fen();
+    std::atomic<bool> ok{true};
+
+    for (size_t i = 0; i < jobs; ++i)
+        threads->run_on_thread(i, [&, i]() {
+            StateInfo rootState;
+            Position  rootPos;
+
+            // Like the root position of a worker, the earlier states are shared
+            rootPos.set(fen, pos.is_chess960(), &rootState);
+            rootState = *pos.state();
+
+            for (size_t j = i; j < rootMoves.size() && ok.load(std::memory_order_relaxed);
+                 j += jobs)
+                if (!f(rootPos, rootMoves[j]))
+                    ok = false;
+        });
+
+    for (size_t i = 0; i < jobs; ++i)
+        threads->wait_on_thread(i);
+
+    return ok;
+}
+
+}  // namespace
+
 // Use the DTZ tables to rank root moves.
 //
 // A return value false indicates that not all probes were successful.
 bool Tablebases::root_probe(Position&          pos,
                             Search::RootMoves& rootMoves,
                             bool               rule50,
-                            bool               rankDTZ) {
-
-    ProbeState result = OK;
-    StateInfo  st;
+                            bool               rankDTZ,
+                            ThreadPool*        threads) {
 
     // Obtain 50-move counter for the root position
     int cnt50 = pos.rule50_count();
@@ -1606,21 +2338,24 @@ bool Tablebases::root_probe(Position&          pos,
     // Check whether a position was repeated since the last zeroing move.
     bool rep = pos.has_repeated();
 
-    int dtz, bound = rule50 ? (MAX_DTZ / 2 - 100) : 1;
+    int bound = rule50 ? (MAX_DTZ / 2 - 100) : 1;
 
     // Probe and rank each move
-    for (auto& m : rootMoves)
-    {
-        pos.do_move(m.pv[0], st);
+    return for_each_root_move(pos, rootMoves, threads, [&](Position& p, Search::RootMove& m) {
+        ProbeState result = OK;
+        StateInfo  st;
+        int        dtz;
+
+        p.do_move(m.pv[0], st);
 
         // Calculate dtz for the current move counting from the root position
-        if (pos.rule50_count() == 0)
+        if (p.rule50_count() == 0)
         {
             // In case of a zeroing move, dtz is one of -101/-1/0/1/101
-            WDLScore wdl = -probe_wdl(pos, &result);
+            WDLScore wdl = -probe_wdl(p, &result);
             dtz          = dtz_before_zeroing(wdl);
         }
-        else if ((rule50 && pos.is_draw(1)) || pos.is_repetition(1))
+        else if ((rule50 && p.is_draw(1)) || p.is_repetition(1))
         {
             // In case a root move leads to a draw by repetition or 50-move rule,
             // we set dtz to zero. Note: since we are only 1 ply from the root,
@@ -1630,15 +2365,15 @@ bool Tablebases::root_probe(Position&          pos,
         else
         {
             // Otherwise, take dtz for the new position and correct by 1 ply
-            dtz = -probe_dtz(pos, &result);
+            dtz = -probe_dtz(p, &result);
             dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
         }
 
         // Make sure that a mating move is assigned a dtz value of 1
-        if (pos.checkers() && dtz == 2 && MoveList<LEGAL>(pos).size() == 0)
+        if (p.checkers() && dtz == 2 && MoveList<LEGAL>(p).size() == 0)
             dtz = 1;
 
-        pos.undo_move(m.pv[0]);
+        p.undo_move(m.pv[0]);
 
         if (result == FAIL)
             return false;
@@ -1661,9 +2396,8 @@ bool Tablebases::root_probe(Position&          pos,
                   : r > -bound
                     ? Value((std::min(-3, r + (MAX_DTZ / 2 - 200)) * int(PawnValue)) / 200)
                     : -VALUE_MATE + MAX_PLY + 1;
-    }
-
-    return true;
+        return true;
+    });
 }
 
 
@@ -1671,26 +2405,27 @@ bool Tablebases::root_probe(Position&          pos,
 // This is a fallback for the case that some or all DTZ tables are missing.
 //
 // A return value false indicates that not all probes were successful.
-bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, bool rule50) {
+bool Tablebases::root_probe_wdl(Position&          pos,
+                                Search::RootMoves& rootMoves,
+                                bool               rule50,
+                                ThreadPool*        threads) {
 
     static const int WDL_to_rank[] = {-MAX_DTZ, -MAX_DTZ + 101, 0, MAX_DTZ - 101, MAX_DTZ};
 
-    ProbeState result = OK;
-    StateInfo  st;
-    WDLScore   wdl;
-
-
     // Probe and rank each move
-    for (auto& m : rootMoves)
-    {
-        pos.do_move(m.pv[0], st);
+    return for_each_root_move(pos, rootMoves, threads, [&](Position& p, Search::RootMove& m) {
+        ProbeState result = OK;
+        StateInfo  st;
+        WDLScore   wdl;
 
-        if (pos.is_draw(1))
+        p.do_move(m.pv[0], st);
+
+        if (p.is_draw(1))
             wdl = WDLDraw;
         else
-            wdl = -probe_wdl(pos, &result);
+            wdl = -probe_wdl(p, &result);
 
-        pos.undo_move(m.pv[0]);
+        p.undo_move(m.pv[0]);
 
         if (result == FAIL)
             return false;
@@ -1700,15 +2435,15 @@ bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, boo
         if (!rule50)
             wdl = wdl > WDLDraw ? WDLWin : wdl < WDLDraw ? WDLLoss : WDLDraw;
         m.tbScore = WDL_to_value[wdl + 2];
-    }
-
-    return true;
+        return true;
+    });
 }
 
 Config Tablebases::rank_root_moves(const OptionsMap&  options,
                                    Position&          pos,
                                    Search::RootMoves& rootMoves,
-                                   bool               rankDTZ) {
+                                   bool               rankDTZ,
+                                   ThreadPool*        threads) {
     Config config;
 
     if (rootMoves.empty())
@@ -1732,13 +2467,13 @@ Config Tablebases::rank_root_moves(const OptionsMap&  options,
     if (config.cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
         // Rank moves using DTZ tables
-        config.rootInTB = root_probe(pos, rootMoves, options["Syzygy50MoveRule"], rankDTZ);
+        config.rootInTB = root_probe(pos, rootMoves, options["Syzygy50MoveRule"], rankDTZ, threads);
 
         if (!config.rootInTB)
         {
             // DTZ tables are missing; try to rank moves using WDL tables
             dtz_available   = false;
-            config.rootInTB = root_probe_wdl(pos, rootMoves, options["Syzygy50MoveRule"]);
+            config.rootInTB = root_probe_wdl(pos, rootMoves, options["Syzygy50MoveRule"], threads);
         }
     }
 
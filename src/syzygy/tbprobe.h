@@ -19,6 +19,8 @@
 #ifndef TBPROBE_H
 #define TBPROBE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -26,6 +28,7 @@
 namespace Stockfish {
 class Position;
 class OptionsMap;
+class ThreadPool;
 
 using Depth = int;
 
@@ -60,18 +63,44 @@ enum ProbeState {
     ZEROING_BEST_MOVE = 2    // Best move zeroes DTZ (capture or pawn move)
 };
 
+// State of a probe from the search: whether it fails instead of waiting for the
+// pages of the files to be read from disk, and the counters of the results cache.
+struct ProbeContext {
+    bool          nonBlocking = false;
+    std::uint64_t cacheProbes = 0;
+    std::uint64_t cacheHits   = 0;
+};
+
 extern int MaxCardinality;
 
 
-void     init(const std::string& paths);
-WDLScore probe_wdl(Position& pos, ProbeState* result);
-int      probe_dtz(Position& pos, ProbeState* result);
-bool     root_probe(Position& pos, Search::RootMoves& rootMoves, bool rule50, bool rankDTZ);
-bool     root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, bool rule50);
-Config   rank_root_moves(const OptionsMap&  options,
-                         Position&          pos,
-                         Search::RootMoves& rootMoves,
-                         bool               rankDTZ = false);
+void     init(const std::string& paths, const std::string& indexFile = "");
+void     resize_cache(std::size_t mbSize);    // A size of 0 disables the cache
+void     set_max_mapped(std::size_t mbSize);  // A size of 0 for no limit
+void     set_io(std::size_t ioThreads, bool randomAccess);
+WDLScore probe_wdl(Position& pos, ProbeState* result, ProbeContext* ctx = nullptr);
+int      probe_dtz(Position& pos, ProbeState* result, ProbeContext* ctx = nullptr);
+
+std::vector<std::string> io_stats();
+std::size_t              mapped_bytes();  // Of the files mapped into memory
+std::size_t              cache_bytes();
+
+// With a thread pool, the root moves are probed in parallel by its threads, which
+// must be idle
+bool   root_probe(Position&          pos,
+                  Search::RootMoves& rootMoves,
+                  bool               rule50,
+                  bool               rankDTZ,
+                  ThreadPool*        threads = nullptr);
+bool   root_probe_wdl(Position&          pos,
+                      Search::RootMoves& rootMoves,
+                      bool               rule50,
+                      ThreadPool*        threads = nullptr);
+Config rank_root_moves(const OptionsMap&  options,
+                       Position&          pos,
+                       Search::RootMoves& rootMoves,
+                       bool               rankDTZ = false,
+                       ThreadPool*        threads = nullptr);
 
 }  // namespace Stockfish::Tablebases
 
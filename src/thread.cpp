@@ -27,6 +27,7 @@
 #include <utility>
 
 #include "memory.h"
+#include "misc.h"
 #include "movegen.h"
 #include "search.h"
 #include "syzygy/tbprobe.h"
@@ -37,6 +38,9 @@
 
 namespace Stockfish {
 
+// Depth below that of the continued line at which a continued search starts
+constexpr Depth ContinuationDepthMargin = 4;
+
 // Constructor launches the thread and waits until it goes to sleep
 // in idle_loop(). Note that 'searching' and 'exit' should be already set.
 Thread::Thread(Search::SharedState&                    sharedState,
@@ -44,7 +48,6 @@ Thread::Thread(Search::SharedState&                    sharedState,
                size_t                                  n,
                OptionalThreadToNumaNodeBinder          binder) :
     idx(n),
-    nthreads(sharedState.options["Threads"]),
     stdThread(&Thread::idle_loop, this) {
 
     wait_for_search_finished();
@@ -85,6 +88,11 @@ void Thread::clear_worker() {
     run_custom_job([this]() { worker->clear(); });
 }
 
+void Thread::init_worker_tables() {
+    assert(worker != nullptr);
+    run_custom_job([this]() { worker->init_tables(); });
+}
+
 // Blocks on the condition variable until the thread has finished searching
 void Thread::wait_for_search_finished() {
 
@@ -131,74 +139,158 @@ void Thread::idle_loop() {
 
 Search::SearchManager* ThreadPool::main_manager() { return main_thread()->worker->main_manager(); }
 
-uint64_t ThreadPool::nodes_searched() const { return accumulate(&Search::Worker::nodes); }
-uint64_t ThreadPool::tb_hits() const { return accumulate(&Search::Worker::tbHits); }
+uint64_t ThreadPool::nodes_searched() const { return accumulate(&Search::WorkerCounters::nodes); }
+uint64_t ThreadPool::tb_hits() const { return accumulate(&Search::WorkerCounters::tbHits); }
+uint64_t ThreadPool::tb_cache_probes() const {
+    return accumulate(&Search::WorkerCounters::tbCacheProbes);
+}
+uint64_t ThreadPool::tb_cache_hits() const {
+    return accumulate(&Search::WorkerCounters::tbCacheHits);
+}
+uint64_t ThreadPool::eval_cache_probes() const {
+    return accumulate(&Search::WorkerCounters::evalCacheProbes);
+}
+uint64_t ThreadPool::eval_cache_hits() const {
+    return accumulate(&Search::WorkerCounters::evalCacheHits);
+}
 
-// Creates/destroys threads to match the requested number.
+// Creates/destroys threads to match the requested number, which is the one of the
+// Threads option unless the memory budget allows fewer.
 // Created and launched threads will immediately go to sleep in idle_loop.
-// Upon resizing, threads are recreated to allow for binding if necessary.
-void ThreadPool::set(const NumaConfig&                           numaConfig,
+// The binding offset is the number of threads of other pools in the process,
+// which are assumed to be bound before these ones.
+// When the NUMA binding of the existing threads doesn't change, they are kept
+// with their histories, and the added ones start from the histories of the main
+// thread. Otherwise, threads are recreated to allow for binding. Returns whether
+// the existing threads were kept.
+bool ThreadPool::set(const NumaConfig&                           numaConfig,
                      Search::SharedState                         sharedState,
-                     const Search::SearchManager::UpdateContext& updateContext) {
+                     const Search::SearchManager::UpdateContext& updateContext,
+                     size_t                                      requested,
+                     size_t                                      bindingOffset) {
+
+    // Binding threads may be problematic when there's multiple NUMA nodes and
+    // multiple Stockfish instances running. In particular, if each instance
+    // runs a single thread then they would all be mapped to the first NUMA node.
+    // This is undesirable, and so the default behaviour (i.e. when the user does not
+    // change the NumaConfig UCI setting) is to not bind the threads to processors
+    // unless we know for sure that we span NUMA nodes and replication is required.
+    const std::string numaPolicy(sharedState.options["NumaPolicy"]);
+
+    // On a hybrid processor the threads are kept off the efficiency cores, which
+    // would slow down the whole search, while they fit on the performance cores
+    const bool performanceCoresOnly = sharedState.options["Exclude Efficiency Cores"]
+                                   && numaPolicy != "none" && numaConfig.num_efficiency_cores() > 0
+                                   && bindingOffset + requested <= numaConfig.num_performance_cores();
+
+    const bool doBindThreads = [&]() {
+        if (numaPolicy == "none")
+            return false;
+
+        if (performanceCoresOnly)
+            return true;
+
+        if (numaPolicy == "auto")
+            return numaConfig.suggests_binding_threads(bindingOffset + requested);
+
+        // numaPolicy == "system" or "cache", or explicitly set by the user
+        return true;
+    }();
 
-    if (threads.size() > 0)  // destroy any existing thread(s)
+    // With the cores of the config ("cache"), each thread is bound to a core and
+    // uses the replicas of the NUMA node of the core.
+    std::vector<NumaIndex> binding;
+    std::vector<size_t>    coreBinding;
+    std::vector<bool>      efficiencyBinding;
+    if (doBindThreads && !numaConfig.cores.empty()
+        && (numaPolicy == "cache" || performanceCoresOnly))
     {
-        main_thread()->wait_for_search_finished();
+        coreBinding = numaConfig.distribute_threads_among_cores(bindingOffset + requested);
+        coreBinding.erase(coreBinding.begin(), coreBinding.begin() + bindingOffset);
+        for (size_t c : coreBinding)
+            binding.emplace_back(numaConfig.cores[c].node);
+
+        if (numaConfig.num_efficiency_cores() > 0)
+            for (size_t c : coreBinding)
+                efficiencyBinding.push_back(numaConfig.cores[c].efficiency);
+    }
+    else if (doBindThreads)
+    {
+        binding = numaConfig.distribute_threads_among_numa_nodes(bindingOffset + requested);
+        binding.erase(binding.begin(), binding.begin() + bindingOffset);
+    }
 
-        threads.clear();
+    const auto nodesUsed = [](const std::vector<NumaIndex>& b) {
+        return b.empty() ? NumaIndex(1) : *std::max_element(b.begin(), b.end()) + 1;
+    };
+    const size_t      common  = std::min(threads.size(), binding.size());
+    const std::string config  = numaConfig.to_string();
+    const bool        keepAll = !threads.empty() && requested > 0 && config == boundNumaConfig
+                        && doBindThreads == !boundThreadToNumaNode.empty()
+                        && nodesUsed(binding) == nodesUsed(boundThreadToNumaNode)
+                        && std::equal(binding.begin(), binding.begin() + common,
+                                      boundThreadToNumaNode.begin())
+                        && coreBinding.empty() == boundThreadToCore.empty()
+                        && std::equal(coreBinding.begin(),
+                                      coreBinding.begin() + std::min(common, coreBinding.size()),
+                                      boundThreadToCore.begin());
+
+    if (threads.size() > 0)  // destroy any existing thread(s) not kept
+    {
+        main_thread()->wait_for_search_finished();
 
-        boundThreadToNumaNode.clear();
+        threads.resize(keepAll ? std::min(threads.size(), requested) : 0);
     }
 
-    const size_t requested = sharedState.options["Threads"];
+    boundThreadToNumaNode       = binding;
+    boundThreadToCore           = coreBinding;
+    boundThreadToEfficiencyCore = efficiencyBinding;
+    boundNumaConfig             = config;
+
+    const size_t firstNew = threads.size();
 
-    if (requested > 0)  // create new thread(s)
+    while (threads.size() < requested)  // create new thread(s)
     {
-        // Binding threads may be problematic when there's multiple NUMA nodes and
-        // multiple Stockfish instances running. In particular, if each instance
-        // runs a single thread then they would all be mapped to the first NUMA node.
-        // This is undesirable, and so the default behaviour (i.e. when the user does not
-        // change the NumaConfig UCI setting) is to not bind the threads to processors
-        // unless we know for sure that we span NUMA nodes and replication is required.
-        const std::string numaPolicy(sharedState.options["NumaPolicy"]);
-        const bool        doBindThreads = [&]() {
-            if (numaPolicy == "none")
-                return false;
-
-            if (numaPolicy == "auto")
-                return numaConfig.suggests_binding_threads(requested);
-
-            // numaPolicy == "system", or explicitly set by the user
-            return true;
-        }();
+        const size_t    threadId = threads.size();
+        const NumaIndex numaId   = doBindThreads ? boundThreadToNumaNode[threadId] : 0;
+        auto            manager  = threadId == 0 ? std::unique_ptr<Search::ISearchManager>(
+                                         std::make_unique<Search::SearchManager>(updateContext))
+                                                 : std::make_unique<Search::NullSearchManager>();
+
+        // When not binding threads we want to force all access to happen
+        // from the same NUMA node, because in case of NUMA replicated memory
+        // accesses we don't want to trash cache in case the threads get scheduled
+        // on the same NUMA node.
+        auto binder =
+          !boundThreadToCore.empty()
+            ? OptionalThreadToNumaNodeBinder(numaConfig, numaId, boundThreadToCore[threadId])
+          : doBindThreads ? OptionalThreadToNumaNodeBinder(numaConfig, numaId)
+                          : OptionalThreadToNumaNodeBinder(numaId);
+
+        threads.emplace_back(
+          std::make_unique<Thread>(sharedState, std::move(manager), threadId, binder));
+    }
 
-        boundThreadToNumaNode = doBindThreads
-                                ? numaConfig.distribute_threads_among_numa_nodes(requested)
-                                : std::vector<NumaIndex>{};
-
-        while (threads.size() < requested)
-        {
-            const size_t    threadId = threads.size();
-            const NumaIndex numaId   = doBindThreads ? boundThreadToNumaNode[threadId] : 0;
-            auto            manager  = threadId == 0 ? std::unique_ptr<Search::ISearchManager>(
-                                             std::make_unique<Search::SearchManager>(updateContext))
-                                                     : std::make_unique<Search::NullSearchManager>();
-
-            // When not binding threads we want to force all access to happen
-            // from the same NUMA node, because in case of NUMA replicated memory
-            // accesses we don't want to trash cache in case the threads get scheduled
-            // on the same NUMA node.
-            auto binder = doBindThreads ? OptionalThreadToNumaNodeBinder(numaConfig, numaId)
-                                        : OptionalThreadToNumaNodeBinder(numaId);
-
-            threads.emplace_back(
-              std::make_unique<Thread>(sharedState, std::move(manager), threadId, binder));
-        }
+    if (requested == 0)
+        return false;
 
+    if (!keepAll)
         clear();
+    else
+    {
+        const Search::Worker& mainWorker = *main_thread()->worker;
 
-        main_thread()->wait_for_search_finished();
+        for (size_t i = firstNew; i < threads.size(); ++i)
+            threads[i]->run_custom_job(
+              [this, i, &mainWorker]() { threads[i]->worker->copy_histories(mainWorker); });
+
+        for (size_t i = firstNew; i < threads.size(); ++i)
+            threads[i]->wait_for_search_finished();
     }
+
+    main_thread()->wait_for_search_finished();
+
+    return keepAll;
 }
 
 
@@ -207,6 +299,33 @@ void ThreadPool::clear() {
     if (threads.size() == 0)
         return;
 
+    // The correction histories that can be shared by the threads of a NUMA node
+    // are allocated and cleared by the first thread bound to it, before the
+    // workers are pointed to them.
+    const NumaIndex nodes =
+      boundThreadToNumaNode.empty()
+        ? 1
+        : *std::max_element(boundThreadToNumaNode.begin(), boundThreadToNumaNode.end()) + 1;
+
+    sharedCorrectionHistories.resize(nodes);
+
+    for (NumaIndex n = 0; n < nodes; ++n)
+    {
+        const auto it = std::find(boundThreadToNumaNode.begin(), boundThreadToNumaNode.end(), n);
+        if (!boundThreadToNumaNode.empty() && it == boundThreadToNumaNode.end())
+            continue;
+
+        const size_t i = it - boundThreadToNumaNode.begin();
+        threads[i]->run_custom_job([this, n]() {
+            if (!sharedCorrectionHistories[n])
+                sharedCorrectionHistories[n] = make_unique_large_page<CorrectionHistories>();
+            sharedCorrectionHistories[n]->clear();
+        });
+    }
+
+    for (auto&& th : threads)
+        th->wait_for_search_finished();
+
     for (auto&& th : threads)
         th->clear_worker();
 
@@ -217,12 +336,23 @@ void ThreadPool::clear() {
     main_manager()->bestPreviousAverageScore = VALUE_INFINITE;
     main_manager()->previousTimeReduction    = 0.85;
 
+    main_manager()->continuation       = {};
     main_manager()->callsCnt           = 0;
     main_manager()->bestPreviousScore  = VALUE_INFINITE;
     main_manager()->originalTimeAdjust = -1;
     main_manager()->tm.clear();
 }
 
+// Reallocates the tables of the workers that depend on the options, keeping
+// the histories, so that it can be done in the middle of a game.
+void ThreadPool::init_worker_tables() {
+    for (auto&& th : threads)
+        th->init_worker_tables();
+
+    for (auto&& th : threads)
+        th->wait_for_search_finished();
+}
+
 void ThreadPool::run_on_thread(size_t threadId, std::function<void()> f) {
     assert(threads.size() > threadId);
     threads[threadId]->run_custom_job(std::move(f));
@@ -248,7 +378,16 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     main_manager()->stopOnPonderhit = stop = abortedSearch = false;
     main_manager()->ponder                                 = limits.ponderMode;
 
-    increaseDepth = true;
+    increaseDepth  = true;
+    publishedNodes = 0;
+    multiPVTable.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(epochMutex);
+        epochThreads = size();
+        epochArrived = 0;
+        epochStop    = false;
+    }
 
     Search::RootMoves rootMoves;
     const auto        legalmoves = MoveList<LEGAL>(pos);
@@ -265,14 +404,43 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
         for (const auto& m : legalmoves)
             rootMoves.emplace_back(m);
 
-    Tablebases::Config tbConfig = Tablebases::rank_root_moves(options, pos, rootMoves);
+    Tablebases::Config tbConfig =
+      Tablebases::rank_root_moves(options, pos, rootMoves, false, this);
+
+    // When the root is the position expected by the last search, continue its
+    // line. The iterations well below its depth would mostly be TT hits.
+    Depth       startDepth = 0;
+    const auto& cont       = main_manager()->continuation;
+
+    if (options["Search Continuation"] && !tbConfig.rootInTB && cont.key == pos.key()
+        && !cont.pv.empty())
+    {
+        Utility::move_to_front(rootMoves, [&](const auto& rm) { return rm == cont.pv[0]; });
+
+        if (rootMoves[0] == cont.pv[0])
+        {
+            rootMoves[0].pv               = cont.pv;
+            rootMoves[0].score            = cont.averageScore;
+            rootMoves[0].uciScore         = cont.averageScore;
+            rootMoves[0].selDepth         = int(cont.pv.size());
+            rootMoves[0].averageScore     = cont.averageScore;
+            rootMoves[0].meanSquaredScore = cont.meanSquaredScore;
+
+            startDepth = std::max(0, cont.depth - ContinuationDepthMargin);
+            if (limits.depth)
+                startDepth = std::min(startDepth, limits.depth - 1);
+        }
+    }
+
+    // The root search takes the first move of each line as its TT move, so the book
+    // move is searched first, and stays first as long as it scores best.
+    if (!startDepth && limits.bookMove != Move::none())
+        Utility::move_to_front(rootMoves, [&](const auto& rm) { return rm == limits.bookMove; });
 
-    // After ownership transfer 'states' becomes empty, so if we stop the search
-    // and call 'go' again without setting a new position states.get() == nullptr.
-    assert(states.get() || setupStates.get());
+    // Keep the states alive for the search, the engine may drop or extend its list
+    assert(states.get());
 
-    if (states.get())
-        setupStates = std::move(states);  // Ownership transfer, states is now empty
+    setupStates = states;
 
     // We use Position::set() to set root position across threads. But there are
     // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
@@ -282,10 +450,14 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     for (auto&& th : threads)
     {
         th->run_custom_job([&]() {
-            th->worker->limits = limits;
-            th->worker->nodes = th->worker->tbHits = th->worker->nmpMinPly =
-              th->worker->bestMoveChanges          = 0;
-            th->worker->rootDepth = th->worker->completedDepth = 0;
+            th->worker->limits    = limits;
+            th->worker->nmpMinPly = 0;
+            th->worker->counters.nodes = th->worker->counters.tbHits =
+              th->worker->counters.bestMoveChanges                  = 0;
+            th->worker->counters.evalCacheProbes = th->worker->counters.evalCacheHits = 0;
+            th->worker->counters.tbCacheProbes = th->worker->counters.tbCacheHits = 0;
+            th->worker->rootDepth                              = startDepth;
+            th->worker->completedDepth                         = startDepth;
             th->worker->rootMoves                              = rootMoves;
             th->worker->rootPos.set(pos.fen(), pos.is_chess960(), &th->worker->rootState);
             th->worker->rootState = setupStates->back();
@@ -299,6 +471,44 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     main_thread()->start_searching();
 }
 
+void ThreadPool::epoch_checkpoint() {
+    std::unique_lock<std::mutex> lock(epochMutex);
+
+    if (++epochArrived == epochThreads)
+        end_epoch();
+    else
+    {
+        const uint64_t current = epoch;
+        epochCv.wait(lock, [&] { return epoch != current; });
+    }
+}
+
+void ThreadPool::epoch_leave(bool stopOthers) {
+    std::lock_guard<std::mutex> lock(epochMutex);
+
+    epochStop |= stopOthers;
+
+    // The last thread to leave commits the writes of the epoch it ends in
+    if (--epochThreads == 0 || epochArrived == epochThreads)
+        end_epoch();
+}
+
+// Called by the last thread to reach the end of the epoch, the others are waiting
+// or have left, so that the node counts and the TT writes are those of the epoch.
+void ThreadPool::end_epoch() {
+    for (auto&& th : threads)
+        th->worker->deferredTT.commit(th->worker->tt);
+
+    const uint64_t nodeLimit = main_thread()->worker->limits.nodes;
+
+    if (epochStop || (nodeLimit && nodes_searched() >= nodeLimit))
+        stop = true;
+
+    epochArrived = 0;
+    ++epoch;
+    epochCv.notify_all();
+}
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = threads.front().get();
@@ -403,6 +613,34 @@ std::vector<size_t> ThreadPool::get_bound_thread_count_by_numa_node() const {
     return counts;
 }
 
+std::vector<size_t> ThreadPool::get_bound_thread_count_by_cache_domain(
+  const NumaConfig& numaConfig) const {
+    std::vector<size_t> counts;
+
+    if (!boundThreadToCore.empty())
+    {
+        counts.resize(numaConfig.cacheDomains.size(), 0);
+
+        for (size_t c : boundThreadToCore)
+            counts[numaConfig.cores[c].cacheDomain] += 1;
+    }
+
+    return counts;
+}
+
+std::array<std::pair<uint64_t, size_t>, 2> ThreadPool::nodes_searched_by_core_type() const {
+    std::array<std::pair<uint64_t, size_t>, 2> result{};
+
+    for (size_t i = 0; i < boundThreadToEfficiencyCore.size() && i < threads.size(); ++i)
+    {
+        auto& [nodes, count] = result[boundThreadToEfficiencyCore[i]];
+        nodes += threads[i]->worker->counters.nodes.load(std::memory_order_relaxed);
+        count += 1;
+    }
+
+    return result;
+}
+
 void ThreadPool::ensure_network_replicated() {
     for (auto&& th : threads)
         th->ensure_network_replicated();
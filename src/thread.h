@@ -19,6 +19,7 @@
 #ifndef THREAD_H_INCLUDED
 #define THREAD_H_INCLUDED
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstddef>
@@ -26,6 +27,8 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "memory.h"
@@ -54,16 +57,25 @@ class OptionalThreadToNumaNodeBinder {
         numaConfig(&cfg),
         numaId(n) {}
 
+    // Binds to a core of the config instead of the whole NUMA node
+    OptionalThreadToNumaNodeBinder(const NumaConfig& cfg, NumaIndex n, size_t c) :
+        numaConfig(&cfg),
+        numaId(n),
+        core(c) {}
+
     NumaReplicatedAccessToken operator()() const {
-        if (numaConfig != nullptr)
+        if (numaConfig != nullptr && core.has_value())
+            return numaConfig->bind_current_thread_to_core(*core);
+        else if (numaConfig != nullptr)
             return numaConfig->bind_current_thread_to_numa_node(numaId);
         else
             return NumaReplicatedAccessToken(numaId);
     }
 
    private:
-    const NumaConfig* numaConfig;
-    NumaIndex         numaId;
+    const NumaConfig*     numaConfig;
+    NumaIndex             numaId;
+    std::optional<size_t> core;
 };
 
 // Abstraction of a thread. It contains a pointer to the worker and a native thread.
@@ -82,6 +94,7 @@ class Thread {
     void idle_loop();
     void start_searching();
     void clear_worker();
+    void init_worker_tables();
     void run_custom_job(std::function<void()> f);
 
     void ensure_network_replicated();
@@ -100,7 +113,7 @@ class Thread {
    private:
     std::mutex                mutex;
     std::condition_variable   cv;
-    size_t                    idx, nthreads;
+    size_t                    idx;
     bool                      exit = false, searching = true;  // Set before starting std::thread
     NativeThread              stdThread;
     NumaReplicatedAccessToken numaAccessToken;
@@ -114,8 +127,10 @@ class ThreadPool {
    public:
     ThreadPool() {}
 
-    ~ThreadPool() {
-        // destroy any existing thread(s)
+    ~ThreadPool() { release(); }
+
+    // Destroys the threads, so that the next set() creates them anew
+    void release() {
         if (threads.size() > 0)
         {
             main_thread()->wait_for_search_finished();
@@ -135,24 +150,71 @@ class ThreadPool {
     void   wait_on_thread(size_t threadId);
     size_t num_threads() const;
     void   clear();
-    void   set(const NumaConfig& numaConfig,
+    void   init_worker_tables();
+    bool   set(const NumaConfig& numaConfig,
                Search::SharedState,
-               const Search::SearchManager::UpdateContext&);
+               const Search::SearchManager::UpdateContext&,
+               size_t requested,
+               size_t bindingOffset = 0);
 
     Search::SearchManager* main_manager();
     Thread*                main_thread() const { return threads.front().get(); }
     uint64_t               nodes_searched() const;
     uint64_t               tb_hits() const;
+    uint64_t               tb_cache_probes() const;
+    uint64_t               tb_cache_hits() const;
+    uint64_t               eval_cache_probes() const;
+    uint64_t               eval_cache_hits() const;
     Thread*                get_best_thread() const;
     void                   start_searching();
     void                   wait_for_search_finished() const;
 
+    // With 'Reproducible Search', the threads wait for each other every
+    // Search::EpochNodes nodes of their own, and the TT writes of the epoch that
+    // ends are committed in a fixed order. A stop only takes effect there, so the
+    // threads always stop at the same node for the same search.
+    void epoch_checkpoint();
+    // Called by a thread whose search is over, which may ask the others to stop
+    void epoch_leave(bool stopOthers);
+
     std::vector<size_t> get_bound_thread_count_by_numa_node() const;
+    // Empty when the threads are not bound to the cores of the config
+    std::vector<size_t> get_bound_thread_count_by_cache_domain(const NumaConfig&) const;
+
+    // The nodes and the number of the threads bound to the performance cores and
+    // to the efficiency cores of a hybrid processor, all 0 without such binding
+    std::array<std::pair<uint64_t, size_t>, 2> nodes_searched_by_core_type() const;
+
+    // Empty when the threads are not bound to NUMA nodes
+    const std::vector<NumaIndex>& get_bound_thread_to_numa_node() const {
+        return boundThreadToNumaNode;
+    }
 
     void ensure_network_replicated();
 
+    // The correction histories of the threads bound to the NUMA node, when shared
+    CorrectionHistories& shared_correction_histories(NumaIndex n) {
+        return *sharedCorrectionHistories[n];
+    }
+    // The NUMA nodes that have their own correction histories allocated
+    std::vector<NumaIndex> shared_correction_history_nodes() const {
+        std::vector<NumaIndex> nodes;
+        for (NumaIndex n = 0; n < sharedCorrectionHistories.size(); ++n)
+            if (sharedCorrectionHistories[n])
+                nodes.push_back(n);
+        return nodes;
+    }
+
     std::atomic_bool stop, abortedSearch, increaseDepth;
 
+    // Sum of the nodes of the workers, lagging behind by less than
+    // Search::NodesPublishInterval nodes per worker. On a cache line of its own,
+    // as all the threads write to it.
+    alignas(64) std::atomic<uint64_t> publishedNodes;
+
+    alignas(64) Search::BusyTable busyTable;
+    Search::MultiPVTable          multiPVTable;
+
     auto cbegin() const noexcept { return threads.cbegin(); }
     auto begin() noexcept { return threads.begin(); }
     auto end() noexcept { return threads.end(); }
@@ -161,15 +223,33 @@ class ThreadPool {
     auto empty() const noexcept { return threads.empty(); }
 
    private:
+    // The states of the moves up to the root, kept alive for the search. After
+    // start_thinking() the search only reads them through the previous pointers
+    // of the root states, never through the list, so the engine may append to it
+    // during the search: a deque keeps its elements in place when it grows.
     StateListPtr                         setupStates;
     std::vector<std::unique_ptr<Thread>> threads;
     std::vector<NumaIndex>               boundThreadToNumaNode;
+    std::vector<size_t>                  boundThreadToCore;
+    std::vector<bool>                    boundThreadToEfficiencyCore;
+    std::string                          boundNumaConfig;
+
+    std::vector<LargePagePtr<CorrectionHistories>> sharedCorrectionHistories;
+
+    void end_epoch();
+
+    // Of the epoch of a reproducible search, protected by the mutex
+    std::mutex              epochMutex;
+    std::condition_variable epochCv;
+    size_t                  epochThreads = 0, epochArrived = 0;
+    uint64_t                epoch        = 0;
+    bool                    epochStop    = false;
 
-    uint64_t accumulate(std::atomic<uint64_t> Search::Worker::* member) const {
+    uint64_t accumulate(std::atomic<uint64_t> Search::WorkerCounters::* member) const {
 
         uint64_t sum = 0;
         for (auto&& th : threads)
-            sum += (th->worker.get()->*member).load(std::memory_order_relaxed);
+            sum += (th->worker->counters.*member).load(std::memory_order_relaxed);
         return sum;
     }
 };
@@ -33,6 +33,64 @@ TimePoint TimeManagement::maximum() const { return maximumTime; }
 
 void TimeManagement::clear() {
     availableNodes = -1;  // When in 'nodes as time' mode
+    lastMove.ply   = -1;  // The overhead estimate is kept for the next game
+}
+
+void TimeManagement::note_stop() {
+    TimePoint none = 0;
+    stopTime.compare_exchange_strong(none, now());
+}
+
+void TimeManagement::bestmove_sent() {
+    if (currentMove.ply < 0)
+        return;
+
+    const TimePoint sent = now();
+    const TimePoint stop = stopTime;
+    lastMove             = currentMove;
+    lastMove.used        = sent - startTime;
+    lastMove.stopLatency = stop ? sent - stop : 0;
+    currentMove.ply      = -1;
+}
+
+// The overhead of a move is the time the clock of the server runs while the
+// engine does not count it: the link both ways, and the time from the stop of
+// the search to the best move being sent. The link latency is what the clock
+// lost since the previous move of the engine, beyond the time the engine saw
+// from 'go' to 'bestmove'. The samples are smoothed as the round trip time of
+// TCP, and the overhead is the average plus four mean deviations, up to 'bound'.
+TimePoint TimeManagement::adapt_overhead(const Search::LimitsType& limits,
+                                         Color                     us,
+                                         int                       ply,
+                                         TimePoint                 bound) {
+    linkLatency = -1;
+
+    if (lastMove.ply + 2 == ply && lastMove.us == us)
+    {
+        const TimePoint latency = lastMove.time + lastMove.inc - limits.time[us] - lastMove.used;
+
+        // The clock goes up at a new period of a 'moves in time' control
+        if (latency >= 0)
+        {
+            const double sample = double(latency + lastMove.stopLatency);
+            linkLatency         = latency;
+
+            if (overheadAvg < 0)
+                overheadAvg = sample, overheadDev = sample / 2;
+            else
+            {
+                overheadDev = 0.75 * overheadDev + 0.25 * std::abs(sample - overheadAvg);
+                overheadAvg = 0.875 * overheadAvg + 0.125 * sample;
+            }
+        }
+    }
+
+    // Pondering moves start before the clock of the engine, they are not measured
+    currentMove  = {us, limits.ponderMode ? -1 : ply, limits.time[us], limits.inc[us], 0, 0};
+    lastMove.ply = -1;
+
+    return overheadAvg < 0 ? bound
+                           : std::min(bound, TimePoint(std::ceil(overheadAvg + 4 * overheadDev)));
 }
 
 void TimeManagement::advance_nodes_time(std::int64_t nodes) {
@@ -44,6 +102,7 @@ void TimeManagement::advance_nodes_time(std::int64_t nodes) {
 // the bounds of time allowed for the current game ply. We currently support:
 //      1) x basetime (+ z increment)
 //      2) x moves in y seconds (+ z increment)
+//      3) x nodes per game (+ z nodes per move), with 'Nodes Budget'
 void TimeManagement::init(Search::LimitsType& limits,
                           Color               us,
                           int                 ply,
@@ -51,15 +110,32 @@ void TimeManagement::init(Search::LimitsType& limits,
                           double&             originalTimeAdjust) {
     TimePoint npmsec = TimePoint(options["nodestime"]);
 
+    // A node budget replaces the clock of the searches that have one, and of the
+    // ones without any limit. It is spent in 'nodes as time' mode, where npmsec
+    // only tells the formulas below how long the game is.
+    const bool useBudget =
+      int(options["Nodes Budget"])
+      && (limits.time[us]
+          || (!limits.movetime && !limits.depth && !limits.mate && !limits.nodes && !limits.infinite));
+
+    if (useBudget && !npmsec)
+        npmsec = BudgetNodesPerMs;
+
     // If we have no time, we don't need to fully initialize TM.
     // startTime is used by movetime and useNodesTime is used in elapsed calls.
-    startTime    = limits.startTime;
-    useNodesTime = npmsec != 0;
+    startTime       = limits.startTime;
+    useNodesTime    = npmsec != 0;
+    stopTime        = 0;
+    currentMove.ply = -1;
+    moveOverhead    = TimePoint(options["Move Overhead"]);
 
-    if (limits.time[us] == 0)
+    if (limits.time[us] == 0 && !useBudget)
         return;
 
-    TimePoint moveOverhead = TimePoint(options["Move Overhead"]);
+    // With 'Adaptive Move Overhead' the option is the bound of the overhead, which
+    // is estimated from the previous moves of the game
+    if (options["Adaptive Move Overhead"] && !useNodesTime)
+        moveOverhead = adapt_overhead(limits, us, ply, moveOverhead);
 
     // optScale is a percentage of available time to use for the current move.
     // maxScale is a multiplier applied to optimumTime.
@@ -69,7 +145,18 @@ void TimeManagement::init(Search::LimitsType& limits,
     // to nodes, and use resulting values in time management formulas.
     // WARNING: to avoid time losses, the given npmsec (nodes per millisecond)
     // must be much lower than the real engine speed.
-    if (useNodesTime)
+    if (useBudget)
+    {
+        if (availableNodes == -1)  // Only once at game start
+            availableNodes = std::int64_t(options["Nodes Budget"]) * 1000;
+
+        // Keep a time, even if the budget is spent, so that the search is bounded
+        limits.time[us] = std::max(TimePoint(availableNodes), TimePoint(1));
+        limits.inc[us]  = TimePoint(options["Nodes Increment"]) * 1000;
+        limits.npmsec   = npmsec;
+        moveOverhead    = 0;  // Nodes are not late
+    }
+    else if (useNodesTime)
     {
         if (availableNodes == -1)                       // Only once at game start
             availableNodes = npmsec * limits.time[us];  // Time is in msec
@@ -19,6 +19,7 @@
 #ifndef TIMEMAN_H_INCLUDED
 #define TIMEMAN_H_INCLUDED
 
+#include <atomic>
 #include <cstdint>
 
 #include "misc.h"
@@ -52,11 +53,46 @@ class TimeManagement {
 
     void clear();
     void advance_nodes_time(std::int64_t nodes);
+    std::int64_t available_nodes() const { return availableNodes; }
+
+    // The search stopped on its limits, or the best move was sent. They measure
+    // the latency of the move for 'Adaptive Move Overhead'. The stop may be noted
+    // by the timer thread while the main thread searches.
+    void note_stop();
+    void bestmove_sent();
+
+    // The overhead of the current move, and the latency of the link that was seen
+    // at the start of it, -1 if none
+    TimePoint move_overhead() const { return moveOverhead; }
+    TimePoint link_latency() const { return linkLatency; }
+    TimePoint stop_latency() const { return lastMove.stopLatency; }
+
+    // The speed at which a 'Nodes Budget' is seen by the time formulas, unless
+    // 'nodestime' is set. A budget of 1000 times it is treated like a 1 second game.
+    static constexpr TimePoint BudgetNodesPerMs = 1000;
 
    private:
-    TimePoint startTime;
-    TimePoint optimumTime;
-    TimePoint maximumTime;
+    TimePoint adapt_overhead(const Search::LimitsType& limits, Color us, int ply, TimePoint bound);
+
+    // A move of the engine with a clock, to find the latency at its next move
+    struct MoveRecord {
+        Color     us;
+        int       ply = -1;
+        TimePoint time, inc;
+        TimePoint used;         // From 'go' to 'bestmove'
+        TimePoint stopLatency;  // From the stop of the search to 'bestmove'
+    };
+
+    TimePoint              startTime;
+    TimePoint              optimumTime;
+    TimePoint              maximumTime;
+    TimePoint              moveOverhead = 0;
+    std::atomic<TimePoint> stopTime     = 0;
+
+    MoveRecord currentMove, lastMove;
+    TimePoint  linkLatency = -1;
+    double     overheadAvg = -1;  // Smoothed overhead and its mean deviation
+    double     overheadDev = 0;
 
     std::int64_t availableNodes = -1;     // When in 'nodes as time' mode
     bool         useNodesTime   = false;  // True if we are in 'nodes as time' mode
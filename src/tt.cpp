@@ -18,12 +18,28 @@
 
 #include "tt.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
-
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(TT_KEY_LANE) && defined(USE_SSE2)
+    #include <emmintrin.h>
+#elif defined(TT_KEY_LANE) && defined(USE_NEON)
+    #include <arm_neon.h>
+#endif
+
+#include "bitboard.h"
 #include "memory.h"
 #include "misc.h"
 #include "syzygy/tbprobe.h"
@@ -34,7 +50,7 @@ namespace Stockfish {
 
 // TTEntry struct is the 10 bytes transposition table entry, defined as below:
 //
-// key        16 bit
+// key        16 bit (kept in the cluster's key lane when built with TT_KEY_LANE)
 // depth       8 bit
 // generation  5 bit
 // pv node     1 bit
@@ -60,10 +76,16 @@ struct TTEntry {
     // The returned age is a multiple of TranspositionTable::GENERATION_DELTA
     uint8_t relative_age(const uint8_t generation8) const;
 
+    // The low 16 bits of the key of the stored position
+    uint16_t& key();
+    uint16_t  key() const { return const_cast<TTEntry*>(this)->key(); }
+
    private:
     friend class TranspositionTable;
 
+#if !defined(TT_KEY_LANE)
     uint16_t key16;
+#endif
     uint8_t  depth8;
     uint8_t  genBound8;
     Move     move16;
@@ -94,17 +116,17 @@ void TTEntry::save(
   Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
 
     // Preserve the old ttmove if we don't have a new one
-    if (m || uint16_t(k) != key16)
+    if (m || uint16_t(k) != key())
         move16 = m;
 
     // Overwrite less valuable entries (cheapest checks first)
-    if (b == BOUND_EXACT || uint16_t(k) != key16 || d - DEPTH_ENTRY_OFFSET + 2 * pv > depth8 - 4
+    if (b == BOUND_EXACT || uint16_t(k) != key() || d - DEPTH_ENTRY_OFFSET + 2 * pv > depth8 - 4
         || relative_age(generation8))
     {
         assert(d > DEPTH_ENTRY_OFFSET);
         assert(d < 256 + DEPTH_ENTRY_OFFSET);
 
-        key16     = uint16_t(k);
+        key()     = uint16_t(k);
         depth8    = uint8_t(d - DEPTH_ENTRY_OFFSET);
         genBound8 = uint8_t(generation8 | uint8_t(pv) << 2 | b);
         value16   = int16_t(v);
@@ -131,31 +153,136 @@ TTWriter::TTWriter(TTEntry* tte) :
 
 void TTWriter::write(
   Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
-    entry->save(k, v, pv, b, d, m, ev, generation8);
+    if (deferred)
+        deferred->record(k, v, pv, b, d, m, ev, generation8);
+    else
+        entry->save(k, v, pv, b, d, m, ev, generation8);
 }
 
+bool TTWriter::is_occupied() const { return entry->is_occupied(); }
+
 
 // A TranspositionTable is an array of Cluster, of size clusterCount. Each cluster consists of ClusterSize number
 // of TTEntry. Each non-empty TTEntry contains information on exactly one position. The size of a Cluster should
 // divide the size of a cache line for best performance, as the cacheline is prefetched when possible.
+//
+// When built with TT_KEY_LANE=32 or 64, the keys of a cluster are moved out of the entries into one
+// contiguous lane at the start of the cluster, so a probe matches all of them with a single SIMD
+// compare. With 8 byte entries a 32 byte cluster still holds 3 of them, and a full cache line holds 6.
+
+#if defined(TT_KEY_LANE)
+
+static_assert(TT_KEY_LANE == 32 || TT_KEY_LANE == 64, "TT_KEY_LANE must be 32 or 64");
+
+static constexpr int ClusterSize = TT_KEY_LANE == 64 ? 6 : 3;
+
+struct alignas(TT_KEY_LANE) Cluster {
+    uint16_t key[TT_KEY_LANE == 64 ? 8 : 4];  // Unused trailing lanes are never matched
+    TTEntry  entry[ClusterSize];
+};
+
+static_assert(sizeof(TTEntry) == 8, "Unexpected TTEntry size");
+static_assert(sizeof(Cluster) == TT_KEY_LANE, "Suboptimal Cluster size");
+
+// Clusters are aligned to their size, so the cluster of an entry is found from its address alone
+inline uint16_t& TTEntry::key() {
+    Cluster* c = reinterpret_cast<Cluster*>(uintptr_t(this) & ~uintptr_t(sizeof(Cluster) - 1));
+    return c->key[this - c->entry];
+}
+
+// The clear epoch of a cluster is kept in its first unused key lane
+inline uint16_t&       epoch_of(Cluster& c) { return c.key[ClusterSize]; }
+inline const uint16_t& epoch_of(const Cluster& c) { return c.key[ClusterSize]; }
+
+#else
 
 static constexpr int ClusterSize = 3;
 
 struct Cluster {
-    TTEntry entry[ClusterSize];
-    char    padding[2];  // Pad to 32 bytes
+    TTEntry  entry[ClusterSize];
+    uint16_t epoch;  // Pad to 32 bytes, see TranspositionTable::materialize()
 };
 
 static_assert(sizeof(Cluster) == 32, "Suboptimal Cluster size");
 
+inline uint16_t& TTEntry::key() { return key16; }
+
+inline uint16_t&       epoch_of(Cluster& c) { return c.epoch; }
+inline const uint16_t& epoch_of(const Cluster& c) { return c.epoch; }
+
+#endif
+
+namespace {
+
+// Returns the index of the entry of the cluster holding the given key, or -1 if there is none
+int find_key(const Cluster& cluster, uint16_t key16) {
+
+#if defined(TT_KEY_LANE) && defined(USE_SSE2)
+    #if TT_KEY_LANE == 64
+    const __m128i keys = _mm_load_si128(reinterpret_cast<const __m128i*>(cluster.key));
+    #else
+    const __m128i keys = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(cluster.key));
+    #endif
+    const unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(keys, _mm_set1_epi16(key16))))
+                        & ((1U << (2 * ClusterSize)) - 1);
+    return mask ? int(lsb(mask)) / 2 : -1;
+
+#elif defined(TT_KEY_LANE) && defined(USE_NEON)
+    #if TT_KEY_LANE == 64
+    const uint16x8_t eq   = vceqq_u16(vld1q_u16(cluster.key), vdupq_n_u16(key16));
+    const uint64_t   bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+    const uint64_t   mask = bits & ((1ULL << (8 * ClusterSize)) - 1);
+    return mask ? int(lsb(mask)) / 8 : -1;
+    #else
+    const uint16x4_t eq   = vceq_u16(vld1_u16(cluster.key), vdup_n_u16(key16));
+    const uint64_t   bits = vget_lane_u64(vreinterpret_u64_u16(eq), 0);
+    const uint64_t   mask = bits & ((1ULL << (16 * ClusterSize)) - 1);
+    return mask ? int(lsb(mask)) / 16 : -1;
+    #endif
+
+#else
+    for (int i = 0; i < ClusterSize; ++i)
+        if (cluster.entry[i].key() == key16)
+            return i;
+    return -1;
+#endif
+}
+
+}  // namespace
+
+std::pair<const void*, size_t> TranspositionTable::memory() const {
+    return {table, clusterCount * sizeof(Cluster)};
+}
 
 // Sets the size of the transposition table,
 // measured in megabytes. Transposition table consists
 // of clusters and each cluster consists of ClusterSize number of TTEntry.
-void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
+// With `rehash` set, the current entries are moved into the new table instead
+// of being discarded, at the cost of holding both tables in memory at once.
+void TranspositionTable::resize(size_t mbSize, ThreadPool& threads, bool rehash, bool lazy) {
+    const size_t newClusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+
+    if (rehash && table)
+    {
+        auto* newTable =
+          static_cast<Cluster*>(aligned_large_pages_alloc(newClusterCount * sizeof(Cluster)));
+
+        // If there is no room for both tables, fall back to a plain resize
+        if (newTable)
+        {
+            this->rehash(newTable, newClusterCount, threads);
+
+            aligned_large_pages_free(table);
+            table        = newTable;
+            clusterCount = newClusterCount;
+            clearEpoch   = 0;
+            return;
+        }
+    }
+
     aligned_large_pages_free(table);
 
-    clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+    clusterCount = newClusterCount;
 
     table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
 
@@ -165,14 +292,125 @@ void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
         exit(EXIT_FAILURE);
     }
 
-    clear(threads);
+    clear(threads, lazy);
+}
+
+
+// Per-thread tables are small, so they are allocated and cleared by their own
+// thread, which also places their pages on its NUMA node.
+void TranspositionTable::resize_private(size_t kbSize) {
+    aligned_large_pages_free(table);
+    table        = nullptr;
+    clusterCount = kbSize * 1024 / sizeof(Cluster);
+
+    if (!clusterCount)
+        return;
+
+    table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+
+    if (!table)
+    {
+        std::cerr << "Failed to allocate " << kbSize << "KB for thread hash table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    clear_private();
+}
+
+void TranspositionTable::clear_private() {
+    generation8 = 0;
+    clearEpoch  = 0;
+    std::memset(table, 0, clusterCount * sizeof(Cluster));
+}
+
+
+// Fills every cluster of newTable with the most valuable entries of the current
+// table that may belong to it. Only 16 bits of the key are stored, so the exact
+// new cluster of an entry is unknown: each new cluster takes its entries from the
+// old clusters covering the same key range. When shrinking, this keeps the deepest
+// and newest of several old clusters; when growing, an entry is copied into all
+// the clusters it may belong to, and the copies in the wrong ones are never hit
+// and age out like any other stale entry. Each thread writes its own slice of
+// newTable, in the same layout as clear(), so the pages are first touched there.
+// The new clusters are written in clear epoch 0, which the caller then sets.
+void TranspositionTable::rehash(Cluster*    newTable,
+                                size_t      newClusterCount,
+                                ThreadPool& threads) const {
+    const size_t threadCount = threads.num_threads();
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads.run_on_thread(i, [this, i, threadCount, newTable, newClusterCount]() {
+            const size_t stride = newClusterCount / threadCount;
+            const size_t start  = stride * i;
+            const size_t len    = i + 1 != threadCount ? stride : newClusterCount - start;
+
+            // Width of the key range covered by one new cluster
+            const uint64_t step = ~uint64_t(0) / newClusterCount;
+
+            for (size_t c = start; c < start + len; ++c)
+            {
+                const uint64_t lo    = c * step;
+                const uint64_t hi    = c + 1 != newClusterCount ? lo + step - 1 : ~uint64_t(0);
+                const size_t   first = mul_hi64(lo, clusterCount);
+                const size_t   last  = mul_hi64(hi, clusterCount);
+
+                // Keep the ClusterSize best entries, ordered by the replace value of probe()
+                const TTEntry* best[ClusterSize] = {};
+                auto           value = [this](const TTEntry* e) {
+                    return e->depth8 - e->relative_age(generation8);
+                };
+
+                for (size_t o = first; o <= last; ++o)
+                    for (const TTEntry& e : table[o].entry)
+                    {
+                        if (!e.is_occupied() || !is_valid(table[o]))
+                            continue;
+
+                        const TTEntry* candidate = &e;
+                        for (auto& slot : best)
+                            if (!slot || value(candidate) > value(slot))
+                            {
+                                std::swap(slot, candidate);
+                                if (!candidate)
+                                    break;
+                            }
+                    }
+
+                Cluster& dst = newTable[c];
+                std::memset(&dst, 0, sizeof(Cluster));
+                for (int k = 0; k < ClusterSize; ++k)
+                    if (best[k])
+                    {
+                        dst.entry[k]       = *best[k];
+                        dst.entry[k].key() = best[k]->key();
+                    }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.wait_on_thread(i);
 }
 
 
 // Initializes the entire transposition table to zero,
-// in a multi-threaded way.
-void TranspositionTable::clear(ThreadPool& threads) {
-    generation8              = 0;
+// in a multi-threaded way. A lazy clear only starts a new epoch, and leaves
+// the zeroing of each cluster to the first probe that touches it, so that a
+// huge table is ready at once and the OS can hand out its pages on demand.
+// The table is zeroed anyway when the epochs run out, so that a cluster stamped
+// before the last full clear is never taken as current.
+void TranspositionTable::clear(ThreadPool& threads, bool lazy) {
+    generation8 = 0;
+
+    if (lazy && clearEpoch != std::numeric_limits<uint16_t>::max())
+    {
+        ++clearEpoch;
+        return;
+    }
+
+    clearEpoch = 0;
+
     const size_t threadCount = threads.num_threads();
 
     for (size_t i = 0; i < threadCount; ++i)
@@ -192,6 +430,80 @@ void TranspositionTable::clear(ThreadPool& threads) {
 }
 
 
+bool TranspositionTable::is_valid(const Cluster& cluster) const {
+    return epoch_of(cluster) == clearEpoch;
+}
+
+
+// Zeroes the cluster if it was not written since the last clear. The epoch shares
+// the cache line of the entries, so the check is free in probe(). Two threads
+// may zero the same stale cluster at once, and the second one may then drop an
+// entry the first one just wrote, like any other racy write to the table.
+// A table allocated for a lazy clear is not zeroed at all, so a cluster of leftover
+// memory matches the epoch with a chance of 1 in 65536, and its entries are then
+// garbage that the search treats as it does key16 collisions.
+void TranspositionTable::materialize(Cluster& cluster) const {
+    if (epoch_of(cluster) == clearEpoch)
+        return;
+
+    std::memset(&cluster, 0, sizeof(Cluster));
+    epoch_of(cluster) = clearEpoch;
+}
+
+
+// Walks the whole table, unlike hashfull(). The number of key16 false positives is
+// estimated from the misses: each of them matches any occupied entry of its cluster
+// with a chance of 1 in 65536.
+std::string TranspositionTable::stats(const TTProbeStats& probes) const {
+    constexpr int         DepthBuckets = 7;
+    constexpr const char* DepthNames[] = {"<1", "1", "2-3", "4-7", "8-15", "16-31", "32+"};
+    constexpr const char* BoundNames[] = {"none", "upper", "lower", "exact"};
+
+    uint64_t depthCount[DepthBuckets] = {}, boundCount[4] = {}, ageCount[5] = {}, occupied = 0;
+
+    for (size_t i = 0; i < clusterCount; ++i)
+        if (is_valid(table[i]))
+            for (const TTEntry& e : table[i].entry)
+                if (e.is_occupied())
+                {
+                    const int d = e.depth8 + DEPTH_ENTRY_OFFSET;
+
+                    ++occupied;
+                    ++depthCount[d < 1 ? 0 : std::min(int(msb(d)) + 1, DepthBuckets - 1)];
+                    ++boundCount[e.genBound8 & 0x3];
+                    ++ageCount[std::min(e.relative_age(generation8) / GENERATION_DELTA, 4)];
+                }
+
+    const uint64_t entries = uint64_t(clusterCount) * ClusterSize;
+    const uint64_t probed  = std::max(probes.hits + probes.misses, uint64_t(1));
+
+    std::ostringstream ss;
+    ss << "Hash table: " << clusterCount * sizeof(Cluster) / (1024 * 1024) << " MB, "
+       << clusterCount << " clusters of " << ClusterSize << " entries, " << occupied
+       << " occupied (" << 100.0 * occupied / entries << "%)";
+
+    ss << "\nDepth : ";
+    for (int i = 0; i < DepthBuckets; ++i)
+        ss << (i ? ", " : "") << DepthNames[i] << " " << depthCount[i];
+
+    ss << "\nBound : ";
+    for (int i = 0; i < 4; ++i)
+        ss << (i ? ", " : "") << BoundNames[i] << " " << boundCount[i];
+
+    ss << "\nAge   : ";
+    for (int i = 0; i < 5; ++i)
+        ss << (i ? ", " : "") << i << (i == 4 ? "+ " : " ") << ageCount[i];
+
+    ss << "\nLast search probes: hits " << probes.hits << " ("
+       << 100.0 * probes.hits / probed << "%), misses " << probes.misses << ", replacements "
+       << probes.replacements
+       << "\nEstimated key16 false positives: "
+       << double(probes.misses) * occupied / clusterCount / 65536;
+
+    return ss.str();
+}
+
+
 // Returns an approximation of the hashtable
 // occupation during a search. The hash is x permill full, as per UCI protocol.
 // Only counts entries which match the current generation.
@@ -199,7 +511,7 @@ int TranspositionTable::hashfull(int maxAge) const {
     int maxAgeInternal = maxAge << GENERATION_BITS;
     int cnt            = 0;
     for (int i = 0; i < 1000; ++i)
-        for (int j = 0; j < ClusterSize; ++j)
+        for (int j = 0; j < ClusterSize && is_valid(table[i]); ++j)
             cnt += table[i].entry[j].is_occupied()
                 && table[i].entry[j].relative_age(generation8) <= maxAgeInternal;
 
@@ -207,6 +519,136 @@ int TranspositionTable::hashfull(int maxAge) const {
 }
 
 
+// A table dump starts with this header, followed by the raw Cluster array. The
+// data is stored in native byte order and layout, so a dump can only be restored
+// by a binary with the same TTEntry format into a table of the same size.
+struct TTFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t clusterBytes;
+    uint64_t clusterCount;
+    uint8_t  generation8;
+    uint8_t  keyLane;  // TT_KEY_LANE of the build, or 0 for keys inside the entries
+    char     padding[6];
+};
+
+static constexpr char     TTFileMagic[8] = {'S', 'F', 'H', 'A', 'S', 'H', '\0', '\0'};
+static constexpr uint32_t TTFileVersion  = 1;
+#if defined(TT_KEY_LANE)
+static constexpr uint8_t KeyLane = TT_KEY_LANE;
+#else
+static constexpr uint8_t KeyLane = 0;
+#endif
+
+
+// Writes the whole table, including the current generation so that the restored
+// entries keep aging correctly, to the given file. The clusters are written in
+// clear epoch 0, and the stale ones as empty.
+bool TranspositionTable::save(const std::string& filename) const {
+    TTFileHeader header{};
+    std::memcpy(header.magic, TTFileMagic, sizeof(TTFileMagic));
+    header.version      = TTFileVersion;
+    header.clusterBytes = sizeof(Cluster);
+    header.clusterCount = clusterCount;
+    header.generation8  = generation8;
+    header.keyLane      = KeyLane;
+
+    std::ofstream stream(filename, std::ios::binary);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    constexpr size_t     ChunkClusters = 4096;
+    std::vector<Cluster> chunk(ChunkClusters);
+
+    for (size_t start = 0; start < clusterCount && stream; start += ChunkClusters)
+    {
+        const size_t len = std::min(ChunkClusters, clusterCount - start);
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            chunk[i] = table[start + i];
+
+            if (!is_valid(chunk[i]))
+                std::memset(&chunk[i], 0, sizeof(Cluster));
+
+            epoch_of(chunk[i]) = 0;
+        }
+
+        stream.write(reinterpret_cast<const char*>(chunk.data()),
+                     std::streamsize(len * sizeof(Cluster)));
+    }
+
+    const bool saved = bool(stream);
+    sync_cout << (saved ? "info string Hash saved successfully to " + filename
+                        : "info string Failed to save hash to " + filename)
+              << sync_endl;
+    return saved;
+}
+
+
+// Restores a table written by save(). Each thread reads its own slice of the
+// file straight into the table, exactly like clear() zeroes it, so that the
+// pages are first touched by the thread (and NUMA node) that will use them.
+bool TranspositionTable::load(const std::string& filename, ThreadPool& threads) {
+    TTFileHeader  header{};
+    std::ifstream stream(filename, std::ios::binary);
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    std::string error;
+    if (!stream || std::memcmp(header.magic, TTFileMagic, sizeof(TTFileMagic))
+        || header.version != TTFileVersion || header.clusterBytes != sizeof(Cluster)
+        || header.keyLane != KeyLane)
+        error = "not a compatible hash file";
+    else if (header.clusterCount != clusterCount)
+        error = "set Hash to "
+              + std::to_string(header.clusterCount * sizeof(Cluster) / (1024 * 1024))
+              + " to load it";
+
+    if (!error.empty())
+    {
+        sync_cout << "info string Failed to load hash from " << filename << ": " << error
+                  << sync_endl;
+        return false;
+    }
+
+    const size_t      threadCount = threads.num_threads();
+    std::atomic<bool> good        = true;
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads.run_on_thread(i, [this, i, threadCount, &filename, &good]() {
+            const size_t stride = clusterCount / threadCount;
+            const size_t start  = stride * i;
+            const size_t len    = i + 1 != threadCount ? stride : clusterCount - start;
+
+            std::ifstream slice(filename, std::ios::binary);
+            slice.seekg(std::streamoff(sizeof(TTFileHeader) + start * sizeof(Cluster)));
+            slice.read(reinterpret_cast<char*>(&table[start]),
+                       std::streamsize(len * sizeof(Cluster)));
+
+            if (!slice)
+                good = false;
+        });
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.wait_on_thread(i);
+
+    if (!good)
+    {
+        // Never search with a partially restored table
+        clear(threads);
+        sync_cout << "info string Failed to load hash from " << filename << ": file truncated"
+                  << sync_endl;
+        return false;
+    }
+
+    generation8 = header.generation8;
+    clearEpoch  = 0;
+    sync_cout << "info string Hash loaded successfully from " << filename << sync_endl;
+    return true;
+}
+
+
 void TranspositionTable::new_search() {
     // increment by delta to keep lower bits as is
     generation8 += GENERATION_DELTA;
@@ -224,14 +666,16 @@ uint8_t TranspositionTable::generation() const { return generation8; }
 // TTEntry t2 if its replace value is greater than that of t2.
 std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key key) const {
 
-    TTEntry* const tte   = first_entry(key);
+    const size_t index = mul_hi64(key, clusterCount);
+    materialize(table[index]);
+
+    TTEntry* const tte   = &table[index].entry[0];
     const uint16_t key16 = uint16_t(key);  // Use the low 16 bits as key inside the cluster
 
-    for (int i = 0; i < ClusterSize; ++i)
-        if (tte[i].key16 == key16)
-            // This gap is the main place for read races.
-            // After `read()` completes that copy is final, but may be self-inconsistent.
-            return {tte[i].is_occupied(), tte[i].read(), TTWriter(&tte[i])};
+    if (const int i = find_key(table[index], key16); i >= 0)
+        // This gap is the main place for read races.
+        // After `read()` completes that copy is final, but may be self-inconsistent.
+        return {tte[i].is_occupied(), tte[i].read(), TTWriter(&tte[i])};
 
     // Find an entry to be replaced according to the replacement strategy
     TTEntry* replace = tte;
@@ -246,8 +690,92 @@ std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key key) cons
 }
 
 
+std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key        key,
+                                                             DeferredTTWrites& deferred) const {
+    auto [ttHit, ttData, ttWriter] = probe(key);
+    ttWriter.deferred              = &deferred;
+
+    if (const TTData* own = deferred.find(key))
+    {
+        TTData data = *own;
+        if (!data.move && ttHit)
+            data.move = ttData.move;
+        return {true, data, ttWriter};
+    }
+
+    return {ttHit, ttData, ttWriter};
+}
+
+
 TTEntry* TranspositionTable::first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
 }
 
+
+// The writes are found by an open addressing table of at least twice their number,
+// so that a probe rarely looks at more than one slot. The keys are random enough to
+// be their own hash.
+size_t DeferredTTWrites::slot(Key key) const {
+    size_t i = size_t(key) & (slots.size() - 1);
+    while (slots[i] && writes[slots[i] - 1].key != key)
+        i = (i + 1) & (slots.size() - 1);
+    return i;
+}
+
+void DeferredTTWrites::clear() {
+    for (const Write& w : writes)
+        slots[slot(w.key)] = 0;
+    writes.clear();
+}
+
+const TTData* DeferredTTWrites::find(Key key) const {
+    if (writes.empty())
+        return nullptr;
+
+    const uint32_t i = slots[slot(key)];
+    return i ? &writes[i - 1].data : nullptr;
+}
+
+void DeferredTTWrites::record(
+  Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
+
+    if (2 * (writes.size() + 1) > slots.size())
+    {
+        slots.assign(std::max(size_t(4096), 2 * slots.size()), 0);
+        for (size_t i = 0; i < writes.size(); ++i)
+            slots[slot(writes[i].key)] = uint32_t(i + 1);
+    }
+
+    const size_t s = slot(k);
+    if (!slots[s])
+    {
+        writes.push_back({k, TTData{m, v, ev, d, b, pv}, generation8});
+        slots[s] = uint32_t(writes.size());
+        return;
+    }
+
+    // The same rules as TTEntry::save() for an entry of the same position
+    Write& w = writes[slots[s] - 1];
+    if (m)
+        w.data.move = m;
+
+    if (b == BOUND_EXACT || d + 2 * pv > w.data.depth - 4 || w.generation8 != generation8)
+    {
+        w.data        = TTData{w.data.move, v, ev, d, b, pv};
+        w.generation8 = generation8;
+    }
+    else if (w.data.depth >= 5 && w.data.bound != BOUND_EXACT)
+        --w.data.depth;
+}
+
+void DeferredTTWrites::commit(const TranspositionTable& tt) {
+    for (const Write& w : writes)
+    {
+        auto [ttHit, ttData, ttWriter] = tt.probe(w.key);
+        ttWriter.write(w.key, w.data.value, w.data.is_pv, w.data.bound, w.data.depth,
+                       w.data.move, w.data.eval, w.generation8);
+    }
+    clear();
+}
+
 }  // namespace Stockfish
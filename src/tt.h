@@ -21,7 +21,10 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "memory.h"
 #include "types.h"
@@ -29,6 +32,8 @@
 namespace Stockfish {
 
 class ThreadPool;
+class DeferredTTWrites;
+class TranspositionTable;
 struct TTEntry;
 struct Cluster;
 
@@ -70,38 +75,113 @@ struct TTData {
 struct TTWriter {
    public:
     void write(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
+    bool is_occupied() const;  // Whether a write would replace the data of another position
 
    private:
     friend class TranspositionTable;
-    TTEntry* entry;
+    TTEntry*          entry;
+    DeferredTTWrites* deferred = nullptr;  // Where the write goes instead, if any
     TTWriter(TTEntry* tte);
 };
 
 
+// The TT writes of one search thread during an epoch of a reproducible search, see
+// ThreadPool::epoch_checkpoint(). Until the end of the epoch they are only seen by
+// the probes of that thread, merged like TTEntry::save() merges them. Then the
+// writes of all the threads are committed to the table in the order of the
+// threads, each in the order of the first write of its key.
+class DeferredTTWrites {
+   public:
+    void clear();
+    // The data written to the key in this epoch, if any
+    const TTData* find(Key key) const;
+    void record(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
+    void commit(const TranspositionTable& tt);
+
+   private:
+    struct Write {
+        Key     key;
+        TTData  data;
+        uint8_t generation8;
+    };
+
+    size_t slot(Key key) const;
+
+    std::vector<Write>    writes;
+    std::vector<uint32_t> slots;  // Index + 1 of the write of a key, 0 if none
+};
+
+
+// Probe counters of one search thread, merged over all threads when the search ends.
+// A replacement is a miss whose entry to be written still holds another position.
+struct TTProbeStats {
+    uint64_t hits         = 0;
+    uint64_t misses       = 0;
+    uint64_t replacements = 0;
+
+    void record(bool hit, const TTWriter& writer) {
+        hits += hit;
+        misses += !hit;
+        replacements += !hit && writer.is_occupied();
+    }
+
+    TTProbeStats& operator+=(const TTProbeStats& s) {
+        hits += s.hits;
+        misses += s.misses;
+        replacements += s.replacements;
+        return *this;
+    }
+};
+
+
 class TranspositionTable {
 
    public:
     ~TranspositionTable() { aligned_large_pages_free(table); }
 
-    void resize(size_t mbSize, ThreadPool& threads);  // Set TT size
-    void clear(ThreadPool& threads);                  // Re-initialize memory, multithreaded
+    void resize(size_t mbSize, ThreadPool& threads, bool rehash = false, bool lazy = false);
+    void clear(ThreadPool& threads, bool lazy = false);  // Re-initialize memory, multithreaded
     int  hashfull(int maxAge = 0)
       const;  // Approximate what fraction of entries (permille) have been written to during this root search
 
+    std::pair<const void*, size_t> memory() const;  // The table and its size in bytes
+
+    // A small table private to one search thread, sized in kilobytes and cleared
+    // by the calling thread. A size of 0 frees it.
+    void resize_private(size_t kbSize);
+    void clear_private();
+
+    // Histograms of the whole table by depth, bound and age, with the given probe counters
+    std::string stats(const TTProbeStats& probes) const;
+
+    bool save(const std::string& filename) const;                 // Dump the table to a file
+    bool load(const std::string& filename, ThreadPool& threads);  // Restore a dump, multithreaded
+
     void
     new_search();  // This must be called at the beginning of each root search to track entry aging
     uint8_t generation() const;  // The current age, used when writing new data to the TT
     std::tuple<bool, TTData, TTWriter>
     probe(const Key key) const;  // The main method, whose retvals separate local vs global objects
+    // Like probe(), but the writes of the thread in the current epoch of a reproducible
+    // search take precedence, and the writer adds to them
+    std::tuple<bool, TTData, TTWriter> probe(const Key key, DeferredTTWrites& deferred) const;
     TTEntry* first_entry(const Key key)
       const;  // This is the hash function; its only external use is memory prefetching.
 
    private:
     friend struct TTEntry;
 
+    void rehash(Cluster* newTable, size_t newClusterCount, ThreadPool& threads) const;
+    bool is_valid(const Cluster& cluster) const;
+    void materialize(Cluster& cluster) const;
+
     size_t   clusterCount;
     Cluster* table = nullptr;
 
+    // Each cluster carries the epoch of the clear it was last zeroed in. A lazy
+    // clear only bumps the epoch, and a cluster is zeroed when it is first probed.
+    uint16_t clearEpoch = 0;
+
     uint8_t generation8 = 0;  // Size must be not bigger than TTEntry::genBound8
 };
 
@@ -24,6 +24,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "ucioption.h"
 
@@ -98,6 +99,21 @@ void Tune::Entry<int>::read_option() {
         value = int((*options)[name]);
 }
 
+template<>
+void Tune::Entry<int>::get_parameter(std::vector<Parameter>& params) {
+    if (options->count(name))
+    {
+        const Option& o = (*options)[name];
+        params.push_back({name, value, o.min, o.max});
+    }
+}
+
+template<>
+void Tune::Entry<int>::set_parameter(std::vector<int>::const_iterator& v) {
+    if (options->count(name))
+        value = *v++;
+}
+
 // Instead of a variable here we have a PostUpdate function: just call it
 template<>
 void Tune::Entry<Tune::PostUpdate>::init_option() {}
@@ -105,6 +121,12 @@ template<>
 void Tune::Entry<Tune::PostUpdate>::read_option() {
     value();
 }
+template<>
+void Tune::Entry<Tune::PostUpdate>::get_parameter(std::vector<Parameter>&) {}
+template<>
+void Tune::Entry<Tune::PostUpdate>::set_parameter(std::vector<int>::const_iterator&) {
+    value();
+}
 
 }  // namespace Stockfish
 
@@ -90,11 +90,21 @@ class Tune {
         return t;
     }  // Singleton
 
+   public:
+    // A parameter that has an option, with its current value and the option's range
+    struct Parameter {
+        std::string name;
+        int         value, min, max;
+    };
+
+   private:
     // Use polymorphism to accommodate Entry of different types in the same vector
     struct EntryBase {
-        virtual ~EntryBase()       = default;
-        virtual void init_option() = 0;
-        virtual void read_option() = 0;
+        virtual ~EntryBase()                                            = default;
+        virtual void init_option()                                      = 0;
+        virtual void read_option()                                      = 0;
+        virtual void get_parameter(std::vector<Parameter>&)             = 0;
+        virtual void set_parameter(std::vector<int>::const_iterator& v) = 0;
     };
 
     template<typename T>
@@ -112,6 +122,8 @@ class Tune {
         void operator=(const Entry&) = delete;  // Because 'value' is a reference
         void init_option() override;
         void read_option() override;
+        void get_parameter(std::vector<Parameter>& params) override;
+        void set_parameter(std::vector<int>::const_iterator& v) override;
 
         std::string name;
         T&          value;
@@ -166,6 +178,21 @@ class Tune {
             e->read_option();
     }
 
+    // The parameters to tune, for a tuner that runs in the engine
+    static std::vector<Parameter> parameters() {
+        std::vector<Parameter> params;
+        for (auto& e : instance().list)
+            e->get_parameter(params);
+        return params;
+    }
+    // Sets the parameters, in the order of parameters(), without going through
+    // their options, and calls the post-update functions as read_options() does
+    static void set_values(const std::vector<int>& values) {
+        auto it = values.cbegin();
+        for (auto& e : instance().list)
+            e->set_parameter(it);
+    }
+
     static bool        update_on_last;
     static OptionsMap* options;
 };
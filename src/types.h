@@ -35,6 +35,9 @@
 //
 // -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 //               | only in 64-bit mode and requires hardware with pext support.
+//
+// -DUSE_HYPERBOLA | Compute the attacks of the sliders instead of looking them
+//                 | up in the 800 KB of magic tables.
 
     #include <cassert>
     #include <cstddef>
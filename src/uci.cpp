@@ -20,20 +20,33 @@
 
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
 #include <iterator>
+#include <numeric>
 #include <optional>
 #include <sstream>
+#include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "benchmark.h"
+#include "book.h"
 #include "engine.h"
 #include "memory.h"
 #include "movegen.h"
+#include "numa.h"
+#include "perft.h"
 #include "position.h"
+#include "protocol.h"
 #include "score.h"
 #include "search.h"
 #include "types.h"
@@ -52,13 +65,84 @@ struct overload: Ts... {
 template<typename... Ts>
 overload(Ts...) -> overload<Ts...>;
 
-void UCIEngine::print_info_string(std::string_view str) {
+// The centipawns of a tablebase win, minus the plies to the conversion
+constexpr int TB_CP = 20000;
+
+namespace {
+
+void append_value(std::string& out, std::string_view s) { out += s; }
+
+template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+void append_value(std::string& out, T value) {
+    char buf[24];
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+}
+
+// Sums the hardware counters of the searches of a benchmark, thread by thread
+void add_perf_counts(std::vector<PerfCounters::Counts>&       sum,
+                     const std::vector<PerfCounters::Counts>& counts) {
+    sum.resize(std::max(sum.size(), counts.size()));
+    for (size_t i = 0; i < counts.size(); ++i)
+        sum[i] += counts[i];
+}
+
+// Prints the hardware counters of each thread, split between the search and the
+// NNUE evaluation
+void print_perf_counts(const std::vector<PerfCounters::Counts>& counts) {
+    using PC = PerfCounters;
+
+    for (size_t t = 0; t < counts.size(); ++t)
+    {
+        const PC::Counts& c = counts[t];
+
+        if (c.error)
+        {
+            std::cerr << "Perf counters   : thread " << t << " not counted, " << std::strerror(c.error)
+                      << (c.error == EACCES || c.error == EPERM
+                            ? " (see /proc/sys/kernel/perf_event_paranoid)"
+                          : c.error == EBUSY  ? " (the counters could not be scheduled)"
+                          : c.error == ENOENT ? " (no hardware counters, as in many virtual machines)"
+                                              : "")
+                      << std::endl;
+            continue;
+        }
+
+        std::cerr << "Perf counters   : thread " << t << std::setw(17) << "search" << std::setw(16)
+                  << "evaluation" << std::setw(8) << "eval %" << std::endl;
+
+        for (int e = 0; e < PC::EVENT_NB; ++e)
+        {
+            std::cerr << "  " << std::left << std::setw(22) << PC::Names[e] << std::right;
+            if (!c.supported[e])
+                std::cerr << std::setw(15) << "n/a" << std::endl;
+            else
+                std::cerr << std::setw(15) << c.total[e] - c.eval[e] << std::setw(16) << c.eval[e]
+                          << std::setw(8) << std::fixed << std::setprecision(1)
+                          << 100.0 * c.eval[e] / std::max<uint64_t>(c.total[e], 1)
+                          << std::defaultfloat << std::endl;
+        }
+
+        const auto ipc = [](uint64_t instructions, uint64_t cycles) {
+            return double(instructions) / std::max<uint64_t>(cycles, 1);
+        };
+        std::cerr << "  " << std::left << std::setw(22) << "IPC" << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(15)
+                  << ipc(c.total[PC::Instructions] - c.eval[PC::Instructions],
+                         c.total[PC::Cycles] - c.eval[PC::Cycles])
+                  << std::setw(16) << ipc(c.eval[PC::Instructions], c.eval[PC::Cycles])
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+}  // namespace
+
+void UCIEngine::print_info_string(std::string_view str, std::string_view prefix) {
     sync_cout_start();
     for (auto& line : split(str, "\n"))
     {
         if (!is_whitespace(line))
         {
-            std::cout << "info string " << line << '\n';
+            std::cout << prefix << "info string " << line << '\n';
         }
     }
     sync_cout_end();
@@ -68,21 +152,25 @@ UCIEngine::UCIEngine(int argc, char** argv) :
     engine(argv[0]),
     cli(argc, argv) {
 
-    engine.get_options().add_info_listener([](const std::optional<std::string>& str) {
-        if (str.has_value())
-            print_info_string(*str);
-    });
-
-    init_search_update_listeners();
+    init_listeners(engine);
+    print_info_string(engine.memory_information().front());
 }
 
-void UCIEngine::init_search_update_listeners() {
-    engine.set_on_iter([](const auto& i) { on_iter(i); });
-    engine.set_on_update_no_moves([](const auto& i) { on_update_no_moves(i); });
-    engine.set_on_update_full(
-      [this](const auto& i) { on_update_full(i, engine.get_options()["UCI_ShowWDL"]); });
-    engine.set_on_bestmove([](const auto& bm, const auto& p) { on_bestmove(bm, p); });
-    engine.set_on_verify_networks([](const auto& s) { print_info_string(s); });
+// The output of contexts is prefixed, so that it can be told apart from the
+// output of the main engine and of the other contexts.
+void UCIEngine::init_listeners(Engine& target, const std::string& prefix) {
+    target.get_options().add_info_listener([prefix](const std::optional<std::string>& str) {
+        if (str.has_value())
+            print_info_string(*str, prefix);
+    });
+    target.set_on_iter([prefix](const auto& i) { on_iter(i, prefix); });
+    target.set_on_update_no_moves([prefix](const auto& i) { on_update_no_moves(i, prefix); });
+    target.set_on_update_full([&target, prefix](const auto& i) {
+        on_update_full(i, target.get_options()["UCI_ShowWDL"], prefix);
+    });
+    target.set_on_bestmove(
+      [prefix](const auto& bm, const auto& p) { on_bestmove(bm, p, prefix); });
+    target.set_on_verify_networks([prefix](const auto& s) { print_info_string(s, prefix); });
 }
 
 void UCIEngine::loop() {
@@ -103,7 +191,12 @@ void UCIEngine::loop() {
         is >> std::skipws >> token;
 
         if (token == "quit" || token == "stop")
+        {
             engine.stop();
+            if (token == "quit")
+                for (auto& [id, context] : contexts)
+                    context->stop();
+        }
 
         // The GUI sends 'ponderhit' to tell that the user has played the expected move.
         // So, 'ponderhit' is sent if pondering was done on the same move that the user
@@ -121,20 +214,23 @@ void UCIEngine::loop() {
         }
 
         else if (token == "setoption")
-            setoption(is);
+            setoption(engine, is);
         else if (token == "go")
         {
             // send info strings after the go command is sent for old GUIs and python-chess
             print_info_string(engine.numa_config_information_as_string());
             print_info_string(engine.thread_allocation_information_as_string());
-            go(is);
+            go(engine, is);
         }
         else if (token == "position")
-            position(is);
+            position(engine, is);
         else if (token == "ucinewgame")
             engine.search_clear();
         else if (token == "isready")
+        {
+            engine.load_hash_file();
             sync_cout << "readyok" << sync_endl;
+        }
 
         // Add custom non-UCI commands, mainly for debugging purposes.
         // These commands must not be used during a search!
@@ -144,12 +240,86 @@ void UCIEngine::loop() {
             bench(is);
         else if (token == BenchmarkCommand)
             benchmark(is);
+        else if (token == "benchsuite")
+            benchmark_suite(is);
         else if (token == "d")
             sync_cout << engine.visualize() << sync_endl;
         else if (token == "eval")
             engine.trace_eval();
         else if (token == "compiler")
             sync_cout << compiler_info() << sync_endl;
+        else if (token == "tt")
+            tt_command(is);
+        else if (token == "tune")
+        {
+            // tune spsa [game pairs] [parallel games] [nodes per move]
+            std::string mode;
+            int         pairs = 1000, games = 16;
+            uint64_t    nodes = 10000;
+            if (is >> std::skipws >> mode && mode == "spsa")
+            {
+                is >> pairs >> games >> nodes;
+                engine.tune_spsa(std::max(pairs, 1), std::max(games / 2, 1) * 2,
+                                 std::max<uint64_t>(nodes, 1));
+            }
+            else
+                sync_cout << "Usage: tune spsa [game pairs] [parallel games] [nodes per move]"
+                          << sync_endl;
+        }
+        else if (token == "threatbench")
+        {
+            int repeats = 20000;
+            is >> repeats;
+            engine.threats_benchmark(std::max(repeats, 1));
+        }
+        else if (token == "trace")
+            trace_command(is);
+        else if (token == "binary")
+        {
+            BinaryProtocol::loop(engine, std::cin, std::cout);
+            init_listeners(engine);
+        }
+        else if (token == "context")
+            context_command(is);
+        else if (token == "shm")
+            for (const auto& line : engine.network_replicas_information())
+                print_info_string(line);
+        else if (token == "memory")
+            for (const auto& line : engine.memory_information())
+                print_info_string(line);
+        else if (token == "tbstats")
+            for (const auto& line : engine.tablebase_io_stats())
+                print_info_string(line);
+        else if (token == "stats")
+            for (const auto& line : engine.search_stats())
+                print_info_string(line);
+        else if (token == "evalbatch")
+        {
+            // The evaluation from the side to move is appended as an EPD "ce" opcode
+            std::string in, out;
+            if (is >> std::skipws >> in >> out)
+                engine.eval_batch(in, out, [](const Position& pos, Value v) {
+                    return " ce " + std::to_string(to_cp(v, pos)) + ";";
+                });
+            else
+                sync_cout << "Usage: evalbatch <input file> <output file>" << sync_endl;
+        }
+        else if (token == "makebook")
+        {
+            std::string games, book;
+            int         plies = 24;
+            if (is >> std::skipws >> games >> book)
+            {
+                is >> plies;
+                if (auto count = Book::build(games, book, plies))
+                    print_info_string("Wrote " + std::to_string(*count) + " book entries to "
+                                      + book);
+                else
+                    print_info_string("Failed to build the book " + book + " from " + games);
+            }
+            else
+                sync_cout << "Usage: makebook <games file> <book file> [max plies]" << sync_endl;
+        }
         else if (token == "export_net")
         {
             std::pair<std::optional<std::string>, std::string> files[2];
@@ -162,6 +332,32 @@ void UCIEngine::loop() {
 
             engine.save_network(files);
         }
+        else if (token == "export_net_int8")
+        {
+            std::string file;
+            if (is >> std::skipws >> file)
+                engine.save_big_network_int8_threats(file);
+            else
+                sync_cout << "Usage: export_net_int8 <file>" << sync_endl;
+        }
+        else if (token == "export_net_native")
+        {
+            std::string fileBig, fileSmall;
+            if (is >> std::skipws >> fileBig >> fileSmall)
+                engine.save_network_native(fileBig, fileSmall);
+            else
+                sync_cout << "Usage: export_net_native <big net file> <small net file>"
+                          << sync_endl;
+        }
+        else if (token == "export_net_compressed")
+        {
+            std::string fileBig, fileSmall;
+            if (is >> std::skipws >> fileBig >> fileSmall)
+                engine.save_network_compressed(fileBig, fileSmall);
+            else
+                sync_cout << "Usage: export_net_compressed <big net file> <small net file>"
+                          << sync_endl;
+        }
         else if (token == "--help" || token == "help" || token == "--license" || token == "license")
             sync_cout
               << "\nStockfish is a powerful chess engine for playing and analyzing."
@@ -209,6 +405,10 @@ Search::LimitsType UCIEngine::parse_limits(std::istream& is) {
             is >> limits.mate;
         else if (token == "perft")
             is >> limits.perft;
+        else if (token == "threads")
+            is >> limits.perftThreads;
+        else if (token == "hash")
+            is >> limits.perftHash;
         else if (token == "infinite")
             limits.infinite = 1;
         else if (token == "ponder")
@@ -217,21 +417,41 @@ Search::LimitsType UCIEngine::parse_limits(std::istream& is) {
     return limits;
 }
 
-void UCIEngine::go(std::istringstream& is) {
+void UCIEngine::go(Engine& target, std::istringstream& is) {
 
     Search::LimitsType limits = parse_limits(is);
 
     if (limits.perft)
-        perft(limits);
+        perft(target, limits);
     else
-        engine.go(limits);
+        target.go(limits);
 }
 
 void UCIEngine::bench(std::istream& args) {
     std::string token;
     uint64_t    num, nodes = 0, cnt = 1;
     uint64_t    nodesSearched = 0;
-    const auto& options       = engine.get_options();
+    uint64_t    evalCacheProbes = 0, evalCacheHits = 0;
+    TimePoint   newGameTime     = 0;
+    const auto& options         = engine.get_options();
+
+    Eval::NNUE::AccumulatorDiffCounters accDiffs;
+    MovePickerStats                     movePicker;
+    std::vector<PerfCounters::Counts>   perfCounts;
+
+    // 'bench perf ...' counts the hardware events of each thread
+    auto argsStart = args.tellg();
+    args >> token;
+    if (token == "scaling")
+    {
+        bench_scaling(args);
+        return;
+    }
+    const bool perf = token == "perf";
+    if (perf)
+        argsStart = args.tellg();
+    args.clear();
+    args.seekg(argsStart);
 
     engine.set_on_update_full([&](const auto& i) {
         nodesSearched = i.nodes;
@@ -257,13 +477,21 @@ void UCIEngine::bench(std::istream& args) {
             if (token == "go")
             {
                 Search::LimitsType limits = parse_limits(is);
+                limits.perfCounters       = perf;
 
                 if (limits.perft)
-                    nodesSearched = perft(limits);
+                    nodesSearched = perft(engine, limits);
                 else
                 {
                     engine.go(limits);
                     engine.wait_for_search_finished();
+
+                    auto [probes, hits] = engine.eval_cache_counts();
+                    evalCacheProbes += probes;
+                    evalCacheHits += hits;
+                    accDiffs += engine.accumulator_diff_counts();
+                    movePicker += engine.move_picker_stats();
+                    add_perf_counts(perfCounts, engine.perf_counts());
                 }
 
                 nodes += nodesSearched;
@@ -273,13 +501,16 @@ void UCIEngine::bench(std::istream& args) {
                 engine.trace_eval();
         }
         else if (token == "setoption")
-            setoption(is);
+            setoption(engine, is);
         else if (token == "position")
-            position(is);
+            position(engine, is);
         else if (token == "ucinewgame")
         {
+            // Like 'ucinewgame' followed by 'isready', which waits for the clear
+            TimePoint start = now();
             engine.search_clear();  // search_clear may take a while
             elapsed = now();
+            newGameTime += elapsed - start;
         }
     }
 
@@ -290,12 +521,154 @@ void UCIEngine::bench(std::istream& args) {
     std::cerr << "\n==========================="    //
               << "\nTotal time (ms) : " << elapsed  //
               << "\nNodes searched  : " << nodes    //
-              << "\nNodes/second    : " << 1000 * nodes / elapsed << std::endl;
+              << "\nNodes/second    : " << 1000 * nodes / elapsed  //
+              << "\nNew game (ms)   : " << newGameTime << std::endl;
+
+    if (evalCacheProbes)
+        std::cerr << "Eval cache hits : " << 100.0 * evalCacheHits / evalCacheProbes << "% of "
+                  << evalCacheProbes << std::endl;
+
+    // Only with LRU slots, so that the output of the default bench is unchanged
+    if (int(engine.get_options()["Refresh Cache Slots"]))
+        std::cerr << "Refresh cache   : " << engine.refresh_cache_memory() / 1024
+                  << " KB per thread" << std::endl;
+
+    // Each line only with the option or the build whose work it measures
+    if (accDiffs.pushed && bool(engine.get_options()["Lazy Accumulator"]))
+        std::cerr << "Acc. diffs      : " << accDiffs.pushed << " pushed, "
+                  << 100.0 * accDiffs.skipped / accDiffs.pushed << "% never built, "
+                  << 100.0 * accDiffs.unconsumed / accDiffs.pushed << "% built but unused"
+                  << std::endl;
+
+#ifdef USE_STATS
+    if (movePicker.calls[MovePickerStats::Captures])
+    {
+        std::cerr << "Move picker     : ns per node";
+        for (auto [stage, name] : {std::pair{MovePickerStats::Captures, ", captures "},
+                                   std::pair{MovePickerStats::Quiets, ", quiets "},
+                                   std::pair{MovePickerStats::Evasions, ", evasions "}})
+            std::cerr << name << int(movePicker.nanoseconds(stage) / nodes) << " ("
+                      << movePicker.moves[stage] / std::max<uint64_t>(movePicker.calls[stage], 1)
+                      << " moves)";
+        std::cerr << std::endl;
+    }
+
+    const ContHistLineCounters& lines = movePicker.contHistLines;
+    if (lines.moves)
+        std::cerr << "Cont. hist lines: " << double(lines.packed) / nodes << " per node, "
+                  << double(lines.interleaved) / nodes << " if interleaved, for "
+                  << double(lines.moves) / nodes << " quiets scored" << std::endl;
+#endif
+
+    print_perf_counts(perfCounts);
 
     // reset callback, to not capture a dangling reference to nodesSearched
     engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
 }
 
+// Runs the bench positions at each thread count from minThreads to maxThreads, to
+// show how the speed and the time to reach the same depth scale. The speedup is
+// the one of the time to depth, and the node overhead is the extra nodes that
+// the threads search to reach the same depth, which is the cost of Lazy SMP.
+//   bench scaling <minThreads> <maxThreads> <step> [hash] [depth] [fenFile]
+void UCIEngine::bench_scaling(std::istream& args) {
+    std::string token;
+    size_t      minThreads = 1, maxThreads = get_hardware_concurrency(), step = 1;
+    uint64_t    nodesSearched = 0;
+
+    args >> minThreads >> maxThreads >> step;
+    args.clear();
+
+    minThreads = std::max(minThreads, size_t(1));
+    maxThreads = std::max(maxThreads, minThreads);
+    step       = std::max(step, size_t(1));
+
+    // The remaining arguments are those of bench, without the thread count
+    std::string ttSize = "16", limit = "13", fenFile = "default";
+    args >> ttSize >> limit >> fenFile;
+    std::istringstream       benchArgs(ttSize + " 1 " + limit + " " + fenFile + " depth");
+    std::vector<std::string> list = Benchmark::setup_bench(engine.fen(), benchArgs);
+
+    // Each run sets its own thread count
+    list.erase(std::remove_if(list.begin(), list.end(),
+                              [](const std::string& cmd) {
+                                  return cmd.find("setoption name Threads ") == 0;
+                              }),
+               list.end());
+
+    engine.set_on_update_full([&](const auto& i) { nodesSearched = i.nodes; });
+    engine.set_on_iter([](const auto&) {});
+    engine.set_on_update_no_moves([](const auto&) {});
+    engine.set_on_bestmove([](const auto&, const auto&) {});
+
+    struct Run {
+        size_t    threads;
+        uint64_t  nodes;
+        TimePoint elapsed;
+    };
+    std::vector<Run> runs;
+
+    for (size_t threads = minThreads; threads <= maxThreads; threads += step)
+    {
+        uint64_t  nodes   = 0;
+        TimePoint elapsed = 0;
+
+        std::cerr << "\nThreads: " << threads << std::flush;
+
+        std::istringstream ss("name Threads value " + std::to_string(threads));
+        setoption(engine, ss);
+
+        for (const auto& cmd : list)
+        {
+            std::istringstream is(cmd);
+            is >> std::skipws >> token;
+
+            if (token == "go")
+            {
+                Search::LimitsType limits = parse_limits(is);
+
+                TimePoint start = now();
+                engine.go(limits);
+                engine.wait_for_search_finished();
+                elapsed += now() - start;
+
+                nodes += nodesSearched;
+                nodesSearched = 0;
+            }
+            else if (token == "setoption")
+                setoption(engine, is);
+            else if (token == "position")
+                position(engine, is);
+            else if (token == "ucinewgame")
+                engine.search_clear();
+        }
+
+        runs.push_back({threads, nodes, std::max<TimePoint>(elapsed, 1)});
+    }
+
+    const Run& base = runs.front();
+
+    std::cerr << "\n\n==========================="
+              << "\nThreads  Time (ms)        Nodes  Nodes/second  Speedup  Efficiency  "
+                 "Node overhead"
+              << std::endl;
+
+    for (const Run& r : runs)
+    {
+        double speedup    = double(base.elapsed) / r.elapsed;
+        double efficiency = speedup * base.threads / r.threads;
+        double overhead   = double(r.nodes) / std::max<uint64_t>(base.nodes, 1) - 1;
+
+        std::cerr << std::setw(7) << r.threads << std::setw(11) << r.elapsed << std::setw(13)
+                  << r.nodes << std::setw(14) << 1000 * r.nodes / r.elapsed << std::fixed
+                  << std::setprecision(2) << std::setw(9) << speedup << std::setw(11)
+                  << 100 * efficiency << "%" << std::setw(13) << 100 * overhead << "%"
+                  << std::defaultfloat << std::endl;
+    }
+
+    init_listeners(engine);
+}
+
 void UCIEngine::benchmark(std::istream& args) {
     // Probably not very important for a test this long, but include for completeness and sanity.
     static constexpr int NUM_WARMUP_POSITIONS = 3;
@@ -311,6 +684,15 @@ void UCIEngine::benchmark(std::istream& args) {
     engine.set_on_bestmove([](const auto&, const auto&) {});
     engine.set_on_verify_networks([](const auto&) {});
 
+    // 'speedtest perf ...' counts the hardware events of each thread
+    std::vector<PerfCounters::Counts> perfCounts;
+    auto                              argsStart = args.tellg();
+    const bool                        perf      = args >> token && token == "perf";
+    if (perf)
+        argsStart = args.tellg();
+    args.clear();
+    args.seekg(argsStart);
+
     Benchmark::BenchmarkSetup setup = Benchmark::setup_benchmark(args);
 
     const int numGoCommands = count_if(setup.commands.begin(), setup.commands.end(),
@@ -320,11 +702,11 @@ void UCIEngine::benchmark(std::istream& args) {
 
     // Set options once at the start.
     auto ss = std::istringstream("name Threads value " + std::to_string(setup.threads));
-    setoption(ss);
+    setoption(engine, ss);
     ss = std::istringstream("name Hash value " + std::to_string(setup.ttSize));
-    setoption(ss);
+    setoption(engine, ss);
     ss = std::istringstream("name UCI_Chess960 value false");
-    setoption(ss);
+    setoption(engine, ss);
 
     // Warmup
     for (const auto& cmd : setup.commands)
@@ -351,7 +733,7 @@ void UCIEngine::benchmark(std::istream& args) {
             nodesSearched = 0;
         }
         else if (token == "position")
-            position(is);
+            position(engine, is);
         else if (token == "ucinewgame")
         {
             engine.search_clear();  // search_clear may take a while
@@ -395,6 +777,7 @@ void UCIEngine::benchmark(std::istream& args) {
             std::cerr << "\rPosition " << cnt++ << '/' << numGoCommands;
 
             Search::LimitsType limits = parse_limits(is);
+            limits.perfCounters       = perf;
 
             TimePoint elapsed = now();
 
@@ -405,12 +788,13 @@ void UCIEngine::benchmark(std::istream& args) {
             totalTime += now() - elapsed;
 
             updateHashfullReadings();
+            add_perf_counts(perfCounts, engine.perf_counts());
 
             nodes += nodesSearched;
             nodesSearched = 0;
         }
         else if (token == "position")
-            position(is);
+            position(engine, is);
         else if (token == "ucinewgame")
         {
             engine.search_clear();  // search_clear may take a while
@@ -457,21 +841,462 @@ void UCIEngine::benchmark(std::istream& args) {
 
     // clang-format on
 
-    init_search_update_listeners();
+    print_perf_counts(perfCounts);
+
+    init_listeners(engine);
+}
+
+namespace {
+
+// The repeats of a measurement
+struct Samples {
+    std::vector<double> runs;
+
+    std::string to_json() const {
+        double sum = 0, sumSq = 0;
+        for (double r : runs)
+            sum += r, sumSq += r * r;
+
+        const double n      = double(runs.size());
+        const double mean   = sum / n;
+        const double stddev = n > 1 ? std::sqrt(std::max(sumSq - n * mean * mean, 0.0) / (n - 1)) : 0;
+
+        std::ostringstream ss;
+        ss << "{\"mean\": " << mean << ", \"stddev\": " << stddev
+           << ", \"min\": " << *std::min_element(runs.begin(), runs.end())
+           << ", \"max\": " << *std::max_element(runs.begin(), runs.end()) << ", \"runs\": [";
+        for (size_t i = 0; i < runs.size(); ++i)
+            ss << (i ? ", " : "") << runs[i];
+        ss << "]}";
+        return ss.str();
+    }
+};
+
+std::string json_string(std::string_view str) {
+    std::ostringstream ss;
+    ss << '"';
+    for (char c : str)
+        if (c == '"' || c == '\\')
+            ss << '\\' << c;
+        else if (c == '\n')
+            ss << "\\n";
+        else if (std::iscntrl(static_cast<unsigned char>(c)))
+            ss << "\\u00" << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15];
+        else
+            ss << c;
+    ss << '"';
+    return ss.str();
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+// Runs the phases of a benchmark suite for hardware qualification, each repeated
+// to see the variance, and prints the results as one JSON object. The phases are
+// eval (NNUE evaluations per second on one thread), perft (from the start
+// position), tt (latency of the TT probes), nps (search speed for 1, 2, 4, ...
+// threads up to the given count) and ttd (time to search the positions to the
+// depth with all the threads).
+//   benchsuite [phases eval,perft,tt,nps,ttd] [repeats 3] [threads <cpus>] [depth 10]
+//              [positions 10] [hash 16] [perftdepth 5] [evalrounds 100] [ttmb 64]
+void UCIEngine::benchmark_suite(std::istream& args) {
+    std::string token, phases = "eval,perft,tt,nps,ttd";
+    int         repeats = 3, depth = 10, positions = 10, perftDepth = 5, evalRounds = 100;
+    size_t      threadCount = get_hardware_concurrency(), hash = 16, ttMB = 64;
+
+    while (args >> token)
+        if (token == "phases")
+            args >> phases;
+        else if (token == "repeats")
+            args >> repeats;
+        else if (token == "threads")
+            args >> threadCount;
+        else if (token == "depth")
+            args >> depth;
+        else if (token == "positions")
+            args >> positions;
+        else if (token == "hash")
+            args >> hash;
+        else if (token == "perftdepth")
+            args >> perftDepth;
+        else if (token == "evalrounds")
+            args >> evalRounds;
+        else if (token == "ttmb")
+            args >> ttMB;
+
+    repeats     = std::clamp(repeats, 1, 100);
+    depth       = std::clamp(depth, 1, MAX_PLY - 1);
+    perftDepth  = std::clamp(perftDepth, 1, 10);
+    evalRounds  = std::max(evalRounds, 1);
+    threadCount = std::clamp(threadCount, size_t(1), size_t(1024));
+    ttMB        = std::clamp(ttMB, size_t(1), size_t(65536));
+
+    std::vector<std::string> fens = Benchmark::default_fens();
+    fens.resize(std::clamp(size_t(std::max(positions, 1)), size_t(1), fens.size()));
+
+    // Only the JSON object is printed
+    uint64_t nodesSearched = 0;
+
+    engine.get_options().add_info_listener([](const auto&) {});
+    engine.set_on_update_full([&](const Engine::InfoFull& i) { nodesSearched = i.nodes; });
+    engine.set_on_iter([](const auto&) {});
+    engine.set_on_update_no_moves([](const auto&) {});
+    engine.set_on_bestmove([](const auto&, const auto&) {});
+    engine.set_on_verify_networks([](const auto&) {});
+
+    auto set_option = [&](const std::string& name, size_t value) {
+        std::istringstream ss("name " + name + " value " + std::to_string(value));
+        setoption(engine, ss);
+    };
+
+    // Searches the positions to the depth, and returns the nodes searched
+    auto search_positions = [&](std::vector<double>& msPerPosition) {
+        uint64_t nodes = 0;
+
+        engine.search_clear();
+
+        for (const auto& fen : fens)
+        {
+            std::istringstream is("depth " + std::to_string(depth));
+            Search::LimitsType limits = parse_limits(is);
+
+            engine.set_position(fen, {});
+
+            auto start = std::chrono::steady_clock::now();
+            engine.go(limits);
+            engine.wait_for_search_finished();
+
+            msPerPosition.push_back(elapsed_ms(start));
+
+            nodes += nodesSearched;
+            nodesSearched = 0;
+        }
+
+        return nodes;
+    };
+
+    const size_t oldThreads = size_t(int(engine.get_options()["Threads"]));
+    const size_t oldHash    = size_t(int(engine.get_options()["Hash"]));
+
+    set_option("Hash", hash);
+    {
+        std::istringstream ss("name UCI_Chess960 value false");
+        setoption(engine, ss);
+    }
+
+    std::string compiler = compiler_info();
+    compiler.erase(0, compiler.find_first_not_of('\n'));
+    compiler.erase(compiler.find_last_not_of('\n') + 1);
+
+    std::ostringstream json;
+    bool               first = true;
+
+    json << "{\"version\": " << json_string(engine_version_info())
+         << ", \"compiler\": " << json_string(compiler)
+         << ", \"large_pages\": " << (has_large_pages() ? "true" : "false")
+         << ", \"settings\": {\"repeats\": " << repeats << ", \"threads\": " << threadCount
+         << ", \"depth\": " << depth << ", \"positions\": " << fens.size()
+         << ", \"hash\": " << hash << ", \"perftdepth\": " << perftDepth
+         << ", \"evalrounds\": " << evalRounds << ", \"ttmb\": " << ttMB << "}, \"phases\": [";
+
+    for (auto phase : split(phases, ","))
+    {
+        Samples wall;
+
+        json << (first ? "" : ", ") << "{\"name\": " << json_string(phase);
+        first = false;
+
+        if (phase == "eval")
+        {
+            Samples rate;
+
+            for (int r = 0; r < repeats; ++r)
+            {
+                auto start = std::chrono::steady_clock::now();
+                rate.runs.push_back(engine.eval_throughput(fens, evalRounds));
+                wall.runs.push_back(elapsed_ms(start));
+            }
+
+            json << ", \"evaluations_per_second\": " << rate.to_json();
+        }
+        else if (phase == "perft")
+        {
+            Samples  rate;
+            uint64_t nodes = 0;
+
+            for (int r = 0; r < repeats; ++r)
+            {
+                auto start = std::chrono::steady_clock::now();
+                nodes      = Benchmark::perft_count(StartFEN, perftDepth, false);
+                wall.runs.push_back(elapsed_ms(start));
+                rate.runs.push_back(nodes * 1000.0 / std::max(wall.runs.back(), 1e-6));
+            }
+
+            json << ", \"nodes\": " << nodes << ", \"nodes_per_second\": " << rate.to_json();
+        }
+        else if (phase == "tt")
+        {
+            Samples hit, miss;
+
+            for (int r = 0; r < repeats; ++r)
+            {
+                auto              start   = std::chrono::steady_clock::now();
+                Engine::TTLatency latency = engine.tt_probe_latency(ttMB);
+                wall.runs.push_back(elapsed_ms(start));
+                hit.runs.push_back(latency.hitNs);
+                miss.runs.push_back(latency.missNs);
+            }
+
+            json << ", \"hit_ns\": " << hit.to_json() << ", \"miss_ns\": " << miss.to_json();
+        }
+        else if (phase == "nps")
+        {
+            json << ", \"scaling\": [";
+
+            for (size_t t = 1;; t = std::min(2 * t, threadCount))
+            {
+                Samples nps, ms;
+
+                set_option("Threads", t);
+
+                for (int r = 0; r < repeats; ++r)
+                {
+                    std::vector<double> searchMs;
+
+                    uint64_t nodes = search_positions(searchMs);
+                    ms.runs.push_back(std::accumulate(searchMs.begin(), searchMs.end(), 0.0));
+                    nps.runs.push_back(nodes * 1000.0 / std::max(ms.runs.back(), 1e-6));
+                }
+
+                wall.runs.insert(wall.runs.end(), ms.runs.begin(), ms.runs.end());
+
+                json << (t > 1 ? ", " : "") << "{\"threads\": " << t
+                     << ", \"nodes_per_second\": " << nps.to_json()
+                     << ", \"search_ms\": " << ms.to_json() << "}";
+
+                if (t == threadCount)
+                    break;
+            }
+
+            json << "]";
+        }
+        else if (phase == "ttd")
+        {
+            std::vector<Samples> perPosition(fens.size());
+
+            set_option("Threads", threadCount);
+
+            for (int r = 0; r < repeats; ++r)
+            {
+                std::vector<double> ms;
+
+                auto start = std::chrono::steady_clock::now();
+                search_positions(ms);
+                wall.runs.push_back(elapsed_ms(start));
+
+                for (size_t i = 0; i < ms.size(); ++i)
+                    perPosition[i].runs.push_back(ms[i]);
+            }
+
+            json << ", \"positions_ms\": [";
+            for (size_t i = 0; i < perPosition.size(); ++i)
+                json << (i ? ", " : "") << perPosition[i].to_json();
+            json << "]";
+        }
+        else
+        {
+            json << ", \"error\": \"unknown phase\"}";
+            continue;
+        }
+
+        json << ", \"wall_ms\": " << wall.to_json() << "}";
+    }
+
+    set_option("Threads", threadCount);
+
+    json << "], \"topology\": {\"hardware_threads\": " << get_hardware_concurrency()
+         << ", \"numa_config\": " << json_string(engine.get_numa_config_as_string())
+         << ", \"numa_information\": "
+         << json_string(engine.numa_config_information_as_string())
+         << ", \"thread_binding\": " << json_string(engine.thread_binding_information_as_string())
+         << "}}";
+
+    set_option("Threads", oldThreads);
+    set_option("Hash", oldHash);
+
+    sync_cout << json.str() << sync_endl;
+
+    init_listeners(engine);
+}
+
+void UCIEngine::tt_command(std::istringstream& is) {
+    std::string action, file;
+    is >> std::skipws >> action;
+
+    if (action == "bench")
+    {
+        size_t mb = 256;
+        is >> mb;
+        engine.tt_benchmark(std::clamp(mb, size_t(1), size_t(65536)));
+        return;
+    }
+
+    if (action == "stats")
+    {
+        engine.tt_stats();
+        return;
+    }
+
+    // The rest of the line, so that the path can contain spaces, as for setoption
+    for (std::string token; is >> token;)
+        file += (file.empty() ? "" : " ") + token;
+
+    if (file.empty())
+        file = std::string(engine.get_options()["HashFile"]);
+
+    if ((action == "save" || action == "load") && file.empty())
+        sync_cout << "No file given and the HashFile option is not set" << sync_endl;
+    else if (action == "save")
+        engine.save_tt(file);
+    else if (action == "load")
+        engine.load_tt(file);
+    else
+        sync_cout << "Unknown tt command: '" << action
+                  << "'. Use 'tt save', 'tt load', 'tt stats' or 'tt bench'." << sync_endl;
 }
 
-void UCIEngine::setoption(std::istringstream& is) {
-    engine.wait_for_search_finished();
-    engine.get_options().setoption(is);
+// Samples the nodes of the searches to a binary file, for offline analysis of the
+// search tree, and decodes such a file into a summary or CSV records.
+//   trace start <file> [rate 1024]
+//   trace stop
+//   trace decode <file> [csv]
+void UCIEngine::trace_command(std::istringstream& is) {
+    std::string action, file, format;
+    int         rate = 1024;
+    is >> std::skipws >> action >> file;
+
+    if (action == "start" && !file.empty())
+    {
+        is >> rate;
+        if (engine.trace_start(file, rate))
+            print_info_string("Tracing 1 in " + std::to_string(std::max(rate, 1))
+                              + " nodes to " + file);
+        else
+            print_info_string("Failed to open " + file);
+    }
+    else if (action == "stop")
+    {
+        auto [written, dropped] = engine.trace_stop();
+        print_info_string("Traced " + std::to_string(written) + " nodes, "
+                          + std::to_string(dropped) + " dropped");
+    }
+    else if (action == "decode" && !file.empty())
+    {
+        is >> format;
+        std::ostringstream ss;
+        if (SearchTrace::decode(file, ss, format == "csv"))
+            sync_cout << ss.str() << sync_endl;
+        else
+            print_info_string(file + " is not a search trace");
+    }
+    else
+        sync_cout << "Unknown trace command. Use 'trace start <file> [rate]', 'trace stop' or "
+                     "'trace decode <file> [csv]'."
+                  << sync_endl;
 }
 
-std::uint64_t UCIEngine::perft(const Search::LimitsType& limits) {
-    auto nodes = engine.perft(engine.fen(), limits.perft, engine.get_options()["UCI_Chess960"]);
+// Games searched concurrently with the main one, each by its own threads with its
+// own hash and histories, while the networks are shared. The output of a context
+// is prefixed with 'context <id>'.
+//   context new
+//   context <id> setoption|position|go|stop|ponderhit|ucinewgame|isready ...
+//   context delete <id>
+void UCIEngine::context_command(std::istringstream& is) {
+    std::string token;
+    is >> std::skipws >> token;
+
+    if (token == "new")
+    {
+        auto        context = std::make_unique<Engine>(engine);
+        const auto  id      = context->context_index();
+        std::string prefix  = "context " + std::to_string(id) + " ";
+
+        init_listeners(*context, prefix);
+        contexts.emplace(id, std::move(context));
+        sync_cout << prefix << "created" << sync_endl;
+        return;
+    }
+
+    size_t id = 0;
+    if (token == "delete")
+        is >> id;
+    else
+        std::istringstream(token) >> id;
+
+    auto it = contexts.find(id);
+    if (it == contexts.end())
+    {
+        sync_cout << "Unknown context: " << id << ". Use 'context new' to create one."
+                  << sync_endl;
+        return;
+    }
+
+    Engine& context = *it->second;
+
+    if (token == "delete")
+    {
+        context.stop();
+        contexts.erase(it);
+        return;
+    }
+
+    is >> token;
+
+    if (token == "setoption")
+        setoption(context, is);
+    else if (token == "position")
+        position(context, is);
+    else if (token == "go")
+        go(context, is);
+    else if (token == "stop")
+        context.stop();
+    else if (token == "ponderhit")
+        context.set_ponderhit(false);
+    else if (token == "ucinewgame")
+        context.search_clear();
+    else if (token == "isready")
+    {
+        context.load_hash_file();
+        sync_cout << "context " << id << " readyok" << sync_endl;
+    }
+    else
+        sync_cout << "Unknown context command: '" << token << "'." << sync_endl;
+}
+
+void UCIEngine::setoption(Engine& target, std::istringstream& is) {
+    target.wait_for_search_finished();
+    target.get_options().setoption(is);
+}
+
+std::uint64_t UCIEngine::perft(Engine& target, const Search::LimitsType& limits) {
+    auto nodes = target.perft(target.fen(), limits.perft, target.get_options()["UCI_Chess960"],
+                              limits.perftThreads, limits.perftHash);
     sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+
+    if (limits.perftThreads || limits.perftHash)
+    {
+        TimePoint elapsed = now() - limits.startTime + 1;  // Avoid a 'divide by zero'
+        sync_cout << "Nodes/second: " << 1000 * nodes / elapsed << "\n" << sync_endl;
+    }
+
     return nodes;
 }
 
-void UCIEngine::position(std::istringstream& is) {
+void UCIEngine::position(Engine& target, std::istringstream& is) {
     std::string token, fen;
 
     is >> token;
@@ -494,7 +1319,7 @@ void UCIEngine::position(std::istringstream& is) {
         moves.push_back(token);
     }
 
-    engine.set_position(fen, moves);
+    target.set_position(fen, moves);
 }
 
 namespace {
@@ -534,8 +1359,7 @@ int win_rate_model(Value v, const Position& pos) {
 }
 
 std::string UCIEngine::format_score(const Score& s) {
-    constexpr int TB_CP = 20000;
-    const auto    format =
+    const auto format =
       overload{[](Score::Mate mate) -> std::string {
                    auto m = (mate.plies > 0 ? (mate.plies + 1) : mate.plies) / 2;
                    return std::string("mate ") + std::to_string(m);
@@ -565,14 +1389,18 @@ int UCIEngine::to_cp(Value v, const Position& pos) {
 }
 
 std::string UCIEngine::wdl(Value v, const Position& pos) {
-    std::stringstream ss;
-
     int wdl_w = win_rate_model(v, pos);
     int wdl_l = win_rate_model(-v, pos);
     int wdl_d = 1000 - wdl_w - wdl_l;
-    ss << wdl_w << " " << wdl_d << " " << wdl_l;
 
-    return ss.str();
+    // Short enough to stay in the small string buffer, without a stream
+    std::string s;
+    append_value(s, wdl_w);
+    s += ' ';
+    append_value(s, wdl_d);
+    s += ' ';
+    append_value(s, wdl_l);
+    return s;
 }
 
 std::string UCIEngine::square(Square s) {
@@ -617,39 +1445,63 @@ Move UCIEngine::to_move(const Position& pos, std::string str) {
     return Move::none();
 }
 
-void UCIEngine::on_update_no_moves(const Engine::InfoShort& info) {
-    sync_cout << "info depth " << info.depth << " score " << format_score(info.score) << sync_endl;
+void UCIEngine::on_update_no_moves(const Engine::InfoShort& info, std::string_view prefix) {
+    sync_cout << prefix << "info depth " << info.depth << " score " << format_score(info.score) << sync_endl;
 }
 
-void UCIEngine::on_update_full(const Engine::InfoFull& info, bool showWDL) {
-    std::stringstream ss;
+// The full updates are frequent with a high MultiPV, so they are formatted without
+// streams into a buffer of the search thread, which is reused from one update to
+// the next. The lines of a multi-PV update are written out together at its end.
+void UCIEngine::on_update_full(const Engine::InfoFull& info,
+                               bool                     showWDL,
+                               std::string_view         prefix) {
+    thread_local std::string out = [] {
+        std::string s;
+        s.reserve(16384);
+        return s;
+    }();
+
+    const auto append = [](auto... values) {
+        (append_value(out, values), ...);
+    };
+
+    append(prefix, "info depth ", info.depth, " seldepth ", info.selDepth, " multipv ",
+           info.multiPV, " score ");
 
-    ss << "info";
-    ss << " depth " << info.depth                 //
-       << " seldepth " << info.selDepth           //
-       << " multipv " << info.multiPV             //
-       << " score " << format_score(info.score);  //
+    // As format_score()
+    info.score.visit(
+      overload{[&](Score::Mate mate) {
+                   append("mate ", (mate.plies > 0 ? (mate.plies + 1) : mate.plies) / 2);
+               },
+               [&](Score::Tablebase tb) {
+                   append("cp ", tb.win ? TB_CP - tb.plies : -TB_CP - tb.plies);
+               },
+               [&](Score::InternalUnits units) { append("cp ", units.value); }});
 
     if (!info.bound.empty())
-        ss << " " << info.bound;
+        append(" ", info.bound);
 
     if (showWDL)
-        ss << " wdl " << info.wdl;
+        append(" wdl ", info.wdl);
 
-    ss << " nodes " << info.nodes        //
-       << " nps " << info.nps            //
-       << " hashfull " << info.hashfull  //
-       << " tbhits " << info.tbHits      //
-       << " time " << info.timeMs        //
-       << " pv " << info.pv;             //
+    append(" nodes ", info.nodes, " nps ", info.nps, " hashfull ", info.hashfull, " tbhits ",
+           info.tbHits);
 
-    sync_cout << ss.str() << sync_endl;
+    append(" time ", info.timeMs, " pv ", info.pv, "\n");
+
+    if (info.endOfBatch)
+    {
+        sync_cout_start();
+        std::cout.write(out.data(), std::streamsize(out.size())).flush();
+        sync_cout_end();
+        out.clear();
+    }
 }
 
-void UCIEngine::on_iter(const Engine::InfoIter& info) {
+void UCIEngine::on_iter(const Engine::InfoIter& info, std::string_view prefix) {
     std::stringstream ss;
 
-    ss << "info";
+    ss << prefix << "info";
     ss << " depth " << info.depth                     //
        << " currmove " << info.currmove               //
        << " currmovenumber " << info.currmovenumber;  //
@@ -657,8 +1509,10 @@ void UCIEngine::on_iter(const Engine::InfoIter& info) {
     sync_cout << ss.str() << sync_endl;
 }
 
-void UCIEngine::on_bestmove(std::string_view bestmove, std::string_view ponder) {
-    sync_cout << "bestmove " << bestmove;
+void UCIEngine::on_bestmove(std::string_view bestmove,
+                            std::string_view ponder,
+                            std::string_view prefix) {
+    sync_cout << prefix << "bestmove " << bestmove;
     if (!ponder.empty())
         std::cout << " ponder " << ponder;
     std::cout << sync_endl;
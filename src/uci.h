@@ -21,6 +21,8 @@
 
 #include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -58,21 +60,31 @@ class UCIEngine {
     Engine      engine;
     CommandLine cli;
 
-    static void print_info_string(std::string_view str);
-
-    void          go(std::istringstream& is);
-    void          bench(std::istream& args);
-    void          benchmark(std::istream& args);
-    void          position(std::istringstream& is);
-    void          setoption(std::istringstream& is);
-    std::uint64_t perft(const Search::LimitsType&);
-
-    static void on_update_no_moves(const Engine::InfoShort& info);
-    static void on_update_full(const Engine::InfoFull& info, bool showWDL);
-    static void on_iter(const Engine::InfoIter& info);
-    static void on_bestmove(std::string_view bestmove, std::string_view ponder);
-
-    void init_search_update_listeners();
+    // Independent games searched in the same process, by context index
+    std::map<size_t, std::unique_ptr<Engine>> contexts;
+
+    static void print_info_string(std::string_view str, std::string_view prefix = "");
+
+    static void          go(Engine& target, std::istringstream& is);
+    void                 bench(std::istream& args);
+    void                 bench_scaling(std::istream& args);
+    void                 benchmark(std::istream& args);
+    void                 benchmark_suite(std::istream& args);
+    static void          position(Engine& target, std::istringstream& is);
+    static void          setoption(Engine& target, std::istringstream& is);
+    void                 tt_command(std::istringstream& is);
+    void                 trace_command(std::istringstream& is);
+    void                 context_command(std::istringstream& is);
+    static std::uint64_t perft(Engine& target, const Search::LimitsType&);
+
+    static void on_update_no_moves(const Engine::InfoShort& info, std::string_view prefix = "");
+    static void
+    on_update_full(const Engine::InfoFull& info, bool showWDL, std::string_view prefix = "");
+    static void on_iter(const Engine::InfoIter& info, std::string_view prefix = "");
+    static void
+    on_bestmove(std::string_view bestmove, std::string_view ponder, std::string_view prefix = "");
+
+    static void init_listeners(Engine& target, const std::string& prefix = "");
 };
 
 }  // namespace Stockfish
@@ -1,4 +1,5 @@
 import argparse
+import json
 import re
 import sys
 import subprocess
@@ -97,6 +98,11 @@ class TestCLI(metaclass=OrderedClassMembers):
         self.stockfish = Stockfish("go perft 4".split(" "), True)
         assert self.stockfish.process.returncode == 0
 
+    def test_go_perft_4_threads_2_hash_1(self):
+        self.stockfish = Stockfish("go perft 4 threads 2 hash 1".split(" "), True)
+        assert self.stockfish.process.returncode == 0
+        assert "Nodes searched: 197281" in self.stockfish.process.stdout
+
     def test_go_movetime_1000(self):
         self.stockfish = Stockfish("go movetime 1000".split(" "), True)
         assert self.stockfish.process.returncode == 0
@@ -148,6 +154,18 @@ class TestCLI(metaclass=OrderedClassMembers):
         )
         assert self.stockfish.process.returncode == 0
 
+    def test_bench_scaling_1_2_1_16_4(self):
+        self.stockfish = Stockfish("bench scaling 1 2 1 16 4".split(" "), True)
+        assert self.stockfish.process.returncode == 0
+        assert "Node overhead" in self.stockfish.process.stderr
+        assert re.search(r"^\s+2\s+\d+\s+\d+", self.stockfish.process.stderr, re.M)
+
+    def test_bench_perf_16_1_4(self):
+        # The counters may not be available, but the bench still runs
+        self.stockfish = Stockfish("bench perf 16 1 4".split(" "), True)
+        assert self.stockfish.process.returncode == 0
+        assert "Perf counters   : thread 0" in self.stockfish.process.stderr
+
     def test_d(self):
         self.stockfish = Stockfish("d".split(" "), True)
         assert self.stockfish.process.returncode == 0
@@ -292,6 +310,162 @@ class TestInteractive(metaclass=OrderedClassMembers):
     def test_clear_hash(self):
         self.stockfish.send_command("setoption name Clear Hash")
 
+    def test_tt_save_and_load(self):
+        self.stockfish.send_command("tt save hash.bin")
+        self.stockfish.equals("info string Hash saved successfully to hash.bin")
+        self.stockfish.send_command("tt load hash.bin")
+        self.stockfish.equals("info string Hash loaded successfully from hash.bin")
+        os.remove("hash.bin")
+
+        # The path is the rest of the line
+        self.stockfish.send_command("tt save hash file.bin")
+        self.stockfish.equals("info string Hash saved successfully to hash file.bin")
+        self.stockfish.send_command("tt load hash file.bin")
+        self.stockfish.equals("info string Hash loaded successfully from hash file.bin")
+        os.remove("hash file.bin")
+
+    def test_hash_file_after_resize(self):
+        # Restored at isready, after the options that clear the table
+        self.stockfish.send_command("setoption name Hash value 8")
+        self.stockfish.send_command("tt save hash.bin")
+        self.stockfish.equals("info string Hash saved successfully to hash.bin")
+        self.stockfish.send_command("setoption name Hash value 16")
+        self.stockfish.send_command("setoption name HashFile value hash.bin")
+        self.stockfish.send_command("setoption name Hash value 8")
+        self.stockfish.send_command("setoption name Threads value 2")
+        self.stockfish.send_command("isready")
+        self.stockfish.equals("info string Hash loaded successfully from hash.bin")
+        self.stockfish.equals("readyok")
+
+        self.stockfish.send_command("setoption name HashFile value <empty>")
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("setoption name Hash value 16")
+        self.stockfish.send_command("isready")
+        self.stockfish.equals("readyok")
+        os.remove("hash.bin")
+
+    def test_tt_stats(self):
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 8")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("tt stats")
+        self.stockfish.starts_with("Hash table:")
+        self.stockfish.starts_with("Depth :")
+        self.stockfish.starts_with("Bound :")
+        self.stockfish.starts_with("Age   :")
+        self.stockfish.starts_with("Last search probes:")
+        self.stockfish.starts_with("Estimated key16 false positives:")
+
+    def test_search_trace(self):
+        trace = os.path.join(PATH, "trace_tmp.bin")
+        self.stockfish.send_command(f"trace start {trace} 16")
+        self.stockfish.starts_with("info string Tracing 1 in 16 nodes")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 8")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("trace stop")
+        self.stockfish.starts_with("info string Traced")
+        self.stockfish.send_command(f"trace decode {trace}")
+        self.stockfish.starts_with("Trace of")
+        os.remove(trace)
+
+    def test_search_stats(self):
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 8")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("stats")
+        self.stockfish.starts_with("info string")
+
+    def test_nodes_budget(self):
+        self.stockfish.send_command("setoption name Nodes Budget value 1000")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go")
+        self.stockfish.starts_with("info string Nodes as time: nodes")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("setoption name Nodes Budget value 0")
+        self.stockfish.send_command("ucinewgame")
+
+    def test_adaptive_move_overhead(self):
+        self.stockfish.send_command("setoption name Adaptive Move Overhead value true")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go wtime 1000 btime 1000")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("position startpos moves e2e4 e7e5")
+        self.stockfish.send_command("go wtime 500 btime 1000")
+        self.stockfish.starts_with("info string Move overhead")
+        self.stockfish.starts_with("bestmove")
+        self.stockfish.send_command("setoption name Adaptive Move Overhead value false")
+        self.stockfish.send_command("ucinewgame")
+
+    def test_evalbatch(self):
+        epd = os.path.join(PATH, "bench_tmp.epd")
+        out = os.path.join(PATH, "evalbatch_tmp.epd")
+        self.stockfish.send_command(f"evalbatch {epd} {out}")
+        self.stockfish.starts_with("info string Evaluated 4 positions")
+
+        with open(out) as f:
+            lines = f.read().splitlines()
+        os.remove(out)
+
+        assert len(lines) == 4
+        assert all(" ce " in line for line in lines)
+
+    def test_book(self):
+        games = os.path.join(PATH, "games_tmp.txt")
+        book = os.path.join(PATH, "book_tmp.bin")
+        with open(games, "w") as f:
+            f.write("e2e4 e7e5 g1f3\ne2e4 e7e5\ne2e4 c7c5\nd2d4 d7d5\n")
+
+        self.stockfish.send_command(f"makebook {games} {book}")
+        self.stockfish.starts_with("info string Wrote 6 book entries")
+        self.stockfish.send_command(f"setoption name BookFile value {book}")
+        self.stockfish.starts_with("info string Book")
+        self.stockfish.send_command("position startpos moves e2e4")
+        self.stockfish.send_command("go depth 12")
+        self.stockfish.equals("bestmove e7e5")
+
+        self.stockfish.send_command("setoption name Book Mode value Order")
+        self.stockfish.send_command("position startpos moves e2e4 e7e5")
+        self.stockfish.send_command("go depth 12")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name Book Mode value Best")
+        self.stockfish.send_command("setoption name BookFile value")
+        self.stockfish.starts_with("info string Book closed")
+        os.remove(games)
+        os.remove(book)
+
+    def test_tt_bench(self):
+        self.stockfish.send_command("tt bench 4")
+        self.stockfish.starts_with("TT probe benchmark with 4 MB")
+        self.stockfish.starts_with("Hit ratio")
+        self.stockfish.starts_with("Hit latency")
+        self.stockfish.starts_with("Miss latency")
+
+    def test_benchsuite(self):
+        self.stockfish.send_command(
+            "benchsuite repeats 2 threads 2 depth 4 positions 2 perftdepth 3 evalrounds 2 ttmb 4"
+        )
+
+        def check(line):
+            if not line.startswith("{"):
+                return False
+
+            result = json.loads(line)
+            phases = {phase["name"]: phase for phase in result["phases"]}
+
+            assert "compiler" in result and "topology" in result
+            assert list(phases) == ["eval", "perft", "tt", "nps", "ttd"]
+            assert phases["perft"]["nodes"] == 8902
+            assert [s["threads"] for s in phases["nps"]["scaling"]] == [1, 2]
+            assert len(phases["ttd"]["positions_ms"]) == 2
+            assert len(phases["eval"]["wall_ms"]["runs"]) == 2
+            return True
+
+        self.stockfish.check_output(check)
+
     def test_fen_position_mate_1(self):
         self.stockfish.send_command("ucinewgame")
         self.stockfish.send_command(
@@ -398,12 +572,38 @@ class TestInteractive(metaclass=OrderedClassMembers):
         self.stockfish.send_command("go depth 5")
         self.stockfish.starts_with("bestmove")
 
+    def test_verify_int8_threats_network(self):
+        current_path = os.path.abspath(os.getcwd())
+        Stockfish(
+            f"export_net_int8 {os.path.join(current_path , 'verify_int8.nnue')}".split(" "),
+            True,
+        )
+
+        self.stockfish.send_command("setoption name EvalFile value verify_int8.nnue")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 5")
+        self.stockfish.starts_with("bestmove")
+
     def test_multipv_setting(self):
         self.stockfish.send_command("setoption name MultiPV value 4")
         self.stockfish.send_command("position startpos")
         self.stockfish.send_command("go depth 5")
         self.stockfish.starts_with("bestmove")
 
+    def test_parallel_multipv_setting(self):
+        self.stockfish.send_command("setoption name Parallel MultiPV value true")
+        self.stockfish.send_command("setoption name Threads value 2")
+        self.stockfish.send_command("setoption name MultiPV value 3")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 10")
+        self.stockfish.contains("info depth 10 seldepth")
+        self.stockfish.contains(" multipv 3 ")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("setoption name MultiPV value 4")
+        self.stockfish.send_command("setoption name Parallel MultiPV value false")
+
     def test_fen_position_with_skill_level(self):
         self.stockfish.send_command("setoption name Skill Level value 10")
         self.stockfish.send_command("position startpos")
@@ -412,6 +612,216 @@ class TestInteractive(metaclass=OrderedClassMembers):
 
         self.stockfish.send_command("setoption name Skill Level value 20")
 
+    def search(self, position, depth, new_game=True):
+        # The depths reported, the last score and node count of the first line, and
+        # the bestmove command of a search to the given depth
+        if new_game:
+            self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command(position)
+        self.stockfish.send_command(f"go depth {depth}")
+
+        result = {"depths": []}
+        regex = r"info depth (\d+) .* multipv 1 score (\w+ -?\d+) .*nodes (\d+)"
+
+        def callback(output):
+            if match := re.match(regex, output):
+                result["depths"].append(int(match[1]))
+                result["score"], result["nodes"] = match[2], int(match[3])
+            if output.startswith("bestmove"):
+                result["bestmove"] = output.split()[1:]
+                return True
+            return False
+
+        self.stockfish.check_output(callback)
+        return result
+
+    def search_with_option(self, name, value, default, position, depth=12):
+        # A search with the option set, then one with its default, both from a
+        # cleared state
+        self.stockfish.send_command(f"setoption name {name} value {value}")
+        result = self.search(position, depth)
+        self.stockfish.send_command(f"setoption name {name} value {default}")
+        return result, self.search(position, depth)
+
+    def info_string(self, regex):
+        # The groups of the first line that matches
+        groups = None
+
+        def callback(output):
+            nonlocal groups
+            if match := re.search(regex, output):
+                groups = match.groups()
+                return True
+            return False
+
+        self.stockfish.check_output(callback)
+        return groups
+
+    def test_thread_hash_setting(self):
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("setoption name Thread Hash value 256")
+        self.stockfish.send_command("memory")
+        assert self.info_string(r"thread hash (\d+)") == ("256",)
+        self.search("position startpos", 10)
+
+        # Setting it again only resizes the table, so the histories of the first
+        # search still order the moves of the next one
+        self.stockfish.send_command("setoption name Thread Hash value 0")
+        self.search("position startpos", 10)
+        kept = self.search("position startpos", 10, new_game=False)
+        self.search("position startpos", 10)
+        self.stockfish.send_command("setoption name Thread Hash value 0")
+        resized = self.search("position startpos", 10, new_game=False)
+        assert kept == resized
+
+    def test_tt_prefetch_setting(self):
+        # A prefetch is only a hint, the search is the same
+        prefetch, default = self.search_with_option(
+            "TT Prefetch Moves", 4, 0, "position startpos"
+        )
+        assert prefetch == default
+
+    def test_eval_cache_setting(self):
+        cached, default = self.search_with_option(
+            "Eval Cache", 4, 0, "position startpos moves e2e4 e7e5"
+        )
+        assert cached == default
+
+        # Every evaluation probes the cache, and transpositions hit it
+        self.stockfish.send_command("setoption name Eval Cache value 4")
+        self.stockfish.send_command("bench 16 1 8")
+        hits, probes = self.info_string(r"^Eval cache hits : ([\d.]+)% of (\d+)")
+        assert float(hits) > 0 and int(probes) > 0
+
+        self.stockfish.send_command("setoption name Eval Cache value 0")
+
+    def test_lazy_accumulator_setting(self):
+        # The accumulators are built later, but to the same values
+        lazy, eager = self.search_with_option(
+            "Lazy Accumulator",
+            "true",
+            "false",
+            "position startpos moves e2e4 e7e5 g1f3",
+        )
+        assert lazy == eager
+
+    def test_speculative_small_net_setting(self):
+        # Only the weights of the network are prefetched, the search is the same
+        speculative, default = self.search_with_option(
+            "Speculative Small Net",
+            "true",
+            "false",
+            "position fen r1bqk2r/pp3ppp/2n5/3p4/1b1P4/2N2N2/PP3PPP/R2QKB1R w KQkq - 0 1 moves d1a4",
+            10,
+        )
+        assert speculative == default
+
+    def test_shared_correction_history_setting(self):
+        self.stockfish.send_command("setoption name Threads value 4")
+
+        # One table per NUMA node in use instead of one per thread
+        tables = {}
+        for value in ("false", "true"):
+            self.stockfish.send_command(
+                f"setoption name Shared Correction History value {value}"
+            )
+            tables[value] = int(self.info_string(r"Correction histories: (\d+) x")[0])
+
+        assert tables["false"] == 4 and 1 <= tables["true"] < 4
+
+        self.stockfish.send_command("position startpos moves e2e4 c7c5")
+        self.stockfish.send_command("go depth 12")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name Shared Correction History value false")
+        self.stockfish.send_command("setoption name Threads value 1")
+
+    def test_numa_policy_cache(self):
+        self.stockfish.send_command("setoption name NumaPolicy value cache")
+        self.stockfish.send_command("setoption name Threads value 2")
+        self.stockfish.contains("by cache:")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 12")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("setoption name NumaPolicy value auto")
+
+    def test_exclude_efficiency_cores_setting(self):
+        self.stockfish.send_command("setoption name Threads value 2")
+        default = self.info_string(r"info string (Using 2 threads.*)")
+        self.stockfish.send_command("setoption name Exclude Efficiency Cores value true")
+        excluded = self.info_string(r"info string (Using 2 threads.*)")
+
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 10")
+        by_core = None
+
+        def callback(output):
+            nonlocal by_core
+            if "Nodes per second by core type" in output:
+                by_core = output
+            return output.startswith("bestmove")
+
+        self.stockfish.check_output(callback)
+
+        # Only a hybrid processor reports the core types, and then none of the
+        # threads runs on an efficiency core. Elsewhere the binding is unchanged.
+        if by_core:
+            assert "efficiency 0 (0 threads)" in by_core
+        else:
+            assert excluded == default
+
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("setoption name Exclude Efficiency Cores value false")
+
+    def test_search_continuation_setting(self):
+        # The expected line is searched from a few plies below the depth it had,
+        # instead of from depth 1
+        first_depth = {}
+        for value in ("true", "false"):
+            self.stockfish.send_command(
+                f"setoption name Search Continuation value {value}"
+            )
+            expected = self.search("position startpos", 10)["bestmove"]
+            assert expected[1] == "ponder"
+
+            line = f"position startpos moves {expected[0]} {expected[2]}"
+            first_depth[value] = self.search(line, 10, new_game=False)["depths"][0]
+
+        assert first_depth["true"] > 1 and first_depth["false"] == 1
+
+    def test_refresh_cache_slots_setting(self):
+        self.stockfish.send_command("memory")
+        default_kib = int(self.info_string(r"refresh caches (\d+)")[0])
+
+        lru, default = self.search_with_option(
+            "Refresh Cache Slots", 2, 0, "position startpos moves e2e4 e7e5 e1e2"
+        )
+        assert lru == default
+
+        # Two slots per perspective instead of one per king square
+        self.stockfish.send_command("setoption name Refresh Cache Slots value 2")
+        self.stockfish.send_command("memory")
+        assert int(self.info_string(r"refresh caches (\d+)")[0]) < default_kib
+
+        self.stockfish.send_command("setoption name Refresh Cache Slots value 0")
+
+    def test_max_memory_setting(self):
+        self.stockfish.send_command("memory")
+        self.stockfish.contains("Memory:")
+        self.stockfish.send_command("setoption name Threads value 4")
+        self.stockfish.send_command("setoption name MaxMemoryMB value 1")
+        self.stockfish.contains("1 of 4 threads")
+        self.stockfish.send_command("position startpos")
+        self.stockfish.send_command("go depth 12")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name MaxMemoryMB value 0")
+        self.stockfish.send_command("setoption name Threads value 1")
+        self.stockfish.send_command("isready")
+        self.stockfish.equals("readyok")
+
 
 class TestSyzygy(metaclass=OrderedClassMembers):
     def beforeAll(self):
@@ -475,6 +885,66 @@ class TestSyzygy(metaclass=OrderedClassMembers):
         self.stockfish.check_output(check_output)
         self.stockfish.expect("bestmove *")
 
+    def test_syzygy_cache(self):
+        self.stockfish.send_command("setoption name SyzygyCache value 1")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("position fen 8/1P6/2B5/8/4K3/8/6k1/8 w - - 0 1")
+        self.stockfish.send_command("go depth 8")
+        self.stockfish.expect("bestmove *")
+
+        self.stockfish.send_command("tbstats")
+        self.stockfish.expect("info string Cache hits: * permille of * probes")
+
+        self.stockfish.send_command("setoption name SyzygyCache value 0")
+
+    def test_syzygy_io_threads(self):
+        self.stockfish.send_command("setoption name SyzygyIOThreads value 2")
+        self.stockfish.send_command("setoption name SyzygyRandomAccess value false")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("position fen 8/1P6/2B5/8/4K3/8/6k1/8 w - - 0 1")
+        self.stockfish.send_command("go depth 8")
+        self.stockfish.expect("bestmove *")
+
+        self.stockfish.send_command("tbstats")
+        self.stockfish.starts_with("info string")
+
+        self.stockfish.send_command("setoption name SyzygyRandomAccess value true")
+        self.stockfish.send_command("setoption name SyzygyIOThreads value 0")
+
+    def test_syzygy_max_mapped(self):
+        self.stockfish.send_command("setoption name SyzygyMaxMappedMB value 1")
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command("bench 16 1 6 default depth")
+        self.stockfish.expect("Nodes searched  :*")
+
+        self.stockfish.send_command("tbstats")
+        self.stockfish.starts_with("info string Mapped")
+
+        self.stockfish.send_command("setoption name SyzygyMaxMappedMB value 0")
+
+    def test_syzygy_index_file(self):
+        index = os.path.join(PATH, "syzygy_tmp.idx")
+        self.stockfish.send_command(f"setoption name SyzygyIndexFile value {index}")
+        self.stockfish.expect(
+            "info string Found 35 WDL and 35 DTZ tablebase files (up to 4-man)."
+        )
+
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.starts_with("info string Loaded the tablebase index")
+        self.stockfish.expect(
+            "info string Found 35 WDL and 35 DTZ tablebase files (up to 4-man)."
+        )
+
+        self.stockfish.send_command("position fen 4k3/PP6/8/8/8/8/8/4K3 w - - 0 1")
+        self.stockfish.send_command("go depth 5")
+        self.stockfish.expect("bestmove *")
+
+        self.stockfish.send_command("setoption name SyzygyIndexFile value")
+        self.stockfish.expect(
+            "info string Found 35 WDL and 35 DTZ tablebase files (up to 4-man)."
+        )
+        os.remove(index)
+
 
 def parse_args():
     parser = argparse.ArgumentParser(description="Run Stockfish with testing options")
@@ -58,4 +58,20 @@ done
 
 rm repeat.exp
 
+# with Reproducible Search, a bench with several threads gives the same
+# node count on every run
+for threads in 2 4
+do
+
+  echo "reprosearch testing bench with $threads threads"
+
+  signatures=$(for run in 1 2 3
+  do
+    printf "setoption name Reproducible Search value true\nbench 16 $threads 10\nquit\n" | ./stockfish 2>&1 | grep "Nodes searched"
+  done | sort -u | wc -l)
+
+  [ "$signatures" -eq 1 ]
+
+done
+
 echo "reprosearch testing OK"